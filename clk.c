@@ -38,7 +38,6 @@ clk_t clk;
 
 static double adc_clock_initial = ADC_CLOCK_TYP;
 static double last_t_rx;
-static u64_t last_ticks;
 static int outside_window;
 
 static int ns_bin[1024];
@@ -84,21 +83,15 @@ void clock_manual_adj(int manual_adj)
     clk.adc_clk_corrections++;      // otherwise c2s_sound() and c2s_waterfall() won't update
 }
 
-// Compute corrected ADC clock based on GPS time.
-// Called on each GPS solution.
-void clock_correction(double t_rx, u64_t ticks)
+// Apply corrected ADC clock estimated by the GPS navigation filter.
+// Called on each GPS solution once the filter's clock estimate has converged.
+void clock_correction(double t_rx, u64_t ticks, double new_adc_clock)
 {
     conn_t *c;
 
-    u64_t diff_ticks = time_diff48(ticks, last_ticks);
     double gps_secs = t_rx - last_t_rx;
-    double new_adc_clock = diff_ticks / gps_secs;
     static double prev_new;
 
-    //printf("GT %6.3f ticks %08x|%08x = %08x|%08x - %08x|%08x\n", gps_secs,
-    //    PRINTF_U64_ARG(diff_ticks), PRINTF_U64_ARG(ticks), PRINTF_U64_ARG(last_ticks));
-
-    last_ticks = ticks;
     last_t_rx = t_rx;
 		
     // First correction allows wider window to capture temperature error.
@@ -126,30 +119,23 @@ void clock_correction(double t_rx, u64_t ticks)
         clk.temp_correct_offset = offset;
     }
 
-    // Perform modified moving average which seems to keep up well during
-    // diurnal temperature drifting while dampening-out any transients.
-    // Keeps up better than a simple cumulative moving average.
-    
-    static double adc_clock_mma;
-    #define MMA_PERIODS 16
-    if (adc_clock_mma == 0) adc_clock_mma = new_adc_clock;
-    adc_clock_mma = ((adc_clock_mma * (MMA_PERIODS-1)) + new_adc_clock) / MMA_PERIODS;
+    // No averaging needed here: the GPS Kalman filter estimate already tracks diurnal
+    // temperature drift (frequency random walk) while rejecting per-solution noise.
     clk.adc_clk_corrections++;
     
-    double diff_mma = adc_clock_mma - clk.adc_clock_base, diff_new = new_adc_clock - prev_new;
-    clk_printf("CLK %3d win %4.0lf MMA %.6lf(%5.1f) %5.1f NEW %.6lf(%5.1f) ratio %.6f\n",
-        clk.adc_clk_corrections, offset_window,
-        adc_clock_mma/1e6, diff_mma, offset, new_adc_clock/1e6, diff_new, diff_new / diff_mma);
+    double diff_new = new_adc_clock - prev_new;
+    clk_printf("CLK %3d win %4.0lf NEW %.6lf(%5.1f) %5.1f GT %6.3f\n",
+        clk.adc_clk_corrections, offset_window, new_adc_clock/1e6, diff_new, offset, gps_secs);
     prev_new = new_adc_clock;
 
     clk.manual_adj = 0;     // remove any manual adjustment now that we're automatically correcting
-    clk.adc_clock_base = adc_clock_mma;
+    clk.adc_clock_base = new_adc_clock;
     
     /*  jksx FIXME XXX WRONG-WRONG-WRONG
     // even if !adjust_clock mode is set adjust for first_time_temp_correction
     for (c = conns; c < &conns[N_CONNS]; c++) {
         if (!c->valid || (!c->adjust_clock && !first_time_temp_correction)) continue;
-        c->adc_clock_corrected = adc_clock_mma;
+        c->adc_clock_corrected = new_adc_clock;
         c->adc_clk_corrections++;
     }
     */
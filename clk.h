@@ -50,5 +50,5 @@ void clock_manual_adj(int manual_adj);
 void clock_init();
 double clock_initial();
 void clock_conn_init(conn_t *conn);
-void clock_correction(double t_rx, u64_t ticks);
+void clock_correction(double t_rx, u64_t ticks, double new_adc_clock);
 int *ClockBins();
@@ -167,13 +167,14 @@ int main(int argc, char *argv[])
 
 	char *ifs = FN_PREFIX ".asm";					// source input
 		  bfs = FN_PREFIX ".aout";					// loaded into FPGA via SPI
+		  sfs = FN_PREFIX ".sym";					// label addresses for simulator profiling
 	char *ofs = "ecode.aout.h";						// included by simulator
 		  hfs = "../" FN_PREFIX ".gen.h";			// included by .cpp / .c
 		  vfs = "../verilog/" FN_PREFIX ".gen.vh";	// included by verilog
 		  cfs = "../verilog/" FN_PREFIX ".coe";		// .coe file to init BRAMs
 
 	int ifn;
-	FILE *ifp[NIFILES_NEST], *ofp, *hfp, *vfp, *cfp;
+	FILE *ifp[NIFILES_NEST], *ofp, *sfp, *hfp, *vfp, *cfp;
 	
 	int bfd;
 	char *lp = linebuf, *cp, *scp, *np, *sp;
@@ -187,7 +188,7 @@ int main(int argc, char *argv[])
 	
 	for (i=1; argc-- > 1; i++)
 	if (argv[i][0] == '-') switch (argv[i][1]) {
-		case 't': ifs = "test.asm"; ofs="test.aout.h"; bfs="test.aout"; break;
+		case 't': ifs = "test.asm"; ofs="test.aout.h"; bfs="test.aout"; sfs="test.sym"; break;
 		case 'c': compare_code=1; printf("compare mode\n"); break;
 		case 'd': debug=1; gen=0; break;
 		case 'b': show_bin=1; gen=0; break;
@@ -988,6 +989,10 @@ int main(int argc, char *argv[])
 	fclose(ofp);
 	close(bfd);
 	
+	if ((sfp = fopen(sfs, "w")) == NULL) sys_panic("fopen sfs");
+	string_labels(sfp);
+	fclose(sfp);
+	
 	if (gen) {
 		fprintf(hfp, "\n#endif\n");
 		fclose(hfp);
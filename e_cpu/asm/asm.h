@@ -13,7 +13,7 @@
 #include <fcntl.h>
 
 extern int curline, debug;
-extern char *fn, *bfs, *hfs, *vfs, *cfs;
+extern char *fn, *bfs, *sfs, *hfs, *vfs, *cfs;
 
 #define	assert(cond) _assert(cond, # cond, __FILE__, __LINE__);
 
@@ -38,6 +38,7 @@ void string_enter(char *string, char **pointer, int flags);
 strs_t *string_find(char *string);
 void string_dump();
 int num_strings();
+void string_labels(FILE *fp);
 
 
 // tokens
@@ -4,12 +4,12 @@
 // debug
 
 int curline, debug;
-char *fn, *bfs, *hfs, *vfs, *cfs;
+char *fn, *bfs, *sfs, *hfs, *vfs, *cfs;
 
 static void remove_files()
 {
 	char rm[256];
-	sprintf(rm, "rm -f %s %s %s %s", bfs, hfs, vfs, cfs);
+	sprintf(rm, "rm -f %s %s %s %s %s", bfs, sfs, hfs, vfs, cfs);
 	system(rm);
 }
 
@@ -93,6 +93,18 @@ int num_strings()
 	return nstrs;
 }
 
+// label byte addresses, used by the simulator to attribute cycles
+void string_labels(FILE *fp)
+{
+	int i;
+	strs_t *s = strs;
+	
+	for (i=0; i<nstrs; s++, i++) {
+		if ((s->flags & (SF_LABEL|SF_DEFINED)) == (SF_LABEL|SF_DEFINED))
+			fprintf(fp, "%04x %s\n", s->val, s->str);
+	}
+}
+
 
 // tokens
 
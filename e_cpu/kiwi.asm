@@ -435,6 +435,7 @@ Commands:
 				u16		CmdGetChan
 				u16		CmdGetClocks
 				u16		CmdGetGlitches
+				u16		CmdSampleTS
 #endif
 
 
@@ -1170,6 +1171,19 @@ CmdGetGlitches: wrEvt	HOST_RST
                  call	UploadGlitches
                 ENDR
                 drop.r
+
+// Same as CmdSample but also returns the 48-bit system clock latched a fixed number of
+// instructions after the trigger so consecutive acquisition snapshots can be aligned.
+CmdSampleTS:	wrEvt	GPS_SAMPLER_RST
+				wrEvt	HOST_RST
+                rdReg	GET_SNAPSHOT		; 0
+                rdBit16z					; 48-bit system clock
+                wrReg	HOST_TX
+                rdBit16						; "
+                wrReg	HOST_TX
+                rdBit16						; "
+                wrReg	HOST_TX
+                ret
 #endif
 
 ; ============================================================================
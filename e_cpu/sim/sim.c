@@ -0,0 +1,586 @@
+/*
+	Instruction-set simulator and cycle profiler for the embedded processor (verilog/cpu.v)
+
+	Executes the assembled image against a model of the host SPI interface (verilog/host.v) and the
+	srq logic (verilog/gps/gps.v, verilog/rx/receiver.v). Requests come from a trace of SPI_CMDs,
+	e.g. one recorded on the Beagle by defining SPI_CMD_TRACE in spi.cpp. Per-command latency
+	(host request to HOST_RDY) and a per-label / per-instruction hot-spot report are printed.
+
+	One instruction per cycle, as in the verilog. I/O that touches the rest of the FPGA (NCOs,
+	sample buffers etc.) is only modelled as far as its effect on the stack and the host FIFO:
+	sample transfers write zeros, writes to other registers are ignored.
+
+	runtime arguments:
+		-r <cycles>	rx srq (audio buffer flip) period, 0 = none (default)
+		-l <n>		run the trace n times
+		-a			profile all cycles, not just those with the CPU_CTR enabled (i.e. include NoCmd polling)
+		-i <n>		number of hot instructions listed (default 20)
+		-m <cycles>	stop after this many cycles (default 1G)
+		-v			print each request and the reply words
+		-b <file>	binary image (default kiwi.aout), symbols from the same name with .sym
+
+	trace file, one request per line, '#' starts a comment:
+		[+usec] cmd [wparam [lparam]]	cmd is a name from the Commands table or a number
+		[+usec] rx						rx srq
+		[+usec] gps <chan>				GPS channel srq
+	+usec is the delay from the previous request, otherwise a command is sent as soon as the eCPU
+	is ready for it (like spi_scan() retrying while BUSY).
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#include "../types.h"
+#include "asm/cpu.h"
+#include "kiwi.gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define	CPU_CLOCK		(16.368*MHz)	// eCPU runs from the GPS clock, see clk.h
+#define	CYCLES(us)		((u64_t) ((us) * CPU_CLOCK / 1e6))
+#define	USEC(cycles)	((cycles) * 1e6 / CPU_CLOCK)
+
+#define	NSTK			256
+#define	NFIFO			1024			// host.v port B is 1K x 16
+#define	NSRQ			GPS_CHANS		// host srq is the MSB, see gps.v
+
+static void panic(const char *str)
+{
+	printf("panic: %s\n", str);
+	exit(-1);
+}
+
+
+// symbols
+
+typedef struct {
+	int addr;
+	char *name;
+} sym_t;
+
+#define	NSYMS	4096
+static sym_t syms[NSYMS];
+static int nsyms;
+static int sym_of[CPU_RAM_SIZE];		// pc -> index of nearest preceding label
+
+static int sym_cmp(const void *a, const void *b)
+{
+	return ((sym_t *) a)->addr - ((sym_t *) b)->addr;
+}
+
+static void sym_load(const char *fn)
+{
+	FILE *fp;
+	char name[256];
+	int i, s, addr;
+
+	if ((fp = fopen(fn, "r")) == NULL) panic("can't open symbol file (assembler too old?)");
+	while (fscanf(fp, "%x %255s", &addr, name) == 2) {
+		if (nsyms == NSYMS) panic("too many symbols");
+		syms[nsyms].addr = addr;
+		syms[nsyms].name = strdup(name);
+		nsyms++;
+	}
+	fclose(fp);
+	qsort(syms, nsyms, sizeof(sym_t), sym_cmp);
+
+	for (i=0, s=-1; i < CPU_RAM_SIZE; i++) {
+		while (s+1 < nsyms && syms[s+1].addr/2 <= i) s++;
+		sym_of[i] = s;
+	}
+}
+
+static sym_t *sym_find(const char *name)
+{
+	int i;
+
+	for (i=0; i < nsyms; i++) if (strcmp(syms[i].name, name) == 0) return &syms[i];
+	return NULL;
+}
+
+static const char *sym_pc(int pc, char *buf)
+{
+	int s = sym_of[pc];
+
+	if (s < 0) sprintf(buf, "0x%04x", pc*2); else
+	if (syms[s].addr == pc*2) sprintf(buf, "%s", syms[s].name); else
+		sprintf(buf, "%s+%d", syms[s].name, pc - syms[s].addr/2);
+	return buf;
+}
+
+
+// cpu
+
+static u2_t mem[CPU_RAM_SIZE];
+static u4_t tos, nos, dstk[NSTK], rstk[NSTK];
+static u1_t sp, rp;
+static u2_t pc;
+static int carry;
+static u64_t cycle;
+
+static u2_t fifo[NFIFO];		// host "bridge" FIFO
+static int hpos, hmax;
+static bool host_rdy, host_noted, rx_noted, rx_out, ctr_ena;
+static u4_t gps_noted, gps_mask, srq_shift, ser_sel, ctr[2];
+
+static u4_t io_rd(u2_t op)
+{
+	u4_t par = 0;
+
+	if (op & 0x800) return 0;		// rdReg2: no selects currently
+
+	if (op & GET_SRQ) {
+		srq_shift = (host_noted << NSRQ) | (gps_noted & gps_mask);
+		host_noted = FALSE; gps_noted = 0;
+	}
+	if (op & GET_RX_SRQ) {
+		rx_out = rx_noted;
+		rx_noted = FALSE;
+	}
+	ser_sel = op & 7;
+
+	if (op & GET_CPU_CTR0) par = ((ctr[1] >>  0) & 0xff) << 8 | ((ctr[0] >>  0) & 0xff); else
+	if (op & GET_CPU_CTR1) par = ((ctr[1] >>  8) & 0xff) << 8 | ((ctr[0] >>  8) & 0xff); else
+	if (op & GET_CPU_CTR2) par = ((ctr[1] >> 16) & 0xff) << 8 | ((ctr[0] >> 16) & 0xff); else
+	if (op & GET_CPU_CTR3) par = ((ctr[1] >> 24) & 0xff) << 8 | ((ctr[0] >> 24) & 0xff); else
+	if (op & GET_STATUS) par = (FPGA_VER << 8) | FPGA_ID; else
+	if (op & HOST_RX) par = fifo[hpos++ & (NFIFO-1)];
+
+	return par;
+}
+
+static int io_bit(u2_t op)
+{
+	int b;
+
+	if (op & 0x40) return rx_out;	// rdBit2: receiver.v ser
+	if (!(ser_sel & GET_SRQ)) return 0;
+	b = (srq_shift >> NSRQ) & 1;
+	srq_shift <<= 1;
+	return b;
+}
+
+static void host_wr(u2_t d)
+{
+	fifo[hpos & (NFIFO-1)] = d;
+	hpos++;
+	if (hpos > hmax) hmax = hpos;
+}
+
+static void cmd_accept();
+static void cmd_done();
+
+static void io_wr(u2_t op, u4_t tos)
+{
+	if (op & 0x800) return;			// wrReg2: receiver/waterfall registers
+	if (op & HOST_TX) host_wr(tos);
+	if (op & SET_MASK) gps_mask = tos;
+}
+
+static void io_evt(u2_t op, u4_t tos)
+{
+	if (op & 0x800) {
+		if (op & (GET_RX_SAMP | RX_GET_BUF_CTR | GET_WF_SAMP_I | GET_WF_SAMP_Q)) host_wr(0);
+		return;
+	}
+
+	if (op & HOST_RST) { hpos = 0; cmd_accept(); }
+	if (op & HOST_RDY) { host_rdy = TRUE; cmd_done(); }
+	if (op & (GET_GPS_SAMPLES | GET_LOG)) host_wr(0);
+	if (op & GET_MEMORY) host_wr(mem[(tos >> 1) & (CPU_RAM_SIZE-1)]);
+	if (op & CPU_CTR_CLR) ctr[0] = ctr[1] = 0;
+	if (op & CPU_CTR_ENA) ctr_ena = TRUE;
+	if (op & CPU_CTR_DIS) ctr_ena = FALSE;
+}
+
+#define	OP8(oc)		((oc) >> 8)
+
+static void step()
+{
+	u2_t op = mem[pc];
+	int op4 = op >> 12, op5 = op & 0xf001, op8 = op >> 8;
+	bool push = !(op & 0x8000);
+	bool ret = (op & OPT_RET) && (op & 0xe000) == 0x8000;
+	bool nz = (tos & 0xffff) != 0;
+	bool jump = (op5 == OC_BRNZ && nz) || op5 == OC_BR || (op5 == OC_BRZ && !nz) || op5 == OC_CALL;
+	bool mem_rd = op4 == 0xe && !(op & 0x800) && (op & GET_MEMORY);
+
+	bool inc_sp = push || op4 == 0xc || op8 == OP8(OC_DUP) || op8 == OP8(OC_R) || op8 == OP8(OC_OVER) || op8 == OP8(OC_R_FROM);
+	bool dec_sp = op4 == 0xd || op8 == OP8(OC_POP) || op8 == OP8(OC_AND) || op8 == OP8(OC_MULT) ||
+		op5 == OC_BRZ || op8 == OP8(OC_ADD) || op8 == OP8(OC_OR) || op8 == OP8(OC_TO_R) ||
+		op5 == OC_BRNZ || op8 == OP8(OC_SUB) || op8 == OP8(OC_XOR) || op8 == OP8(OC_STORE16);
+	bool inc_rp = op8 == OP8(OC_TO_R) || op5 == OC_CALL;
+	bool dec_rp = op8 == OP8(OC_R_FROM) || ret;
+
+	// stack BRAM outputs are registered: they read what the previous cycle addressed
+	u4_t dstk_dout = dstk[sp], rstk_dout = rstk[rp];
+	u1_t next_sp = sp + inc_sp - dec_sp, next_rp = rp + inc_rp - dec_rp;
+	u2_t pc_plus_2 = ((pc + 1) & (CPU_RAM_SIZE-1)) << 1;
+
+	// alu
+	u4_t a = (op8 == OP8(OC_ADDI))? (op & 0x7f) : (mem_rd? 2 : nos);
+	u4_t b = (op8 == OP8(OC_SUB))? ~tos : tos;
+	int ci = (op8 == OP8(OC_ADD) && (op & OPT_CIN) && carry) || op8 == OP8(OC_SUB);
+	u64_t sum = (u64_t) a + b + ci;
+	u4_t alu;
+
+	if (push) alu = op; else
+	if (mem_rd) alu = sum; else
+	switch (op8) {
+		case OP8(OC_ADD): case OP8(OC_ADDI): case OP8(OC_SUB): alu = sum; break;
+	#ifdef USE_CPU_MULT
+		case OP8(OC_MULT): alu = (s4_t) (s2_t) nos * (s2_t) tos; break;
+	#endif
+		case OP8(OC_AND): alu = nos & tos; break;
+		case OP8(OC_OR): alu = nos | tos; break;
+		case OP8(OC_NOT): alu = ~tos; break;
+		case OP8(OC_SHL): case OP8(OC_SHL64): alu = tos << 1; break;
+		case OP8(OC_SHR): alu = (u4_t) ((s4_t) tos >> 1); break;
+		default: alu = tos; break;
+	}
+	if (op8 == OP8(OC_ADD)) carry = sum >> 32;
+
+	u4_t next_tos;
+	if (op4 == 0xb || op4 == 0xd) {
+		next_tos = nos;
+		if (op4 == 0xd) io_wr(op, tos);
+	} else
+	if (op4 == 0xc) {
+		next_tos = io_rd(op);
+	} else
+	switch (op8) {
+		case OP8(OC_SWAP): case OP8(OC_TO_R): case OP8(OC_OVER): case OP8(OC_POP): next_tos = nos; break;
+		case OP8(OC_ROT): next_tos = dstk_dout; break;
+		case OP8(OC_R_FROM): case OP8(OC_R): next_tos = rstk_dout; break;
+		case OP8(OC_SWAP16): next_tos = (tos << 16) | (tos >> 16); break;
+		case OP8(OC_RDBIT): next_tos = (tos << 1) | io_bit(op); break;
+		case OP8(OC_FETCH16): next_tos = mem[(tos >> 1) & (CPU_RAM_SIZE-1)]; break;
+		case OP8(OC_SP): next_tos = sp; break;
+		case OP8(OC_RP): next_tos = rp; break;
+		default: next_tos = alu; break;
+	}
+
+	if (op4 == 0xe) io_evt(op, tos);
+	if (op8 == OP8(OC_STORE16)) mem[(tos >> 1) & (CPU_RAM_SIZE-1)] = nos;
+
+	// stack writes
+	if (op8 == OP8(OC_ROT) || inc_sp) dstk[next_sp] = nos;
+	if (inc_rp) rstk[next_rp] = (op5 == OC_CALL)? pc_plus_2 : tos;
+
+	if (op8 == OP8(OC_SWAP) || op8 == OP8(OC_ROT)) nos = tos; else
+	if (op8 == OP8(OC_SHL64)) nos = (nos << 1) | (tos >> 31); else
+	if (inc_sp) nos = tos; else
+	if (dec_sp) nos = dstk_dout;
+
+	if (ret) pc = (rstk_dout >> 1) & (CPU_RAM_SIZE-1); else
+	if (jump) pc = (op >> 1) & (CPU_RAM_SIZE-1); else
+		pc = pc_plus_2 >> 1;
+
+	tos = next_tos;
+	sp = next_sp;
+	rp = next_rp;
+
+	ctr[0]++;
+	if (ctr_ena) ctr[1]++;
+}
+
+
+// host
+
+typedef enum { R_CMD, R_RX, R_GPS } req_e;
+
+typedef struct {
+	req_e type;
+	int has_us;
+	double us;			// delay after previous request
+	u2_t w[4];			// MOSI: cmd, wparam, lparam_lo, lparam_hi
+} req_t;
+
+static req_t *reqs;
+static int nreqs;
+
+static const char *cmd_name[NUM_CMDS];
+
+typedef struct {
+	u4_t n;
+	u64_t lat, lat_min, lat_max;		// request to HOST_RDY
+	u64_t svc, svc_min, svc_max;		// HOST_RST to HOST_RDY
+} cmd_stat_t;
+
+static cmd_stat_t cmd_stat[NUM_CMDS];
+
+static req_t *cur;
+static u64_t t_req, t_accept;
+static bool accepted;
+static int verbose;
+
+// name the Commands table entries from their handler labels
+static void cmd_names()
+{
+	int i, j;
+	sym_t *t = sym_find("Commands");
+
+	if (t == NULL) panic("no Commands table");
+	for (i=0; i < NUM_CMDS; i++) {
+		int addr = mem[t->addr/2 + i];
+		cmd_name[i] = NULL;
+		for (j=0; j < nsyms; j++) {
+			if (syms[j].addr == addr && (cmd_name[i] == NULL || strncmp(syms[j].name, "Cmd", 3) == 0))
+				cmd_name[i] = syms[j].name;
+		}
+		if (cmd_name[i] == NULL) cmd_name[i] = "?";
+	}
+}
+
+static void trace_load(const char *fn)
+{
+	FILE *fp;
+	char line[256], *cp, tok[64];
+	int i, n, nalloc = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) panic("can't open trace file");
+
+	while (fgets(line, sizeof(line), fp)) {
+		req_t r;
+		u4_t wparam = 0, lparam = 0;
+
+		if ((cp = strchr(line, '#')) != NULL) *cp = '\0';
+		cp = line;
+		memset(&r, 0, sizeof(r));
+
+		if (sscanf(cp, " +%lf%n", &r.us, &n) == 1) { r.has_us = 1; cp += n; }
+		if (sscanf(cp, " %63s%n", tok, &n) != 1) continue;
+		cp += n;
+
+		if (strcmp(tok, "rx") == 0) {
+			r.type = R_RX;
+		} else
+		if (strcmp(tok, "gps") == 0) {
+			r.type = R_GPS;
+			if (sscanf(cp, "%u", &wparam) != 1 || wparam >= GPS_CHANS) panic("bad gps chan");
+			r.w[0] = wparam;
+		} else {
+			r.type = R_CMD;
+			if (isdigit(tok[0])) i = strtol(tok, NULL, 0); else
+			for (i=0; i < NUM_CMDS && strcmp(tok, cmd_name[i]) != 0; i++)
+				;
+			if (i < 0 || i >= NUM_CMDS) { printf("%s: ", tok); panic("unknown command"); }
+			sscanf(cp, "%i %i", &wparam, &lparam);
+			r.w[0] = i; r.w[1] = wparam; r.w[2] = lparam & 0xffff; r.w[3] = lparam >> 16;
+		}
+
+		if (nreqs == nalloc) {
+			nalloc = nalloc? nalloc*2 : 256;
+			reqs = (req_t *) realloc(reqs, nalloc * sizeof(req_t));
+		}
+		reqs[nreqs++] = r;
+	}
+	fclose(fp);
+}
+
+static void cmd_accept()
+{
+	if (cur && !accepted) { t_accept = cycle; accepted = TRUE; }
+}
+
+static void cmd_done()
+{
+	int i;
+
+	if (!cur) return;
+
+	cmd_stat_t *s = &cmd_stat[cur->w[0]];
+	u64_t lat = cycle - t_req, svc = accepted? (cycle - t_accept) : 0;
+	if (s->n == 0 || lat < s->lat_min) s->lat_min = lat;
+	if (lat > s->lat_max) s->lat_max = lat;
+	if (s->n == 0 || svc < s->svc_min) s->svc_min = svc;
+	if (svc > s->svc_max) s->svc_max = svc;
+	s->lat += lat; s->svc += svc; s->n++;
+
+	if (verbose) {
+		printf("%12llu %-20s %5llu cycles:", cycle, cmd_name[cur->w[0]], lat);
+		for (i=0; i < hmax && i < 8; i++) printf(" %04x", fifo[i]);
+		printf("%s\n", (hmax > 8)? " ..." : "");
+	}
+	cur = NULL;
+}
+
+// issue the next request when its time has come and, for a command, the eCPU is ready
+static int next_req, loops = 1;
+static u64_t t_prev;
+
+static bool host()
+{
+	req_t *r;
+
+	if (next_req == nreqs) {
+		if (--loops <= 0) return cur != NULL;
+		next_req = 0;
+	}
+
+	r = &reqs[next_req];
+	if (r->has_us && cycle < t_prev + CYCLES(r->us)) return TRUE;
+
+	if (r->type == R_RX) rx_noted = TRUE; else
+	if (r->type == R_GPS) gps_noted |= 1 << r->w[0]; else {
+		if (!host_rdy || cur) return TRUE;
+
+		// the host writes the request into the FIFO while shifting out the previous reply
+		memset(fifo, 0, sizeof(fifo));
+		memcpy(fifo, r->w, sizeof(r->w));
+		hmax = 0;
+		host_rdy = FALSE;
+		host_noted = TRUE;
+		cur = r; t_req = cycle; accepted = FALSE;
+	}
+
+	t_prev = cycle;
+	next_req++;
+	return TRUE;
+}
+
+
+// report
+
+static u64_t pc_cycles[CPU_RAM_SIZE];
+
+typedef struct {
+	int s;
+	u64_t cycles, calls;
+} hot_t;
+
+static int hot_cmp(const void *a, const void *b)
+{
+	u64_t ca = ((hot_t *) a)->cycles, cb = ((hot_t *) b)->cycles;
+	return (ca < cb) - (ca > cb);
+}
+
+static const char *alu_name[32] = {
+	"nop", "dup", "swap", "swap16", "over", "pop", "rot", "addi", "add", "sub", "mult", "and", "or", "xor", "not", "0x8F",
+	"shl64", "shl", "shr", "rdbit", "fetch16", "store16", "sp", "rp", "0x98", "0x99", "0x9A", "0x9B", "r", "r_from", "to_r", "0x9F"
+};
+
+static const char *disasm(u2_t op, char *buf)
+{
+	char lbuf[64];
+	int op5 = op & 0xf001;
+
+	if (!(op & 0x8000)) sprintf(buf, "push 0x%x", op); else
+	if ((op & 0xe000) == 0x8000) {
+		sprintf(buf, "%s%s%s", (op & 0xff00) == OC_RDBIT && (op & 0x40)? "rdbit2" : alu_name[(op >> 8) & 0x1f],
+			(op & 0xff00) == OC_ADD && (op & OPT_CIN)? ".cin" : "", (op & OPT_RET)? ".r" : "");
+		if ((op & 0xff00) == OC_ADDI) sprintf(buf + strlen(buf), " %d", op & 0x7f);
+	} else
+	if ((op & 0xe000) == 0xa000 || (op & 0xf000) == 0xb000) {
+		sprintf(buf, "%s %s", (op5 == OC_CALL)? "call" : (op5 == OC_BR)? "br" : (op5 == OC_BRZ)? "brz" : "brnz",
+			sym_pc((op >> 1) & (CPU_RAM_SIZE-1), lbuf));
+	} else {
+		const char *io[] = { "rdreg", "wrreg", "wrevt" };
+		if (op >= 0xf000) sprintf(buf, "0x%04x", op); else
+		sprintf(buf, "%s%s 0x%03x", io[((op >> 12) & 0xf) - 0xc], (op & 0x800)? "2":"", op & 0x7ff);
+	}
+	return buf;
+}
+
+static void report(int nhot)
+{
+	int i, n, s;
+	u64_t total = 0;
+	char buf[64], buf2[64];
+	static hot_t hot[NSYMS+1];
+
+	printf("\n%llu cycles (%.3f ms), eCPU busy %.1f%%\n", cycle, USEC(cycle)/1e3, ctr[0]? ctr[1] * 100.0 / ctr[0] : 0);
+
+	printf("\ncommand latency (request to HOST_RDY) and service (HOST_RST to HOST_RDY), usec:\n");
+	printf("%-20s %8s %9s %9s %9s %9s %9s\n", "", "count", "lat avg", "lat min", "lat max", "svc avg", "svc max");
+	for (i=0; i < NUM_CMDS; i++) {
+		cmd_stat_t *c = &cmd_stat[i];
+		if (c->n == 0) continue;
+		printf("%-20s %8u %9.2f %9.2f %9.2f %9.2f %9.2f\n", cmd_name[i], c->n,
+			USEC((double) c->lat / c->n), USEC(c->lat_min), USEC(c->lat_max), USEC((double) c->svc / c->n), USEC(c->svc_max));
+	}
+
+	// per-label: cycles attributed to the nearest preceding label, "calls" are executions of the label itself
+	for (i=0; i <= nsyms; i++) { hot[i].s = i-1; hot[i].cycles = hot[i].calls = 0; }
+	for (i=0; i < CPU_RAM_SIZE; i++) {
+		s = sym_of[i];
+		hot[s+1].cycles += pc_cycles[i];
+		if (s >= 0 && syms[s].addr == i*2) hot[s+1].calls += pc_cycles[i];
+		total += pc_cycles[i];
+	}
+	if (total == 0) return;
+	qsort(hot, nsyms+1, sizeof(hot_t), hot_cmp);
+
+	printf("\nhot spots by label:\n%-24s %12s %7s %10s\n", "", "cycles", "%", "entries");
+	for (i=0; i <= nsyms && hot[i].cycles; i++) {
+		printf("%-24s %12llu %6.2f%% %10llu\n", (hot[i].s < 0)? "(none)" : syms[hot[i].s].name,
+			hot[i].cycles, hot[i].cycles * 100.0 / total, hot[i].calls);
+	}
+
+	// per-instruction
+	for (i=0; i < CPU_RAM_SIZE; i++) { hot[i].s = i; hot[i].cycles = pc_cycles[i]; }
+	qsort(hot, CPU_RAM_SIZE, sizeof(hot_t), hot_cmp);
+
+	printf("\nhot instructions:\n");
+	for (n=0; n < nhot && hot[n].cycles; n++) {
+		i = hot[n].s;
+		printf("%04x %-24s %-24s %12llu %6.2f%%\n", i*2, sym_pc(i, buf), disasm(mem[i], buf2),
+			hot[n].cycles, hot[n].cycles * 100.0 / total);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i, all = 0, nhot = 20;
+	u64_t rx_period = 0, max_cycles = 1ULL << 30;
+	const char *bfs = "kiwi.aout", *tfs = NULL;
+	char sfs[256], *cp;
+	FILE *fp;
+
+	for (i=1; i < argc; i++) {
+		if (argv[i][0] != '-') { tfs = argv[i]; continue; }
+		switch (argv[i][1]) {
+			case 'r': if (++i < argc) rx_period = strtoull(argv[i], NULL, 0); break;
+			case 'l': if (++i < argc) loops = strtol(argv[i], NULL, 0); break;
+			case 'a': all = 1; break;
+			case 'i': if (++i < argc) nhot = strtol(argv[i], NULL, 0); break;
+			case 'm': if (++i < argc) max_cycles = strtoull(argv[i], NULL, 0); break;
+			case 'v': verbose = 1; break;
+			case 'b': if (++i < argc) bfs = argv[i]; break;
+		}
+	}
+
+	if (tfs == NULL) {
+		printf("usage: s [-r rx_srq_cycles] [-l loops] [-a] [-i nhot] [-m max_cycles] [-v] [-b kiwi.aout] trace\n");
+		printf("nominal rx srq period %.0f cycles\n", CPU_CLOCK * NRX_SAMPS / SND_RATE);
+		exit(-1);
+	}
+
+	if ((fp = fopen(bfs, "r")) == NULL) panic("can't open binary");
+	i = fread(mem, sizeof(u2_t), CPU_RAM_SIZE, fp);
+	fclose(fp);
+	printf("loaded %s: %d/%d words\n", bfs, i, CPU_RAM_SIZE);
+
+	strcpy(sfs, bfs);
+	if ((cp = strrchr(sfs, '.')) != NULL) *cp = '\0';
+	strcat(sfs, ".sym");
+	sym_load(sfs);
+	cmd_names();
+	trace_load(tfs);
+	printf("%d requests from %s\n", nreqs, tfs);
+	if (nreqs == 0) exit(0);
+
+	// the first two insns aren't executed by the hardware, but are nops anyway
+	for (cycle = 0; cycle < max_cycles; cycle++) {
+		if (!host()) break;
+		if (rx_period && cycle && (cycle % rx_period) == 0) rx_noted = TRUE;
+		if (all || ctr_ena) pc_cycles[pc]++;
+		step();
+	}
+	if (cycle == max_cycles) printf("stopped at cycle limit, %d/%d requests\n", next_req, nreqs);
+
+	report(nhot);
+	return 0;
+}
@@ -25,6 +25,9 @@ Boston, MA  02110-1301, USA.
 #include "cfg.h"
 #include "gps.h"
 #include "ext_int.h"
+#include "fastfir.h"
+#include "coroutines.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -70,8 +73,186 @@ void ext_adjust_clock_offset(int rx_chan, double offset)
     */
 }
 
+////////////////////////////////
+// sample delivery
+////////////////////////////////
+
+// The audio task queues an entry per audio block and wakes the channel's delivery task which runs the
+// callbacks at EXT_PRIORITY, i.e. after the audio has been sent. The IQ and real samples are queued in
+// place in the rx_dpump_t rings, so when the queue is full the oldest entry is dropped while its samples
+// are still valid. The FFT is copied since the FIR reuses its buffer.
+//
+// Callback time is accounted per channel. Each EXT_BUDGET_WINDOW_MS over ext_budget_pct of the cpu
+// halves the rate blocks are delivered at, and a window under budget undoes one halving. Over budget
+// with EXT_THROTTLE_MAX halvings the callbacks are unregistered and the client told.
+
+#define	EXT_BUDGET_WINDOW_MS	1000
+#define	EXT_THROTTLE_MAX		3
+
+int ext_budget_pct = EXT_BUDGET_PCT_DEFAULT;
+
+struct ext_q_t {
+	TYPECPX *fft, *iq;
+	TYPEMONO16 *real;
+	int ratio, ns_fft, ns_iq, ns_real;
+	int nS_meter;
+	float S_meter_dBm[2];
+};
+
+static struct ext_deliver_t {
+	tid_t tid;
+	u4_t wr, rd;
+	ext_q_t q[EXT_Q_LEN], pend;
+	TYPECPX *fft;			// [EXT_Q_LEN][CONV_FFT_SIZE], allocated when first needed
+	u4_t seq, window_ms, run_us;
+	int throttle;
+} ext_deliver[RX_CHANS];
+
+static void ext_deliver_reset(int rx_chan)
+{
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	d->rd = d->wr;
+	memset(&d->pend, 0, sizeof(d->pend));
+	d->window_ms = timer_ms();
+	d->run_us = 0;
+	d->throttle = 0;
+	metric_set(M_EXT_THROTTLE, rx_chan, 0);
+}
+
+static void ext_budget(int rx_chan)
+{
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	ext_users_t *eu = &ext_users[rx_chan];
+	u4_t now = timer_ms(), window = now - d->window_ms;
+	if (window < EXT_BUDGET_WINDOW_MS) return;
+
+	// run_us / (window * 1000) > ext_budget_pct / 100
+	bool over = (ext_budget_pct && d->run_us > window * 10 * ext_budget_pct);
+	d->window_ms = now;
+	d->run_us = 0;
+	int throttle = d->throttle;
+	if (over) throttle++; else if (throttle) throttle--;
+	bool exceeded = (throttle > EXT_THROTTLE_MAX);
+
+	if (exceeded) {
+		lprintf("EXT %s rx%d: over cpu budget of %d%%, sample callbacks unregistered\n",
+			eu->ext? eu->ext->name : "?", rx_chan, ext_budget_pct);
+		eu->receive_iq = NULL;
+		eu->receive_real = NULL;
+		eu->receive_FFT = NULL;
+		eu->receive_S_meter = NULL;
+		ext_send_msg(rx_chan, false, "MSG ext_budget_exceeded=%d", ext_budget_pct);
+		throttle = 0;
+	}
+
+	if (throttle != d->throttle) {
+		d->throttle = throttle;
+		metric_set(M_EXT_THROTTLE, rx_chan, throttle);
+		
+		// ext_budget_exceeded already tells the client the samples have stopped
+		if (!exceeded)
+			ext_send_msg(rx_chan, false, "MSG ext_budget_throttle=%d", throttle);
+	}
+}
+
+static void ext_deliver_task(void *param)
+{
+	int i, rx_chan = (int) FROM_VOID_PARAM(param);
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	ext_users_t *eu = &ext_users[rx_chan];
+
+	while (1) {
+		TaskSleepReason("wait for samples");
+
+		while (d->rd != d->wr) {
+			ext_q_t q = d->q[d->rd & (EXT_Q_LEN-1)];
+			d->rd++;
+
+			if (d->seq++ & ((1 << d->throttle) - 1)) {
+				metric_add(M_EXT_DROPS, rx_chan, 1);
+				continue;
+			}
+
+			u4_t run_us = timer_us();
+			if (q.fft && eu->receive_FFT)
+				eu->receive_FFT(rx_chan, 0, q.ratio, q.ns_fft, q.fft);
+			for (i = 0; i < q.nS_meter && eu->receive_S_meter; i++)
+				eu->receive_S_meter(rx_chan, q.S_meter_dBm[i]);
+			if (q.iq && eu->receive_iq)
+				eu->receive_iq(rx_chan, 0, q.ns_iq, q.iq);
+			if (q.real && eu->receive_real)
+				eu->receive_real(rx_chan, 0, q.ns_real, q.real);
+			run_us = timer_us() - run_us;
+
+			d->run_us += run_us;
+			metric_observe(M_EXT_RUN, rx_chan, run_us / 1e6);
+		}
+
+		ext_budget(rx_chan);
+	}
+}
+
+static void ext_deliver_start(int rx_chan)
+{
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	if (d->tid) return;
+	ext_deliver_reset(rx_chan);
+	d->tid = CreateTaskF(ext_deliver_task, TO_VOID_PARAM(rx_chan), EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
+}
+
+// called by the FIR when receive_FFT is registered, before the other ext_queue_*() of the block
+void ext_queue_FFT(int rx_chan, int ratio, int ns_out, TYPECPX *samps)
+{
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	if (d->fft == NULL) return;
+	assert(ns_out <= CONV_FFT_SIZE);
+	TYPECPX *fft = d->fft + (d->wr & (EXT_Q_LEN-1)) * CONV_FFT_SIZE;
+	memcpy(fft, samps, ns_out * sizeof(TYPECPX));
+	d->pend.fft = fft;
+	d->pend.ratio = ratio;
+	d->pend.ns_fft = ns_out;
+}
+
+void ext_queue_S_meter(int rx_chan, float S_meter_dBm)
+{
+	ext_q_t *q = &ext_deliver[rx_chan].pend;
+	if (q->nS_meter < (int) ARRAY_LEN(q->S_meter_dBm))
+		q->S_meter_dBm[q->nS_meter++] = S_meter_dBm;
+}
+
+void ext_queue_iq(int rx_chan, int ns_out, TYPECPX *samps)
+{
+	ext_q_t *q = &ext_deliver[rx_chan].pend;
+	q->iq = samps;
+	q->ns_iq = ns_out;
+}
+
+void ext_queue_real(int rx_chan, int ns_out, TYPEMONO16 *samps)
+{
+	ext_q_t *q = &ext_deliver[rx_chan].pend;
+	q->real = samps;
+	q->ns_real = ns_out;
+}
+
+void ext_queue_commit(int rx_chan)
+{
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	ext_q_t *q = &d->pend;
+	if (!d->tid || (!q->fft && !q->iq && !q->real && !q->nS_meter)) return;
+
+	if (d->wr - d->rd == EXT_Q_LEN) {
+		d->rd++;
+		metric_add(M_EXT_DROPS, rx_chan, 1);
+	}
+	d->q[d->wr & (EXT_Q_LEN-1)] = *q;
+	d->wr++;
+	memset(q, 0, sizeof(*q));
+	TaskWakeup(d->tid, TRUE, TO_VOID_PARAM(rx_chan));
+}
+
 void ext_register_receive_iq_samps(ext_receive_iq_samps_t func, int rx_chan)
 {
+	ext_deliver_start(rx_chan);
 	ext_users[rx_chan].receive_iq = func;
 }
 
@@ -92,6 +273,7 @@ void ext_unregister_receive_iq_samps_task(int rx_chan)
 
 void ext_register_receive_real_samps(ext_receive_real_samps_t func, int rx_chan)
 {
+	ext_deliver_start(rx_chan);
 	ext_users[rx_chan].receive_real = func;
 }
 
@@ -112,6 +294,10 @@ void ext_unregister_receive_real_samps_task(int rx_chan)
 
 void ext_register_receive_FFT_samps(ext_receive_FFT_samps_t func, int rx_chan, bool postFiltered)
 {
+	ext_deliver_t *d = &ext_deliver[rx_chan];
+	if (d->fft == NULL)
+		d->fft = (TYPECPX *) malloc(EXT_Q_LEN * CONV_FFT_SIZE * sizeof(TYPECPX));
+	ext_deliver_start(rx_chan);
 	ext_users[rx_chan].receive_FFT = func;
 	ext_users[rx_chan].postFiltered = postFiltered;
 }
@@ -121,8 +307,19 @@ void ext_unregister_receive_FFT_samps(int rx_chan)
 	ext_users[rx_chan].receive_FFT = NULL;
 }
 
+int ext_register_receive_subband_samps(ext_receive_iq_samps_t func, int rx_chan, float lo_Hz, float hi_Hz, int decim)
+{
+	return m_FastFIR[rx_chan].AddSubband(func, lo_Hz, hi_Hz, decim, SND_RATE);
+}
+
+void ext_unregister_receive_subband_samps(int rx_chan, int handle)
+{
+	m_FastFIR[rx_chan].RemoveSubband(handle);
+}
+
 void ext_register_receive_S_meter(ext_receive_S_meter_t func, int rx_chan)
 {
+	ext_deliver_start(rx_chan);
 	ext_users[rx_chan].receive_S_meter = func;
 }
 
@@ -227,21 +424,18 @@ void extint_send_extlist(conn_t *conn)
 char *extint_list_js()
 {
 	int i;
-	char *sb, *sb2;
+	char *sb;
 	
 	sb = NULL;
 	for (i=0; i < n_exts; i++) {
 		ext_t *ext = ext_list[i];
-		asprintf(&sb2, "<script src=\"extensions/%s/%s.js\"></script>\n", ext->name, ext->name);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
+		sb = kstr_asprintf(sb, "<script src=\"extensions/%s/%s.js\"></script>\n", ext->name, ext->name);
 		
 		for (const char **fp = ext->aux_files; *fp != NULL; fp++) {
-            asprintf(&sb2, "<script src=\"extensions/%s/%s\"></script>\n", ext->name, *fp);
-            sb = kstr_cat(sb, kstr_wrap(sb2));
+            sb = kstr_asprintf(sb, "<script src=\"extensions/%s/%s\"></script>\n", ext->name, *fp);
 		}
 		
-		asprintf(&sb2, "<link rel=\"stylesheet\" type=\"text/css\" href=\"extensions/%s/%s.css\" />\n", ext->name, ext->name);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
+		sb = kstr_asprintf(sb, "<link rel=\"stylesheet\" type=\"text/css\" href=\"extensions/%s/%s.css\" />\n", ext->name, ext->name);
 	}
 
 	return sb;
@@ -259,6 +453,8 @@ void extint_load_extension_configs(conn_t *conn)
 void extint_ext_users_init(int rx_chan)
 {
     memset(&ext_users[rx_chan], 0, sizeof(ext_users_t));
+    m_FastFIR[rx_chan].RemoveSubbands();
+    if (ext_deliver[rx_chan].tid) ext_deliver_reset(rx_chan);
 }
 
 void extint_setup_c2s(void *param)
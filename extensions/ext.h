@@ -71,6 +71,14 @@ void ext_unregister_receive_real_samps_task(int rx_chan);
 void ext_register_receive_FFT_samps(ext_receive_FFT_samps_t func, int rx_chan, bool postFiltered);
 void ext_unregister_receive_FFT_samps(int rx_chan);
 
+// call to start/stop receiving complex samples of a sub-band of the audio channel, e.g. 1350 to 1650 Hz
+// Centred on (lo_Hz + hi_Hz)/2 (rounded to an FFT bin) at a sample rate of SND_RATE/decim (decim a power of 2).
+// Uses the FFT done for the passband FIR so several extensions on one channel share it.
+// The passband plus the filter transitions (about 90 Hz each side) must fit in SND_RATE/decim.
+// Returns a handle for unregistering or -1 if none available or the sub-band doesn't fit.
+int ext_register_receive_subband_samps(ext_receive_iq_samps_t func, int rx_chan, float lo_Hz, float hi_Hz, int decim);
+void ext_unregister_receive_subband_samps(int rx_chan, int handle);
+
 // call to start/stop receiving S-meter data
 void ext_register_receive_S_meter(ext_receive_S_meter_t func, int rx_chan);
 void ext_unregister_receive_S_meter(int rx_chan);
@@ -45,6 +45,19 @@ struct ext_users_t {
 
 extern ext_users_t ext_users[RX_CHANS];
 
+// The sample callbacks above aren't called from the audio task but queued, one entry per audio block,
+// to a per-channel delivery task with a cpu budget. See ext.c
+#define	EXT_Q_LEN				8		// pow2, < N_DPBUF since the IQ and real samples are queued in place
+#define	EXT_BUDGET_PCT_DEFAULT	20		// "ext_budget_pct" cfg, 0 = no limit
+
+extern int ext_budget_pct;
+
+void ext_queue_FFT(int rx_chan, int ratio, int ns_out, TYPECPX *samps);
+void ext_queue_S_meter(int rx_chan, float S_meter_dBm);
+void ext_queue_iq(int rx_chan, int ns_out, TYPECPX *samps);
+void ext_queue_real(int rx_chan, int ns_out, TYPEMONO16 *samps);
+void ext_queue_commit(int rx_chan);
+
 // internal use
 void extint_setup();
 void extint_init();
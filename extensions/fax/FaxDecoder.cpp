@@ -55,50 +55,40 @@ static int median(int *x, int n)
      return x[n/2];
 }
 
-static TYPEREAL apply_firfilter(FaxDecoder::firfilter *filter, TYPEREAL sample)
-{
 // Narrow, middle and wide fir low pass filter from ACfax
-     const int buffer_count = 17;
-     const TYPEREAL lpfcoeff[3][17]={
-          { -7,-18,-15, 11, 56,116,177,223,240,223,177,116, 56, 11,-15,-18, -7},
-          {  0,-18,-38,-39,  0, 83,191,284,320,284,191, 83,  0,-39,-38,-18,  0},
-          {  6, 20,  7,-42,-74,-12,159,353,440,353,159,-12,-74,-42,  7, 20,  6}};
-
-     const TYPEREAL *c = lpfcoeff[filter->bandwidth];
-     const TYPEREAL *c_end=lpfcoeff[filter->bandwidth] + ((sizeof *lpfcoeff) / (sizeof **lpfcoeff));
-     TYPEREAL* const b_begin=filter->buffer;
-     TYPEREAL* const b_end=filter->buffer + buffer_count;
-     TYPEREAL sum=0;
-
-     TYPEREAL *current = filter->buffer + filter->current;
-     // replace oldest value with current
-     *current=sample;
-
-     // convolution
-     while(current!=b_end)
-          sum+=(*current++)*(*c++);
-     current=b_begin;
-     while(c!=c_end)
-          sum+=(*current++)*(*c++);
-
-     // point again to oldest value
-     if(--current<b_begin)
-          current=b_end-1;
-
-     filter->current = current - filter->buffer;
-     return sum;
+static const TYPEREAL lpfcoeff[3][FAX_FIR_TAPS]={
+     { -7,-18,-15, 11, 56,116,177,223,240,223,177,116, 56, 11,-15,-18, -7},
+     {  0,-18,-38,-39,  0, 83,191,284,320,284,191, 83,  0,-39,-38,-18,  0},
+     {  6, 20,  7,-42,-74,-12,159,353,440,353,159,-12,-74,-42,  7, 20,  6}};
+
+// Carrier mixer sine table, shared read-only by all channels.
+// Cosine is read a quarter cycle ahead.
+#define FAX_NCO_SIZE    (1 << FAX_NCO_BITS)
+#define FAX_NCO_SHIFT   (32 - FAX_NCO_BITS)
+#define FAX_NCO_QUARTER (FAX_NCO_SIZE / 4)
+
+static TYPEREAL nco_sin[FAX_NCO_SIZE];
+static bool nco_init;
+
+static void nco_table_init()
+{
+    if (nco_init) return;
+    for (int i = 0; i < FAX_NCO_SIZE; i++)
+        nco_sin[i] = MSIN(K_2PI * i / FAX_NCO_SIZE);
+    nco_init = true;
 }
 
+static const TYPEREAL normalize_sample = 1.0/32768.0;
+
 void FaxDecoder::UpdateSampleRate()
 {
     m_SamplesPerSec_frac = ext_update_get_sample_rateHz(m_rx_chan);
     m_SamplesPerSec_nom = SND_RATE;
-    m_SampleRateRatio = m_SamplesPerSec_frac / m_SamplesPerSec_nom;
 }
 
 void FaxDecoder::ProcessSamples(s2_t *samps, int nsamps, float shift)
 {
-    int i = 0;
+    int i;
     
     if (m_bEndDecoding) return;
     
@@ -112,39 +102,43 @@ void FaxDecoder::ProcessSamples(s2_t *samps, int nsamps, float shift)
         m_skip -= skip;
     }
 
-    while (i < nsamps) {
-        for (; i < nsamps && m_samp_idx < m_SamplesPerLine;) {
-            samples[m_samp_idx] = samps[i];
-            m_samp_idx++;
-            m_fi += m_SampleRateRatio;
-            i = trunc(m_fi);
-        }
+    // Samples are resampled from the actual audio rate to exactly the nominal rate, so the
+    // demodulator sees a uniformly spaced stream with the line length fixed at m_SamplesPerLine.
+    // They are then demodulated as they arrive, a block at a time, into the current line, and
+    // the pixels averaged as each block completes. So the end of a line only has to send it.
+    while (nsamps > 0) {
+        int nin = MIN(nsamps, RESAMP_MAX_IN);
+        assert(resamp_max_out(&m_resamp, nin) <= ARRAY_LEN(m_rs));
+        int nout = resamp_process(&m_resamp, samps, nin, m_rs);
+        samps += nin;
+        nsamps -= nin;
+
+        for (i = 0; i < nout;) {
+            if (m_samp_idx == 0 && m_blk_n == 0) StartLine();
+        
+            for (; i < nout && m_samp_idx + m_blk_n < m_SamplesPerLine && m_blk_n < FAX_BLK; i++)
+                m_blk[m_blk_n++] = m_rs[i] * normalize_sample;     // -1..0..1
         
-        if (m_samp_idx == m_SamplesPerLine) {
-		    NextTask("DecodeFax BD");
-            if (ev_dump) evLatency(EC_TRIG_ACCUM_ON, EV_EXT, ev_dump, "FAX", evprintf("rx%d fax task cycle time", m_rx_chan));
-            DecodeFax();
-            if (ev_dump) evLatency(EC_TRIG_ACCUM_OFF, EV_EXT, ev_dump, "FAX", evprintf("rx%d fax task cycle time", m_rx_chan));
-		    NextTask("DecodeFax AD");
-            m_samp_idx = 0;
+            if (m_blk_n == FAX_BLK || m_samp_idx + m_blk_n == m_SamplesPerLine) {
+                DemodulateData(m_blk_n, data + m_samp_idx);
+                AccumulatePixels(data + m_samp_idx, m_blk_n);
+                m_samp_idx += m_blk_n;
+                m_blk_n = 0;
+            }
+        
+            if (m_samp_idx == m_SamplesPerLine) {
+                if (ev_dump) evLatency(EC_TRIG_ACCUM_ON, EV_EXT, ev_dump, "FAX", evprintf("rx%d fax task cycle time", m_rx_chan));
+                DecodeFax();
+                if (ev_dump) evLatency(EC_TRIG_ACCUM_OFF, EV_EXT, ev_dump, "FAX", evprintf("rx%d fax task cycle time", m_rx_chan));
+                m_samp_idx = 0;
+            }
         }
     }
-    m_fi -= nsamps;     // keep bounded
 }
 
-static float mm_mag[8192], mm_y[8192], mm_xo[8192], mm_x[8192];
-static u1_t mm_d[8192];
-static int frame;
-static u1_t scope[4][1024];
-static TYPEREAL normalize_sample = 1.0/32768.0;
-
-void FaxDecoder::DemodulateData()
+// Called at the start of each line to track the sample rate for the resampler
+void FaxDecoder::StartLine()
 {
-     double f=0, ph_inc;
-     int i;
-     int tslice0 = m_SamplesPerLine/4, tslice1 = m_SamplesPerLine/2, tslice3 = m_SamplesPerLine*3/4;
-
-    // update sps for mixers
     UpdateSampleRate();
 
     if (m_SamplesPerSec_frac != m_SamplesPerSec_frac_prev) {
@@ -154,84 +148,85 @@ void FaxDecoder::DemodulateData()
         m_SamplesPerSec_frac_prev = m_SamplesPerSec_frac;
     }
     
-    ph_inc = m_carrier/m_SamplesPerSec_frac;
-    //printf("FaxDecoder::DecodeFax m_rx_chan=%d m_SamplesPerSec_nom=%.1f\n", m_rx_chan, m_SamplesPerSec_nom);
+    resamp_set_rate(&m_resamp, m_SamplesPerSec_frac, m_SamplesPerSec_nom);
 
-    //printf("%f .. %f .. %f | %f .. %f .. %f | %f\n", MASIN(-1), MASIN(0), MASIN(1), MASIN(-1)/K_2PI, MASIN(0)/K_2PI, MASIN(1)/K_2PI, K_2PI);
-    //printf("DemodulateData srate= %.3f %.3f car=%.3f dev=%.3f ph_inc=%.3f\n",
-    //    m_SamplesPerSec_nom, m_SamplesPerSec_frac, m_carrier, m_deviation, ph_inc);
+    // the mixer runs on the resampled stream
+    m_nco_inc = (u4_t) round(m_carrier / m_SamplesPerSec_nom * 4294967296.0);
 
-    for (i=0; i < m_SamplesPerLine; i++) {
+    m_pix = m_pix_sum = m_pix_n = 0;
+    m_pix_end = m_SamplesPerLine / m_imagewidth;
+}
 
-        if (i == tslice0 || i == tslice1 || i == tslice3)
-            NextTask("DemodulateData");
+void FaxDecoder::DemodulateData(int nsamps, u1_t *out)
+{
+    const int hist = FAX_FIR_TAPS-1;
+    TYPEREAL *mi = m_I + hist, *mq = m_Q + hist;
+    int i, j;
+
+    // mix to carrier so start/stop/black/white freqs will be relative to zero
+    u4_t ph = m_nco_phase;
+    for (i = 0; i < nsamps; i++) {
+        TYPEREAL samp = m_blk[i];
+        mi[i] = samp * nco_sin[((ph >> FAX_NCO_SHIFT) + FAX_NCO_QUARTER) & (FAX_NCO_SIZE-1)];
+        mq[i] = samp * nco_sin[ph >> FAX_NCO_SHIFT];
+        ph += m_nco_inc;
+    }
+    m_nco_phase = ph;
+
+    // block low pass filter, delay line precedes the block
+    TYPEREAL *In = m_In + 1, *Qn = m_Qn + 1;
+    for (i = 0; i < nsamps; i++) {
+        TYPEREAL si = 0, sq = 0;
+        for (j = 0; j < FAX_FIR_TAPS; j++) {
+            si += m_I[i+j] * m_lpf[j];
+            sq += m_Q[i+j] * m_lpf[j];
+        }
+        In[i] = si;
+        Qn[i] = sq;
+    }
+    memmove(m_I, m_I + nsamps, hist * sizeof(TYPEREAL));
+    memmove(m_Q, m_Q + nsamps, hist * sizeof(TYPEREAL));
+
+    // normalize, then the cross product with the previous sample gives sin(phase change)
+    for (i = 0; i < nsamps; i++) {
+        TYPEREAL mag2 = In[i]*In[i] + Qn[i]*Qn[i];
+        TYPEREAL inv = (mag2 > 0)? 1 / MSQRT(mag2) : 0;
+        In[i] *= inv;
+        Qn[i] *= inv;
+    }
 
-        // mix to carrier so start/stop/black/white freqs will be relative to zero
+    for (i = 0; i < nsamps; i++) {
+        TYPEREAL x = m_disc_gain * (In[i]*Qn[i-1] - Qn[i]*In[i-1]);
+        if (x < -1.0) x = -1.0; else if (x > 1.0) x = 1.0;      // clamp
+        out[i] = (u1_t) ((x/2.0 + 0.5) * 255.0);
+    }
 
-        TYPEREAL samp = samples[i] * normalize_sample;      // -1..0..1
+    m_In[0] = In[nsamps-1];
+    m_Qn[0] = Qn[nsamps-1];
+}
 
-        TYPEREAL Icur = apply_firfilter(firfilters+0, samp*MCOS(K_2PI*f));
-        TYPEREAL Qcur = apply_firfilter(firfilters+1, samp*MSIN(K_2PI*f));
+// Pixel i is the average of line samples spl*i/width .. spl*(i+1)/width - 1,
+// samps[] being the demodulator output starting at line sample m_samp_idx.
+void FaxDecoder::AccumulatePixels(u1_t *samps, int nsamps)
+{
+    int spl = m_SamplesPerLine;
 
-        f += ph_inc;
-        if (f > 1.0) f -= 1.0;      // keep bounded
-        
-        TYPEREAL mag = MSQRT(Qcur*Qcur + Icur*Icur);
-        mm_mag[i] = mag;
-        //if (i>=100&&i<104)
-        //real_printf("%7.1f %7.1f %6.3f ", Icur, mag, Icur/mag);
-        Icur /= mag;
-        Qcur /= mag;
-
-        //if (i==100) { real_printf("%.0f ", mag); fflush(stdout); }
-        //if (mag > 0.1) {
-        if (1) {
-        
-            TYPEREAL x = -1.3 * (Icur*(Qcur-Qprev) - Qcur*(Icur-Iprev)) * (m_SamplesPerSec_nom/m_deviation/8);
-            //if (i==100) { real_printf("%.1f ", x); fflush(stdout); }
-        
-            if (x < -1.0) x = -1.0; else if (x > 1.0) x = 1.0;      // clamp
+    for (int i = 0; i < nsamps; i++) {
+        m_pix_sum += samps[i];
+        m_pix_n++;
 
-            x = x/2.0 + 0.5;
-            data[i] = (u1_t)(x*255.0);
-            mm_d[i] = data[i];
-            
-            //if (i<48) real_printf("%3d ", data[i]);
-        } else {
-            data[i] = 255;      // force noise floor to white?
+        // a line with fewer samples than pixels repeats a sample, as a pixel always has at least one
+        while (m_pix < m_imagewidth && m_samp_idx + i + 1 >= m_pix_end) {
+            m_line[m_pix++] = m_pix_n? (m_pix_sum / m_pix_n) : samps[i];
+            m_pix_end = spl * (m_pix+1) / m_imagewidth;
+            m_pix_sum = m_pix_n = 0;
         }
-
-        data_i[i] = data[i];
-
-        Iprev = Icur;
-        Qprev = Qcur;
     }
-    NextTask("DemodulateData");
-     
-    //real_printf("\n");
-    
-    //print_max_min_i("data", data_i, n);
-    //print_max_min_f("mag", mm_mag, n);
-    //print_max_min_f("y", mm_y, n);
-    //print_max_min_f("xo", mm_xo, n);
-    //print_max_min_f("x", mm_x, n);
-    //print_max_min_u1("data", mm_d, n);
-
-    #if 0
-    if ((frame&3) == 3) {
-        ext_send_msg_data(m_rx_chan, false, FAX_MSG_CLEAR, NULL, 0);
-        ext_send_msg_data(m_rx_chan, false, 0, &scope[0][0], 1024);
-        ext_send_msg_data(m_rx_chan, false, 1, &scope[1][0], 1024);
-    }
-    frame++;
-    #endif
 }
 
 bool FaxDecoder::DecodeFax()
 {
     const int phasingSkipLines = 2;
-    
-    DemodulateData();
 
 //jksx
 #if 0
@@ -304,7 +299,7 @@ if (type == STOP) printf("FAX lineType=STOP\n");
             m_imgdata = (u1_t*)realloc(m_imgdata, m_imagewidth*height*m_imagecolors);
         }
        
-        DecodeImageLine(data, m_SamplesPerLine, m_imgdata+imgpos);
+        DecodeImageLine(m_imgdata+imgpos);
         
         int skiplen = ((phasingSkipData-phasingSkippedData)%m_SamplesPerLine)*m_imagewidth/m_SamplesPerLine;
         phasingSkippedData = phasingSkipData; /* reset skipped position */
@@ -379,69 +374,14 @@ int FaxDecoder::FaxPhasingLinePosition(u1_t *image, int imagewidth)
     return (min+n/2) % imagewidth;
 }
 
-/* decode a single line of fax data from buffer placing it in image pointer
-   buffer should contain m_SamplesPerSec_nom*60.0/m_lpm*colors bytes
+/* place the line of pixels accumulated from the demodulator output in image pointer
    image will contain imagewidth*colors bytes
 */
-void FaxDecoder::DecodeImageLine(u1_t* buffer, int buffer_len, u1_t *image)
+void FaxDecoder::DecodeImageLine(u1_t *image)
 {
-    //int n = m_SamplesPerSec_nom*60.0/m_lpm;
-    int spl = m_SamplesPerLine;
-
-    if (buffer_len != spl) {
-        printf("m_SamplesPerSec_nom=%.1f buffer_len=%d spl=%d\n", m_SamplesPerSec_nom, buffer_len, spl);
-        panic("DecodeImageLine requires specific buffer length");
-    }
-
-    int i, c;
-
-    #if 0
-        int stats[3];
-        stats[0] = stats[1] = stats[2] = 0;
-        for (i = 0; i < spl; i++) {
-            if (buffer[i] == 0) stats[0]++;
-            else
-            if (buffer[i] == 255) stats[2]++;
-            else {
-                stats[1]++;
-                //printf("%3d@%d\n", buffer[i], i);
-            }
-        }
-        printf("%4d: %4d | %4d | %4d\n", spl, stats[0], stats[1], stats[2]);
-    #endif
-
-    for (i = 0; i < m_imagewidth; i++) {
-        int pixel;
-        
-        int firstsample = spl * i/m_imagewidth;
-        int lastsample = spl * (i+1)/m_imagewidth - 1;
-        
-        int pixelSamples = 0, sample = firstsample;
-        pixel = 0;
-
-        do {
-            pixel += buffer[sample];
-            pixelSamples++;
-        } while (sample++ < lastsample);
-
-        pixel /= pixelSamples;
-        if (0 && i < 512) {
-            float p = ((float) pixel)/255.0*2.0 - 1.0;
-            p *= 1.6;
-            if (p > 1.0) p = 1.0; else if (p < -1.0) p = -1.0;
-            p = (p + 1.0)/2.0;
-            image[i] = p*255;
-        } else {
-            image[i] = pixel;
-        }
-        //if (i < 12) real_printf("%3d|%3d ", pixel, image[i]);
-    }
-    //real_printf("\n");
-
-    NextTask("DecodeImageLine 1");
+    memcpy(image, m_line, m_imagewidth);
     ext_send_msg_data(m_rx_chan, false, FAX_MSG_DRAW, image, m_imagewidth);
     FileWrite(image, m_imagewidth);
-    NextTask("DecodeImageLine 2");
 }
 
 void FaxDecoder::InitializeImage()
@@ -455,6 +395,7 @@ void FaxDecoder::InitializeImage()
     FreeImage();
     //printf("InitializeImage h=%d\n", height);
     m_imgdata = (u1_t*)malloc(m_imagewidth*height*m_imagecolors);
+    m_line = (u1_t*)malloc(m_imagewidth*m_imagecolors);
 
     m_imageline = 0;
     lasttype = IMAGE;
@@ -466,6 +407,7 @@ void FaxDecoder::InitializeImage()
 void FaxDecoder::FreeImage()
 {
      free(m_imgdata);
+     free(m_line);
      m_imageline = 0;
 }
 
@@ -485,13 +427,16 @@ void FaxDecoder::SetupBuffers()
     printf("FAX rx%d SamplesPerSec=%.3f/%.0f lpm=%d SamplesPerLine=%d\n",
         m_rx_chan, m_SamplesPerSec_frac, m_SamplesPerSec_nom, m_lpm, m_SamplesPerLine);
     
-    samples = new s2_t[m_SamplesPerLine];
-    m_samp_idx = 0;
-    m_fi = 0;
+    m_samp_idx = m_blk_n = 0;
+    resamp_init(&m_resamp, m_SamplesPerSec_frac, m_SamplesPerSec_nom);
     data = new u1_t[m_SamplesPerLine];
-    data_i = new int[m_SamplesPerLine];
     datadouble = new double[m_SamplesPerLine];
 
+    m_nco_phase = 0;
+    memset(m_I, 0, sizeof(m_I));
+    memset(m_Q, 0, sizeof(m_Q));
+    m_In[0] = m_Qn[0] = 0;
+
     phasingPos = new int[m_phasingLines];
     phasingLinesLeft = phasingSkipData = phasingSkippedData = 0;
 
@@ -502,7 +447,6 @@ void FaxDecoder::SetupBuffers()
 
 void FaxDecoder::CleanUpBuffers()
 {
-     delete [] samples;
      delete [] data;
      delete [] datadouble;
      delete [] phasingPos;
@@ -536,8 +480,12 @@ bool FaxDecoder::Configure(int rx_chan, int imagewidth, int BitsPerPixel, int ca
     m_offset = 0;
     m_imgsize = 0;
 
-    firfilters[0] = firfilter(bandwidth);
-    firfilters[1] = firfilter(bandwidth);
+    m_bandwidth = bandwidth;
+    m_lpf = lpfcoeff[bandwidth];
+    nco_table_init();
+
+    // discriminator output scaled so black/white (carrier -/+ deviation) is full scale
+    m_disc_gain = 1.3 * (SND_RATE/m_deviation/8);
 
     if (reset) {
         CleanUpBuffers();
@@ -565,7 +513,7 @@ void FaxDecoder::FileOpen()
     asprintf(&m_fn, "/root/kiwi.config/fax.ch%d.pgm", m_rx_chan);
     m_file = pgm_file_open(m_fn, &m_offset, m_imagewidth, 0, 255);
 
-    if (m_file <= 0) {
+    if (m_file == NULL) {
         printf("FAX rx%d open FAILED %s\n", m_rx_chan, m_fn);
     } else {
         printf("FAX rx%d open %s\n", m_rx_chan, m_fn);
@@ -574,7 +522,7 @@ void FaxDecoder::FileOpen()
 
 void FaxDecoder::FileWrite(u1_t *data, int datalen)
 {
-    if (m_file <= 0) return;
+    if (m_file == NULL) return;
     //printf("len=%d m_fax_line=%d\n", datalen, m_fax_line);
     fwrite(data, datalen, 1, m_file);
     m_fax_line++;
@@ -583,7 +531,7 @@ void FaxDecoder::FileWrite(u1_t *data, int datalen)
 
 void FaxDecoder::FileClose()
 {
-    if (m_file <= 0) return;
+    if (m_file == NULL) return;
     
     fflush(m_file);
     pgm_file_height(m_file, m_offset, m_fax_line);
@@ -29,23 +29,22 @@
 #include "types.h"
 #include "kiwi.h"
 #include "datatypes.h"
+#include "rx_resamp.h"
 
 #define FAX_MSG_CLEAR   255
 #define FAX_MSG_DRAW    254
 #define FAX_MSG_SCOPE   0       // channel 0, 1, 2, 3
 
+#define FAX_FIR_TAPS    17
+#define FAX_BLK         256     // demodulator block size (samples)
+#define FAX_NCO_BITS    10      // sine table size = 2^FAX_NCO_BITS
+
 class FaxDecoder
 {
 public:
 
     struct firfilter {
         enum Bandwidth {NARROW, MIDDLE, WIDE};
-        firfilter() {}
-    firfilter(enum Bandwidth b) : bandwidth(b), current(0)
-        { for(int i=0; i<17; i++) buffer[i] = 0; }
-        enum Bandwidth bandwidth;
-        TYPEREAL buffer[17];
-        int current;
     };
 
     FaxDecoder() {}
@@ -77,7 +76,9 @@ public:
 
 private:
     bool DecodeFax();
-    void DemodulateData();
+    void StartLine();
+    void DemodulateData(int nsamps, u1_t *out);
+    void AccumulatePixels(u1_t *samps, int nsamps);
 
     void CloseInput();
     void SetupBuffers();
@@ -91,29 +92,42 @@ private:
     bool m_bEndDecoding;        /* flag to end decoding thread */
     double m_SamplesPerSec_nom;
     double m_SamplesPerSec_frac, m_SamplesPerSec_frac_prev;
-    double m_SampleRateRatio, m_fi;
     int m_SamplesPerLine, m_skip;
     int m_BytesPerLine;
 
     /* internal state machine */
-    TYPEREAL Iprev, Qprev;
-    s2_t *samples;
     int m_samp_idx;
     u1_t *data;
-    int *data_i;
+
+    /* streaming demodulator */
+    resamp_t m_resamp;                          // input at m_SamplesPerSec_frac to exactly m_SamplesPerSec_nom
+    TYPEMONO16 m_rs[RESAMP_MAX_IN + 16];        // resampler output
+    u4_t m_nco_phase, m_nco_inc;                // carrier mixer phase accumulator
+    TYPEREAL m_disc_gain;
+    const TYPEREAL *m_lpf;                      // low pass filter coefficients
+    int m_blk_n;
+    TYPEREAL m_blk[FAX_BLK];                    // resampled input awaiting demodulation
+    TYPEREAL m_I[FAX_FIR_TAPS-1 + FAX_BLK],     // filter delay line followed by block being filtered
+             m_Q[FAX_FIR_TAPS-1 + FAX_BLK];
+    TYPEREAL m_In[1 + FAX_BLK],                 // normalized filter output, [0] = last sample of previous block
+             m_Qn[1 + FAX_BLK];
+
+    /* pixels of the current line, averaged as the demodulator output arrives */
+    u1_t *m_line;
+    int m_pix, m_pix_end, m_pix_sum, m_pix_n;   // pixel, its end (sample index in line), partial sum
 
     enum Header {IMAGE, START, STOP};
 
     TYPEREAL FourierTransformSub(u1_t* buffer, int buffer_len, int freq);
     Header DetectLineType(u1_t* buffer, int buffer_len);
-    void DecodeImageLine(u1_t* buffer, int buffer_len, u1_t *image);
+    void DecodeImageLine(u1_t *image);
     int FaxPhasingLinePosition(u1_t *image, int imagewidth);
     void UpdateSampleRate();
 
     /* fax settings */
     int m_BitsPerPixel;
     double m_carrier, m_deviation;
-    struct firfilter firfilters[2];
+    enum firfilter::Bandwidth m_bandwidth;
     bool m_bSkipHeaderDetection;
     bool m_bIncludeHeadersInImages;
     int m_imagecolors;
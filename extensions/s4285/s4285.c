@@ -10,74 +10,193 @@
 #include "kiwi.h"
 #include "datatypes.h"
 #include "st4285.h"
+#include "str.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <math.h>
 #include <strings.h>
+#include <string.h>
+#include <pthread.h>
 
 //#define S4285_DEBUG_MSG	true
 #define S4285_DEBUG_MSG	false
 
+#define	MODE_RX				0
+#define	MODE_TX_LOOPBACK	1
+
+#define	DRAW_POINTS		0
+#define	DRAW_DENSITY	1
+
+// The demodulator, equalizer and Viterbi decoder of each channel run on their own thread so
+// several channels can decode at once (and the rest of the server isn't held up by them).
+// Audio blocks are handed over in a single-producer/single-consumer ring. The decoder thread
+// doesn't call the ext_send_msg*() routines: the constellation frames and status it produces
+// are picked up and sent by a task. The display settings the decoder thread uses
+// are set by s4285_msgs() in the req_* fields and picked up by the thread between blocks.
+
+#define N_RXBLK			512
+#define N_RXBLKS		64			// must be power of 2, ~2.7 secs of audio
+#define S4285_POLL_MS	10			// decoder thread poll interval when idle
+#define S4285_SEND_MS	50			// how often the task sends frames and status
+
 struct s4285_t {
 	int rx_chan, run, mode, draw;
 	int rx_task;
 
+	// audio -> decoder thread
+	TYPEMONO16 rx_blocks[N_RXBLKS][N_RXBLK];
+	int rx_len[N_RXBLKS];
+	u4_t rx_head, rx_tail;			// head only written by the audio side, tail only by the decoder thread
+	u4_t rx_drops;
+	pthread_t thread;
+	bool thread_running, stop;
+
+	// decoder thread -> task
+	bool status_ready;
+	char status[256];
+	bool frame_ready;
+	int frame_draw, frame_len;
+
+	// s4285_msgs() -> decoder thread
+	int req_gain, req_points, req_draw, req_decode;
+	u4_t req_clear, clear_seen;
+
+	// decoder thread only
 	float gain;
 	double cma;
 	u4_t ncma;
-	int ring, points;
+	int ring, points, decode;
 	#define N_IQ_RING (16*1024)
 	float iq[N_IQ_RING][NIQ];
 	u1_t plot[N_IQ_RING][2][NIQ];
 	u1_t map[N_IQ_RING][NIQ];
+	u1_t frame[N_IQ_RING*2*NIQ + 1];
 };
 
 static s4285_t s4285[RX_CHANS];
 
-#define	MODE_RX				0
-#define	MODE_TX_LOOPBACK	1
-
-#define	DRAW_POINTS		0
-#define	DRAW_DENSITY	1
-
-#define N_RXBLK 512
-#define N_RXBLKS 256
-TYPEMONO16 s4285_rx_blocks[N_RXBLKS][512];
-int s4285_rx_ra, s4285_rx_wa, s4285_rx_count, s4285_rx_count_max;
+static void s4285_settings(s4285_t *e)
+{
+	// 0 .. +100 dB of S4285_MAX_VAL
+	int gain = __atomic_load_n(&e->req_gain, __ATOMIC_ACQUIRE);
+	e->gain = gain? pow(10.0, ((float) -gain) / 10.0) : 0;
+	e->draw = __atomic_load_n(&e->req_draw, __ATOMIC_ACQUIRE);
+	int points = __atomic_load_n(&e->req_points, __ATOMIC_ACQUIRE);
+	if (points != e->points) {
+		e->points = points;
+		e->ring = 0;
+	}
+	int decode = __atomic_load_n(&e->req_decode, __ATOMIC_ACQUIRE);
+	if (decode != e->decode) {
+		char resp[256];
+		m_CSt4285[e->rx_chan].control((void *) (decode? "SET,DECODE,ON" : "SET,DECODE,OFF"), resp, 0);
+		e->decode = decode;
+	}
+	u4_t clear = __atomic_load_n(&e->req_clear, __ATOMIC_ACQUIRE);
+	if (clear != e->clear_seen) {
+		e->cma = e->ncma = 0;
+		e->clear_seen = clear;
+	}
+}
 
-static void send_status(int rx_chan)
+static void *s4285_decoder(void *param)
 {
+	s4285_t *e = (s4285_t *) param;
+	CSt4285 *st = &m_CSt4285[e->rx_chan];
 	char status[256];
-	bool upd;
-	if ((upd = m_CSt4285[rx_chan].get_status_text(status))) {
-		ext_send_msg_encoded(rx_chan, S4285_DEBUG_MSG, "EXT", "status", "%s", status);
+	bool status_pending = false;
+
+	while (!__atomic_load_n(&e->stop, __ATOMIC_ACQUIRE)) {
+
+		// the status buffer isn't touched until the task has sent what's in it, only the latest is kept
+		if (status_pending && !__atomic_load_n(&e->status_ready, __ATOMIC_ACQUIRE)) {
+			kiwi_strncpy(e->status, status, sizeof(e->status));
+			__atomic_store_n(&e->status_ready, true, __ATOMIC_RELEASE);
+			status_pending = false;
+		}
+
+		u4_t tail = e->rx_tail;
+		if (tail == __atomic_load_n(&e->rx_head, __ATOMIC_ACQUIRE)) {
+			usleep(S4285_POLL_MS * 1000);
+			continue;
+		}
+		int b = tail & (N_RXBLKS-1);
+		s4285_settings(e);
+		st->process_rx_block(&e->rx_blocks[b][0], e->rx_len[b], K_AMPMAX);
+		__atomic_store_n(&e->rx_tail, tail+1, __ATOMIC_RELEASE);
+
+		if (st->get_status_text(status))
+			status_pending = true;
 	}
-	//printf("upd %d\n", upd? 1:0);
+	return NULL;
+}
+
+static void s4285_stop(s4285_t *e)
+{
+	if (!e->thread_running) return;
+	__atomic_store_n(&e->stop, true, __ATOMIC_RELEASE);
+	pthread_join(e->thread, NULL);
+	e->thread_running = false;
+
+	if (e->rx_drops)
+		lprintf("S4285 RX%d: %d audio blocks dropped, decoder not keeping up\n", e->rx_chan, e->rx_drops);
+}
+
+static void s4285_start(s4285_t *e)
+{
+	s4285_stop(e);
+	e->rx_head = e->rx_tail = e->rx_drops = 0;
+	e->stop = false;
+	e->frame_ready = e->status_ready = false;
+	m_CSt4285[e->rx_chan].reset();
+	e->decode = 0;		// reset() turns decoding off
+	s4285_settings(e);
+	e->thread_running = (pthread_create(&e->thread, NULL, s4285_decoder, e) == 0);
+	if (!e->thread_running)
+		lprintf("S4285 RX%d: can't create decoder thread\n", e->rx_chan);
 }
 
-void s4285_rx(void *param)
+static void s4285_task(void *param)
 {
+	int rx_chan = (int) FROM_VOID_PARAM(param);
+	s4285_t *e = &s4285[rx_chan];
+
 	while (1) {
-		int rx_chan = TaskSleep();
-		s4285_t *e = &s4285[rx_chan];
+		if (__atomic_load_n(&e->frame_ready, __ATOMIC_ACQUIRE)) {
+			ext_send_msg_data(rx_chan, S4285_DEBUG_MSG, e->frame_draw, e->frame, e->frame_len);
+			__atomic_store_n(&e->frame_ready, false, __ATOMIC_RELEASE);
+		}
 
-		if (e->mode == MODE_TX_LOOPBACK) {
-			while (m_CSt4285[rx_chan].process_rx_block_tx_loopback()) {
-				TaskFastIntr("s4285_rx");
-			}
+		if (__atomic_load_n(&e->status_ready, __ATOMIC_ACQUIRE)) {
+			ext_send_msg_encoded(rx_chan, S4285_DEBUG_MSG, "EXT", "status", "%s", e->status);
+			__atomic_store_n(&e->status_ready, false, __ATOMIC_RELEASE);
+		}
+
+		TaskSleepMsec(S4285_SEND_MS);
+	}
+}
+
+// blocks of any length are split to fit the ring
+static void s4285_queue(s4285_t *e, TYPEMONO16 *samps, int nsamps)
+{
+	while (nsamps > 0) {
+		int n = MIN(nsamps, N_RXBLK);
+		u4_t head = e->rx_head;
+
+		if (head - __atomic_load_n(&e->rx_tail, __ATOMIC_ACQUIRE) == N_RXBLKS) {
+			e->rx_drops++;
+			metric_add(M_EXT_DROPS, e->rx_chan, 1);
 		} else {
-			while (s4285_rx_count) {
-				m_CSt4285[rx_chan].process_rx_block(&s4285_rx_blocks[s4285_rx_ra][0], N_RXBLK, K_AMPMAX);
-				s4285_rx_ra++;
-				if (s4285_rx_ra == N_RXBLKS) s4285_rx_ra = 0;
-				s4285_rx_count--;
-				TaskFastIntr("s4285_rx");
-				send_status(rx_chan);
-			}
+			int b = head & (N_RXBLKS-1);
+			memcpy(&e->rx_blocks[b][0], samps, n * sizeof(TYPEMONO16));
+			e->rx_len[b] = n;
+			__atomic_store_n(&e->rx_head, head+1, __ATOMIC_RELEASE);
 		}
-		send_status(rx_chan);
+		samps += n;
+		nsamps -= n;
 	}
 }
 
@@ -86,30 +205,20 @@ void s4285_data(int rx_chan, int ch, int nsamps, TYPEMONO16 *samps)
 {
 	s4285_t *e = &s4285[rx_chan];
 	
+	// in loopback the transmitter output goes through the same receive path as the audio
 	if (e->mode == MODE_TX_LOOPBACK) {
 		//m_CSt4285[rx_chan].getTxOutput((void *) samps, nsamps, TYPE_IQ_F32_DATA, K_AMPMAX);
 		m_CSt4285[rx_chan].getTxOutput((void *) samps, nsamps, TYPE_REAL_S16_DATA, K_AMPMAX);
-		if (e->rx_task) TaskWakeup(e->rx_task, TRUE, e->rx_chan);
-	} else {
-		#if 0
-		static u4_t last_time;
-		u4_t now = timer_us();
-		printf("s4285 nsamps %d %7.3f msec\n", nsamps, (float) (now - last_time) / 1e3);
-		last_time = now;
-		#endif
-		
-		assert(nsamps == N_RXBLK);
-		memcpy(&s4285_rx_blocks[s4285_rx_wa][0], samps, sizeof(TYPEMONO16)*N_RXBLK);
-		s4285_rx_wa++;
-		if (s4285_rx_wa == N_RXBLKS) s4285_rx_wa = 0;
-		s4285_rx_count++;
-		if (s4285_rx_count > s4285_rx_count_max) {
-			printf("%d\n", s4285_rx_count);
-			s4285_rx_count_max = s4285_rx_count;
-		}
-		assert(s4285_rx_count < N_RXBLKS);
-		if (e->rx_task) TaskWakeup(e->rx_task, TRUE, e->rx_chan);
 	}
+
+	#if 0
+	static u4_t last_time;
+	u4_t now = timer_us();
+	printf("s4285 nsamps %d %7.3f msec\n", nsamps, (float) (now - last_time) / 1e3);
+	last_time = now;
+	#endif
+
+	s4285_queue(e, samps, nsamps);
 }
 
 #define S4285_MAX_VAL 2.0
@@ -142,6 +251,18 @@ void s4285_data(int rx_chan, int ch, int nsamps, TYPEMONO16 *samps)
 	d = (u1_t) t; \
 }
 
+// Called on the decoder thread. If the task hasn't sent the previous frame yet this one
+// is skipped, it's only the display.
+static void s4285_frame(s4285_t *e, u1_t *bytes, int nbytes)
+{
+	if (__atomic_load_n(&e->frame_ready, __ATOMIC_ACQUIRE)) return;
+	memcpy(e->frame, bytes, nbytes);
+	e->frame[nbytes] = 0;
+	e->frame_draw = e->draw;
+	e->frame_len = nbytes + 1;
+	__atomic_store_n(&e->frame_ready, true, __ATOMIC_RELEASE);
+}
+
 void s4285_rx_callback(int rx_chan, FComplex *samps, int nsamps, int incr)
 {
 	s4285_t *e = &s4285[rx_chan];
@@ -184,7 +305,7 @@ void s4285_rx_callback(int rx_chan, FComplex *samps, int nsamps, int incr)
 			e->iq[ring][Q] = nQ;
 			ring++;
 			if (ring >= e->points) {
-				ext_send_msg_data(rx_chan, S4285_DEBUG_MSG, e->draw, &(e->plot[0][0][0]), e->points*4 +1);
+				s4285_frame(e, &(e->plot[0][0][0]), e->points*4);
 				ring = 0;
 			}
 		}
@@ -207,7 +328,7 @@ void s4285_rx_callback(int rx_chan, FComplex *samps, int nsamps, int incr)
 			
 			ring++;
 			if (ring >= e->points) {
-				ext_send_msg_data(rx_chan, S4285_DEBUG_MSG, e->draw, &(e->map[0][0]), e->points*2 +1);
+				s4285_frame(e, &(e->map[0][0]), e->points*2);
 				ring = 0;
 			}
 		}
@@ -239,24 +360,25 @@ bool s4285_msgs(char *msg, int rx_chan)
 	if (n == 1) {
 		if (e->run) {
 			if (!e->rx_task) {
-				e->rx_task = CreateTaskF(s4285_rx, 0, EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
+				e->rx_task = CreateTaskF(s4285_task, TO_VOID_PARAM(rx_chan), EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
 			}
-			m_CSt4285[rx_chan].reset();
 			//m_CSt4285[rx_chan].setSampleRate(ext_update_get_sample_rateHz());
 			m_CSt4285[rx_chan].registerRxCallback(s4285_rx_callback, rx_chan);
 			m_CSt4285[rx_chan].registerTxCallback(s4285_tx_callback);
+			if (e->req_points == 0)
+				e->req_points = 128;
+			s4285_start(e);
 			//m_CSt4285[rx_chan].control((void *) "SET MODE 600L", NULL, 0);
 			//ext_register_receive_iq_samps(s4285_data, rx_chan);
 			ext_register_receive_real_samps(s4285_data, rx_chan);
 		} else {
-			ext_unregister_receive_iq_samps(rx_chan);
+			ext_unregister_receive_real_samps(rx_chan);
+			s4285_stop(e);
 			if (e->rx_task) {
 				TaskRemove(e->rx_task);
 				e->rx_task = 0;
 			}
 		}
-		if (e->points == 0)
-			e->points = 128;
 		return true;
 	}
 	
@@ -268,31 +390,37 @@ bool s4285_msgs(char *msg, int rx_chan)
 	int gain;
 	n = sscanf(msg, "SET gain=%d", &gain);
 	if (n == 1) {
-		// 0 .. +100 dB of S4285_MAX_VAL
-		e->gain = gain? pow(10.0, ((float) -gain) / 10.0) : 0;
-		printf("e->gain %.6f\n", e->gain);
+		__atomic_store_n(&e->req_gain, gain, __ATOMIC_RELEASE);
 		return true;
 	}
 	
 	int points;
 	n = sscanf(msg, "SET points=%d", &points);
 	if (n == 1) {
-		e->points = points;
-		printf("points %d\n", points);
+		if (points < 1) points = 1;
+		if (points > N_IQ_RING) points = N_IQ_RING;
+		__atomic_store_n(&e->req_points, points, __ATOMIC_RELEASE);
 		return true;
 	}
 	
 	int draw;
 	n = sscanf(msg, "SET draw=%d", &draw);
 	if (n == 1) {
-		e->draw = draw;
-		printf("draw %d\n", draw);
+		__atomic_store_n(&e->req_draw, draw, __ATOMIC_RELEASE);
+		return true;
+	}
+	
+	// demodulate and Viterbi decode the data, not just track the preamble
+	int decode;
+	n = sscanf(msg, "SET decode=%d", &decode);
+	if (n == 1) {
+		__atomic_store_n(&e->req_decode, decode? 1:0, __ATOMIC_RELEASE);
 		return true;
 	}
 	
 	n = strcmp(msg, "SET clear");
 	if (n == 0) {
-		e->cma = e->ncma = 0;
+		__atomic_fetch_add(&e->req_clear, 1, __ATOMIC_RELEASE);
 		return true;
 	}
 	
@@ -301,7 +429,14 @@ bool s4285_msgs(char *msg, int rx_chan)
 
 void s4285_close(int rx_chan)
 {
+	s4285_t *e = &s4285[rx_chan];
 
+	ext_unregister_receive_real_samps(rx_chan);
+	s4285_stop(e);
+	if (e->rx_task) {
+		TaskRemove(e->rx_task);
+		e->rx_task = 0;
+	}
 }
 
 void s4285_main();
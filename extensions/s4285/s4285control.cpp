@@ -641,6 +641,10 @@ void CSt4285::get_set_params( const char *cmd, char *resp )
 		{
 			set_rx_mode( set_rx_mode_text( params[2] ));
 		}
+		if( strcmp(params[1],"DECODE") == 0 )
+		{
+			m_decode = ( strcmp(params[2],"ON") == 0 );
+		}
 	}
 }
 void CSt4285::status_string( void )
@@ -13,16 +13,9 @@
 #include "stdio.h"
 #include "st4285.h"
 
-#define BF(v,w,x,y,z) \
-	tempa = (acm[w]*(float)0.999) + (metric[x]*(float)0.001); \
-	tempb = (acm[y]*(float)0.999) + (metric[z]*(float)0.001); \
-	if (tempa > tempb) { \
-		tm[v] = tempa; \
-		path[v][hp] = w; \
-	} else { \
-		tm[v] = tempb; \
-		path[v][hp] = y; \
-	}
+#ifdef __ARM_NEON__
+ #include <arm_neon.h>
+#endif
 
 void CSt4285::parity( int state, int *bit1, int *bit2 )
 {
@@ -90,6 +83,12 @@ void CSt4285::convolutional_init( void )
 	{
 		parity( i, &parity_lookup[i].bit1, &parity_lookup[i].bit2 );
 	}
+
+	/* Branch metric of the transition from state 2i to state i, see viterbi_decode() */
+	for( i=0; i< NR_CONVOLUTIONAL_STATES/2; i++)
+	{
+		bm_sel[i] = (parity_lookup[i<<1].bit1<<1) + parity_lookup[i<<1].bit2;
+	}
 	path_length = NORMAL_PATH_LENGTH;
 }
 void CSt4285::convolutional_encode_reset( void )
@@ -117,7 +116,7 @@ void CSt4285::viterbi_decode_reset( void )
 		acm[i] = 0.0;
 		for( j = 0 ; j < NORMAL_PATH_LENGTH ; j++ )
 		{
-			path[i][j] = 0;
+			path[j][i] = 0;
 		}	
 	} 
 	acm[0] = (float)0.1;
@@ -137,15 +136,21 @@ void CSt4285::convolutional_encode( int in, int *bit1, int *bit2 )
  * Positive metric = logic 0
  * Negative metric = logic 1
  *
+ * The add-compare-select is done a butterfly at a time: states j and j+32 both come from
+ * states 2j and 2j+1, with the branch metrics of the two transitions swapped (the parity
+ * taps include both the newest and the oldest bit). So four butterflies are one vector op.
+ *
  */
 
 int CSt4285::viterbi_decode( float metric1, float metric2 )
 {
-	float tempa,tempb;
+	enum { HALF = NR_CONVOLUTIONAL_STATES/2 };
 	float metricX0,metricX1,metric0X,metric1X;
 	float metric[4];
+	float bm0[HALF], bm1[HALF];
 	float tm[NR_CONVOLUTIONAL_STATES];
 	float max_value;
+	int   *pp = path[hp];
 	int   state;
 	int   i,p;
 	
@@ -168,70 +173,49 @@ int CSt4285::viterbi_decode( float metric1, float metric2 )
 	metric[3] = metric1X + metricX1;
 
 
-	BF(0,0,0,1,3)
-	BF(1,2,2,3,1)
-	BF(2,4,0,5,3)
-	BF(3,6,2,7,1)
-	BF(4,8,3,9,0)
-	BF(5,10,1,11,2)
-	BF(6,12,3,13,0)
-	BF(7,14,1,15,2)
-	BF(8,16,3,17,0)
-	BF(9,18,1,19,2)
-	BF(10,20,3,21,0)
-	BF(11,22,1,23,2)
-	BF(12,24,0,25,3)
-	BF(13,26,2,27,1)
-	BF(14,28,0,29,3)
-	BF(15,30,2,31,1)
-	BF(16,32,1,33,2)
-	BF(17,34,3,35,0)
-	BF(18,36,1,37,2)
-	BF(19,38,3,39,0)
-	BF(20,40,2,41,1)
-	BF(21,42,0,43,3)
-	BF(22,44,2,45,1)
-	BF(23,46,0,47,3)
-	BF(24,48,2,49,1)
-	BF(25,50,0,51,3)
-	BF(26,52,2,53,1)
-	BF(27,54,0,55,3)
-	BF(28,56,1,57,2)
-	BF(29,58,3,59,0)
-	BF(30,60,1,61,2)
-	BF(31,62,3,63,0)
-	BF(32,0,3,1,0)
-	BF(33,2,1,3,2)
-	BF(34,4,3,5,0)
-	BF(35,6,1,7,2)
-	BF(36,8,0,9,3)
-	BF(37,10,2,11,1)
-	BF(38,12,0,13,3)
-	BF(39,14,2,15,1)
-	BF(40,16,0,17,3)
-	BF(41,18,2,19,1)
-	BF(42,20,0,21,3)
-	BF(43,22,2,23,1)
-	BF(44,24,3,25,0)
-	BF(45,26,1,27,2)
-	BF(46,28,3,29,0)
-	BF(47,30,1,31,2)
-	BF(48,32,2,33,1)
-	BF(49,34,0,35,3)
-	BF(50,36,2,37,1)
-	BF(51,38,0,39,3)
-	BF(52,40,1,41,2)
-	BF(53,42,3,43,0)
-	BF(54,44,1,45,2)
-	BF(55,46,3,47,0)
-	BF(56,48,1,49,2)
-	BF(57,50,3,51,0)
-	BF(58,52,1,53,2)
-	BF(59,54,3,55,0)
-	BF(60,56,2,57,1)
-	BF(61,58,0,59,3)
-	BF(62,60,2,61,1)
-	BF(63,62,0,63,3)
+	for( i = 0; i < HALF; i++ )
+	{
+		bm0[i] = metric[bm_sel[i]]*(float)0.001;
+		bm1[i] = metric[3-bm_sel[i]]*(float)0.001;
+	}
+
+#ifdef __ARM_NEON__
+	static const int32_t odd[4] = { 1, 3, 5, 7 };
+	int32x4_t pred = vld1q_s32(odd);
+	float32x4_t k = vdupq_n_f32((float)0.999);
+
+	for( i = 0; i < HALF; i += 4 )
+	{
+		float32x4x2_t s = vld2q_f32(&acm[i*2]);		// even, odd predecessors
+		float32x4_t e = vmulq_f32(s.val[0], k);
+		float32x4_t o = vmulq_f32(s.val[1], k);
+		float32x4_t m0 = vld1q_f32(&bm0[i]);
+		float32x4_t m1 = vld1q_f32(&bm1[i]);
+		float32x4_t a0 = vaddq_f32(e, m0), b0 = vaddq_f32(o, m1);
+		float32x4_t a1 = vaddq_f32(e, m1), b1 = vaddq_f32(o, m0);
+		uint32x4_t d0 = vcgtq_f32(a0, b0);
+		uint32x4_t d1 = vcgtq_f32(a1, b1);
+
+		vst1q_f32(&tm[i], vbslq_f32(d0, a0, b0));
+		vst1q_f32(&tm[i+HALF], vbslq_f32(d1, a1, b1));
+
+		// the even predecessor when it won (compare result all ones, i.e. -1)
+		vst1q_s32(&pp[i], vaddq_s32(pred, vreinterpretq_s32_u32(d0)));
+		vst1q_s32(&pp[i+HALF], vaddq_s32(pred, vreinterpretq_s32_u32(d1)));
+		pred = vaddq_s32(pred, vdupq_n_s32(8));
+	}
+#else
+	for( i = 0; i < HALF; i++ )
+	{
+		float e  = acm[i*2]*(float)0.999;
+		float o  = acm[i*2+1]*(float)0.999;
+		float a0 = e + bm0[i], b0 = o + bm1[i];
+		float a1 = e + bm1[i], b1 = o + bm0[i];
+
+		if( a0 > b0 ) { tm[i] = a0; pp[i] = i*2; } else { tm[i] = b0; pp[i] = i*2+1; }
+		if( a1 > b1 ) { tm[i+HALF] = a1; pp[i+HALF] = i*2; } else { tm[i+HALF] = b1; pp[i+HALF] = i*2+1; }
+	}
+#endif
 
 	max_value = 0;
 	state     = 0;
@@ -254,7 +238,7 @@ int CSt4285::viterbi_decode( float metric1, float metric2 )
 
     for( i = 0 ; i < path_length-1; i++ )
     {
-		state = path[state][p];
+		state = path[p][state];
         if( p == 0 )
             p = path_length-1;
         else
@@ -352,7 +352,6 @@ void CSt4285::demodulate_and_equalize( FComplex *in )
 	data_offset			= 0;
 	soft_index			= 0;
 	
-TaskFastIntr("s4285_de0");
 	switch(rx_mode&0x00F0)
 	{
 		case RX_75_BPS:
@@ -362,49 +361,42 @@ TaskFastIntr("s4285_de0");
 			for( i = 0; i < DATA_LENGTH ; i++ )
 			{
 				equalize_data( &in[symbol_offset] );
-TaskFastIntr("s4285_de0_d0");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < PROBE_LENGTH ; i++ )
 			{
 				equalize_train( &in[symbol_offset], scrambler_train_table[rx_scramble_count] );
-TaskFastIntr("s4285_de0_p0");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < DATA_LENGTH ; i++ )
 			{
 				equalize_data( &in[symbol_offset] );
-TaskFastIntr("s4285_de0_d1");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < PROBE_LENGTH ; i++ )
 			{
 				equalize_train( &in[symbol_offset], scrambler_train_table[rx_scramble_count] );
-TaskFastIntr("s4285_de0_p1");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < DATA_LENGTH ; i++ )
 			{
 				equalize_data( &in[symbol_offset] );
-TaskFastIntr("s4285_de0_d2");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < PROBE_LENGTH ; i++ )
 			{
 				equalize_train( &in[symbol_offset], scrambler_train_table[rx_scramble_count] );
-TaskFastIntr("s4285_de0_p2");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
 			for( i = 0; i < DATA_LENGTH ; i++ )
 			{
 				equalize_data( &in[symbol_offset] );
-TaskFastIntr("s4285_de0_d3");
 				rx_scramble_count++;
 				symbol_offset +=2;
 			}
@@ -658,9 +650,7 @@ TaskFastIntr("s4285_de0_d3");
 	
 	/* De-interleave if required */	
 	
-TaskFastIntr("s4285_de1");
-int do_viterbi = 0;
-if (do_viterbi) {
+if (m_decode) {
 	if( (rx_mode&0x00F0) <= RX_2400_BPS )
 	{ 
 		for( i = 0 ; i < soft_index; i++ ) sd[i] = deinterleave( sd[i] ); 
@@ -668,7 +658,6 @@ if (do_viterbi) {
 
 	/* Error correct and pack for output */
 
-TaskFastIntr("s4285_de2");
 	switch( rx_mode&0x00F0)
 	{
 		case RX_75_BPS:
@@ -703,7 +692,6 @@ TaskFastIntr("s4285_de2");
 			for( i = 0; i<DATA_LENGTH*2; i++ )
 			{
 				data[data_offset++] = viterbi_decode( sd[i*2],sd[(i*2)+1]);
-TaskFastIntr("s4285_de2_vd");
 			}
 			break;
 		case RX_1200_BPS:
@@ -731,7 +719,6 @@ TaskFastIntr("s4285_de2_vd");
 	}
 }
 
-TaskFastIntr("s4285_de3");
 	// Output data
 	for( i = 0; i < data_offset; i++ )
 	{
@@ -742,7 +729,6 @@ TaskFastIntr("s4285_de3");
 			output_offset = 0;
 		}
 	}
-TaskFastIntr("s4285_de4");
 }
 
 #endif
@@ -10,9 +10,22 @@
 
 #include "stdafx.h"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "st4285.h"
 
+#ifdef __ARM_NEON__
+ #include <arm_neon.h>
+
+// Horizontal sum. FComplex arrays are loaded with vld2q_f32() which splits them into
+// re and im vectors, four elements at a time.
+static inline float vsum_f32(float32x4_t v)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+#endif
+
 /*
  *
  * Diagnostic routine
@@ -38,8 +51,8 @@ void CSt4285::kalman_reset_ud( void )
 		for( i = 0; i < j ; i++ )
 
 		{
-			u[i][j].re = 0.0;
-			u[i][j].im = 0.0;
+			u[j][i].re = 0.0;
+			u[j][i].im = 0.0;
 		}
 		d[j]         = 1.0;
 	}
@@ -93,12 +106,29 @@ void CSt4285::kalman_calculate( FComplex *x )
 
 	for( j = 1; j < KN_44 ; j++)              // 6.3
 	{
-		f[j].re  = cmultRealConj(u[0][j],x[0]) + x[j].re; 
-		f[j].im  = cmultImagConj(u[0][j],x[0]) - x[j].im;
+		FComplex *uj = u[j];
+#ifdef __ARM_NEON__
+		float32x4_t sre = vdupq_n_f32(0), sim = vdupq_n_f32(0);
+		for( i = 0 ; i+4 <= j ; i += 4 )
+		{
+			float32x4x2_t uv = vld2q_f32(&uj[i].re);
+			float32x4x2_t xv = vld2q_f32(&x[i].re);
+			sre = vmlaq_f32(sre, uv.val[0], xv.val[0]);
+			sre = vmlaq_f32(sre, uv.val[1], xv.val[1]);
+			sim = vmlaq_f32(sim, uv.val[1], xv.val[0]);
+			sim = vmlsq_f32(sim, uv.val[0], xv.val[1]);
+		}
+		f[j].re = vsum_f32(sre) + x[j].re;
+		f[j].im = vsum_f32(sim) - x[j].im;
+		for( ; i < j ; i++ )
+#else
+		f[j].re  = cmultRealConj(uj[0],x[0]) + x[j].re; 
+		f[j].im  = cmultImagConj(uj[0],x[0]) - x[j].im;
 		for( i = 1 ; i < j ; i++ )
+#endif
 		{			
-			f[j].re += cmultRealConj(u[i][j],x[i]);
-			f[j].im += cmultImagConj(u[i][j],x[i]); 
+			f[j].re += cmultRealConj(uj[i],x[i]);
+			f[j].im += cmultImagConj(uj[i],x[i]); 
 		}
 	}
 
@@ -133,11 +163,28 @@ void CSt4285::kalman_calculate( FComplex *x )
 
 		d[j] = d[j]*hq*B*y;              // 6.13
 
- 		for( i = 0; i < j ; i++ )
+		FComplex *uj = u[j];
+		i = 0;
+#ifdef __ARM_NEON__
+		for( ; i+4 <= j ; i += 4 )
+		{
+			float32x4x2_t b0 = vld2q_f32(&uj[i].re);
+			float32x4x2_t gi = vld2q_f32(&g[i].re);
+			float32x4x2_t un, gn;
+
+			un.val[0] = vaddq_f32(b0.val[0], vmlaq_n_f32(vmulq_n_f32(gi.val[0], h[j].re), gi.val[1], h[j].im));
+			un.val[1] = vaddq_f32(b0.val[1], vmlsq_n_f32(vmulq_n_f32(gi.val[0], h[j].im), gi.val[1], h[j].re));
+			gn.val[0] = vaddq_f32(gi.val[0], vmlaq_n_f32(vmulq_n_f32(b0.val[0], g[j].re), b0.val[1], g[j].im));
+			gn.val[1] = vaddq_f32(gi.val[1], vmlsq_n_f32(vmulq_n_f32(b0.val[0], g[j].im), b0.val[1], g[j].re));
+			vst2q_f32(&uj[i].re, un);
+			vst2q_f32(&g[i].re, gn);
+		}
+#endif
+ 		for( ; i < j ; i++ )
 		{
-			B0           =  u[i][j];
-			u[i][j].re =  B0.re + cmultRealConj(h[j],g[i]); // 6.15
-			u[i][j].im =  B0.im + cmultImagConj(h[j],g[i]);
+			B0           =  uj[i];
+			uj[i].re =  B0.re + cmultRealConj(h[j],g[i]); // 6.15
+			uj[i].im =  B0.im + cmultImagConj(h[j],g[i]);
 
 			g[i].re +=  cmultRealConj(g[j],B0);               // 6.16
 			g[i].im +=  cmultImagConj(g[j],B0);
@@ -165,7 +212,18 @@ void CSt4285::kalman_update( FComplex *data, FComplex error )
 	error.re *= y;
 	error.im *= y;
  
-	for( i = 0; i < KN_44 ; i++ )
+	i = 0;
+#ifdef __ARM_NEON__
+	for( ; i+4 <= KN_44 ; i += 4 )
+	{
+		float32x4x2_t cv = vld2q_f32(&c[i].re);
+		float32x4x2_t gv = vld2q_f32(&g[i].re);
+		cv.val[0] = vaddq_f32(cv.val[0], vmlsq_n_f32(vmulq_n_f32(gv.val[0], error.re), gv.val[1], error.im));
+		cv.val[1] = vaddq_f32(cv.val[1], vmlaq_n_f32(vmulq_n_f32(gv.val[1], error.re), gv.val[0], error.im));
+		vst2q_f32(&c[i].re, cv);
+	}
+#endif
+	for( ; i < KN_44 ; i++ )
 	{
 		c[i].re  += cmultReal(error,g[i]);
 		c[i].im  += cmultImag(error,g[i]);
@@ -188,12 +246,26 @@ FComplex CSt4285::equalize( FComplex *in )
 	float    ii,qq,iq,qi;
 	FComplex symbol;
 	
-	for( i = 0 ; i < FF_EQ_LENGTH ; i++ )
-	{
-		d_eq[i] = in[i];
-	}
+	memcpy( d_eq, in, FF_EQ_LENGTH * sizeof(FComplex) );
+
 	/* Calculate the symbol */ 
 
+#ifdef __ARM_NEON__
+	float32x4_t vii = vdupq_n_f32(0), vqq = vdupq_n_f32(0), viq = vdupq_n_f32(0), vqi = vdupq_n_f32(0);
+	for( i = 0; i < (FF_EQ_LENGTH+FB_EQ_LENGTH); i += 4 )
+	{
+		float32x4x2_t dv = vld2q_f32(&d_eq[i].re);
+		float32x4x2_t cv = vld2q_f32(&c[i].re);
+		vii = vmlaq_f32(vii, dv.val[0], cv.val[0]);
+		vqq = vmlaq_f32(vqq, dv.val[1], cv.val[1]);
+		viq = vmlaq_f32(viq, dv.val[0], cv.val[1]);
+		vqi = vmlaq_f32(vqi, dv.val[1], cv.val[0]);
+	}
+	ii = vsum_f32(vii);
+	qq = vsum_f32(vqq);
+	iq = vsum_f32(viq);
+	qi = vsum_f32(vqi);
+#else
 	ii = d_eq[0].re*c[0].re;
 	qq = d_eq[0].im*c[0].im;
 	iq = d_eq[0].re*c[0].im;
@@ -206,6 +278,7 @@ FComplex CSt4285::equalize( FComplex *in )
 		iq += d_eq[i].re*c[i].im;
 		qi += d_eq[i].im*c[i].re;
 	}
+#endif
 
 	symbol.re = ii - qq;
 	symbol.im = iq + qi;
@@ -214,12 +287,7 @@ FComplex CSt4285::equalize( FComplex *in )
 }
 void CSt4285::update_fb( FComplex in )
 {
-	int i;
-
-	for( i = (FF_EQ_LENGTH+FB_EQ_LENGTH-1) ; i > FF_EQ_LENGTH ; i-- )
-	{
-		d_eq[i] = d_eq[i-1];
-	}
+	memmove( &d_eq[FF_EQ_LENGTH+1], &d_eq[FF_EQ_LENGTH], (FB_EQ_LENGTH-1) * sizeof(FComplex) );
 	d_eq[FF_EQ_LENGTH] =   in; /* Update */
 }
 /*
@@ -193,7 +193,7 @@ doppler_t CSt4285::doppler_error( FComplex *in )
 		imag += cmultImagConj(in[i],in[i+PPN_62]);
 	}
 	if( real == 0.0 ) {
-		printf("doppler_error: DIV0\n");
+		//printf("doppler_error: DIV0\n");
 		//real = (doppler_t)0.0000000001;/* No divide by zero */
 	}
 	//doppler_t error_old  = (doppler_t)(-atan2(imag,real)*0.008064516129);	// * (1/124)
@@ -235,7 +235,6 @@ int CSt4285::train_and_equalize_on_preamble( FComplex *in )
 	for( i = 0, count = 0 ; i < PREAMBLE_LENGTH; i++ )
 	{
 		symbol = equalize_train( &in[(i*SPS)], rx_preamble_lookup[i] );	
-TaskFastIntr("s4285_tp0");
 		if(symbol.re*rx_preamble_lookup[i].re > 0) count++;	
 	}	
 	return count;
@@ -300,7 +299,6 @@ void CSt4285::rx_downconvert( float *in, FComplex *frate_b, FComplex *hrate_b, f
 		hrate_b[i+SAMPLE_BLOCK_SIZE] = agc( rx_filter( &frate_b[i*2] ));
 	}
 
-	TaskFastIntr("s4285_dn0");
 }
 
 /*
@@ -326,7 +324,6 @@ void CSt4285::rx_final_downconvert( FComplex *in, float *delta )
 		accumulator += *delta;
 		if( accumulator >= 2*M_PI ) accumulator -= (float)(2*M_PI);			
 	}
-	printf("mix %f %f osc %f %f\n", mix.re, mix.im, osc.re, osc.im);
 }
 #else
 
@@ -400,7 +397,6 @@ void CSt4285::process_rx_block( float *in )
 	int			start[RX_CHANNELS];
 	float		mag[RX_CHANNELS], max_mag;
 	int			updated_preamble_start;
-	int			do_demod = 0;
 			
 	if( rx_state == RX_HUNTING )
 	{
@@ -426,17 +422,15 @@ void CSt4285::process_rx_block( float *in )
 				max_mag        = mag[i];
 			}
 		}	     
-		printf("s4285: %c0/%c1/%c2 %3d/%3d/%3d %f/%f/%f\n",
-			(rx_chan==0)?'*':' ', (rx_chan==1)?'*':' ', (rx_chan==2)?'*':' ',
-			start[0], start[1], start[2], mag[0], mag[1], mag[2]
-		);
+		//printf("s4285: %c0/%c1/%c2 %3d/%3d/%3d %f/%f/%f\n",
+		//	(rx_chan==0)?'*':' ', (rx_chan==1)?'*':' ', (rx_chan==2)?'*':' ',
+		//	start[0], start[1], start[2], mag[0], mag[1], mag[2]
+		//);
 //return;
-TaskFastIntr("s4285_rx1");
 		
 		/* Train on the probe sequence of the best channel */
 		equalize_reset();
 		preamble_matches = train_and_equalize_on_preamble( &hrate_b[rx_chan][preamble_start] );
-TaskFastIntr("s4285_rx2");
 
 		m_preamble_errors = PREAMBLE_LENGTH - preamble_matches;
 		//printf("s4285 RX_HUNTING: INDEX %3d MATCHES %3d ERRORS %3d MSEC %.3f\n",
@@ -444,7 +438,7 @@ TaskFastIntr("s4285_rx2");
 		
 		if( ( m_preamble_errors <= 15 ) && ( preamble_check( &hrate_b[rx_chan][preamble_start] ) != 0 ) )
 		{
-			printf("s4285 RX_HUNTING: preamble okay!\n");
+			//printf("s4285 RX_HUNTING: preamble okay!\n");
 		    /* Find frequency error */
 			initial_doppler_correct( &hrate_b[rx_chan][preamble_start], &sync_delta );
 			report_frequency_error( sync_delta, rx_chan );
@@ -456,11 +450,9 @@ TaskFastIntr("s4285_rx2");
 
 			/* re-equalize */
 			equalize_reset();
-TaskFastIntr("s4285_rx3");
 
 			/* Train and equalize on the frequency corrected preamble */
 			preamble_matches = train_and_equalize_on_preamble( &hrate_b[rx_chan][preamble_start] );
-TaskFastIntr("s4285_rx4");
 
 			/* Actions done whatsoever */
 			bad_preamble_count  = 0;
@@ -470,8 +462,7 @@ TaskFastIntr("s4285_rx4");
 			deinterleaver_reset();
 
 			/* Normal data reception */
-			if (do_demod) demodulate_and_equalize( &hrate_b[rx_chan][data_start] );			
-TaskFastIntr("s4285_rx5");
+			if (m_decode) demodulate_and_equalize( &hrate_b[rx_chan][data_start] );			
 		}
 	}	// RX_HUNTING
 	else
@@ -481,7 +472,6 @@ T_EN(dn);
 		rx_final_downconvert( &hrate_b[rx_chan][SAMPLE_BLOCK_SIZE], &sync_delta );
 
 T_EX(dn);
-TaskFastIntr("s4285_rx6");
 T_EN(pr);
 		preamble_matches = train_and_equalize_on_preamble( &hrate_b[rx_chan][preamble_start] );
 
@@ -489,11 +479,9 @@ T_EN(pr);
 
 		sync_deinterleaver();
 T_EX(pr);
-TaskFastIntr("s4285_rx7");
 T_EN(de);
-		if (do_demod) demodulate_and_equalize( &hrate_b[rx_chan][data_start] );
+		if (m_decode) demodulate_and_equalize( &hrate_b[rx_chan][data_start] );
 T_EX(de);
-TaskFastIntr("s4285_rx8");
 T_EN(co);
 
 		m_preamble_errors = PREAMBLE_LENGTH - preamble_matches;
@@ -523,8 +511,7 @@ T_EN(co);
 			bad_preamble_count = 0;
 		}	
 T_EX(co);
-TaskFastIntr("s4285_rx9");
-#if 1
+#if 0
 printf("s4285 %7.3f: %6.3fdn %6.3fco %6.3fde %6.3fco\n",
 	f_dn + f_pr + f_de + f_co, f_dn, f_pr, f_de, f_co);
 #endif
@@ -535,13 +522,6 @@ printf("s4285 %7.3f: %6.3fdn %6.3fco %6.3fde %6.3fco\n",
 	//printf("s4285: %s\n", m_status_text);
 }
 
-void CSt4285::check_fast_intr()
-{
-	run_us += timer_us() - run_start;
-	TaskFastIntr("s4285_fastintr");
-	run_start = timer_us();
-}
-
 //
 // Input samples at 48000
 //
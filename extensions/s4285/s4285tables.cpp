@@ -367,6 +367,7 @@ void CSt4285::start( void )
 	hp                    = 0;
 	frequency_error[0]    = 0;
 	sample_rate			  = DEFAULT_SAMPLE_RATE;
+	m_decode              = false;
 
 	m_status_text[0]      = 0;
 	rx_scramble_count     = 0;
@@ -146,6 +146,7 @@ private:
 	bool m_status_update;
 	char m_status_text[256];
 	unsigned int run_start, run_us;
+	bool m_decode;		// demodulate and Viterbi decode the data, not just track the preamble
 
 	// Control variables
 	DuplexMode duplex_mode;
@@ -216,7 +217,7 @@ private:
 	FComplex  c[KN_44];
 	FComplex  f[KN_44];
 	FComplex  g[KN_44];
-	FComplex  u[KN_44][KN_44];
+	FComplex  u[KN_44][KN_44];		// stored transposed, u[j][i] is element i,j so the inner loops are contiguous
 	FComplex  h[KN_44];
 	float     d[KN_44];
 	float     a[KN_44];
@@ -241,7 +242,8 @@ private:
 	ParityLookup parity_lookup[128];
 	int          encode_state;
 	float        acm[NR_CONVOLUTIONAL_STATES];	// Accumulated distance
-	int          path[NR_CONVOLUTIONAL_STATES][NORMAL_PATH_LENGTH];
+	int          path[NORMAL_PATH_LENGTH][NR_CONVOLUTIONAL_STATES];	// survivor predecessors, by time then state
+	int          bm_sel[NR_CONVOLUTIONAL_STATES/2];
 	int          hp;
 	int          path_length;
 	float        m_viterbi_confidence;
@@ -281,7 +283,6 @@ public:
 
 private:
 	FDemodulate (CSt4285::*demod)(FComplex);
-	void check_fast_intr();
 
 	// Control
 	int get_tx_octets_per_block( void );
@@ -444,7 +444,7 @@ void wspr_init()
     wspr_hash_init();
 }
     
-void wspr_decode(wspr_t *w)
+int wspr_decode(wspr_t *w)
 {
     char cr[] = "(C) 2016, Steven Franke - K9AN";
     (void) cr;
@@ -1060,6 +1060,11 @@ void wspr_decode(wspr_t *w)
 	}
 	wspr_send_peaks(w, pk_freq, npk);
 
+	if (w->skimmer) {
+		wspr_skimmer_upload(w, uniques);
+		return uniques;
+	}
+
 	//jksd
 	// upload spots at the end of the decoding when there is less load on wsprnet.org
 	for (i = 0; i < uniques; i++) {
@@ -1072,4 +1077,6 @@ void wspr_decode(wspr_t *w)
 			dp->hour, dp->min, dp->snr, dp->dt_print, dp->freq_print, (int) dp->drift1, dp->c_l_p);
 		TaskSleepMsec(1000);
 	}
+
+	return uniques;
 }
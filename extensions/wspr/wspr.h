@@ -64,6 +64,7 @@
 	#define WSPR_FFTW_FREE fftwf_free
 	#define WSPR_FFTW_PLAN fftwf_plan
 	#define WSPR_FFTW_PLAN_DFT_1D fftwf_plan_dft_1d
+	#define WSPR_FFTW_PLAN_MANY_DFT fftwf_plan_many_dft
 	#define WSPR_FFTW_DESTROY_PLAN fftwf_destroy_plan
 	#define WSPR_FFTW_EXECUTE fftwf_execute
 #else
@@ -73,6 +74,7 @@
 	#define WSPR_FFTW_FREE fftw_free
 	#define WSPR_FFTW_PLAN fftw_plan
 	#define WSPR_FFTW_PLAN_DFT_1D fftw_plan_dft_1d
+	#define WSPR_FFTW_PLAN_MANY_DFT fftw_plan_many_dft
 	#define WSPR_FFTW_DESTROY_PLAN fftw_destroy_plan
 	#define WSPR_FFTW_EXECUTE fftw_execute
 #endif
@@ -154,7 +156,13 @@ typedef struct {
 	int capture;
 	int status, status_resume;
 	bool send_error, abort_decode;
-	int WSPR_FFTtask_id, WSPR_DecodeTask_id;
+	int WSPR_DecodeTask_id;
+	
+	// server-side skimmer
+	bool skimmer;
+	int band;
+	conn_t *conn;
+	u64_t conn_tstamp;
 	
 	// options
 	int quickmode, medium_effort, more_candidates, stackdecoder, subtraction;
@@ -164,14 +172,10 @@ typedef struct {
 	
 	// sampler
 	bool reset, tsync;
-	int last_sec;
-	int decim, didx, group;
-	double fi;
+	int subband, fir_phase, didx, group;
 	
-	// FFT task
-	WSPR_FFTW_COMPLEX *fftin, *fftout;
-	WSPR_FFTW_PLAN fftplan;
-	int FFTtask_group;
+	// FFT task: groups fft_grp up to fft_ready are waiting
+	int fft_grp, fft_ready;
 	
 	// computed by sampler or FFT task, processed by decode task
 	#define N_PING_PONG 2
@@ -195,7 +199,8 @@ extern int bfo;
 void wspr_init();
 void wspr_data(int rx_chan, int ch, int nsamps, TYPECPX *samps);
 void wspr_decode_old(wspr_t *w);
-void wspr_decode(wspr_t *w);
+int wspr_decode(wspr_t *w);
+void wspr_skimmer_upload(wspr_t *w, int nspots);
 void wspr_send_peaks(wspr_t *w, pk_t *pk, int npk);
 void wspr_hash_init();
 
@@ -36,6 +36,13 @@
 #include <stdlib.h>
 #include <math.h>
 #include <strings.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "cfg.h"
+#include "metrics.h"
+#include "fir.h"
 
 #define WSPR_DATA		0
 
@@ -70,71 +77,124 @@ static void wspr_status(wspr_t *w, int status, int resume)
 	}
 }
 
-// compute FFTs incrementally during data capture rather than all at once at the beginning of the decode
-void WSPR_FFT(void *param)
+// One timebase for all the channels. The 2-minute cycle starts on the even UTC minutes, i.e. when
+// the epoch seconds are a multiple of CTIME, so there's no need for gmtime() on every callback.
+static struct {
+	time_t t;		// updated once a second by whichever channel's samples arrive first
+	int sec;		// into the cycle
+} wspr_tb;
+
+static void wspr_timebase()
 {
-	int i,j,k;
+	time_t t = time(NULL);
+	if (t == wspr_tb.t) return;
 	
-	while (1) {
-		
-		//wprintf("WSPR_FFTtask sleep..\n");
-		int rx_chan = (int) FROM_VOID_PARAM(TaskSleep());
+	int last_sec = wspr_tb.sec;
+	wspr_tb.t = t;
+	wspr_tb.sec = t % CTIME;
 	
-		wspr_t *w = &wspr[rx_chan];
-		int grp = w->FFTtask_group;
-		int first = grp*FPG, last = first+FPG;
-		//wprintf("WSPR FFT pp=%d grp=%d (%d-%d)\n", w->fft_ping_pong, grp, first, last);
+	// decoding must be finished by 40 seconds into the odd minute
+	if (wspr_tb.sec >= 100 && last_sec < 100) {
+		for (int i=0; i < RX_CHANS; i++)
+			if (wspr[i].capture) wspr[i].abort_decode = true;
+	}
+}
+
+// The FFTs of all the capturing channels are done by one task, batched into a single FFTW plan
+// execution. Channels synced to the timebase finish their groups at nearly the same time.
+static struct {
+	bool init;
+	int tid;
+	WSPR_FFTW_COMPLEX *in, *out;			// [RX_CHANS][FPG][NFFT]
+	WSPR_FFTW_PLAN plan[RX_CHANS+1];		// FPG*n FFTs
+} wspr_fft;
+
+typedef struct {
+	wspr_t *w;
+	int grp, pp;
+} wspr_fft_job_t;
+
+// a group from each channel with one waiting, oldest first
+static int wspr_fft_jobs(wspr_fft_job_t *job)
+{
+	int i, n = 0;
+	bool more = true;
 	
-		// Do ffts over 2 symbols, stepped by half symbols
-		WSPR_CPX_t *id = w->i_data[w->fft_ping_pong], *qd = w->q_data[w->fft_ping_pong];
+	while (more && n < RX_CHANS) {
+		more = false;
+		for (i=0; i < RX_CHANS && n < RX_CHANS; i++) {
+			wspr_t *w = &wspr[i];
+			if (!w->capture || w->fft_grp >= w->fft_ready) continue;
+			job[n].w = w;
+			job[n].grp = w->fft_grp++;
+			job[n].pp = w->fft_ping_pong;
+			n++;
+			more = true;
+		}
+	}
+	return n;
+}
+
+// Wake the FFT task when every capturing channel has a group, or a channel has been waiting a whole group,
+// or it's the last group of the cycle (the decode waits on it and the next sync would lose it).
+static void wspr_fft_ready(wspr_t *w, int ready)
+{
+	int i;
+	bool all = true;
 	
-		//float maxiq = 1e-66, maxpwr = 1e-66;
-		//int maxi=0;
-		float savg[NFFT];
-		memset(savg, 0, sizeof(savg));
-		
-		// FIXME: A large noise burst can washout the w->pwr_sampavg which prevents a proper
-		// peak list being created in the decoder. An individual signal can be decoded fine
-		// in the presence of the burst. But if there is no peak in the list the decoding
-		// process is never started! We've seen this problem fairly frequently.
+	w->fft_ready = ready;
+	for (i=0; i < RX_CHANS; i++) {
+		wspr_t *wc = &wspr[i];
+		if (wc->capture && wc->fft_grp >= wc->fft_ready) all = false;
+	}
+	if (all || (w->fft_ready - w->fft_grp) > 1 || ready*FPG >= nffts)
+		TaskWakeup(wspr_fft.tid, FALSE, 0);
+}
+
+// FFT output of one group: accumulate the power and send the spectrum to the client
+static void wspr_fft_group(wspr_fft_job_t *job, WSPR_FFTW_COMPLEX *fftout)
+{
+	int i, j, k;
+	wspr_t *w = job->w;
+	int grp = job->grp, pp = job->pp;
+	int first = grp*FPG, last = first+FPG;
+	//wprintf("WSPR FFT pp=%d grp=%d (%d-%d)\n", pp, grp, first, last);
+	
+	//float maxiq = 1e-66, maxpwr = 1e-66;
+	//int maxi=0;
+	float savg[NFFT];
+	memset(savg, 0, sizeof(savg));
+	
+	// FIXME: A large noise burst can washout the w->pwr_sampavg which prevents a proper
+	// peak list being created in the decoder. An individual signal can be decoded fine
+	// in the presence of the burst. But if there is no peak in the list the decoding
+	// process is never started! We've seen this problem fairly frequently.
+	
+	for (i=first; i<last; i++, fftout += NFFT) {
 		
-		for (i=first; i<last; i++) {
-			for (j=0; j<NFFT; j++) {
-				k = i*HSPS+j;
-				w->fftin[j][0] = id[k] * window[j];
-				w->fftin[j][1] = qd[k] * window[j];
-				//if (i==0) wprintf("IN %d %fi %fq\n", j, w->fftin[j][0], w->fftin[j][1]);
-			}
-			
-			//u4_t start = timer_us();
-			TRY_YIELD;
-			WSPR_FFTW_EXECUTE(w->fftplan);
-			TRY_YIELD;
-			//if (i==0) wprintf("512 FFT %.1f us\n", (float)(timer_us()-start));
-			
-			// NFFT = SPS*2
-			// unwrap fftout:
-			//      |1---> SPS
-			// 2--->|      SPS
-
-			for (j=0; j<NFFT; j++) {
-				k = j+SPS;
-				if (k > (NFFT-1))
-					k -= NFFT;
-				float ii = w->fftout[k][0];
-				float qq = w->fftout[k][1];
-				float pwr = ii*ii + qq*qq;
-				//if (i==0) wprintf("OUT %d %fi %fq\n", j, ii, qq);
-				//if (ii > maxiq) { maxiq = ii; }
-				//if (pwr > maxpwr) { maxpwr = pwr; maxi = k; }
-				w->pwr_samp[w->fft_ping_pong][j][i] = pwr;
-				w->pwr_sampavg[w->fft_ping_pong][j] += pwr;
-				savg[j] += pwr;
-			}
-			TRY_YIELD;
+		// NFFT = SPS*2
+		// unwrap fftout:
+		//      |1---> SPS
+		// 2--->|      SPS
+
+		for (j=0; j<NFFT; j++) {
+			k = j+SPS;
+			if (k > (NFFT-1))
+				k -= NFFT;
+			float ii = fftout[k][0];
+			float qq = fftout[k][1];
+			float pwr = ii*ii + qq*qq;
+			//if (i==0) wprintf("OUT %d %fi %fq\n", j, ii, qq);
+			//if (ii > maxiq) { maxiq = ii; }
+			//if (pwr > maxpwr) { maxpwr = pwr; maxi = k; }
+			w->pwr_samp[pp][j][i] = pwr;
+			w->pwr_sampavg[pp][j] += pwr;
+			savg[j] += pwr;
 		}
-	
-		// send spectrum data to client
+	}
+
+	// send spectrum data to client (the skimmer doesn't have one)
+	if (!w->skimmer) {
 		float smspec[nbins_411], dB, max_dB=-99, min_dB=99;
 		renormalize(w, savg, smspec);
 		
@@ -165,19 +225,79 @@ void WSPR_FFT(void *param)
 		if (ext_send_msg_data(w->rx_chan, WSPR_DEBUG_MSG, WSPR_DATA, ws, nbins_411+1) < 0) {
 			w->send_error = true;
 		}
+	}
+
+	//wprintf("WSPR_FFTtask group %d:%d %d-%d(%d) %f %f(%d)\n", pp, grp, first, last, nffts, maxiq, maxpwr, maxi);
+	//wprintf("  %d-%d(%d)\r", first, last, nffts); fflush(stdout);
+	
+	if (last < nffts || !w->create_tasks) return;
+
+	w->decode_ping_pong = pp;
+	wprintf("WSPR ---DECODE -> %d\n", w->decode_ping_pong);
+	wprintf("\n");
+	TaskWakeup(w->WSPR_DecodeTask_id, TRUE, TO_VOID_PARAM(w->rx_chan));
+}
+
+// compute FFTs incrementally during data capture rather than all at once at the beginning of the decode
+void WSPR_FFT(void *param)
+{
+	int i, j, k, n, njobs;
+	wspr_fft_job_t job[RX_CHANS];
 	
-		//wprintf("WSPR_FFTtask group %d:%d %d-%d(%d) %f %f(%d)\n", w->fft_ping_pong, grp, first, last, nffts, maxiq, maxpwr, maxi);
-		//wprintf("  %d-%d(%d)\r", first, last, nffts); fflush(stdout);
+	while (1) {
 		
-		if (last < nffts) continue;
+		// anything that became ready while the last batch ran is picked up before sleeping
+		if ((njobs = wspr_fft_jobs(job)) == 0) {
+			//wprintf("WSPR_FFTtask sleep..\n");
+			TaskSleep();
+			continue;
+		}
 	
-		w->decode_ping_pong = w->fft_ping_pong;
-		wprintf("WSPR ---DECODE -> %d\n", w->decode_ping_pong);
-		wprintf("\n");
-		TaskWakeup(w->WSPR_DecodeTask_id, TRUE, TO_VOID_PARAM(w->rx_chan));
+		// Do ffts over 2 symbols, stepped by half symbols
+		for (n=0; n < njobs; n++) {
+			wspr_t *w = job[n].w;
+			WSPR_CPX_t *id = w->i_data[job[n].pp], *qd = w->q_data[job[n].pp];
+			int first = job[n].grp*FPG;
+			
+			for (i=0; i<FPG; i++) {
+				WSPR_FFTW_COMPLEX *fftin = &wspr_fft.in[(n*FPG + i) * NFFT];
+				for (j=0; j<NFFT; j++) {
+					k = (first+i)*HSPS+j;
+					fftin[j][0] = id[k] * window[j];
+					fftin[j][1] = qd[k] * window[j];
+					//if (i==0) wprintf("IN %d %fi %fq\n", j, fftin[j][0], fftin[j][1]);
+				}
+			}
+		}
+			
+		//u4_t start = timer_us();
+		TRY_YIELD;
+		WSPR_FFTW_EXECUTE(wspr_fft.plan[njobs]);
+		TRY_YIELD;
+		//wprintf("%d x 512 FFT %.1f us\n", njobs*FPG, (float)(timer_us()-start));
+		
+		for (n=0; n < njobs; n++) {
+			wspr_fft_group(&job[n], &wspr_fft.out[n*FPG*NFFT]);
+			TRY_YIELD;
+		}
     }
 }
 
+static void wspr_fft_init()
+{
+	int n, nfft = NFFT;
+	
+	if (wspr_fft.init) return;
+	wspr_fft.in = (WSPR_FFTW_COMPLEX*) WSPR_FFTW_MALLOC(sizeof(WSPR_FFTW_COMPLEX) * RX_CHANS*FPG*NFFT);
+	wspr_fft.out = (WSPR_FFTW_COMPLEX*) WSPR_FFTW_MALLOC(sizeof(WSPR_FFTW_COMPLEX) * RX_CHANS*FPG*NFFT);
+	for (n=1; n <= RX_CHANS; n++) {
+		wspr_fft.plan[n] = WSPR_FFTW_PLAN_MANY_DFT(1, &nfft, n*FPG, wspr_fft.in, NULL, 1, NFFT,
+			wspr_fft.out, NULL, 1, NFFT, FFTW_FORWARD, FFTW_ESTIMATE);
+	}
+	wspr_fft.tid = CreateTaskF(WSPR_FFT, 0, EXT_PRIORITY, 0, 0);
+	wspr_fft.init = true;
+}
+
 void wspr_send_peaks(wspr_t *w, pk_t *pk, int npk)
 {
     char peaks_s[NPK*(6+1 + LEN_CALL) + 16];
@@ -191,6 +311,26 @@ void wspr_send_peaks(wspr_t *w, pk_t *pk, int npk)
 	ext_send_msg_encoded(w->rx_chan, WSPR_DEBUG_MSG, "EXT", "WSPR_PEAKS", "%s", peaks_s);
 }
 
+// Server-side skimmer: with WSPR.autorun set, the bands listed in WSPR.skimmer_bands are decoded on channels of
+// their own without a browser connection. Spots are appended to WSPR_SPOT_FILE, which is renamed to
+// WSPR_SPOT_FILE_OLD (replacing it) when it reaches WSPR_SPOT_FILE_KB so they take a bounded amount of space.
+
+#define WSPR_SPOT_FILE DIR_CFG "/wspr_spots.txt"
+#define WSPR_SPOT_FILE_OLD DIR_CFG "/wspr_spots.old.txt"
+#define WSPR_SPOT_FILE_KB 256
+
+// same names and center frequencies as the band menu of wspr.js
+static const struct {
+	const char *name;
+	double cf_kHz;
+} wspr_bands[] = {
+	{ "lf", 137.5 }, { "mf", 475.7 }, { "160m", 1838.1 }, { "80m", 3594.1 }, { "60m", 5288.7 }, { "40m", 7040.1 },
+	{ "30m", 10140.2 }, { "20m", 14097.1 }, { "17m", 18106.1 }, { "15m", 21096.1 }, { "12m", 24926.1 }, { "10m", 28126.1 }
+};
+
+static int n_skim, skim_band[RX_CHANS];
+static wspr_t *skim_w[RX_CHANS];
+
 void WSPR_Deco(void *param)
 {
     u4_t start=0;
@@ -212,41 +352,58 @@ void WSPR_Deco(void *param)
 		wprintf("WSPR_DecodeTask wakeup\n");
 	
 		wspr_status(w, DECODING, NONE);
-		wspr_decode(w);
+		int nspots = wspr_decode(w);
 	
 		if (w->abort_decode)
 			wprintf("decoder aborted\n");
 	
+		float secs = (float)(timer_ms()-start)/1000.0;
+		metric_observe(M_WSPR_DECODE, rx_chan, secs);
+		metric_add(M_WSPR_SPOTS, rx_chan, nspots);
+		if (w->skimmer) {
+			lprintf("WSPR skimmer %s: %d spot%s, decode %.1f sec%s\n", wspr_bands[w->band].name,
+				nspots, (nspots == 1)? "":"s", secs, w->abort_decode? " (aborted)":"");
+		}
+	
 		wspr_status(w, w->status_resume, NONE);
     }
 }
 
-static double frate;
+// The sub-band with its filter transitions doesn't fit in FSRATE, so it arrives at 2*FSRATE
+// and is decimated by 2 here. The filter stops where an alias would reach BW_MAX/2.
 static int int_decimate;
+static CFir wspr_fir[RX_CHANS];
+
+static bool wspr_skimmer_conn_ok(wspr_t *w)
+{
+	conn_t *c = w->conn;
+	return (c != NULL && c->valid && c->internal_connection && c->rx_channel == w->rx_chan && c->tstamp == w->conn_tstamp);
+}
 
+// Samples arrive at 2*FSRATE, from a sub-band of the channel centred on the BFO.
+// Since the BFO is a multiple of FSRATE no further frequency shift is needed.
 void wspr_data(int rx_chan, int ch, int nsamps, TYPECPX *samps)
 {
 	wspr_t *w = &wspr[rx_chan];
 	int i;
 
-    // FIXME: Someday it's possible samp rate will be different between rx_chans
-    // if they have different bandwidths. Not possible with current architecture
-    // of data pump.
-    double frate = ext_update_get_sample_rateHz(rx_chan);
-    double fdecimate = frate / FSRATE;
-	
+	// the skimmer's channel was closed (e.g. kicked) and has been reused
+	if (w->skimmer && w->capture && !wspr_skimmer_conn_ok(w))
+		w->send_error = TRUE;
+
 	//wprintf("WD%d didx %d send_error %d reset %d\n", w->capture, w->didx, w->send_error, w->reset);
 	if (w->send_error) {
 		wprintf("RX%d STOP send_error %d\n", w->rx_chan, w->send_error);
-		ext_unregister_receive_iq_samps(w->rx_chan);
+		ext_unregister_receive_subband_samps(w->rx_chan, w->subband);
+		w->subband = -1;
 		w->send_error = FALSE;
 		w->capture = FALSE;
 		w->reset = TRUE;
 	}
 
 	if (w->reset) {
-		w->ping_pong = w->decim = w->didx = w->group = 0;
-		w->fi = 0;
+		w->ping_pong = w->didx = w->group = 0;
+		w->fft_grp = w->fft_ready = 0;
 		w->tsync = FALSE;
 		w->status_resume = IDLE;	// decoder finishes after we stop capturing
 		w->reset = FALSE;
@@ -256,21 +413,14 @@ void wspr_data(int rx_chan, int ch, int nsamps, TYPECPX *samps)
 		return;
 	}
 	
-	time_t t;
-	time(&t); struct tm tm; gmtime_r(&t, &tm);
-	if (tm.tm_sec != w->last_sec) {
-		if (tm.tm_min&1 && tm.tm_sec == 40)
-			w->abort_decode = true;
-		
-		w->last_sec = tm.tm_sec;
-	}
+	wspr_timebase();
 	
     if (w->tsync == FALSE) {		// sync to even minute boundary
-        if (!(tm.tm_min&1) && (tm.tm_sec == 0)) {
+        if (wspr_tb.sec == 0) {
             w->ping_pong ^= 1;
-            wprintf("WSPR SYNC ping_pong %d, %s", w->ping_pong, ctime(&t));
-            w->decim = w->didx = w->group = 0;
-            w->fi = 0;
+            wprintf("WSPR SYNC ping_pong %d, %s", w->ping_pong, ctime(&wspr_tb.t));
+            w->didx = w->group = 0;
+            w->fft_grp = w->fft_ready = 0;
             if (w->status != DECODING)
                 wspr_status(w, RUNNING, RUNNING);
             w->tsync = TRUE;
@@ -281,86 +431,35 @@ void wspr_data(int rx_chan, int ch, int nsamps, TYPECPX *samps)
     	memset(&w->pwr_sampavg[w->ping_pong][0], 0, sizeof(w->pwr_sampavg[0]));
 	}
 	
-	if (w->group == 0) w->utc[w->ping_pong] = t;
+	if (w->group == 0) w->utc[w->ping_pong] = wspr_tb.t;
 	
 	WSPR_CPX_t *idat = w->i_data[w->ping_pong], *qdat = w->q_data[w->ping_pong];
 	//double scale = 1000.0;
 	double scale = 1.0;
 	
-	// NO-NO-NO
-	// Can't do fractional decimation via "drop-sampling" like this because of
-	// the artifacts generated. Must do fractional "resampling" involving
-	// interpolation, decimation and FIR filtering (like the new audio re-sampler).
-	//
-	// Maybe we were thinking of the old "drop-sampling" *interpolator* used by audio.
-	// Although even that relies on the passband FIR doing the necessary pre-interpolation
-	// filtering. And a post-interpolation LPF is also required.
-	//
-	// Much more efficient to raise the audio bandwith to 12 kHz and be able to use
-	// *integer* decimation (12k / 32 = 375 Hz) here like we originally did when
-	// the WSPR extension was first written (before the audio b/w was changed to accomodate
-	// the S4285 extension).
-	
-	#define FRACTIONAL_DECIMATION 0
-	#if FRACTIONAL_DECIMATION
-
-        for (i = trunc(w->fi); i < nsamps;) {
-    
-            if (w->didx >= TPOINTS) {
-                return;
-            }
-    
-            if (w->group == 3) w->tsync = FALSE;	// arm re-sync
-            
-            WSPR_CPX_t re = (WSPR_CPX_t) samps[i].re/scale;
-            WSPR_CPX_t im = (WSPR_CPX_t) samps[i].im/scale;
-            idat[w->didx] = re;
-            qdat[w->didx] = im;
-    
-            if ((w->didx % NFFT) == (NFFT-1)) {
-                //wprintf("WSPR SAMPLER pp=%d grp=%d frate=%.1f fdecimate=%.1f rx_chan=%d\n",
-                //    w->ping_pong, w->group, frate, fdecimate, rx_chan);
-                w->fft_ping_pong = w->ping_pong;
-                w->FFTtask_group = w->group-1;
-                if (w->group) TaskWakeup(w->WSPR_FFTtask_id, TRUE, w->rx_chan);	// skip first to pipeline
-                w->group++;
-            }
-            w->didx++;
-    
-            w->fi += fdecimate;
-            i = trunc(w->fi);
-        }
-        w->fi -= nsamps;	// keep bounded
+	for (i=0; i<nsamps; i++) {
+		TYPECPX s;
+		wspr_fir[rx_chan].ProcessFilter(1, &samps[i], &s);
+		if ((w->fir_phase ^= 1) != 0)
+			continue;
 
-	#else
+		if (w->didx >= TPOINTS)
+			return;
 
-		for (i=0; i<nsamps; i++) {
-	
-			// decimate
-			if (w->decim++ < (int_decimate-1))
-				continue;
-			w->decim = 0;
-			
-			if (w->didx >= TPOINTS)
-				return;
-
-    		if (w->group == 3) w->tsync = FALSE;	// arm re-sync
-			
-			WSPR_CPX_t re = (WSPR_CPX_t) samps[i].re/scale;
-			WSPR_CPX_t im = (WSPR_CPX_t) samps[i].im/scale;
-			idat[w->didx] = re;
-			qdat[w->didx] = im;
-	
-			if ((w->didx % NFFT) == (NFFT-1)) {
-				w->fft_ping_pong = w->ping_pong;
-				w->FFTtask_group = w->group-1;
-				if (w->group) TaskWakeup(w->WSPR_FFTtask_id, TRUE, TO_VOID_PARAM(w->rx_chan));	// skip first to pipeline
-				w->group++;
-			}
-			w->didx++;
+		if (w->group == 3) w->tsync = FALSE;	// arm re-sync
+		
+		WSPR_CPX_t re = (WSPR_CPX_t) s.re/scale;
+		WSPR_CPX_t im = (WSPR_CPX_t) s.im/scale;
+		idat[w->didx] = re;
+		qdat[w->didx] = im;
+
+		if ((w->didx % NFFT) == (NFFT-1)) {
+			w->fft_ping_pong = w->ping_pong;
+			if (w->group) wspr_fft_ready(w, w->group);	// skip first to pipeline
+			w->group++;
 		}
-
-    #endif
+		w->didx++;
+	}
 }
 
 void wspr_close(int rx_chan)
@@ -368,13 +467,146 @@ void wspr_close(int rx_chan)
 	wspr_t *w = &wspr[rx_chan];
 	//wprintf("WSPR wspr_close RX%d\n", rx_chan);
 	if (w->create_tasks) {
-		//wprintf("WSPR wspr_close TaskRemove FFT%d deco%d\n", w->WSPR_FFTtask_id, w->WSPR_DecodeTask_id);
-		TaskRemove(w->WSPR_FFTtask_id);
+		//wprintf("WSPR wspr_close TaskRemove deco%d\n", w->WSPR_DecodeTask_id);
 		TaskRemove(w->WSPR_DecodeTask_id);
 		w->create_tasks = false;
 	}
 }
 
+static void wspr_capture(wspr_t *w, int capture)
+{
+	int rx_chan = w->rx_chan;
+	
+	w->capture = capture;
+	if (w->capture) {
+		wspr_fft_init();
+		if (!w->create_tasks) {
+			w->WSPR_DecodeTask_id = CreateTaskF(WSPR_Deco, 0, EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
+			w->create_tasks = true;
+		}
+		
+		w->send_error = false;
+		w->reset = TRUE;
+		ext_unregister_receive_subband_samps(rx_chan, w->subband);
+		wspr_fir[rx_chan].InitLPFilter(0, 1.0, 70.0, BW_MAX/2, FSRATE - BW_MAX/2, FSRATE*2);
+		w->fir_phase = 0;
+		w->subband = ext_register_receive_subband_samps(wspr_data, rx_chan, bfo - BW_MAX/2, bfo + BW_MAX/2, int_decimate);
+		wprintf("WSPR CAPTURE --------------------------------------------------------------\n");
+
+		wspr_status(w, SYNC, RUNNING);
+	} else {
+		w->abort_decode = true;
+		ext_unregister_receive_subband_samps(rx_chan, w->subband);
+		w->subband = -1;
+		wspr_close(rx_chan);
+	}
+}
+
+// uploaded "locally": wsprd's wspr_spots.txt layout followed by the band
+void wspr_skimmer_upload(wspr_t *w, int nspots)
+{
+	int i;
+	struct tm tm;
+	
+	if (nspots == 0) return;
+	struct stat st;
+	if (stat(WSPR_SPOT_FILE, &st) == 0 && st.st_size >= WSPR_SPOT_FILE_KB * 1024)
+		rename(WSPR_SPOT_FILE, WSPR_SPOT_FILE_OLD);
+	FILE *fp = fopen(WSPR_SPOT_FILE, "a");
+	if (fp == NULL) {
+		lprintf("WSPR skimmer: can't open %s\n", WSPR_SPOT_FILE);
+		return;
+	}
+	
+	gmtime_r(&w->utc[w->decode_ping_pong], &tm);
+	for (i = 0; i < nspots; i++) {
+		decode_t *dp = &w->deco[i];
+		fprintf(fp, "%02d%02d%02d %02d%02d %3.0f %4.1f %10.6f %2d %-22s %s\n",
+			tm.tm_year % 100, tm.tm_mon+1, tm.tm_mday, dp->hour, dp->min,
+			dp->snr, dp->dt_print, dp->freq_print, (int) dp->drift1, dp->c_l_p, wspr_bands[w->band].name);
+	}
+	fclose(fp);
+}
+
+static wspr_t *wspr_skimmer_start(int band)
+{
+	double cf_kHz = wspr_bands[band].cf_kHz;
+	double dial_kHz = cf_kHz - bfo/1e3;
+	
+	conn_t *c = rx_server_internal("WSPR");
+	if (c == NULL) return NULL;
+	int rx_chan = c->rx_channel;
+	wspr_t *w = &wspr[rx_chan];
+	
+	// what wspr.js would have the browser send
+	rx_server_internal_cmd(c, "SET mod=usb low_cut=%.0f high_cut=%.0f freq=%.3f", bfo - BW_MAX/2, bfo + BW_MAX/2, dial_kHz - freq_offset);
+	rx_server_internal_cmd(c, "SET agc=1 hang=0 thresh=-100 slope=6 decay=1000 manGain=50");
+	rx_server_internal_cmd(c, "SET AR OK in=%d out=%d", SND_RATE, SND_RATE);
+	
+	w->rx_chan = rx_chan;
+	w->skimmer = true;
+	w->band = band;
+	w->conn = c;
+	w->conn_tstamp = c->tstamp;
+	w->dialfreq_MHz = dial_kHz / kHz;
+	w->cf_offset = round((cf_kHz - floor(cf_kHz)) * 1000);
+	wspr_capture(w, TRUE);
+	
+	lprintf("WSPR skimmer %s: %.1f kHz on RX%d\n", wspr_bands[band].name, cf_kHz, rx_chan);
+	return w;
+}
+
+// (re)starts the bands whenever their channel is lost and one is free
+void WSPR_Skimmer(void *param)
+{
+	int i;
+	
+	TaskSleepSec(15);		// server and data pump up
+	
+	while (1) {
+		for (i=0; i < n_skim; i++) {
+			if (skim_w[i] != NULL && wspr_skimmer_conn_ok(skim_w[i])) continue;
+			skim_w[i] = wspr_skimmer_start(skim_band[i]);
+		}
+		TaskSleepSec(CTIME/4);
+	}
+}
+
+static void wspr_skimmer_init()
+{
+	bool error;
+	int i;
+	
+	if (cfg_int("WSPR.autorun", &error, CFG_OPTIONAL) == 0 || error) return;
+	
+	int cfg_bfo = cfg_int("WSPR.BFO", &error, CFG_OPTIONAL);
+	bfo = (error || cfg_bfo <= 0)? 750 : cfg_bfo;
+	
+	const char *grid = cfg_string("WSPR.grid", &error, CFG_OPTIONAL);
+	if (!error && grid != NULL && *grid != '\0') set_reporter_grid((char *) grid);
+	cfg_string_free(grid);
+	
+	const char *bands = cfg_string("WSPR.skimmer_bands", &error, CFG_OPTIONAL);
+	if (!error && bands != NULL) {
+		char *list = strdup(bands), *saveptr, *b;
+		for (b = strtok_r(list, ", ", &saveptr); b != NULL && n_skim < RX_CHANS; b = strtok_r(NULL, ", ", &saveptr)) {
+			for (i=0; i < ARRAY_LEN(wspr_bands) && strcasecmp(b, wspr_bands[i].name) != 0; i++)
+				;
+			if (i == ARRAY_LEN(wspr_bands)) {
+				lprintf("WSPR skimmer: unknown band \"%s\"\n", b);
+				continue;
+			}
+			skim_band[n_skim++] = i;
+		}
+		free(list);
+	}
+	cfg_string_free(bands);
+	
+	if (n_skim == 0) return;
+	lprintf("WSPR skimmer: %d band%s, BFO %d, spots to %s\n", n_skim, (n_skim == 1)? "":"s", bfo, WSPR_SPOT_FILE);
+	CreateTask(WSPR_Skimmer, 0, EXT_PRIORITY);
+}
+
 bool wspr_msgs(char *msg, int rx_chan)
 {
 	wspr_t *w = &wspr[rx_chan];
@@ -384,6 +616,7 @@ bool wspr_msgs(char *msg, int rx_chan)
 	
 	if (strcmp(msg, "SET ext_server_init") == 0) {
 		w->rx_chan = rx_chan;
+		w->skimmer = false;
 		time_t t; time(&t);
 		ext_send_msg(w->rx_chan, WSPR_DEBUG_MSG, "EXT nbins=%d WSPR_TIME=%d ready", nbins_411, t);
 		wspr_status(w, IDLE, IDLE);
@@ -415,30 +648,15 @@ bool wspr_msgs(char *msg, int rx_chan)
 		return true;
 	}
 
-	n = sscanf(msg, "SET capture=%d", &w->capture);
+	int capture;
+	n = sscanf(msg, "SET capture=%d", &capture);
 	if (n == 1) {
-		if (w->capture) {
-			if (!w->create_tasks) {
-				w->WSPR_FFTtask_id = CreateTaskF(WSPR_FFT, 0, EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
-				w->WSPR_DecodeTask_id = CreateTaskF(WSPR_Deco, 0, EXT_PRIORITY, CTF_RX_CHANNEL | (rx_chan & CTF_CHANNEL), 0);
-				w->create_tasks = true;
-			}
-			
+		if (capture) {
 			// send server time to client since that's what sync is based on
 			time_t t; time(&t);
 			ext_send_msg(w->rx_chan, WSPR_DEBUG_MSG, "EXT WSPR_TIME=%d", t);
-			
-			w->send_error = false;
-			w->reset = TRUE;
-			ext_register_receive_iq_samps(wspr_data, rx_chan);
-			wprintf("WSPR CAPTURE --------------------------------------------------------------\n");
-
-			wspr_status(w, SYNC, RUNNING);
-		} else {
-			w->abort_decode = true;
-			ext_unregister_receive_iq_samps(w->rx_chan);
-			wspr_close(w->rx_chan);
 		}
+		wspr_capture(w, capture);
 		return true;
 	}
 	
@@ -475,16 +693,12 @@ void wspr_main()
 		w->medium_effort = 1;
 		w->wspr_type = WSPR_TYPE_2MIN;
 		
-		w->fftin = (WSPR_FFTW_COMPLEX*) WSPR_FFTW_MALLOC(sizeof(WSPR_FFTW_COMPLEX)*NFFT);
-		w->fftout = (WSPR_FFTW_COMPLEX*) WSPR_FFTW_MALLOC(sizeof(WSPR_FFTW_COMPLEX)*NFFT);
-		w->fftplan = WSPR_FFTW_PLAN_DFT_1D(NFFT, w->fftin, w->fftout, FFTW_FORWARD, FFTW_ESTIMATE);
-	
 		w->status_resume = IDLE;
 		w->tsync = FALSE;
 		w->capture = 0;
-		w->last_sec = -1;
 		w->abort_decode = false;
 		w->send_error = false;
+		w->subband = -1;
 	}
 	
 	for (i=0; i < NFFT; i++) {
@@ -492,13 +706,12 @@ void wspr_main()
 	}
 
 	ext_register(&wspr_ext);
-    frate = ext_update_get_sample_rateHz(-2);
-    double fdecimate = frate / FSRATE;
-    int_decimate = SND_RATE / FSRATE;
-    wprintf("WSPR %s decimation: srate=%.6f/%d decim=%.6f/%d sps=%d NFFT=%d nbins_411=%d\n", FRACTIONAL_DECIMATION? "fractional" : "integer",
-        frate, SND_RATE, fdecimate, int_decimate, SPS, NFFT, nbins_411);
+    double frate = ext_update_get_sample_rateHz(-2);
+    int_decimate = SND_RATE / (FSRATE*2);
+    wprintf("WSPR sub-band decimation: srate=%.6f/%d decim=%d sps=%d NFFT=%d nbins_411=%d\n",
+        frate, SND_RATE, int_decimate, SPS, NFFT, nbins_411);
     
-    //int autorun = cfg_int("WSPR.autorun", NULL, CFG_REQUIRED);
+    wspr_skimmer_init();
 }
 
 #endif
@@ -21,6 +21,7 @@
 #include "gps.h"
 #include "spi.h"
 #include "ephemeris.h"
+#include "navsync.h"
 
 #include <inttypes.h>
 #include <stdlib.h>
@@ -54,6 +55,7 @@ struct CHANNEL { // Locally-held channel data
     int ch, sv;                     // Association
     int probation;                  // Temporarily disables use if channel noisy
     int holding, rd_pos;            // NAV data bit counters
+    NAVSYNC nav;                    // Subframe sync and parity
     u4_t id;
 	SPI_MISO miso;
 	
@@ -68,8 +70,9 @@ struct CHANNEL { // Locally-held channel data
     void  Tracking();
     void  SignalLost();
     void  UploadEmbeddedState();
-    int   ParityCheck(char *buf, int *nbits);
-    void  Subframe(char *buf);
+    int   NavSync(uint16_t word);
+    void  ParityError();
+    void  Subframe(u4_t *sf);
     void  Status();
     int   RemoteBits(uint16_t wr_pos);
     bool  GetSnapshot(uint16_t wr_pos, int *p_sv, int *p_bits, float *p_pwr);
@@ -90,23 +93,6 @@ static double GetFreq(uint16_t *u) { // Convert NCO command to Hertz
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-const char preambleUpright [] = {1,0,0,0,1,0,1,1};
-const char preambleInverse [] = {0,1,1,1,0,1,0,0};
-
-static int parity(char *p, char *word, char D29, char D30) {
-    char *d = word-1;
-    for (int i=1; i<25; i++) d[i] ^= D30;
-    p[0] = D29 ^ d[1] ^ d[2] ^ d[3] ^ d[5] ^ d[6] ^ d[10] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[17] ^ d[18] ^ d[20] ^ d[23];
-    p[1] = D30 ^ d[2] ^ d[3] ^ d[4] ^ d[6] ^ d[7] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[18] ^ d[19] ^ d[21] ^ d[24];
-    p[2] = D29 ^ d[1] ^ d[3] ^ d[4] ^ d[5] ^ d[7] ^ d[8] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[19] ^ d[20] ^ d[22];
-    p[3] = D30 ^ d[2] ^ d[4] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[20] ^ d[21] ^ d[23];
-    p[4] = D30 ^ d[1] ^ d[3] ^ d[5] ^ d[6] ^ d[7] ^ d[9] ^ d[10] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[18] ^ d[21] ^ d[22] ^ d[24];
-    p[5] = D29 ^ d[3] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[10] ^ d[11] ^ d[13] ^ d[15] ^ d[19] ^ d[22] ^ d[23] ^ d[24];
-    return memcmp(d+25, p, 6);
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////
-
 void CHANNEL::UploadEmbeddedState() {
     spi_get(CmdGetChan, &miso, sizeof(ul), ch);
     memcpy(&ul, miso.byte, sizeof(ul));
@@ -242,7 +228,6 @@ void CHANNEL::Acquisition() {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 void CHANNEL::Tracking() {
-    char buf[300 + MAX_NAV_BITS - 1];
 
     const int POLLING_PS = 4;  // Poll 4 times per second
     const int POLLING_US = 1000000 / POLLING_PS;
@@ -257,6 +242,7 @@ void CHANNEL::Tracking() {
 
 	float sumpwr=0;
     holding=0;
+    nav.Reset();
 
 	evGPS(EC_TRIG3, EV_GPS, ch, "GPS", "trig3 Tracking1");
 	static int firsttime[16];
@@ -282,26 +268,11 @@ void CHANNEL::Tracking() {
 		firsttime[ch]=0;
 		
         for(; avail; avail-=16) {
-            int word = ul.nav_buf[rd_pos/16];
-            for (int i=0; i<16; i++) {
-                word<<=1;
-                buf[holding++] = (word>>16) & 1;
-            }
-            rd_pos+=16;
-            rd_pos&=MAX_NAV_BITS-1;
-        }
-
-        while (holding>=300) { // Enough for a subframe?
-            int nbits;
-            if (0==ParityCheck(buf, &nbits)) {
+            if (NavSync(ul.nav_buf[rd_pos/16])) {
 				watchdog=0; sumpwr=0;
-			} else {
-				if (nbits != 1) GPSstat(STAT_SUB, 0, ch, PARITY);
 			}
-			
-			// ParityCheck() return nbits = 1 to shift buf by 1 bit until a preamble match
-            memmove(buf, buf+nbits, holding-=nbits);
-			GPSstat(STAT_WDOG, 0, ch, watchdog/POLLING_PS, holding, ul.ca_unlocked);
+            rd_pos+=16;
+            rd_pos&=MAX_NAV_BITS-1;
         }
 
 		Status();
@@ -381,9 +352,9 @@ float CHANNEL::GetPower() {
 
 static unsigned subframe_dump;
 
-void CHANNEL::Subframe(char *buf) {
-	unsigned sub = bin(buf+49,3);
-    unsigned page = bin(buf+62,6);
+void CHANNEL::Subframe(u4_t *sf) {
+	unsigned sub = bin(sf,49,3);
+    unsigned page = bin(sf,62,6);
 
 #ifndef	QUIET
     printf("prn%02d sub %d ", sv+1, sub);
@@ -394,8 +365,8 @@ void CHANNEL::Subframe(char *buf) {
     if (!gps_debug) {
 	    if (sub < 1 || sub > SUBFRAMES) return;
     } else {
-        unsigned tlm = bin(buf+8,14);
-        unsigned tow = bin(buf+30,17);
+        unsigned tlm = bin(sf,8,14);
+        unsigned tow = bin(sf,30,17);
         static unsigned last_good_tlm, last_good_tow;
         static bool gps_debugging;
         static int sub_seen[SUBFRAMES+1];
@@ -407,9 +378,9 @@ void CHANNEL::Subframe(char *buf) {
         
         if (sub < 1 || sub > SUBFRAMES) {
             lprintf("GPS: unknown subframe %d prn%02d preamble 0x%02x[0x8b] tlm %d[%d] tow %d[%d] alert %d data-id %d sv-page-id %d novfl %d tracking %d good %d frames %d par_errs %d\n",
-                sub, sv+1, bin(buf,8), tlm, last_good_tlm, tow, last_good_tow, bin(buf+47,1), bin(buf+60,2), page, gps.ch[ch].novfl, gps.tracking, gps.good, gps.ch[ch].frames, gps.ch[ch].par_errs);
+                sub, sv+1, bin(sf,0,8), tlm, last_good_tlm, tow, last_good_tow, bin(sf,47,1), bin(sf,60,2), page, gps.ch[ch].novfl, gps.tracking, gps.good, gps.ch[ch].frames, gps.ch[ch].par_errs);
             for (int i=0; i<10; i++) {
-                lprintf("GPS: w%d b%3d %06x %02x\n", i, i*30, bin(buf+i*30,24), bin(buf+i*30+24,6));
+                lprintf("GPS: w%d b%3d %06x %02x\n", i, i*30, bin(sf,i*30,24), bin(sf,i*30+24,6));
             }
             //subframe_dump = 5 * 25;   // full 12.5 min cycle
             subframe_dump = 5 * 2;      // two subframe cycles
@@ -448,32 +419,32 @@ void CHANNEL::Status() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-int CHANNEL::ParityCheck(char *buf, int *nbits) {
-    char p[6];
+// Subframe sync and parity check (NAVSYNC), processing NAV data one 16-bit word at a time.
+// Returns true when a subframe passes parity.
 
-    // Upright or inverted preamble?  Setting of parity bits resolves phase ambiguity.
-    if      (0==memcmp(buf, preambleUpright, 8)) p[4]=p[5]=0;
-    else if (0==memcmp(buf, preambleInverse, 8)) p[4]=p[5]=1;
-    else return *nbits=1;
+int CHANNEL::NavSync(uint16_t word) {
+    int ev = nav.Push(word);
 
-    // Parity check up to ten 30-bit words ...
-    for (int i=0; i<300; i+=30) {
-        if (parity(p, buf+i, p[4], p[5])) {
-            Status();
-#ifndef QUIET
-            puts("parity");
-#endif
-            probation=2;
-            return *nbits=i+30;
-        }
+    if (ev & NAV_PARITY) ParityError();
+
+    if (ev & NAV_SUBFRAME) {
+        Status();
+        Subframe(nav.subframe);
+        Ephemeris[sv].Subframe(nav.subframe);
+        if (probation) probation--;
     }
 
+    holding = nav.Holding();
+    return (ev & NAV_SUBFRAME) != 0;
+}
+
+void CHANNEL::ParityError() {
     Status();
-    Subframe(buf);
-    Ephemeris[sv].Subframe(buf);
-    if (probation) probation--;
-    *nbits=300;
-    return 0;
+#ifndef QUIET
+    puts("parity");
+#endif
+    probation=2;
+    GPSstat(STAT_SUB, 0, ch, PARITY);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -204,15 +204,14 @@ bool EPHEM::Valid() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-void EPHEM::Subframe(char *buf) { // called from channel tasks
+void EPHEM::Subframe(u4_t *sf) { // called from channel tasks
     char nav[30];
 
-	int sub = bin(buf+49,3);
+	int sub = bin(sf,49,3);
 
-    for (int i=0; i<30; buf+=6) {	// skip 6 parity bits
+    for (int i=0; i<30; sf++) {	// skip 6 parity bits
         for (int j=0; j<3; j++) {
-			nav[i++] = bin(buf,8);
-			buf += 8;
+			nav[i++] = *sf >> (22 - j*8);
         }
     }
 
@@ -47,7 +47,7 @@ class EPHEM {
 public:
     unsigned tow;
 
-    void   Subframe(char *buf);
+    void   Subframe(u4_t *sf);
     bool   Valid();
     double GetClockCorrection(double t);
     void   GetXYZ(double *x, double *y, double *z, double t);
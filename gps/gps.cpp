@@ -30,10 +30,9 @@
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-unsigned bin(char *s, int n) {
-	unsigned u = *s;
-	while (--n) u += u + *++s;
-	return u;
+// Extract n bits starting at subframe bit position pos (not spanning a 30-bit word)
+unsigned bin(u4_t *sf, int pos, int n) {
+	return (sf[pos/30] >> (30 - pos%30 - n)) & ((1<<n) - 1);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -44,6 +43,7 @@ void gps_main(int argc, char *argv[])
 
 	printf("GPS starting..\n");
     SearchParams(argc, argv);
+    WarmInit();
 
 	SearchInit();
 
@@ -67,6 +67,9 @@ void gps_main(int argc, char *argv[]);
 #define NSAMPLES  	(FS_I/BIN_SIZE)
 #define NUM_SATS    32
 
+#define ACQ_NC_MAX	8		// max snapshots integrated non-coherently during acquisition
+#define ACQ_HIST	10		// minutes of acquisition probability history
+
 ///////////////////////////////////////////////////////////////////////////////
 // Official GPS constants
 
@@ -90,6 +93,28 @@ void SearchEnable(int sv);
 int  SearchCode(int sv, unsigned int g1);
 void SearchParams(int argc, char *argv[]);
 
+//////////////////////////////////////////////////////////////
+// Warm start
+
+#define WARM_DOP_WIN			4	// +/- FFT bins searched around predicted Doppler
+#define WARM_DOP_WIN_NO_BIAS	12	// ... before front-end oscillator offset is known
+
+struct WARM_PRED {
+    bool valid;
+    int visible;                // number of SVs predicted above elevation mask
+    int sv[NUM_SATS];           // predicted visible SVs, highest elevation first
+    bool known[NUM_SATS];       // have orbit for SV (if not predicted, SV is below the mask)
+    bool predicted[NUM_SATS];   // SV predicted visible
+    int dop[NUM_SATS];          // predicted Doppler incl. oscillator offset (FFT bins)
+    float dop_raw[NUM_SATS];    // predicted Doppler excl. oscillator offset (FFT bins)
+    int dop_win;                // +/- FFT bins to search around dop[]
+};
+
+void WarmInit();
+void WarmFix(double x, double y, double z, double tow);
+bool WarmPredict(WARM_PRED *p);
+void WarmAcquired(int sv, int lo_shift, WARM_PRED *p);
+
 //////////////////////////////////////////////////////////////
 // Tracking
 
@@ -125,6 +150,7 @@ enum STAT {
     STAT_ACQUIRE,
     STAT_EPL,
     STAT_NOVFL,
+    STAT_ACQ,
     STAT_DEBUG
 };
 
@@ -136,6 +162,13 @@ struct gps_stats_t {
 	int StatDay;    // 0 = Sunday
 	int StatNS, StatEW;
     signed delta_tLS, delta_tLSF;
+
+	int acq_nc;				// current non-coherent integration depth (snapshots)
+	struct gps_acq_t {
+		unsigned minute;
+		int tries, hits;
+		int nc_sum;			// integration depth used, summed over tries
+	} acq[ACQ_HIST];		// acquisition probability vs. time, one minute per entry
 	
 	struct gps_chan_t {
 		int prn;
@@ -161,7 +194,7 @@ struct UMS {
     }
 };
 
-unsigned bin(char *s, int n);
+unsigned bin(u4_t *sf, int pos, int n);
 void StatTask(void *param);
 void GPSstat(STAT st, double, int=0, int=0, int=0, int=0, double=0);
 
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (C) 2013 Andrew Holme
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+//////////////////////////////////////////////////////////////////////////
+
+#include "navsync.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+const u4_t preambleUpright = 0x8b;
+const u4_t preambleInverse = 0x74;
+
+// Bit masks of data bits d1..d24 (d1 = b23) contributing to D25..D30 (ICD-GPS-200 table 20-XIV)
+static const u4_t parity_mask[6] = { 0xEC7CD2, 0x763E69, 0xBB1F34, 0x5D8F9A, 0xAEC7CD, 0x2DEA27 };
+
+// Checks parity of 30-bit word *w given the last two bits of the previous word (D29* in b1, D30* in b0).
+// Data bits of *w are returned with the D30* inversion removed.
+bool NavParity(u4_t *w, u4_t prev) {
+    u4_t d = (*w >> 6) & 0xffffff, p = 0;
+    if (prev & 1) d ^= 0xffffff;
+    for (int i=0; i<6; i++) p = (p<<1) | __builtin_parity(d & parity_mask[i]);
+    if (prev & 2) p ^= 0x29;    // D29* contributes to D25, D27, D30
+    if (prev & 1) p ^= 0x16;    // D30* contributes to D26, D28, D29
+    *w = (d<<6) | (*w & 0x3f);
+    return p == (*w & 0x3f);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Hunting: each bit position is tested for an upright or inverted preamble whose TLM word
+// passes parity (the polarity resolves the phase ambiguity, as D29* = D30* = 0 at the end of
+// every subframe). Then the following nine words are collected and checked 30 bits at a time.
+// A parity error discards the bits up to the end of the failing word and restarts the hunt.
+// A false preamble only advances the hunt by one bit so a real one following isn't skipped.
+//
+// A 16-bit word can complete at most one subframe or find one parity error, and a completed
+// subframe stays in subframe[] until the next call.
+
+int NAVSYNC::Push(uint16_t word) {
+    int ev = 0;
+
+    sr = (sr << 16) | word;
+    sr_bits += 16;
+
+    while (sr_bits >= 30) {
+        u4_t w = (sr >> (sr_bits-30)) & 0x3fffffff;
+
+        if (words == 0) {
+            u4_t pre = w >> 22;
+            if      (pre == preambleUpright) prev = 0;
+            else if (pre == preambleInverse) prev = 3;
+            else {
+                sr_bits--;
+                continue;
+            }
+        }
+
+        u4_t last = w & 3;
+
+        if (!NavParity(&w, prev)) {
+            if (words == 0) {
+                sr_bits--;      // false preamble: keep hunting from the next bit
+                continue;
+            }
+            sr_bits -= 30;
+            words = 0;
+            ev |= NAV_PARITY;
+            continue;
+        }
+
+        sr_bits -= 30;
+        prev = last;
+        subframe[words++] = w;
+        if (words < 10) continue;
+
+        words = 0;
+        ev |= NAV_SUBFRAME;
+    }
+
+    return ev;
+}
@@ -0,0 +1,48 @@
+//////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (C) 2013 Andrew Holme
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef	__NAVSYNC_H_
+#define	__NAVSYNC_H_
+
+#include "types.h"
+
+#include <inttypes.h>
+
+// NAV subframe sync and parity check, fed one 16-bit word of NAV bits at a time.
+// Subframes are kept as ten packed 30-bit words, first bit received in b29 (d1) down to D30 in b0.
+
+#define NAV_SUBFRAME    1               // subframe[] holds a subframe that passed parity
+#define NAV_PARITY      2               // parity error in the subframe being collected
+
+struct NAVSYNC {
+    u64_t sr;                           // NAV bit shift register, newest bit in b0
+    int sr_bits;                        // Valid bits in sr
+    int words;                          // Subframe words collected, 0 = hunting for preamble
+    u4_t prev;                          // D29*, D30* of previous word
+    u4_t subframe[10];                  // Subframe being collected
+
+    void Reset() { sr_bits = words = 0; }
+    int  Push(uint16_t word);           // returns NAV_SUBFRAME | NAV_PARITY events
+    int  Holding() { return words*30 + sr_bits; }
+};
+
+bool NavParity(u4_t *w, u4_t prev);
+
+#endif
@@ -93,6 +93,10 @@ static fftwf_plan fwd_plan, rev_plan;
 
 static fftwf_complex copy_buf[FFT_LEN];
 
+// Non-coherent accumulation of correlation power, [doppler][code phase sample]
+static float *acc;
+static int acc_dops, acc_spms;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 float inline Bipolar(int bit) {
@@ -101,7 +105,7 @@ float inline Bipolar(int bit) {
 
 #include <ctype.h>
 
-static int decim=DECIM_DEF, decim_nom=0, min_sig=MIN_SIG_DECIM, test_mode;
+static int decim=DECIM_DEF, decim_nom=0, min_sig=MIN_SIG_DECIM, test_mode, acq_nc_max=ACQ_NC_MAX;
  
 void SearchParams(int argc, char *argv[]) {
 	int i;
@@ -110,7 +114,7 @@ void SearchParams(int argc, char *argv[]) {
 		char *v = argv[i];
 		if (strcmp(v, "?")==0 || strcmp(v, "-?")==0 || strcmp(v, "--?")==0 || strcmp(v, "-h")==0 ||
 			strcmp(v, "h")==0 || strcmp(v, "-help")==0 || strcmp(v, "--h")==0 || strcmp(v, "--help")==0) {
-			printf("GPS args:\n\t-gp decimation_factor signal_threshold\n\t-gt test mode\n");
+			printf("GPS args:\n\t-gp decimation_factor signal_threshold\n\t-gnc max_snapshots_integrated\n\t-gt test mode\n");
 			xit(0);
 		}
 		if (strcmp(v, "-gp")==0) {
@@ -125,6 +129,12 @@ void SearchParams(int argc, char *argv[]) {
 			i++; decim_nom = strtol(argv[i], 0, 0);
 			printf("GPS decim_nom=%d\n", decim_nom);
 		} else
+		if (strcmp(v, "-gnc")==0) {
+			i++; acq_nc_max = strtol(argv[i], 0, 0);
+			if (acq_nc_max < 1) acq_nc_max = 1;
+			if (acq_nc_max > ACQ_NC_MAX) acq_nc_max = ACQ_NC_MAX;
+			printf("GPS acq_nc_max=%d\n", acq_nc_max);
+		} else
 		if (strcmp(v, "-gt")==0) {
 			decim = 1; test_mode = 1;
 			printf("GPS test_mode\n");
@@ -137,6 +147,9 @@ void SearchParams(int argc, char *argv[]) {
 }
 
 static char bits[NSAMPLES][2];
+
+#define	DOP_COLD	(5000/BIN_SIZE)		// +/- 5 kHz doppler search
+
 #define NTAPS	31
  
  // half-band filter
@@ -283,9 +296,18 @@ void SearchInit() {
 
 		DecimateBy2float(nsamples, copy_buf, fwd_buf, false);
 		fftwf_execute(fwd_plan);
-		memcpy(code[sv], fwd_buf, sizeof fwd_buf);
+
+		// cache the conjugate so Correlate() doesn't have to form it for every doppler bin
+		for (int i=0; i<FFT_LEN/2; i++) {
+			code[sv][i][0] =  fwd_buf[i][0];
+			code[sv][i][1] = -fwd_buf[i][1];
+		}
     }
 
+    acc_spms = FS_I/decim/1000;
+    acc_dops = DOP_COLD*2 + 1;
+    acc = (float *) kiwi_malloc("gps acc", acc_dops * acc_spms * sizeof(float));
+
     CreateTask(SearchTask, 0, GPS_ACQ_PRIORITY);
 }
 
@@ -320,45 +342,64 @@ void SearchFree() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-static void Sample() {
-    const int lo_sin[] = {1,1,0,0}; // Quadrature local oscillators
-    const int lo_cos[] = {1,0,0,1};
+// Snapshot acquisition: the FPGA sampler holds 4 ms of 1-bit samples.
+// Several snapshots are captured back-to-back (raw) before any processing so that the
+// time between them, measured with the FPGA system clock, is short and accurate enough
+// to realign their correlation outputs for non-coherent integration.
 
-    const float lo_rate = 4*FC/FS; // NCO rate
+#define SAMP_PACKET		(GPS_SAMPS * 2)
+#define SAMP_RAW_BYTES	(((NSAMPLES/8 + SAMP_PACKET-1) / SAMP_PACKET) * SAMP_PACKET)
+
+struct SNAPSHOT_RAW {
+	u64_t ticks;		// FPGA system clock (ADC clock) at sampler trigger
+	int t_sample;		// timer_us() at sampler trigger
+	char byte[SAMP_RAW_BYTES];
+};
 
+static SNAPSHOT_RAW snaps[ACQ_NC_MAX];
+
+static void SampleRaw(SNAPSHOT_RAW *snap) {
     const int US = 1000000/BIN_SIZE; // Sample length
-    const int PACKET = GPS_SAMPS * 2;
+    static SPI_MISO rx;
 
-    float lo_phase=0; // NCO phase accumulator
-    int i=0, j, b;
-	
-	spi_set(CmdSample); // Trigger sampler and reset code generator in FPGA
+	snap->t_sample = timer_us();
+	spi_get(CmdSampleTS, &rx, S2B(3)); // Trigger sampler and reset code generator in FPGA
+
+    // NB: see tools/ext64.c for why the (u64_t) casting is very important
+	snap->ticks = ((u64_t) rx.word[0]<<32) | ((u64_t) rx.word[1]<<16) | rx.word[2];
 	TaskSleepUsec(US);
 
-	while (i < NSAMPLES) {
-        static SPI_MISO rx;
-		spi_get(CmdGetGPSSamples, &rx, PACKET);
+	for (int j=0; j < SAMP_RAW_BYTES; j += SAMP_PACKET) {
+		spi_get(CmdGetGPSSamples, &rx, SAMP_PACKET);
+		memcpy(snap->byte + j, rx.byte, SAMP_PACKET);
+	}
+}
 
-        for (j=0; j<PACKET; j++) {
-			int byte = rx.byte[j];
+static void Sample(SNAPSHOT_RAW *snap) {
+    const int lo_sin[] = {1,1,0,0}; // Quadrature local oscillators
+    const int lo_cos[] = {1,0,0,1};
 
-            for (b=0; b<8; b++) {
-            	int bit = byte&1;
-				byte>>=1;
+    const float lo_rate = 4*FC/FS; // NCO rate
 
-                // Down convert to complex (IQ) baseband by mixing (XORing)
-                // samples with quadrature local oscillators (mix down by both FS and FC)
-                if (i >= NSAMPLES)
-                	break;
+    float lo_phase=0; // NCO phase accumulator
+    int i=0, j, b;
+	
+	for (j=0; i < NSAMPLES; j++) {
+		int byte = snap->byte[j];
 
-				bits[i][0] = bit ^ lo_sin[int(lo_phase)];
-				bits[i][1] = bit ^ lo_cos[int(lo_phase)];
+		for (b=0; b<8 && i < NSAMPLES; b++) {
+			int bit = byte&1;
+			byte>>=1;
 
-				i++;
-                lo_phase += lo_rate;
-                if (lo_phase>=4) lo_phase-=4;
-            }
-        }
+			// Down convert to complex (IQ) baseband by mixing (XORing)
+			// samples with quadrature local oscillators (mix down by both FS and FC)
+			bits[i][0] = bit ^ lo_sin[int(lo_phase)];
+			bits[i][1] = bit ^ lo_cos[int(lo_phase)];
+
+			i++;
+			lo_phase += lo_rate;
+			if (lo_phase>=4) lo_phase-=4;
+		}
     }
 
     NextTask("samp0");
@@ -389,56 +430,110 @@ static void Sample() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-static float Correlate(int sv, int sample_rate, fftwf_complex *data, int *max_snr_dop, int *max_snr_i) {
-
-	bool isDecim = ((sample_rate == (FS_I/decim)) && (decim != 1));
+static void Correlate(int sv, int fft_len, fftwf_complex *data, int dop, float *pwr) {
     fftwf_complex *prod = rev_buf;
-    float max_snr=0;
-    int i, fft_len = isDecim? FFT_LEN/decim : FFT_LEN;
-    
-    // see paper about baseband FFT symmetry (since input from GPS FE is a real signal)
-    // this simulates throwing away the upper 1/2 of the FFT so subsequent FFT
-    // output processing can be 1/2 the size (the FFT itself has to be the same size).
-    if (test_mode) for (i=fft_len/2; i<fft_len; i++) data[i][0] = data[i][1] = 0;
+    fftwf_complex *cc = code[sv];
+    int i, j;
+
+    // conj(data) * code, code spectrum rotated by dop bins (doppler shift).
+    // code[] holds the conjugate, so this is conj(data * code[]):
+    // (a+ib)(x+iy) = (ax-by) + i(ay+bx)
+    int d = ((dop % fft_len) + fft_len) % fft_len;
+    for (i=0, j=fft_len-d; i<d; i++, j++) {
+        prod[i][0] =   data[i][0]*cc[j][0] - data[i][1]*cc[j][1];
+        prod[i][1] = -(data[i][0]*cc[j][1] + data[i][1]*cc[j][0]);
+    }
+    for (j=0; i<fft_len; i++, j++) {
+        prod[i][0] =   data[i][0]*cc[j][0] - data[i][1]*cc[j][1];
+        prod[i][1] = -(data[i][0]*cc[j][1] + data[i][1]*cc[j][0]);
+    }
 
-	// +/- 5 kHz doppler search
-    for (int dop=-5000/BIN_SIZE; dop<=5000/BIN_SIZE; dop++) {
-        float max_pwr=0, tot_pwr=0;
-        int max_pwr_i=0;
+    NextTaskP("coor FFT LONG RUN", NT_LONG_RUN);
+    fftwf_execute(rev_plan);
+    NextTask("corr FFT end");
 
-        // (a-ib)(x+iy) = (ax+by) + i(ay-bx)
-        for (i=0; i<fft_len; i++) {
-            int j=(i-dop+fft_len)%fft_len;	// doppler shifting applied to C/A code FFT
-            prod[i][0] = data[i][0]*code[sv][j][0] + data[i][1]*code[sv][j][1];
-            prod[i][1] = data[i][0]*code[sv][j][1] - data[i][1]*code[sv][j][0];
-        }
+    for (i=0; i<acc_spms; i++)		// 1 msec of samples
+        pwr[i] = prod[i][0]*prod[i][0] + prod[i][1]*prod[i][1];
+}
 
-        NextTaskP("coor FFT LONG RUN", NT_LONG_RUN);
-        fftwf_execute(rev_plan);
-        NextTask("corr FFT end");
+// Code phase of snapshot k relative to snapshot 0 for a given Doppler bin.
+// Each snapshot restarts the sampler, so the signal's code phase advances between
+// snapshots by the elapsed time (scaled by the code Doppler) modulo the 1 ms code period.
+static int CodeAlign(SNAPSHOT_RAW *s0, SNAPSHOT_RAW *sk, int dop) {
+	if (s0 == sk) return 0;
+	double secs = time_diff48(sk->ticks, s0->ticks) / adc_clock_system();
+	double ca_rate = 1.0 + (dop*BIN_SIZE)/L1;
+	return (int) fmod(nearbyint(secs * ca_rate * acc_spms * 1000.0), acc_spms);
+}
+
+static float AccSNR(int dops, int dop_min, int *max_snr_dop, int *max_snr_i) {
+	float max_snr=0;
 
-        for (i=0; i<sample_rate/1000; i++) {		// 1 msec of samples
-            float pwr = prod[i][0]*prod[i][0] + prod[i][1]*prod[i][1];
+	for (int k=0; k<dops; k++) {
+		float *a = acc + k*acc_spms;
+        float max_pwr=0, tot_pwr=0;
+        int i, max_pwr_i=0;
+
+        for (i=0; i<acc_spms; i++) {
+        	float pwr = a[i];
             if (pwr>max_pwr) max_pwr=pwr, max_pwr_i=i;
             tot_pwr += pwr;
         }
-        NextTask("corr pwr");
 
         float ave_pwr = tot_pwr/i;
         float snr = max_pwr/ave_pwr;
-        if (snr>max_snr) max_snr=snr, *max_snr_dop=dop, *max_snr_i=max_pwr_i;
-
-#if 0
-		int j;
-		printf("SV-%d DOP %3d ", sv, dop);
-		for (j=max_pwr_i-5; j<max_pwr_i+5; j++)
-			printf("%5d:%5.2f ", j, (prod[j][0]*prod[j][0] + prod[j][1]*prod[j][1])/ave_pwr);
-		printf("\n");
-#endif
+        if (snr>max_snr) max_snr=snr, *max_snr_dop=dop_min+k, *max_snr_i=max_pwr_i;
+	}
+	
+	return max_snr;
+}
 
-    }
+// Detection threshold for the ratio of peak to mean power after integrating n snapshots.
+// Noise fluctuation of the mean power drops as 1/sqrt(n).
+static float MinSig(int n) {
+	return 1 + (min_sig-1) / sqrtf(n);
+}
+
+// Integrates up to nc snapshots, stopping early once the SV is detected.
+// Returns the SNR and sets *nc to the number of snapshots used.
+// Code phase is returned relative to the last snapshot taken (*last).
+static float Acquire(int sv, int dop_min, int dop_max, int *nc, int *max_snr_dop, int *max_snr_i, SNAPSHOT_RAW **last) {
+    int fft_len = (decim != 1)? FFT_LEN/decim : FFT_LEN;
+    int dops = dop_max - dop_min + 1;
+    float snr=0;
+    int n, k, i;
     
-    return max_snr;
+    assert(dops <= acc_dops);
+    static float pwr[FS_I/1000];
+
+    for (n=0; n < *nc; n++) SampleRaw(&snaps[n]);
+    memset(acc, 0, dops * acc_spms * sizeof(float));
+
+    for (n=0; n < *nc; n++) {
+		Sample(&snaps[n]);
+
+		// see paper about baseband FFT symmetry (since input from GPS FE is a real signal)
+		// this simulates throwing away the upper 1/2 of the FFT so subsequent FFT
+		// output processing can be 1/2 the size (the FFT itself has to be the same size).
+		if (test_mode) for (i=fft_len/2; i<fft_len; i++) fwd_buf[i][0] = fwd_buf[i][1] = 0;
+
+		for (k=0; k<dops; k++) {
+			Correlate(sv, fft_len, fwd_buf, dop_min+k, pwr);
+			int d = CodeAlign(&snaps[0], &snaps[n], dop_min+k);
+			float *a = acc + k*acc_spms;
+			for (i=0; i < acc_spms-d; i++) a[i] += pwr[i+d];
+			for (; i < acc_spms; i++) a[i] += pwr[i+d-acc_spms];
+		}
+        NextTask("corr pwr");
+        
+		snr = AccSNR(dops, dop_min, max_snr_dop, max_snr_i);
+		if (snr >= MinSig(n+1)) { n++; break; }
+    }
+
+    *nc = n;
+    *last = &snaps[n-1];
+    *max_snr_i = (*max_snr_i + CodeAlign(&snaps[0], *last, *max_snr_dop)) % acc_spms;
+    return snr;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -464,10 +559,60 @@ void SearchEnable(int sv) {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 static int searchTaskID = -1;
+static int last_ch=-1;
+static float snr;
+
+// Every so often search all SVs regardless of prediction in case the antenna has moved.
+#define	WARM_FULL_PASS	4
+
+// Returns true if SV was acquired and handed to a tracking channel.
+static bool SearchSV(int sv, int dop_min, int dop_max, int *p_lo_shift=NULL) {
+    int us, ch, nc, lo_shift=0, ca_shift=0;
+    SNAPSHOT_RAW *last;
+
+	while((ch=ChanReset())<0) {		// all channels busy?
+		TaskSleepMsec(1000);
+		//NextTask("all chans busy");
+	}
+	
+	if ((last_ch != ch) && (snr < MinSig(gps.acq_nc))) GPSstat(STAT_PRN, 0, last_ch, 0, 0, 0);
+
+#ifndef	QUIET
+	printf("FFT-PRN%d dop %d..%d nc %d\n", sv+1, dop_min, dop_max, gps.acq_nc); fflush(stdout);
+#endif
+	us = timer_us();
+	nc = gps.acq_nc;
+	snr = Acquire(sv, dop_min, dop_max, &nc, &lo_shift, &ca_shift, &last);
+	ca_shift *= decim;
+	
+	us = timer_us()-us;
+	bool detect = (snr >= MinSig(nc));
+
+#ifndef	QUIET
+	printf("FFT-PRN%d %1.1f secs SNR=%1.1f nc %d\n", sv+1,
+		(float)us/1000000.0, snr, nc);
+	fflush(stdout);
+#endif
+
+	GPSstat(STAT_PRN, snr, ch, Sats[sv].prn, !detect, us);
+	GPSstat(STAT_ACQ, 0, nc, detect);
+	last_ch = ch;
+
+	if (!detect)
+		return false;
+
+	GPSstat(STAT_DOP, 0, ch, lo_shift, ca_shift);
+	if (p_lo_shift) *p_lo_shift = lo_shift;
+
+	Busy[sv] = true;
+	ChanStart(ch, sv, last->t_sample, (Sats[sv].T1<<4) +
+								 Sats[sv].T2, lo_shift, ca_shift);
+	return true;
+}
 
 void SearchTask(void *param) {
-    int i, us, ret, ch, last_ch=-1, sv, t_sample, lo_shift=0, ca_shift=0;
-    float snr=0;
+    int i, sv, lo_shift, pass, tried, found;
+    WARM_PRED warm;
 
 	searchTaskID = TaskID();
 
@@ -478,7 +623,28 @@ void SearchTask(void *param) {
     GPSstat(STAT_PARAMS, 0, decim, min_sig);
 	GPSstat(STAT_ACQUIRE, 0, 1);
 
-    for(;;) {
+    gps.acq_nc = 1;
+
+    for(pass=0;; pass++) {
+    	tried = found = 0;
+    
+    	// Warm start: SVs predicted to be visible, searched over a narrow Doppler window.
+    	if (WarmPredict(&warm)) {
+    		for (i=0; i<warm.visible; i++) {
+    			sv = warm.sv[i];
+				if (Busy[sv]) continue;
+				int dop = warm.dop[sv];
+				tried++;
+				if (SearchSV(sv, dop - warm.dop_win, dop + warm.dop_win, &lo_shift)) {
+					WarmAcquired(sv, lo_shift, &warm);
+					found++;
+				}
+    		}
+    	}
+
+		// Cold: full Doppler search, skipping SVs the orbit prediction says are below the horizon.
+		bool skip_below = warm.valid && (pass % WARM_FULL_PASS) != 0;
+
         for (sv=0; sv<NUM_SATS; sv++) {
 
             if (Busy[sv]) {	// SV already acquired?
@@ -486,42 +652,22 @@ void SearchTask(void *param) {
                 continue;
             }
 
-			while((ch=ChanReset())<0) {		// all channels busy?
-				TaskSleepMsec(1000);
-				//NextTask("all chans busy");
-			}
-			
-			if ((last_ch != ch) && (snr < min_sig)) GPSstat(STAT_PRN, 0, last_ch, 0, 0, 0);
-
-#ifndef	QUIET
-			printf("FFT-PRN%d\n", sv+1); fflush(stdout);
-#endif
-            us = t_sample = timer_us(); // sample time
-            Sample();
-
-			snr = Correlate(sv, FS_I/decim, fwd_buf, &lo_shift, &ca_shift);
-			ca_shift *= decim;
-            
-            us = timer_us()-us;
-
-#ifndef	QUIET
-			printf("FFT-PRN%d %1.1f secs SNR=%1.1f\n", sv+1,
-				(float)us/1000000.0, snr);
-			fflush(stdout);
-#endif
-
-            GPSstat(STAT_PRN, snr, ch, Sats[sv].prn, snr < min_sig, us);
-            last_ch = ch;
-
-            if (snr < min_sig)
-                continue;
-
-            GPSstat(STAT_DOP, 0, ch, lo_shift, ca_shift);
+            if (skip_below && warm.known[sv] && !warm.predicted[sv]) {
+            	NextTask("below");
+            	continue;
+            }
 
-			Busy[sv] = true;
-			ChanStart(ch, sv, t_sample, (Sats[sv].T1<<4) +
-										 Sats[sv].T2, lo_shift, ca_shift);
+			tried++;
+			if (SearchSV(sv, -DOP_COLD, DOP_COLD)) found++;
     	}
+    	
+    	// Adapt the integration depth: go deeper when a whole pass finds nothing while too few
+    	// SVs are tracked, back off to single snapshots once there are enough for fixes.
+    	if (gps.good >= 4)
+    		gps.acq_nc = 1;
+    	else
+    	if (tried && !found && gps.tracking < 4)
+    		gps.acq_nc = MIN(gps.acq_nc*2, acq_nc_max);
 	}
 }
 
@@ -27,6 +27,7 @@
 #include "clk.h"
 #include "ephemeris.h"
 #include "spi.h"
+#include "timing.h"
 
 #define MAX_ITER 20
 
@@ -161,120 +162,142 @@ double SNAPSHOT::GetClock() {
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
+// Per-epoch measurements: corrected transmit times and SV positions
 
-static int Solve(int chans, double *x_n, double *y_n, double *z_n, double *t_bias) {
-    int i, j, r, c;
-
-    double t_tx[GPS_CHANS]; // Clock replicas in seconds since start of week
-
-    double x_sv[GPS_CHANS],
-           y_sv[GPS_CHANS],
-           z_sv[GPS_CHANS];
-
-    double t_pc;  // Uncorrected system time when clock replica snapshots taken
-    double t_rx;    // Corrected GPS time
-
-    double dPR[GPS_CHANS]; // Pseudo range error
-
-    double jac[GPS_CHANS][4], ma[4][4], mb[4][4], mc[4][GPS_CHANS], md[4];
+static double t_tx[GPS_CHANS];  // Clock replicas in seconds since start of week
 
-    double weight[GPS_CHANS];
+static double x_sv[GPS_CHANS],
+              y_sv[GPS_CHANS],
+              z_sv[GPS_CHANS];
 
-    *x_n = *y_n = *z_n = *t_bias = t_pc = 0;
+static double weight[GPS_CHANS];
 
-    for (i=0; i<chans; i++) {
+static bool LoadMeasurements(int chans) {
+    for (int i=0; i<chans; i++) {
         NextTask("solve1");
 
         weight[i] = Replicas[i].power;
 
         // Un-corrected time of transmission
         t_tx[i] = Replicas[i].GetClock();
-        if (t_tx[i] == NAN) return MAX_ITER;
+        if (isnan(t_tx[i])) return false;
 
         // Clock correction
         t_tx[i] -= Replicas[i].eph.GetClockCorrection(t_tx[i]);
 
         // Get SV position in ECEF coords
         Replicas[i].eph.GetXYZ(x_sv+i, y_sv+i, z_sv+i, t_tx[i]);
-
-        t_pc += t_tx[i];
     }
 
-    // Approximate starting value for receiver clock
-    t_pc = t_pc/chans + 75e-3;
+    return true;
+}
 
-    // Iterate to user xyzt solution using Taylor Series expansion:
-    for(j=0; j<MAX_ITER; j++) {
-        NextTask("solve2");
+static double WeekDiff(double t1, double t0) {
+    double t = t1 - t0;
+    if      (t> 302400) t -= 604800;
+    else if (t<-302400) t += 604800;
+    return t;
+}
 
-        t_rx = t_pc - *t_bias;
+// Pseudo range error of channel i for a receiver at x_n,y_n,z_n at GPS time t_rx.
+// u[] = unit vector from SV to receiver.
+static double PseudoRangeError(int i, double x_n, double y_n, double z_n, double t_rx, double u[3]) {
+    double dt = WeekDiff(t_rx, t_tx[i]);
 
-        for (i=0; i<chans; i++) {
-            // Convert SV position to ECI coords (20.3.3.4.3.3.2)
-            double theta = (t_tx[i] - t_rx) * OMEGA_E;
+    // Convert SV position to ECI coords (20.3.3.4.3.3.2)
+    double theta = -dt * OMEGA_E;
 
-            double x_sv_eci = x_sv[i]*cos(theta) - y_sv[i]*sin(theta);
-            double y_sv_eci = x_sv[i]*sin(theta) + y_sv[i]*cos(theta);
-            double z_sv_eci = z_sv[i];
+    double x_sv_eci = x_sv[i]*cos(theta) - y_sv[i]*sin(theta);
+    double y_sv_eci = x_sv[i]*sin(theta) + y_sv[i]*cos(theta);
+    double z_sv_eci = z_sv[i];
 
-            // Geometric range (20.3.3.4.3.4)
-            double gr = sqrt(pow(*x_n - x_sv_eci, 2) +
-                             pow(*y_n - y_sv_eci, 2) +
-                             pow(*z_n - z_sv_eci, 2));
+    // Geometric range (20.3.3.4.3.4)
+    double gr = sqrt(pow(x_n - x_sv_eci, 2) +
+                     pow(y_n - y_sv_eci, 2) +
+                     pow(z_n - z_sv_eci, 2));
 
-            dPR[i] = C*(t_rx - t_tx[i]) - gr;
+    u[0] = (x_n - x_sv_eci) / gr;
+    u[1] = (y_n - y_sv_eci) / gr;
+    u[2] = (z_n - z_sv_eci) / gr;
 
-            jac[i][0] = (*x_n - x_sv_eci) / gr;
-            jac[i][1] = (*y_n - y_sv_eci) / gr;
-            jac[i][2] = (*z_n - z_sv_eci) / gr;
-            jac[i][3] = C;
+    return C*dt - gr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Solve a*x = b for symmetric positive definite a (n <= 5) by Cholesky decomposition.
+// a is overwritten.
+
+static bool Cholesky(int n, double a[][5], double *b, double *x) {
+    int i, j, k;
+
+    for (j=0; j<n; j++) {
+        double d = a[j][j];
+        for (k=0; k<j; k++) d -= a[j][k]*a[j][k];
+        if (d <= 0) return false;
+        a[j][j] = sqrt(d);
+        for (i=j+1; i<n; i++) {
+            double s = a[i][j];
+            for (k=0; k<j; k++) s -= a[i][k]*a[j][k];
+            a[i][j] = s / a[j][j];
         }
+    }
 
-        // ma = transpose(H) * W * H
-        for (r=0; r<4; r++)
-            for (c=0; c<4; c++) {
-            ma[r][c] = 0;
-            for (i=0; i<chans; i++) ma[r][c] += jac[i][r]*weight[i]*jac[i][c];
+    for (i=0; i<n; i++) {      // forward: L*y = b
+        double s = b[i];
+        for (k=0; k<i; k++) s -= a[i][k]*x[k];
+        x[i] = s / a[i][i];
+    }
+    for (i=n-1; i>=0; i--) {   // back: L'*x = y
+        double s = x[i];
+        for (k=i+1; k<n; k++) s -= a[k][i]*x[k];
+        x[i] = s / a[i][i];
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Iterated weighted least-squares fix from scratch.
+// Only needed to (re)start the Kalman filter below.
+
+static int SolveLS(int chans, double *x_n, double *y_n, double *z_n, double *t_rx) {
+    int i, j, r, c;
+    double t_pc=0;  // Uncorrected system time when clock replica snapshots taken
+    double t_bias=0;
+
+    *x_n = *y_n = *z_n = 0;
+
+    for (i=0; i<chans; i++)
+        t_pc += t_tx[i];
+
+    // Approximate starting value for receiver clock
+    t_pc = t_pc/chans + 75e-3;
+
+    // Iterate to user xyzt solution using Taylor Series expansion:
+    for(j=0; j<MAX_ITER; j++) {
+        double ma[5][5], mb[5], md[5];
+
+        *t_rx = t_pc - t_bias;
+
+        for (r=0; r<4; r++) {
+            mb[r] = 0;
+            for (c=0; c<4; c++) ma[r][c] = 0;
         }
 
-        double determinant =
-            ma[0][3]*ma[1][2]*ma[2][1]*ma[3][0] - ma[0][2]*ma[1][3]*ma[2][1]*ma[3][0] - ma[0][3]*ma[1][1]*ma[2][2]*ma[3][0] + ma[0][1]*ma[1][3]*ma[2][2]*ma[3][0]+
-            ma[0][2]*ma[1][1]*ma[2][3]*ma[3][0] - ma[0][1]*ma[1][2]*ma[2][3]*ma[3][0] - ma[0][3]*ma[1][2]*ma[2][0]*ma[3][1] + ma[0][2]*ma[1][3]*ma[2][0]*ma[3][1]+
-            ma[0][3]*ma[1][0]*ma[2][2]*ma[3][1] - ma[0][0]*ma[1][3]*ma[2][2]*ma[3][1] - ma[0][2]*ma[1][0]*ma[2][3]*ma[3][1] + ma[0][0]*ma[1][2]*ma[2][3]*ma[3][1]+
-            ma[0][3]*ma[1][1]*ma[2][0]*ma[3][2] - ma[0][1]*ma[1][3]*ma[2][0]*ma[3][2] - ma[0][3]*ma[1][0]*ma[2][1]*ma[3][2] + ma[0][0]*ma[1][3]*ma[2][1]*ma[3][2]+
-            ma[0][1]*ma[1][0]*ma[2][3]*ma[3][2] - ma[0][0]*ma[1][1]*ma[2][3]*ma[3][2] - ma[0][2]*ma[1][1]*ma[2][0]*ma[3][3] + ma[0][1]*ma[1][2]*ma[2][0]*ma[3][3]+
-            ma[0][2]*ma[1][0]*ma[2][1]*ma[3][3] - ma[0][0]*ma[1][2]*ma[2][1]*ma[3][3] - ma[0][1]*ma[1][0]*ma[2][2]*ma[3][3] + ma[0][0]*ma[1][1]*ma[2][2]*ma[3][3];
-
-        // mb = inverse(ma) = inverse(transpose(H)*W*H)
-        mb[0][0] = (ma[1][2]*ma[2][3]*ma[3][1] - ma[1][3]*ma[2][2]*ma[3][1] + ma[1][3]*ma[2][1]*ma[3][2] - ma[1][1]*ma[2][3]*ma[3][2] - ma[1][2]*ma[2][1]*ma[3][3] + ma[1][1]*ma[2][2]*ma[3][3]) / determinant;
-        mb[0][1] = (ma[0][3]*ma[2][2]*ma[3][1] - ma[0][2]*ma[2][3]*ma[3][1] - ma[0][3]*ma[2][1]*ma[3][2] + ma[0][1]*ma[2][3]*ma[3][2] + ma[0][2]*ma[2][1]*ma[3][3] - ma[0][1]*ma[2][2]*ma[3][3]) / determinant;
-        mb[0][2] = (ma[0][2]*ma[1][3]*ma[3][1] - ma[0][3]*ma[1][2]*ma[3][1] + ma[0][3]*ma[1][1]*ma[3][2] - ma[0][1]*ma[1][3]*ma[3][2] - ma[0][2]*ma[1][1]*ma[3][3] + ma[0][1]*ma[1][2]*ma[3][3]) / determinant;
-        mb[0][3] = (ma[0][3]*ma[1][2]*ma[2][1] - ma[0][2]*ma[1][3]*ma[2][1] - ma[0][3]*ma[1][1]*ma[2][2] + ma[0][1]*ma[1][3]*ma[2][2] + ma[0][2]*ma[1][1]*ma[2][3] - ma[0][1]*ma[1][2]*ma[2][3]) / determinant;
-        mb[1][0] = (ma[1][3]*ma[2][2]*ma[3][0] - ma[1][2]*ma[2][3]*ma[3][0] - ma[1][3]*ma[2][0]*ma[3][2] + ma[1][0]*ma[2][3]*ma[3][2] + ma[1][2]*ma[2][0]*ma[3][3] - ma[1][0]*ma[2][2]*ma[3][3]) / determinant;
-        mb[1][1] = (ma[0][2]*ma[2][3]*ma[3][0] - ma[0][3]*ma[2][2]*ma[3][0] + ma[0][3]*ma[2][0]*ma[3][2] - ma[0][0]*ma[2][3]*ma[3][2] - ma[0][2]*ma[2][0]*ma[3][3] + ma[0][0]*ma[2][2]*ma[3][3]) / determinant;
-        mb[1][2] = (ma[0][3]*ma[1][2]*ma[3][0] - ma[0][2]*ma[1][3]*ma[3][0] - ma[0][3]*ma[1][0]*ma[3][2] + ma[0][0]*ma[1][3]*ma[3][2] + ma[0][2]*ma[1][0]*ma[3][3] - ma[0][0]*ma[1][2]*ma[3][3]) / determinant;
-        mb[1][3] = (ma[0][2]*ma[1][3]*ma[2][0] - ma[0][3]*ma[1][2]*ma[2][0] + ma[0][3]*ma[1][0]*ma[2][2] - ma[0][0]*ma[1][3]*ma[2][2] - ma[0][2]*ma[1][0]*ma[2][3] + ma[0][0]*ma[1][2]*ma[2][3]) / determinant;
-        mb[2][0] = (ma[1][1]*ma[2][3]*ma[3][0] - ma[1][3]*ma[2][1]*ma[3][0] + ma[1][3]*ma[2][0]*ma[3][1] - ma[1][0]*ma[2][3]*ma[3][1] - ma[1][1]*ma[2][0]*ma[3][3] + ma[1][0]*ma[2][1]*ma[3][3]) / determinant;
-        mb[2][1] = (ma[0][3]*ma[2][1]*ma[3][0] - ma[0][1]*ma[2][3]*ma[3][0] - ma[0][3]*ma[2][0]*ma[3][1] + ma[0][0]*ma[2][3]*ma[3][1] + ma[0][1]*ma[2][0]*ma[3][3] - ma[0][0]*ma[2][1]*ma[3][3]) / determinant;
-        mb[2][2] = (ma[0][1]*ma[1][3]*ma[3][0] - ma[0][3]*ma[1][1]*ma[3][0] + ma[0][3]*ma[1][0]*ma[3][1] - ma[0][0]*ma[1][3]*ma[3][1] - ma[0][1]*ma[1][0]*ma[3][3] + ma[0][0]*ma[1][1]*ma[3][3]) / determinant;
-        mb[2][3] = (ma[0][3]*ma[1][1]*ma[2][0] - ma[0][1]*ma[1][3]*ma[2][0] - ma[0][3]*ma[1][0]*ma[2][1] + ma[0][0]*ma[1][3]*ma[2][1] + ma[0][1]*ma[1][0]*ma[2][3] - ma[0][0]*ma[1][1]*ma[2][3]) / determinant;
-        mb[3][0] = (ma[1][2]*ma[2][1]*ma[3][0] - ma[1][1]*ma[2][2]*ma[3][0] - ma[1][2]*ma[2][0]*ma[3][1] + ma[1][0]*ma[2][2]*ma[3][1] + ma[1][1]*ma[2][0]*ma[3][2] - ma[1][0]*ma[2][1]*ma[3][2]) / determinant;
-        mb[3][1] = (ma[0][1]*ma[2][2]*ma[3][0] - ma[0][2]*ma[2][1]*ma[3][0] + ma[0][2]*ma[2][0]*ma[3][1] - ma[0][0]*ma[2][2]*ma[3][1] - ma[0][1]*ma[2][0]*ma[3][2] + ma[0][0]*ma[2][1]*ma[3][2]) / determinant;
-        mb[3][2] = (ma[0][2]*ma[1][1]*ma[3][0] - ma[0][1]*ma[1][2]*ma[3][0] - ma[0][2]*ma[1][0]*ma[3][1] + ma[0][0]*ma[1][2]*ma[3][1] + ma[0][1]*ma[1][0]*ma[3][2] - ma[0][0]*ma[1][1]*ma[3][2]) / determinant;
-        mb[3][3] = (ma[0][1]*ma[1][2]*ma[2][0] - ma[0][2]*ma[1][1]*ma[2][0] + ma[0][2]*ma[1][0]*ma[2][1] - ma[0][0]*ma[1][2]*ma[2][1] - ma[0][1]*ma[1][0]*ma[2][2] + ma[0][0]*ma[1][1]*ma[2][2]) / determinant;
-
-        // mc = inverse(transpose(H)*W*H) * transpose(H)
-        for (r=0; r<4; r++)
-            for (c=0; c<chans; c++) {
-            mc[r][c] = 0;
-            for (i=0; i<4; i++) mc[r][c] += mb[r][i]*jac[c][i];
+        // ma = transpose(H) * W * H, mb = transpose(H) * W * dPR
+        for (i=0; i<chans; i++) {
+            double jac[4];
+            double dPR = PseudoRangeError(i, *x_n, *y_n, *z_n, *t_rx, jac);
+            jac[3] = C;
+
+            for (r=0; r<4; r++) {
+                for (c=0; c<4; c++) ma[r][c] += jac[r]*weight[i]*jac[c];
+                mb[r] += jac[r]*weight[i]*dPR;
+            }
         }
 
         // md = inverse(transpose(H)*W*H) * transpose(H) * W * dPR
-        for (r=0; r<4; r++) {
-            md[r] = 0;
-            for (i=0; i<chans; i++) md[r] += mc[r][i]*weight[i]*dPR[i];
-        }
+        if (!Cholesky(4, ma, mb, md)) return MAX_ITER;
 
         double dx = md[0];
         double dy = md[1];
@@ -283,25 +306,172 @@ static int Solve(int chans, double *x_n, double *y_n, double *z_n, double *t_bia
 
         double err_mag = sqrt(dx*dx + dy*dy + dz*dz);
 
-        // printf("%14g%14g%14g%14g%14g\n", err_mag, *t_bias, *x_n, *y_n, *z_n);
+        // printf("%14g%14g%14g%14g%14g\n", err_mag, t_bias, *x_n, *y_n, *z_n);
 
         if (err_mag<1.0) break;
 
-        *x_n    += dx;
-        *y_n    += dy;
-        *z_n    += dz;
-        *t_bias += dt;
+        *x_n   += dx;
+        *y_n   += dy;
+        *z_n   += dz;
+        t_bias += dt;
     }
 
-	if (j != MAX_ITER && t_rx != 0) {
-    	GPSstat(STAT_TIME, t_rx);
-    	clock_correction(t_rx, ticks);
-		//printf("SOLUTION worked %d %.1f\n", j, t_rx);
-	} else {
-		//printf("SOLUTION failed %.1f\n", t_rx);
+    return j;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Position/clock Kalman filter
+//
+// Error-state filter. The nominal solution is the ECEF position, the GPS time at the snapshot
+// (t_rx) and the ADC clock frequency relating snapshot ticks to GPS time. The filter estimates
+// corrections to it with covariance over the state [x y z b d]:
+//      x,y,z   position (m)
+//      b       receiver clock (m, C * seconds)
+//      d       ADC clock frequency error (m/s, C * fractional frequency)
+// Each snapshot is one measurement update (any number of channels, processed sequentially)
+// using the previous solution as the prior, so no iteration or matrix inverse is needed.
+
+#define NX  5
+
+#define KF_Q_POS        1e-2        // (m^2/s) position random walk, antenna is normally fixed
+#define KF_S_F          1e-19       // (s) white frequency noise of ADC clock
+#define KF_S_G          1e-18       // (1/s) random walk frequency noise (XO temperature drift)
+#define KF_PR_SIGMA     10.0        // (m) pseudo range noise at KF_PR_RSSI
+#define KF_PR_RSSI      1000.0
+#define KF_GATE         5.0         // innovation rejection (sigmas)
+#define KF_MAX_GAP      60.0        // (s) restart from least-squares after this long without an update
+#define KF_MAX_REJECTS  3           // restart after this many epochs with all channels rejected
+#define KF_CLK_SIGMA_HZ 2.0         // only steer ADC clock once estimate is this good
+
+struct NAV_KF {
+    bool valid;
+    double x, y, z, t_rx;
+    double adc_clock;               // ticks per GPS second
+    u64_t ticks;                    // ticks at t_rx
+    double P[NX][NX];
+    int rejects;
+};
+
+static NAV_KF kf;
+
+static void KalmanInit(double x, double y, double z, double t_rx) {
+    int r, c;
+
+    // keep frequency estimate from before a restart
+    double ppm = kf.valid? 1 : (clk.adc_clk_corrections? 1 : ADC_CLOCK_PPM_TYP);
+    if (!kf.valid) kf.adc_clock = adc_clock_system();
+
+    kf.valid = true;
+    kf.x = x; kf.y = y; kf.z = z; kf.t_rx = t_rx;
+    kf.ticks = ticks;
+    kf.rejects = 0;
+
+    for (r=0; r<NX; r++)
+        for (c=0; c<NX; c++)
+            kf.P[r][c] = 0;
+    kf.P[0][0] = kf.P[1][1] = kf.P[2][2] = 100*100;
+    kf.P[3][3] = 100*100;
+    kf.P[4][4] = pow(C * ppm * 1e-6, 2);
+}
+
+static bool KalmanUpdate(int chans) {
+    int i, r, c;
+
+    // Predict: snapshot time advances by elapsed ticks at the estimated ADC clock rate.
+    double dt = time_diff48(ticks, kf.ticks) / kf.adc_clock;
+    if (dt <= 0 || dt > KF_MAX_GAP) return false;
+
+    kf.t_rx += dt;
+    if (kf.t_rx >= 604800) kf.t_rx -= 604800;
+    kf.ticks = ticks;
+
+    // P = F*P*F' + Q, F = I except F[3][4] = dt
+    for (r=0; r<NX; r++) kf.P[r][3] += dt * kf.P[r][4];
+    for (c=0; c<NX; c++) kf.P[3][c] += dt * kf.P[4][c];
+
+    double C2 = C*C;
+    for (r=0; r<3; r++) kf.P[r][r] += KF_Q_POS * dt;
+    kf.P[3][3] += C2 * (KF_S_F * dt + KF_S_G * dt*dt*dt / 3);
+    kf.P[3][4] += C2 * KF_S_G * dt*dt / 2;
+    kf.P[4][3] += C2 * KF_S_G * dt*dt / 2;
+    kf.P[4][4] += C2 * KF_S_G * dt;
+
+    // Sequential scalar updates, one per channel.
+    // The error state is applied to the nominal solution after each so the next
+    // channel is linearised about the latest estimate.
+    int used = 0;
+    for (i=0; i<chans; i++) {
+        double u[3], h[NX], ph[NX], k[NX];
+        double y = PseudoRangeError(i, kf.x, kf.y, kf.z, kf.t_rx, u);
+
+        h[0] = u[0]; h[1] = u[1]; h[2] = u[2]; h[3] = -1; h[4] = 0;
+
+        double rssi = sqrt(weight[i]);
+        double sigma = KF_PR_SIGMA * KF_PR_RSSI / MAX(rssi, KF_PR_RSSI/4);
+
+        double s = sigma*sigma;
+        for (r=0; r<NX; r++) {
+            ph[r] = 0;
+            for (c=0; c<NX; c++) ph[r] += kf.P[r][c] * h[c];
+            s += h[r] * ph[r];
+        }
+
+        if (y*y > KF_GATE*KF_GATE * s) continue;     // outlier
+        used++;
+
+        for (r=0; r<NX; r++) k[r] = ph[r] / s;
+
+        // P = (I - K*H) * P, then symmetrise
+        for (r=0; r<NX; r++)
+            for (c=0; c<NX; c++)
+                kf.P[r][c] -= k[r] * ph[c];
+        for (r=0; r<NX; r++)
+            for (c=0; c<r; c++)
+                kf.P[r][c] = kf.P[c][r] = (kf.P[r][c] + kf.P[c][r]) / 2;
+
+        kf.x += k[0] * y;
+        kf.y += k[1] * y;
+        kf.z += k[2] * y;
+        kf.t_rx += k[3] * y / C;
+
+        // d > 0: more GPS time elapsed than the ticks suggested, i.e. clock slower than assumed
+        kf.adc_clock /= 1 + k[4] * y / C;
+    }
+
+    if (used == 0) {
+        if (++kf.rejects >= KF_MAX_REJECTS) return false;
+    } else
+        kf.rejects = 0;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool Solve(int chans, double *x_n, double *y_n, double *z_n, double *t_rx) {
+
+    if (!LoadMeasurements(chans)) return false;
+
+    if (!kf.valid || !KalmanUpdate(chans)) {
+        if (chans < 4) { kf.valid = false; return false; }
+        if (SolveLS(chans, x_n, y_n, z_n, t_rx) == MAX_ITER) return false;
+        KalmanInit(*x_n, *y_n, *z_n, *t_rx);
+    }
+
+    *x_n = kf.x; *y_n = kf.y; *z_n = kf.z;
+    *t_rx = kf.t_rx;
+
+	if (*t_rx != 0) {
+    	GPSstat(STAT_TIME, *t_rx);
+    	
+    	// ADC clock: the filter's estimate is already smoothed
+    	double clk_sigma = sqrt(kf.P[4][4]) / C * kf.adc_clock;
+    	if (clk_sigma < KF_CLK_SIGMA_HZ)
+    	    clock_correction(*t_rx, ticks, kf.adc_clock);
+		//printf("SOLUTION worked %.1f clk %.3f +/- %.3f\n", *t_rx, kf.adc_clock, clk_sigma);
 	}
 	
-    return j;
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -331,25 +501,30 @@ static void LatLonAlt(
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 void SolveTask(void *param) {
-    double x, y, z, t_b, lat, lon, alt;
+    double x, y, z, t_rx, lat, lon, alt;
     
     for (;;) {
 		TaskSleepMsec(4000);
         int good = LoadReplicas();
         gps.good = good;
         bool enable = SearchTaskRun();
-        if (!enable || good < 4) continue;
         
-        int iter = Solve(good, &x, &y, &z, &t_b);
+        // once the filter is running even a single SV keeps the clock estimate going
+        if (!enable || good < (kf.valid? 1:4)) continue;
+        
+        bool ok = Solve(good, &x, &y, &z, &t_rx);
         TaskStat(TSTAT_INCR|TSTAT_ZERO, 0, 0, 0);
-        if (iter == MAX_ITER) continue;
+        if (!ok || good < 4) continue;
         
         LatLonAlt(x, y, z, lat, lon, alt);
 
-        if (alt > 9000 || alt < -100)
+        if (alt > 9000 || alt < -100) {
+        	kf.valid = false;
         	continue;
+        }
 
         gps.fixes++;
+        WarmFix(x, y, z, t_rx);
         GPSstat(STAT_LAT, lat*180/PI);
         GPSstat(STAT_LON, lon*180/PI);
         GPSstat(STAT_ALT, alt);
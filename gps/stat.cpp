@@ -129,6 +129,20 @@ void GPSstat(STAT st, double d, int i, int j, int k, int m, double d2) {
 			}
             break;
             
+        case STAT_ACQ: {
+			// i = snapshots integrated, j = detected
+			unsigned minute = (timer_ms() - gps.start)/60000 + 1;	// 0 = entry unused
+			gps_stats_t::gps_acq_t *a = &gps.acq[minute % ACQ_HIST];
+			if (a->minute != minute) {
+				a->minute = minute;
+				a->tries = a->hits = a->nc_sum = 0;
+			}
+			a->tries++;
+			if (j) a->hits++;
+			a->nc_sum += i;
+            break;
+        }
+
         case STAT_NOVFL:
 			if (i < 0 || i >= GPS_CHANS) return;
 			c = &gps.ch[i];
@@ -344,6 +358,19 @@ void StatTask(void *param) {
 			adc_clock_system()/1e6, (offset >= 0)? "+":"", offset, clk.adc_clk_corrections, gps.acquiring);
 			printf("\n");
 
+		// acquisition probability, most recent minute first
+		unsigned minute = (timer_ms() - gps.start)/60000 + 1;
+		printf("  NC: %d  Pd:", gps.acq_nc);
+		for (i=0; i<ACQ_HIST; i++, minute--) {
+			gps_stats_t::gps_acq_t *a = &gps.acq[minute % ACQ_HIST];
+			if (a->minute == minute && a->tries)
+				printf(" %3d%%/%.1f", a->hits*100/a->tries, (float) a->nc_sum/a->tries);
+			else
+				printf("     -    ");
+			if (minute == 1) break;
+		}
+		printf("\n");
+
 		printf("\n");
 
 		NextTask("stat2");		
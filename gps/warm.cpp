@@ -0,0 +1,218 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+// GPS warm start
+//
+// The last fix position, its GPS time and the ephemerides in use are saved to disk.
+// On restart these predict which SVs are above the horizon and their Doppler so the
+// search task can look for them first over a narrow Doppler window instead of
+// cycling through all 32 SVs with the full +/- 5 kHz search.
+
+#include "types.h"
+#include "kiwi.h"
+#include "gps.h"
+#include "ephemeris.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#define WARM_FN				DIR_CFG "/gps.warm.bin"
+#define WARM_MAGIC			0x4b47574d		// "KGWM"
+#define WARM_VERSION		1
+
+#define	WARM_SAVE_SECS		(30*60)			// limit SD card writes
+#define WARM_EPH_PRELOAD	(2*60*60)		// ephemeris fresh enough to use for fixes
+#define WARM_EPH_PREDICT	(24*60*60)		// ephemeris good enough to predict visibility and Doppler
+#define WARM_ELEV_MASK		5.0				// degrees
+#define	WARM_BIAS_AVG		0.25			// oscillator offset averaging
+
+#define SECS_PER_WEEK		604800
+
+struct WARM_FILE {
+	u4_t magic, version, eph_size;
+	double x, y, z;					// ECEF position of last fix
+	double tow;						// GPS time-of-week of last fix
+	time_t utc;						// system time of last fix
+	float dop_bias;					// front-end oscillator offset (FFT bins)
+	int bias_n;						// number of acquisitions contributing to dop_bias
+	time_t eph_utc[NUM_SATS];		// system time ephemeris was last valid, 0 = none
+	EPHEM eph[NUM_SATS];
+};
+
+static WARM_FILE warm;
+static bool have_pos;
+static time_t last_save;
+
+static void WarmSave() {
+	FILE *fp;
+	const char *tmp = WARM_FN ".tmp";
+
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		lprintf("GPS: warm start save failed: %s\n", tmp);
+		return;
+	}
+
+	bool ok = (fwrite(&warm, sizeof(warm), 1, fp) == 1);
+	ok = (fclose(fp) == 0) && ok;
+	if (ok) ok = (rename(tmp, WARM_FN) == 0);
+	if (!ok) {
+		lprintf("GPS: warm start save failed: %s\n", WARM_FN);
+		unlink(tmp);
+	}
+}
+
+void WarmInit() {
+	FILE *fp;
+
+	warm.magic = WARM_MAGIC;
+	warm.version = WARM_VERSION;
+	warm.eph_size = sizeof(EPHEM);
+
+	if ((fp = fopen(WARM_FN, "r")) == NULL)
+		return;
+
+	WARM_FILE w;
+	size_t n = fread(&w, sizeof(w), 1, fp);
+	fclose(fp);
+
+	if (n != 1 || w.magic != WARM_MAGIC || w.version != WARM_VERSION || w.eph_size != sizeof(EPHEM)) {
+		lprintf("GPS: warm start file %s ignored (bad format)\n", WARM_FN);
+		return;
+	}
+
+	warm = w;
+	have_pos = true;
+
+	// System time may not be set yet (no RTC on the Beagle), so only preload
+	// ephemerides into the solver if it is plausible.
+	time_t now = time(NULL);
+	int preloaded = 0;
+
+	for (int sv=0; sv<NUM_SATS; sv++) {
+		time_t age = now - warm.eph_utc[sv];
+		if (!warm.eph_utc[sv] || age < 0 || age > WARM_EPH_PRELOAD) continue;
+		memcpy(Ephemeris+sv, warm.eph+sv, sizeof(EPHEM));
+		preloaded++;
+	}
+
+	lprintf("GPS: warm start from %s, fix %.0f min ago, %d ephemerides preloaded, bias %.1f bins\n",
+		WARM_FN, (now - warm.utc) / 60.0, preloaded, warm.dop_bias);
+}
+
+void WarmFix(double x, double y, double z, double tow) {
+	time_t now = time(NULL);
+
+	warm.x = x; warm.y = y; warm.z = z;
+	warm.tow = tow;
+	warm.utc = now;
+
+	for (int sv=0; sv<NUM_SATS; sv++) {
+		if (!Ephemeris[sv].Valid()) continue;
+		memcpy(warm.eph+sv, Ephemeris+sv, sizeof(EPHEM));
+		warm.eph_utc[sv] = now;
+	}
+
+	if (!have_pos || (now - last_save) >= WARM_SAVE_SECS) {
+		WarmSave();
+		last_save = now;
+	}
+
+	have_pos = true;
+}
+
+void WarmAcquired(int sv, int lo_shift, WARM_PRED *p) {
+	if (!p->valid || !p->predicted[sv]) return;
+
+	// Difference between observed and predicted Doppler is the front-end oscillator offset
+	// (common to all SVs) plus prediction error. Average it to centre future searches.
+	float bias = lo_shift - p->dop_raw[sv];
+	if (warm.bias_n == 0)
+		warm.dop_bias = bias;
+	else
+		warm.dop_bias += WARM_BIAS_AVG * (bias - warm.dop_bias);
+	warm.bias_n++;
+}
+
+bool WarmPredict(WARM_PRED *p) {
+	int sv, i;
+	double elev[NUM_SATS];
+
+	memset(p, 0, sizeof(*p));
+	if (!have_pos) return false;
+
+	time_t now = time(NULL);
+	time_t dt = now - warm.utc;
+	if (dt < 0) return false;	// system time not set yet
+
+	double t = fmod(warm.tow + dt, SECS_PER_WEEK);
+	double r = sqrt(warm.x*warm.x + warm.y*warm.y + warm.z*warm.z);
+	if (r == 0) return false;
+
+	for (sv=0; sv<NUM_SATS; sv++) {
+		EPHEM *e;
+		time_t age = now - warm.eph_utc[sv];
+
+		if (Ephemeris[sv].Valid())
+			e = Ephemeris+sv;
+		else
+		if (warm.eph_utc[sv] && age >= 0 && age <= WARM_EPH_PREDICT)
+			e = warm.eph+sv;
+		else
+			continue;	// no orbit knowledge: must be searched cold
+
+		double x0, y0, z0, x1, y1, z1;
+		e->GetXYZ(&x0, &y0, &z0, t);
+		e->GetXYZ(&x1, &y1, &z1, t+1);
+		NextTask("warm predict");
+
+		double dx = x0 - warm.x, dy = y0 - warm.y, dz = z0 - warm.z;
+		double range = sqrt(dx*dx + dy*dy + dz*dz);
+
+		// geocentric "up" is close enough for a visibility mask
+		elev[sv] = asin((dx*warm.x + dy*warm.y + dz*warm.z) / (range*r)) * 180/PI;
+		p->known[sv] = true;
+		if (elev[sv] < WARM_ELEV_MASK) continue;
+
+		// SV velocity (ECEF, receiver is stationary) projected onto line-of-sight
+		double range_rate = ((x1-x0)*dx + (y1-y0)*dy + (z1-z0)*dz) / range;
+		double dop_hz = -range_rate * L1/C;
+
+		p->predicted[sv] = true;
+		p->dop_raw[sv] = dop_hz/BIN_SIZE;
+		p->dop[sv] = nearbyint(p->dop_raw[sv] + warm.dop_bias);
+		p->sv[p->visible++] = sv;
+	}
+
+	// search highest elevation first
+	for (i=1; i<p->visible; i++) {
+		int s = p->sv[i], j;
+		for (j=i; j>0 && elev[p->sv[j-1]] < elev[s]; j--)
+			p->sv[j] = p->sv[j-1];
+		p->sv[j] = s;
+	}
+
+	// narrow the window once the oscillator offset has been learned
+	p->dop_win = warm.bias_n? WARM_DOP_WIN : WARM_DOP_WIN_NO_BIAS;
+	p->valid = (p->visible != 0);
+	return p->valid;
+}
@@ -81,15 +81,21 @@ struct snd_t {
 
 extern snd_t snd_inst[RX_CHANS];
 
+// audio output rate a client can ask for with "SET out_rate=" (resampled by the server)
+#define SND_OUT_RATE_MIN	4000
+#define SND_OUT_RATE_MAX	48000
+#define SND_OUT_MAX_RATIO	((SND_OUT_RATE_MAX + SND_RATE-1) / SND_RATE)
+#define SND_OUT_MAX_BLK		(FASTFIR_OUTBUF_SIZE * SND_OUT_MAX_RATIO + 2)		// samples out for one FIR block in
+
 struct snd_pkt_t {
 	struct {
 		char id[4];
 		u4_t seq;           // waterfall syncs to this sequence number on the client-side
-		char smeter[2];
+		char smeter[2];     // SND_FLAG_* in upper bits; SND_FLAG_DECIM: first data byte is decimation
 	} __attribute__((packed)) h;
 	union {
-        u1_t buf_iq[FASTFIR_OUTBUF_SIZE * 2 * sizeof(u2_t)];
-        u1_t buf_real[FASTFIR_OUTBUF_SIZE * sizeof(u2_t)];
+        u1_t buf_iq[SND_OUT_MAX_BLK * 2 * sizeof(u2_t)];
+        u1_t buf_real[SND_OUT_MAX_BLK * sizeof(u2_t)];
     };
 } __attribute__((packed));
 
@@ -116,13 +122,20 @@ void dump();
 
 enum websocket_mode_e { WS_MODE_ALLOC, WS_MODE_LOOKUP, WS_MODE_CLOSE };
 conn_t *rx_server_websocket(struct mg_connection *mc, websocket_mode_e);
+conn_t *rx_server_internal(const char *name);
+void rx_server_internal_cmd(conn_t *c, const char *fmt, ...);
 
 void c2s_sound_init();
 void c2s_sound_setup(void *param);
 void c2s_sound(void *param);
 
 void c2s_waterfall_init();
-void c2s_waterfall_compression(int rx_chan, bool compression);
+// waterfall compression, "SET wf_comp="
+#define	WF_COMP_NONE	0
+#define	WF_COMP_ADPCM	1		// each line independently, the default
+#define	WF_COMP_DELTA	2		// each line relative to the previous one, see rx_waterfall.cpp
+
+void c2s_waterfall_compression(int rx_chan, int compression);
 void c2s_waterfall_setup(void *param);
 void c2s_waterfall(void *param);
 
@@ -2750,9 +2750,14 @@ static const char *suggest_connection_header(const struct mg_connection *conn) {
   return should_keep_alive(conn) ? "keep-alive" : "close";
 }
 
-static void construct_etag(char *buf, size_t buf_len, const file_stat_t *st) {
-  mg_snprintf(buf, buf_len, "\"%lx.%" INT64_FMT "\"",
-              (unsigned long) st->st_mtime, (int64_t) st->st_size);
+static void construct_etag(char *buf, size_t buf_len, const file_stat_t *st,
+                           unsigned int hash) {
+  if (hash)
+    mg_snprintf(buf, buf_len, "\"%lx.%" INT64_FMT ".%08x\"",
+                (unsigned long) st->st_mtime, (int64_t) st->st_size, hash);
+  else
+    mg_snprintf(buf, buf_len, "\"%lx.%" INT64_FMT "\"",
+                (unsigned long) st->st_mtime, (int64_t) st->st_size);
 }
 
 // Return True if we should reply 304 Not Modified.
@@ -2762,7 +2767,7 @@ static int is_not_modified(struct connection *conn,
   char etag[64];
   const char *ims = mg_get_header(mc, "If-Modified-Since");
   const char *inm = mg_get_header(mc, "If-None-Match");
-  construct_etag(etag, sizeof(etag), stp);
+  construct_etag(etag, sizeof(etag), stp, mc->cache_info.etag_hash);
 
   mc->cache_info.if_none_match = (inm != NULL);
   if (inm != NULL) {
@@ -2780,8 +2785,10 @@ static int is_not_modified(struct connection *conn,
   }
   
   // spec says If-Modified-Since ignored if If-None-Match present
-  return (mc->cache_info.if_none_match && mc->cache_info.etag_match) ||
-  		 (mc->cache_info.if_mod_since && mc->cache_info.not_mod_since);
+  // (otherwise content changed without an mtime change, e.g. %[] substitution, gets a stale 304)
+  if (mc->cache_info.if_none_match)
+    return mc->cache_info.etag_match;
+  return (mc->cache_info.if_mod_since && mc->cache_info.not_mod_since);
 }
 
 // For given directory path, substitute it to valid index file.
@@ -2893,7 +2900,7 @@ void mg_send_standard_headers(struct mg_connection *mc, const char *path, file_s
   // http://www.w3.org/Protocols/rfc2616/rfc2616-sec3.html#sec3.3
   gmt_time_string(date, sizeof(date), &curtime);
   gmt_time_string(lm, sizeof(lm), &st->st_mtime);
-  construct_etag(etag, sizeof(etag), st);
+  construct_etag(etag, sizeof(etag), st, mc->cache_info.etag_hash);
 
   n = mg_snprintf(headers, sizeof(headers),
                   "HTTP/1.1 %d %s\r\n"
@@ -2925,6 +2932,7 @@ static void call_request_handler_if_data_is_buffered(struct connection *conn) {
   if ((size_t) loc->len >= mc->content_len) {
   
   	// if e.g. in-memory filesystem, first get cache info so caching status can be determined
+  	mc->cache_info.etag_hash = 0;
   	if (call_request_handler(conn, MG_CACHE_INFO) == MG_TRUE) {
 		// if MG_TRUE handler has set mc->st
 		mc->cache_info.cached = is_not_modified(conn, &mc->cache_info.st);
@@ -64,6 +64,7 @@ struct mg_connection {
       bool not_mod_since;
     bool if_none_match;
       bool etag_match;
+    unsigned int etag_hash;   // if non-zero appended to etag (e.g. hash of substituted content)
   } cache_info;
 
   void *connection_param;     // Placeholder for connection-specific data
@@ -120,6 +120,27 @@ void spi_init()
 
 u4_t spi_retry;
 
+// Record the command stream in the trace format of the eCPU simulator (e_cpu/sim)
+// so firmware changes can be profiled against a real workload.
+//#define SPI_CMD_TRACE
+#ifdef SPI_CMD_TRACE
+#include "timer.h"
+
+#define SPI_CMD_TRACE_FN	"/tmp/spi_cmd.trace"
+
+static void spi_cmd_trace(spi_mosi_data_t *d)
+{
+	static FILE *fp;
+	static u64_t last;
+
+	if (fp == NULL && (fp = fopen(SPI_CMD_TRACE_FN, "w")) == NULL) return;
+	u64_t now = timer_us64();
+	fprintf(fp, "+%llu %s %d %u\n", last? now - last : 0, cmds[d->cmd], d->wparam,
+		d->lparam_lo | ((u4_t) d->lparam_hi << 16));
+	last = now;
+}
+#endif
+
 static void spi_scan(SPI_MOSI *mosi, SPI_MISO *miso=&junk, int rbytes=0) {
 	int i;
 	
@@ -139,6 +160,10 @@ static void spi_scan(SPI_MOSI *mosi, SPI_MISO *miso=&junk, int rbytes=0) {
 	if (mosi->data.cmd != CmdFlush) { ecpu_cmds++; TaskStat(TSTAT_CMDS, 0, 0, 0); }
 	ecpu_tcmds++;
 	
+	#ifdef SPI_CMD_TRACE
+		spi_cmd_trace(&mosi->data);
+	#endif
+	
 	evSpiCmd(EC_EVENT, EV_SPILOOP, -1, "spi_scan", evprintf("ENTER %s(%d) mosi %p:%dx miso %p%s:%dB prev %p%s:%dx",
 		cmds[mosi->data.cmd], mosi->data.cmd, mosi, tx_xfers,
 		miso, (miso == &junk)? " (&junk)":"", rbytes,
@@ -66,6 +66,7 @@ enum SPI_CMD { // Embedded CPU commands, order must match 'Commands:' table in .
     CmdGetChan,
     CmdGetClocks,
     CmdGetGlitches,
+    CmdSampleTS,
     
     CmdCheckLast
 };
@@ -111,6 +112,7 @@ static const char *cmds[] = {
     "CmdGetChan",
     "CmdGetClocks",
     "CmdGetGlitches",
+    "CmdSampleTS",
 };
 
 #define DMA_ALIGNMENT __attribute__ ((aligned(256)))
@@ -72,6 +72,41 @@ CAgc m_Agc[RX_CHANS];
 								//corresponding to -160dB.
 								//K = 10^( -8 + log(32767) )
 
+//log10 and 10^x are table driven with a maximum error of about 0.005dB
+#define LOG_BITS 10				//float mantissa bits used to index log table
+#define EXP_BITS 10				//fractional exponent bits used to index 2^x table
+
+static TYPEREAL log2_tab[1<<LOG_BITS];
+static TYPEREAL exp2_tab[1<<EXP_BITS];
+static bool agc_tables_init;
+
+static void AgcTablesInit()
+{
+	if (agc_tables_init) return;
+	for(int i=0; i<(1<<LOG_BITS); i++)		//log2 of mantissa at middle of each bin
+		log2_tab[i] = MLOG(1.0 + (i+0.5)/(1<<LOG_BITS)) / MLOG(2.0);
+	for(int i=0; i<(1<<EXP_BITS); i++)
+		exp2_tab[i] = MPOW(2.0, (TYPEREAL)i/(1<<EXP_BITS));
+	agc_tables_init = true;
+}
+
+static inline TYPEREAL FastLog10(float x)	//x > 0
+{
+	union { float f; u4_t u; } v;
+	v.f = x;
+	int e = (int)((v.u >> 23) & 0xff) - 127;
+	return (e + log2_tab[(v.u >> (23-LOG_BITS)) & ((1<<LOG_BITS)-1)]) * 0.30102999566;
+}
+
+static inline TYPEREAL FastPow10(TYPEREAL x)
+{
+	TYPEREAL y = x * 3.32192809489;		//log2(10)
+	TYPEREAL n = floor(y);
+	int idx = (int)((y - n) * (1<<EXP_BITS) + 0.5);
+	if (idx == (1<<EXP_BITS)) { idx = 0; n++; }
+	return ldexp(exp2_tab[idx], (int) n);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -111,6 +146,7 @@ void CAgc::SetParameters(bool AgcOn,  bool UseHang, int Threshold, int ManualGai
 		return;		//just return if no parameter changed
 	}
 	//m_Mutex.lock();
+	AgcTablesInit();
 	m_AgcOn = AgcOn;
 	m_UseHang = UseHang;
 	m_Threshold = Threshold;
@@ -124,14 +160,15 @@ void CAgc::SetParameters(bool AgcOn,  bool UseHang, int Threshold, int ManualGai
 		{
 			m_SigDelayBuf[i].re = 0.0;
 			m_SigDelayBuf[i].im = 0.0;
-			m_MagBuf[i] = -16.0;
 		}
 		m_SigDelayPtr = 0;
 		m_HangTimer = 0;
 		m_Peak = -16.0;
 		m_DecayAve = -5.0;
 		m_AttackAve = -5.0;
-		m_MagBufPos = 0;
+		m_PeakHead = m_PeakCount = 0;
+		m_SampleNum = 0;
+		m_Gain = 0;
 	}
 
 	//convert m_ThreshGain to linear manual gain value
@@ -158,117 +195,130 @@ void CAgc::SetParameters(bool AgcOn,  bool UseHang, int Threshold, int ManualGai
 	m_DelaySamples = (int)(m_SampleRate*DELAY_TIMECONST);
 	m_WindowSamples = (int)(m_SampleRate*WINDOW_TIMECONST);
 
-	//clamp Delay samples within buffer limit
+	//clamp Delay and window samples within buffer limit
 	if(m_DelaySamples >= MAX_DELAY_BUF-1)
 		m_DelaySamples = MAX_DELAY_BUF-1;
+	if(m_WindowSamples > MAX_DELAY_BUF)
+		m_WindowSamples = MAX_DELAY_BUF;
 
 	//m_Mutex.unlock();
 }
 
 //////////////////////////////////////////////////////////////////////
-// Automatic Gain Control calculator for COMPLEX data
+// Runs the AGC detector over up to AGC_BLK input samples.
+// Leaves the delayed input signal in m_DelayedBlk[] and the gain to apply to it in m_GainBlk[].
 //////////////////////////////////////////////////////////////////////
-void CAgc::ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData)
+void CAgc::ProcessBlock(int Length, TYPECPX* pInData)
 {
-	TYPEREAL gain;
 	TYPEREAL mag;
-	TYPECPX delayedin;
-	//m_Mutex.lock();
-	if(m_AgcOn)
+	int i, j;
+
+	for(i=0; i<Length; i++)
 	{
-		for(int i=0; i<Length; i++)
+		TYPECPX in = pInData[i];	//get latest input sample
+		//Get delayed sample of input signal
+		m_DelayedBlk[i] = m_SigDelayBuf[m_SigDelayPtr];
+		//put new input sample into signal delay buffer
+		m_SigDelayBuf[m_SigDelayPtr++] = in;
+		if( m_SigDelayPtr >= m_DelaySamples)	//deal with delay buffer wrap around
+			m_SigDelayPtr = 0;
+
+		mag = MFABS(in.re);
+		TYPEREAL mim = MFABS(in.im);
+		if(mim>mag)
+			mag = mim;
+		mag = FastLog10( mag + MIN_CONSTANT ) - MLOG10(MAX_AMPLITUDE);		//0==max  -8 is min==-160dB
+
+		//peak value within a sliding window of 'm_WindowSamples' magnitudes:
+		//expire the oldest, then drop samples from the back that can never be the peak again.
+		//Expiring first keeps at most m_WindowSamples-1 entries before the push.
+		u4_t t = m_SampleNum++;
+		if(m_PeakCount && (u4_t)(t - m_PeakTime[m_PeakHead]) >= (u4_t) m_WindowSamples)
 		{
-			TYPECPX in = pInData[i];	//get latest input sample
-			//Get delayed sample of input signal
-			delayedin = m_SigDelayBuf[m_SigDelayPtr];
-			//put new input sample into signal delay buffer
-			m_SigDelayBuf[m_SigDelayPtr++] = in;
-			if( m_SigDelayPtr >= m_DelaySamples)	//deal with delay buffer wrap around
-				m_SigDelayPtr = 0;
-
-#if 1
-			mag = MFABS(in.re);
-			TYPEREAL mim = MFABS(in.im);
-			if(mim>mag)
-				mag = mim;
-			mag = MLOG10( mag + MIN_CONSTANT ) - MLOG10(MAX_AMPLITUDE);		//0==max  -8 is min==-160dB
-#else
-			mag = in.re*in.re+in.im*in.im;
-			//mag is power so 0.5 factor takes square root of power
-			mag = 0.5* MLOG10( mag/(MAX_AMPLITUDE*MAX_AMPLITUDE) + 1e-16);	//clamped to -160dBfs
-#endif
-
-			//create a sliding window of 'm_WindowSamples' magnitudes and output the peak value within the sliding window
-			TYPEREAL tmp = m_MagBuf[m_MagBufPos];	//get oldest mag sample from buffer into tmp
-			m_MagBuf[m_MagBufPos++] = mag;			//put latest mag sample in buffer;
-			if( m_MagBufPos >= m_WindowSamples)		//deal with magnitude buffer wrap around
-				m_MagBufPos = 0;
-			if(mag > m_Peak)
+			m_PeakHead = (m_PeakHead + 1) % MAX_DELAY_BUF;
+			m_PeakCount--;
+		}
+		while(m_PeakCount && m_PeakMag[(m_PeakHead + m_PeakCount - 1) % MAX_DELAY_BUF] <= mag)
+			m_PeakCount--;
+		j = (m_PeakHead + m_PeakCount++) % MAX_DELAY_BUF;
+		m_PeakMag[j] = mag;
+		m_PeakTime[j] = t;
+		m_Peak = m_PeakMag[m_PeakHead];
+
+		//averagers written as ave += alpha*(peak - ave) with the rise or fall alpha selected
+		//so the compiler can avoid data dependent branches
+		//attack averager has separate rise and fall time constants
+		TYPEREAL alpha = (m_Peak>m_AttackAve)? m_AttackRiseAlpha : m_AttackFallAlpha;
+		m_AttackAve += alpha*(m_Peak - m_AttackAve);
+
+		if(m_UseHang)
+		{	//using hang timer mode
+			if(m_Peak>m_DecayAve)	//if magnitude is rising (use m_DecayRiseAlpha time constant)
 			{
-				m_Peak = mag;	//if new sample is larger than current peak then use it, no need to look at buffer values
+				m_DecayAve += m_DecayRiseAlpha*(m_Peak - m_DecayAve);
+				m_HangTimer = 0;	//reset hang timer
 			}
 			else
-			{
-				if(tmp == m_Peak)		//tmp is oldest sample pulled out of buffer
-				{	//if oldest sample pulled out was last peak then need to find next highest peak in buffer
-					m_Peak = -8.0;		//set to lowest value to find next max peak
-					//search all buffer for maximum value and set as new peak
-					for(int i=0; i<m_WindowSamples; i++)
-					{
-						tmp = m_MagBuf[i];
-						if(tmp > m_Peak)
-							m_Peak = tmp;
-					}
-				}
+			{	//here if decreasing signal
+				if(m_HangTimer<m_HangTime)
+					m_HangTimer++;	//just inc and hold current m_DecayAve
+				else	//else decay with m_DecayFallAlpha which is RELEASE_TIMECONST
+					m_DecayAve += m_DecayFallAlpha*(m_Peak - m_DecayAve);
 			}
+		}
+		else
+		{	//using exponential decay mode, decay averager also has separate rise and fall time constants
+			alpha = (m_Peak>m_DecayAve)? m_DecayRiseAlpha : m_DecayFallAlpha;
+			m_DecayAve += alpha*(m_Peak - m_DecayAve);
+		}
 
+		//gain only computed at the end of each interpolation interval (or block)
+		if(((m_SampleNum % AGC_GAIN_INTERP) != 0) && (i != Length-1))
+			continue;
+
+		//use greater magnitude of attack or Decay Averager
+		if(m_AttackAve>m_DecayAve)
+			mag = m_AttackAve;
+		else
+			mag = m_DecayAve;
+
+		//calc gain depending on which side of knee the magnitude is on
+		TYPEREAL gain;
+		if(mag<=m_Knee)		//use fixed gain if below knee
+			gain = m_FixedGain;
+		else				//use variable gain if above knee
+			gain = AGC_OUTSCALE * FastPow10( mag*(m_GainSlope - 1.0) );
+		if(m_Gain == 0)
+			m_Gain = gain;
+
+		//linear ramp from previous gain across the samples since
+		int n = (m_SampleNum-1) % AGC_GAIN_INTERP + 1;
+		if(n > i+1) n = i+1;
+		TYPEREAL step = (gain - m_Gain) / n;
+		for(j=0; j<n; j++)
+			m_GainBlk[i-n+1+j] = m_Gain + step*(j+1);
+		m_Gain = gain;
+	}
+}
 
-			if(m_UseHang)
-			{	//using hang timer mode
-				if(m_Peak>m_AttackAve)	//if power is rising (use m_AttackRiseAlpha time constant)
-					m_AttackAve = (1.0-m_AttackRiseAlpha)*m_AttackAve + m_AttackRiseAlpha*m_Peak;
-				else					//else magnitude is falling (use  m_AttackFallAlpha time constant)
-					m_AttackAve = (1.0-m_AttackFallAlpha)*m_AttackAve + m_AttackFallAlpha*m_Peak;
-
-				if(m_Peak>m_DecayAve)	//if magnitude is rising (use m_DecayRiseAlpha time constant)
-				{
-					m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*m_Peak;
-					m_HangTimer = 0;	//reset hang timer
-				}
-				else
-				{	//here if decreasing signal
-					if(m_HangTimer<m_HangTime)
-						m_HangTimer++;	//just inc and hold current m_DecayAve
-					else	//else decay with m_DecayFallAlpha which is RELEASE_TIMECONST
-						m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*m_Peak;
-				}
-			}
-			else
-			{	//using exponential decay mode
-				// perform average of magnitude using 2 averagers each with separate rise and fall time constants
-				if(m_Peak>m_AttackAve)	//if magnitude is rising (use m_AttackRiseAlpha time constant)
-					m_AttackAve = (1.0-m_AttackRiseAlpha)*m_AttackAve + m_AttackRiseAlpha*m_Peak;
-				else					//else magnitude is falling (use  m_AttackFallAlpha time constant)
-					m_AttackAve = (1.0-m_AttackFallAlpha)*m_AttackAve + m_AttackFallAlpha*m_Peak;
-
-				if(m_Peak>m_DecayAve)	//if magnitude is rising (use m_DecayRiseAlpha time constant)
-					m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*(m_Peak);
-				else					//else magnitude is falling (use m_DecayFallAlpha time constant)
-					m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*(m_Peak);
+//////////////////////////////////////////////////////////////////////
+// Automatic Gain Control calculator for COMPLEX data
+//////////////////////////////////////////////////////////////////////
+void CAgc::ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData)
+{
+	//m_Mutex.lock();
+	if(m_AgcOn)
+	{
+		for(int blk=0; blk<Length; blk+=AGC_BLK)
+		{
+			int n = MIN(AGC_BLK, Length-blk);
+			ProcessBlock(n, pInData+blk);
+			TYPECPX *out = pOutData+blk;
+			for(int i=0; i<n; i++)
+			{
+				out[i].re = m_DelayedBlk[i].re * m_GainBlk[i];
+				out[i].im = m_DelayedBlk[i].im * m_GainBlk[i];
 			}
-			//use greater magnitude of attack or Decay Averager
-			if(m_AttackAve>m_DecayAve)
-				mag = m_AttackAve;
-			else
-				mag = m_DecayAve;
-
-			//calc gain depending on which side of knee the magnitude is on
-			if(mag<=m_Knee)		//use fixed gain if below knee
-				gain = m_FixedGain;
-			else				//use variable gain if above knee
-				gain = AGC_OUTSCALE * MPOW(10.0, mag*(m_GainSlope - 1.0) );
-			pOutData[i].re = delayedin.re * gain;
-			pOutData[i].im = delayedin.im * gain;
 		}
 	}
 	else
@@ -287,104 +337,16 @@ void CAgc::ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData)
 //////////////////////////////////////////////////////////////////////
 void CAgc::ProcessData(int Length, TYPECPX* pInData, TYPEMONO16* pOutData)
 {
-	TYPEREAL gain;
-	TYPEREAL mag;
-	TYPECPX delayedin;
 	//m_Mutex.lock();
 	if(m_AgcOn)
 	{
-		for(int i=0; i<Length; i++)
+		for(int blk=0; blk<Length; blk+=AGC_BLK)
 		{
-			TYPECPX in = pInData[i];	//get latest input sample
-			//Get delayed sample of input signal
-			delayedin = m_SigDelayBuf[m_SigDelayPtr];
-			//put new input sample into signal delay buffer
-			m_SigDelayBuf[m_SigDelayPtr++] = in;
-			if( m_SigDelayPtr >= m_DelaySamples)	//deal with delay buffer wrap around
-				m_SigDelayPtr = 0;
-
-#if 1
-			mag = MFABS(in.re);
-			TYPEREAL mim = MFABS(in.im);
-			if(mim>mag)
-				mag = mim;
-			mag = MLOG10( mag + MIN_CONSTANT ) - MLOG10(MAX_AMPLITUDE);		//0==max  -8 is min==-160dB
-#else
-			mag = in.re*in.re+in.im*in.im;
-			//mag is power so 0.5 factor takes square root of power
-			mag = 0.5* MLOG10( mag/(MAX_AMPLITUDE*MAX_AMPLITUDE) + 1e-16);	//clamped to -160dBfs
-#endif
-
-			//create a sliding window of 'm_WindowSamples' magnitudes and output the peak value within the sliding window
-			TYPEREAL tmp = m_MagBuf[m_MagBufPos];	//get oldest mag sample from buffer into tmp
-			m_MagBuf[m_MagBufPos++] = mag;			//put latest mag sample in buffer;
-			if( m_MagBufPos >= m_WindowSamples)		//deal with magnitude buffer wrap around
-				m_MagBufPos = 0;
-			if(mag > m_Peak)
-			{
-				m_Peak = mag;	//if new sample is larger than current peak then use it, no need to look at buffer values
-			}
-			else
-			{
-				if(tmp == m_Peak)		//tmp is oldest sample pulled out of buffer
-				{	//if oldest sample pulled out was last peak then need to find next highest peak in buffer
-					m_Peak = -8.0;		//set to lowest value to find next max peak
-					//search all buffer for maximum value and set as new peak
-					for(int i=0; i<m_WindowSamples; i++)
-					{
-						tmp = m_MagBuf[i];
-						if(tmp > m_Peak)
-							m_Peak = tmp;
-					}
-				}
-			}
-
-
-			if(m_UseHang)
-			{	//using hang timer mode
-				if(m_Peak>m_AttackAve)	//if power is rising (use m_AttackRiseAlpha time constant)
-					m_AttackAve = (1.0-m_AttackRiseAlpha)*m_AttackAve + m_AttackRiseAlpha*m_Peak;
-				else					//else magnitude is falling (use  m_AttackFallAlpha time constant)
-					m_AttackAve = (1.0-m_AttackFallAlpha)*m_AttackAve + m_AttackFallAlpha*m_Peak;
-
-				if(m_Peak>m_DecayAve)	//if magnitude is rising (use m_DecayRiseAlpha time constant)
-				{
-					m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*m_Peak;
-					m_HangTimer = 0;	//reset hang timer
-				}
-				else
-				{	//here if decreasing signal
-					if(m_HangTimer<m_HangTime)
-						m_HangTimer++;	//just inc and hold current m_DecayAve
-					else	//else decay with m_DecayFallAlpha which is RELEASE_TIMECONST
-						m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*m_Peak;
-				}
-			}
-			else
-			{	//using exponential decay mode
-				// perform average of magnitude using 2 averagers each with separate rise and fall time constants
-				if(m_Peak>m_AttackAve)	//if magnitude is rising (use m_AttackRiseAlpha time constant)
-					m_AttackAve = (1.0-m_AttackRiseAlpha)*m_AttackAve + m_AttackRiseAlpha*m_Peak;
-				else					//else magnitude is falling (use  m_AttackFallAlpha time constant)
-					m_AttackAve = (1.0-m_AttackFallAlpha)*m_AttackAve + m_AttackFallAlpha*m_Peak;
-
-				if(m_Peak>m_DecayAve)	//if magnitude is rising (use m_DecayRiseAlpha time constant)
-					m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*(m_Peak);
-				else					//else magnitude is falling (use m_DecayFallAlpha time constant)
-					m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*(m_Peak);
-			}
-			//use greater magnitude of attack or Decay Averager
-			if(m_AttackAve>m_DecayAve)
-				mag = m_AttackAve;
-			else
-				mag = m_DecayAve;
-
-			//calc gain depending on which side of knee the magnitude is on
-			if(mag<=m_Knee)		//use fixed gain if below knee
-				gain = m_FixedGain;
-			else				//use variable gain if above knee
-				gain = AGC_OUTSCALE * MPOW(10.0, mag*(m_GainSlope - 1.0) );
-			pOutData[i] = (TYPEMONO16) (delayedin.re * gain);
+			int n = MIN(AGC_BLK, Length-blk);
+			ProcessBlock(n, pInData+blk);
+			TYPEMONO16 *out = pOutData+blk;
+			for(int i=0; i<n; i++)
+				out[i] = (TYPEMONO16) (m_DelayedBlk[i].re * m_GainBlk[i]);
 		}
 	}
 	else
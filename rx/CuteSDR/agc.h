@@ -1,66 +1,79 @@
-//////////////////////////////////////////////////////////////////////
-// agc.h: interface for the CAgc class.
-//
-//  This class implements an automatic gain function.
-//
-// History:
-//	2010-09-15  Initial creation MSW
-//	2011-03-27  Initial release
-//////////////////////////////////////////////////////////////////////
-#ifndef AGCX_H
-#define AGCX_H
-
-#include "datatypes.h"
-#include "kiwi.h"
-
-#define MAX_DELAY_BUF 2048
-
-class CAgc
-{
-public:
-	CAgc();
-	virtual ~CAgc();
-	void SetParameters(bool AgcOn, bool UseHang, int Threshold, int ManualGain, int Slope, int Decay, TYPEREAL SampleRate);
-	void ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData);
-	void ProcessData(int Length, TYPECPX* pInData, TYPEMONO16* pOutData);
-
-private:
-	bool m_AgcOn;				//internal copy of AGC settings parameters
-	bool m_UseHang;
-	int m_Threshold;
-	int m_ManualGain;
-	int m_Slope;
-	int m_Decay;
-	TYPEREAL m_SampleRate;
-
-	TYPEREAL m_SlopeFactor;
-	TYPEREAL m_ManualAgcGain;
-
-	TYPEREAL m_DecayAve;
-	TYPEREAL m_AttackAve;
-
-	TYPEREAL m_AttackRiseAlpha;
-	TYPEREAL m_AttackFallAlpha;
-	TYPEREAL m_DecayRiseAlpha;
-	TYPEREAL m_DecayFallAlpha;
-
-	TYPEREAL m_FixedGain;
-	TYPEREAL m_Knee;
-	TYPEREAL m_GainSlope;
-	TYPEREAL m_Peak;
-
-	int m_SigDelayPtr;
-	int m_MagBufPos;
-	int m_DelaySize;
-	int m_DelaySamples;
-	int m_WindowSamples;
-	int m_HangTime;
-	int m_HangTimer;
-
-	TYPECPX m_SigDelayBuf[MAX_DELAY_BUF];
-	TYPEREAL m_MagBuf[MAX_DELAY_BUF];
-};
-
-extern CAgc m_Agc[RX_CHANS];
-
-#endif //  AGCX_H
+//////////////////////////////////////////////////////////////////////
+// agc.h: interface for the CAgc class.
+//
+//  This class implements an automatic gain function.
+//
+// History:
+//	2010-09-15  Initial creation MSW
+//	2011-03-27  Initial release
+//////////////////////////////////////////////////////////////////////
+#ifndef AGCX_H
+#define AGCX_H
+
+#include "datatypes.h"
+#include "kiwi.h"
+
+#define MAX_DELAY_BUF 2048
+#define AGC_BLK 64				//samples processed per pass, output may overwrite input
+#define AGC_GAIN_INTERP 8		//gain computed every this many samples and linearly interpolated
+
+class CAgc
+{
+public:
+	CAgc();
+	virtual ~CAgc();
+	void SetParameters(bool AgcOn, bool UseHang, int Threshold, int ManualGain, int Slope, int Decay, TYPEREAL SampleRate);
+	void ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData);
+	void ProcessData(int Length, TYPECPX* pInData, TYPEMONO16* pOutData);
+
+private:
+	void ProcessBlock(int Length, TYPECPX* pInData);
+
+	bool m_AgcOn;				//internal copy of AGC settings parameters
+	bool m_UseHang;
+	int m_Threshold;
+	int m_ManualGain;
+	int m_Slope;
+	int m_Decay;
+	TYPEREAL m_SampleRate;
+
+	TYPEREAL m_SlopeFactor;
+	TYPEREAL m_ManualAgcGain;
+
+	TYPEREAL m_DecayAve;
+	TYPEREAL m_AttackAve;
+
+	TYPEREAL m_AttackRiseAlpha;
+	TYPEREAL m_AttackFallAlpha;
+	TYPEREAL m_DecayRiseAlpha;
+	TYPEREAL m_DecayFallAlpha;
+
+	TYPEREAL m_FixedGain;
+	TYPEREAL m_Knee;
+	TYPEREAL m_GainSlope;
+	TYPEREAL m_Peak;
+
+	int m_SigDelayPtr;
+	int m_DelaySize;
+	int m_DelaySamples;
+	int m_WindowSamples;
+	int m_HangTime;
+	int m_HangTimer;
+
+	TYPECPX m_SigDelayBuf[MAX_DELAY_BUF];
+
+	//sliding window peak: monotonic deque of (magnitude, sample number), decreasing magnitude
+	TYPEREAL m_PeakMag[MAX_DELAY_BUF];
+	u4_t m_PeakTime[MAX_DELAY_BUF];
+	int m_PeakHead, m_PeakCount;
+	u4_t m_SampleNum;
+
+	//output of ProcessBlock()
+	TYPEREAL m_Gain;				//gain at end of last interpolation interval
+	TYPECPX m_DelayedBlk[AGC_BLK];
+	TYPEREAL m_GainBlk[AGC_BLK];
+};
+
+extern CAgc m_Agc[RX_CHANS];
+
+#endif //  AGCX_H
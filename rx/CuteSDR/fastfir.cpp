@@ -103,11 +103,18 @@ int i;
 	m_FFT_CoefPlan = MFFTW_PLAN_DFT_1D(CONV_FFT_SIZE, (MFFTW_COMPLEX*) m_pFilterCoef, (MFFTW_COMPLEX*) m_pFilterCoef, FFTW_FORWARD, FFTW_MEASURE);
 	m_FFT_FwdPlan = MFFTW_PLAN_DFT_1D(CONV_FFT_SIZE, (MFFTW_COMPLEX*) m_pFFTBuf, (MFFTW_COMPLEX*) m_pFFTBuf, FFTW_FORWARD, FFTW_MEASURE);
 	m_FFT_RevPlan = MFFTW_PLAN_DFT_1D(CONV_FFT_SIZE, (MFFTW_COMPLEX*) m_pFFTBuf, (MFFTW_COMPLEX*) m_pFFTBuf, FFTW_BACKWARD, FFTW_MEASURE);
+	m_FFT_RevPlanDecim[0] = m_FFT_RevPlan;
+	for( i=1; i<=CONV_MAX_DECIM_LOG2; i++)
+		m_FFT_RevPlanDecim[i] = MFFTW_PLAN_DFT_1D(CONV_FFT_SIZE >> i, (MFFTW_COMPLEX*) m_pFFTBuf, (MFFTW_COMPLEX*) m_pFFTBuf, FFTW_BACKWARD, FFTW_MEASURE);
 	
 	m_FLoCut = -1.0;
 	m_FHiCut = 1.0;
 	m_Offset = 1.0;
 	m_SampleRate = 1.0;
+	m_MaxDecim = 1;
+	m_DecimLog2 = 0;
+	m_NumSubbands = 0;
+	memset(m_Subband, 0, sizeof(m_Subband));
 }
 
 CFastFIR::~CFastFIR()
@@ -128,7 +135,6 @@ CFastFIR::~CFastFIR()
 void CFastFIR::SetupParameters( TYPEREAL FLoCut, TYPEREAL FHiCut,
 								TYPEREAL Offset, TYPEREAL SampleRate)
 {
-int i;
 	if( (FLoCut==m_FLoCut) && (FHiCut==m_FHiCut) &&
 		(Offset==m_Offset) && (SampleRate==m_SampleRate) )
 	{
@@ -153,6 +159,21 @@ int i;
 	}
 	//std::cout<<"FastFIR: LOcut="<<FLoCut<<" HIcut="<<FHiCut<<" SampleRate="<<SampleRate<<"\n";
 	//m_Mutex.lock();
+	MakeFilterCoef(FLoCut, FHiCut, SampleRate, m_pFilterCoef);
+
+	//convert FIR coefficients to frequency domain by taking forward FFT
+	MFFTW_EXECUTE(m_FFT_CoefPlan);
+	SetDecimation();
+	//m_Mutex.unlock();
+}
+
+//////////////////////////////////////////////////////////////////////
+//  Fill the CONV_FFT_SIZE Coef buffer with the time domain bandpass FIR
+// coefficients for FLoCut to FHiCut (already offset).
+//////////////////////////////////////////////////////////////////////
+void CFastFIR::MakeFilterCoef(TYPEREAL FLoCut, TYPEREAL FHiCut, TYPEREAL SampleRate, TYPECPX* Coef)
+{
+int i;
 	//calculate some normalized filter parameters
 	TYPEREAL nFL = FLoCut/SampleRate;
 	TYPEREAL nFH = FHiCut/SampleRate;
@@ -162,8 +183,8 @@ int i;
 
 	for(i=0; i<CONV_FFT_SIZE; i++)		//zero pad entire coefficient buffer to FFT size
 	{
-		m_pFilterCoef[i].re = 0.0;
-		m_pFilterCoef[i].im = 0.0;
+		Coef[i].re = 0.0;
+		Coef[i].im = 0.0;
 	}
 
 	//create LP FIR windowed sinc, MSIN(x)/x complex LP filter coefficients
@@ -179,13 +200,186 @@ int i;
 
 		//shift lowpass filter coefficients in frequency by (hicut+lowcut)/2 to form bandpass filter anywhere in range
 		// (also scales by 1/FFTsize since inverse FFT routine scales by FFTsize)
-		m_pFilterCoef[i].re = z * MCOS(nFs * x) / (TYPEREAL) CONV_FFT_SIZE;
-		m_pFilterCoef[i].im = z * MSIN(nFs * x) / (TYPEREAL) CONV_FFT_SIZE;
+		Coef[i].re = z * MCOS(nFs * x) / (TYPEREAL) CONV_FFT_SIZE;
+		Coef[i].im = z * MSIN(nFs * x) / (TYPEREAL) CONV_FFT_SIZE;
 	}
+}
 
-	//convert FIR coefficients to frequency domain by taking forward FFT
-	MFFTW_EXECUTE(m_FFT_CoefPlan);
-	//m_Mutex.unlock();
+//////////////////////////////////////////////////////////////////////
+//  Allow ProcessData() to decimate its output by up to MaxDecim (1, 2 or 4).
+// The decimation actually used depends on the filter passband and is returned.
+// Output sample rate is SampleRate / decimation.
+//////////////////////////////////////////////////////////////////////
+int CFastFIR::SetMaxDecimation(int MaxDecim)
+{
+	if(MaxDecim != m_MaxDecim)
+	{
+		m_MaxDecim = MaxDecim;
+		SetDecimation();
+	}
+	return GetDecimation();
+}
+
+//////////////////////////////////////////////////////////////////////
+//  Choose the largest decimation whose Nyquist bandwidth (less a guard band for the
+// filter transition) still contains the passband. No frequency shift is needed
+// so the decimated output has exactly the same spectrum.
+//////////////////////////////////////////////////////////////////////
+void CFastFIR::SetDecimation()
+{
+	TYPEREAL fmax = MAX(MFABS(m_FLoCut + m_Offset), MFABS(m_FHiCut + m_Offset));
+	int n;
+
+	for(n=0; n<CONV_MAX_DECIM_LOG2 && (2 << n) <= m_MaxDecim; n++)
+	{
+		if(fmax >= CONV_DECIM_GUARD * m_SampleRate / (2 << (n+1)))
+			break;
+	}
+	m_DecimLog2 = n;
+}
+
+//////////////////////////////////////////////////////////////////////
+//  Channelizer: register a consumer of the FLoCut to FHiCut sub-band of the
+// channel. It is filtered and decimated in the frequency domain from the same
+// forward FFT ProcessData() does for the passband filter, so each extra consumer
+// only costs its masked bins and a CONV_FFT_SIZE/Decim inverse FFT.
+// Output is centred on (FLoCut+FHiCut)/2 rounded to the nearest FFT bin and
+// func receives (CONV_FFT_SIZE-CONV_FIR_SIZE+1)/Decim samples per FFT block.
+// Decim must be a power of 2, and the masked bins (the passband and the filter
+// transitions) must fit in the CONV_FFT_SIZE/Decim output bins or they would fold
+// onto the passband. Returns a handle for RemoveSubband() or -1.
+//////////////////////////////////////////////////////////////////////
+int CFastFIR::AddSubband(conv_subband_func_t func, TYPEREAL FLoCut, TYPEREAL FHiCut, int Decim, TYPEREAL SampleRate)
+{
+int i, h;
+	if( (FLoCut >= FHiCut) || (FLoCut <= -SampleRate/2.0) || (FHiCut >= SampleRate/2.0) ||
+		Decim < 1 || (Decim & (Decim-1)) || Decim > (CONV_FIR_SIZE-1) )
+	{
+		std::cout<<"FastFIR: Subband parameter error\n";
+		return -1;
+	}
+	for(h=0; h<CONV_MAX_SUBBANDS && m_Subband[h].func != NULL; h++)
+		;
+	if(h == CONV_MAX_SUBBANDS)
+		return -1;
+
+	conv_subband_t *sb = &m_Subband[h];
+	TYPECPX *coef = (TYPECPX *) MFFTW_MALLOC(sizeof(TYPECPX) * CONV_FFT_SIZE);
+	MFFTW_PLAN plan = MFFTW_PLAN_DFT_1D(CONV_FFT_SIZE, (MFFTW_COMPLEX*) coef, (MFFTW_COMPLEX*) coef, FFTW_FORWARD, FFTW_ESTIMATE);
+	MakeFilterCoef(FLoCut, FHiCut, SampleRate, coef);
+	MFFTW_EXECUTE(plan);
+	MFFTW_DESTROY_PLAN(plan);
+
+	//bin mask: the contiguous run of bins around the passband above the floor
+	TYPEREAL peak = 0;
+	for(i=0; i<CONV_FFT_SIZE; i++)
+		peak = MAX(peak, coef[i].re*coef[i].re + coef[i].im*coef[i].im);
+	TYPEREAL floor = peak * CONV_SUBBAND_FLOOR * CONV_SUBBAND_FLOOR;
+	int center = (int) lround((FLoCut+FHiCut)/2.0 * CONV_FFT_SIZE / SampleRate);
+	int lo = center, hi = center;
+	for(i=0; i<CONV_FFT_SIZE/2; i++)
+	{
+		TYPECPX *c = &coef[(lo-1) & (CONV_FFT_SIZE-1)];
+		if(c->re*c->re + c->im*c->im < floor) break;
+		lo--;
+	}
+	for(i=0; i<CONV_FFT_SIZE/2; i++)
+	{
+		TYPECPX *c = &coef[(hi+1) & (CONV_FFT_SIZE-1)];
+		if(c->re*c->re + c->im*c->im < floor) break;
+		hi++;
+	}
+	if(hi - lo + 1 > CONV_FFT_SIZE / Decim)
+	{
+		std::cout<<"FastFIR: Subband "<<(hi - lo + 1)<<" bins wide, decimated output only "<<(CONV_FFT_SIZE / Decim)<<"\n";
+		MFFTW_FREE(coef);
+		return -1;
+	}
+
+	sb->nbins = hi - lo + 1;
+	sb->bin_lo = lo & (CONV_FFT_SIZE-1);
+	sb->shift = center;
+	sb->phase = (-center * (CONV_FIR_SIZE-1)) & (CONV_FFT_SIZE-1);	//output sample 0 is at (CONV_FIR_SIZE-1) in the block
+	sb->size = CONV_FFT_SIZE / Decim;
+	sb->coef = (TYPECPX *) malloc(sizeof(TYPECPX) * sb->nbins);
+	for(i=0; i<sb->nbins; i++)
+		sb->coef[i] = coef[(sb->bin_lo + i) & (CONV_FFT_SIZE-1)];
+	MFFTW_FREE(coef);
+	sb->buf = (TYPECPX *) MFFTW_MALLOC(sizeof(TYPECPX) * sb->size);
+	sb->plan = MFFTW_PLAN_DFT_1D(sb->size, (MFFTW_COMPLEX*) sb->buf, (MFFTW_COMPLEX*) sb->buf, FFTW_BACKWARD, FFTW_ESTIMATE);
+	sb->func = func;
+	m_NumSubbands++;
+	return h;
+}
+
+void CFastFIR::RemoveSubband(int Handle)
+{
+	if(Handle < 0 || Handle >= CONV_MAX_SUBBANDS)
+		return;
+	conv_subband_t *sb = &m_Subband[Handle];
+	if(sb->func == NULL)
+		return;
+	sb->func = NULL;
+	MFFTW_DESTROY_PLAN(sb->plan);
+	MFFTW_FREE(sb->buf);
+	free(sb->coef);
+	m_NumSubbands--;
+}
+
+void CFastFIR::RemoveSubbands()
+{
+	for(int h=0; h<CONV_MAX_SUBBANDS; h++)
+		RemoveSubband(h);
+}
+
+//////////////////////////////////////////////////////////////////////
+//  Run the registered sub-bands on the forward FFT in m_pFFTBuf.
+// Masked bins are filtered, moved down by the shift and folded into the
+// smaller inverse FFT (every decim'th sample of the full rate filter output).
+// Moving by whole bins leaves a phase of shift*(time of the block start) which is undone.
+//////////////////////////////////////////////////////////////////////
+void CFastFIR::ProcessSubbands(int rx_chan)
+{
+	for(int h=0; h<CONV_MAX_SUBBANDS; h++)
+	{
+		conv_subband_t *sb = &m_Subband[h];
+		if(sb->func == NULL)
+			continue;
+
+		int i, j, mask = sb->size - 1;
+		TYPECPX *buf = sb->buf;
+		for(i=0; i<sb->size; i++)
+		{
+			buf[i].re = 0.0;
+			buf[i].im = 0.0;
+		}
+		for(i=0; i<sb->nbins; i++)
+		{
+			int k = (sb->bin_lo + i) & (CONV_FFT_SIZE-1);
+			TYPECPX *m = &sb->coef[i], *s = &m_pFFTBuf[k], *d = &buf[(k - sb->shift) & mask];
+			d->re += m->re * s->re - m->im * s->im;
+			d->im += m->re * s->im + m->im * s->re;
+		}
+		MFFTW_EXECUTE(sb->plan);
+
+		//rotate by the phase the shift has accumulated over previous blocks
+		TYPEREAL ph = -K_2PI * sb->phase / CONV_FFT_SIZE;
+		TYPEREAL pc = MCOS(ph), ps = MSIN(ph);
+		int decim_log2 = __builtin_ctz(CONV_FFT_SIZE / sb->size);
+		j = (CONV_FIR_SIZE-1) >> decim_log2;
+		if(sb->phase != 0)
+		{
+			for(i=j; i<sb->size; i++)
+			{
+				TYPEREAL re = buf[i].re;
+				buf[i].re = re * pc - buf[i].im * ps;
+				buf[i].im = re * ps + buf[i].im * pc;
+			}
+		}
+		sb->phase = (sb->phase + sb->shift * (CONV_FFT_SIZE - CONV_FIR_SIZE + 1)) & (CONV_FFT_SIZE-1);
+
+		sb->func(rx_chan, 0, sb->size - j, &buf[j]);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -228,18 +422,39 @@ int outpos = 0;
 
 			if (receive_FFT_pre) {
 				//print_max_min_c("postFFT", m_pFFTBuf, CONV_FFT_SIZE);
-				receive_FFT(rx_chan, 0, CONV_FFT_TO_OUTBUF_RATIO, CONV_FFT_SIZE, m_pFFTBuf);
+				ext_queue_FFT(rx_chan, CONV_FFT_TO_OUTBUF_RATIO, CONV_FFT_SIZE, m_pFFTBuf);
 			}
 
+			if(m_NumSubbands)
+				ProcessSubbands(rx_chan);
+
 			CpxMpy(CONV_FFT_SIZE, m_pFilterCoef, m_pFFTBuf, m_pFFTBuf);
 
 			if (receive_FFT_post)
-				receive_FFT(rx_chan, 0, CONV_FFT_TO_OUTBUF_RATIO, CONV_FFT_SIZE, m_pFFTBuf);
+				ext_queue_FFT(rx_chan, CONV_FFT_TO_OUTBUF_RATIO, CONV_FFT_SIZE, m_pFFTBuf);
 
-			MFFTW_EXECUTE(m_FFT_RevPlan);
-			for(j=(CONV_FIR_SIZE-1); j<CONV_FFT_SIZE; j++)
-			{	//copy FFT output into OutBuf minus CONV_FIR_SIZE-1 samples at beginning
-				OutBuf[outpos++] = m_pFFTBuf[j];
+			if(m_DecimLog2)
+			{	//decimate in the frequency domain: fold the (band limited) spectrum into
+				//CONV_FFT_SIZE/decim bins, then a smaller inverse FFT gives every decim'th sample
+				int size = CONV_FFT_SIZE >> m_DecimLog2;
+				for(int k=size; k<CONV_FFT_SIZE; k++)
+				{
+					m_pFFTBuf[k & (size-1)].re += m_pFFTBuf[k].re;
+					m_pFFTBuf[k & (size-1)].im += m_pFFTBuf[k].im;
+				}
+				MFFTW_EXECUTE(m_FFT_RevPlanDecim[m_DecimLog2]);
+				for(j=(CONV_FIR_SIZE-1) >> m_DecimLog2; j<size; j++)
+				{	//copy FFT output into OutBuf minus (CONV_FIR_SIZE-1)/decim samples at beginning
+					OutBuf[outpos++] = m_pFFTBuf[j];
+				}
+			}
+			else
+			{
+				MFFTW_EXECUTE(m_FFT_RevPlan);
+				for(j=(CONV_FIR_SIZE-1); j<CONV_FFT_SIZE; j++)
+				{	//copy FFT output into OutBuf minus CONV_FIR_SIZE-1 samples at beginning
+					OutBuf[outpos++] = m_pFFTBuf[j];
+				}
 			}
 			for(j=0; j<(CONV_FIR_SIZE - 1);j++)
 			{	//copy overlap buffer into start of fft input buffer
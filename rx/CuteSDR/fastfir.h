@@ -19,6 +19,29 @@
 #define CONV_FIR_SIZE (CONV_FFT_SIZE/2+1)	//must be <= FFT size. Make 1/2 +1 if want
 											//output to be in power of 2
 
+#define CONV_MAX_DECIM_LOG2 2				//output decimation of 1, 2 or 4
+#define CONV_MAX_DECIM (1 << CONV_MAX_DECIM_LOG2)
+#define CONV_DECIM_GUARD 0.9				//passband must be within this fraction of decimated Nyquist
+
+#define CONV_MAX_SUBBANDS 4					//channelizer consumers per channel
+#define CONV_SUBBAND_FLOOR 3.0e-5			//bins below -90 dB of the sub-band peak response are masked off
+
+//a consumer of a frequency-domain sub-band of the channel, see AddSubband()
+//same as ext_receive_iq_samps_t
+typedef void (*conv_subband_func_t)(int rx_chan, int ch, int nsamps, TYPECPX *samps);
+
+struct conv_subband_t
+{
+	conv_subband_func_t func;				//called with the sub-band samples at SampleRate/decim
+	int size;								//inverse FFT size: CONV_FFT_SIZE/decim
+	int bin_lo, nbins;						//bin mask: forward FFT bins with non-negligible response
+	int shift;								//bins the sub-band is moved down by to centre it on zero
+	int phase;								//accumulated block phase of the shift, in 1/CONV_FFT_SIZE cycles
+	TYPECPX *coef;							//nbins of sub-band filter response
+	TYPECPX *buf;
+	MFFTW_PLAN plan;
+};
+
 class CFastFIR  
 {
 public:
@@ -26,15 +49,25 @@ public:
 	virtual ~CFastFIR();
 
 	void SetupParameters( TYPEREAL FLoCut,TYPEREAL FHiCut,TYPEREAL Offset, TYPEREAL SampleRate);
+	int SetMaxDecimation(int MaxDecim);
+	int GetDecimation() { return 1 << m_DecimLog2; }
+	int AddSubband(conv_subband_func_t func, TYPEREAL FLoCut, TYPEREAL FHiCut, int Decim, TYPEREAL SampleRate);
+	void RemoveSubband(int Handle);
+	void RemoveSubbands();
 	int ProcessData(int rx_chan, int InLength, TYPECPX* InBuf, TYPECPX* OutBuf);
 
 private:
 	inline void CpxMpy(int N, TYPECPX* m, TYPECPX* src, TYPECPX* dest);
+	void SetDecimation();
+	void MakeFilterCoef(TYPEREAL FLoCut, TYPEREAL FHiCut, TYPEREAL SampleRate, TYPECPX* Coef);
+	void ProcessSubbands(int rx_chan);
 
 	TYPEREAL m_FLoCut;
 	TYPEREAL m_FHiCut;
 	TYPEREAL m_Offset;
 	TYPEREAL m_SampleRate;
+	int m_MaxDecim;
+	int m_DecimLog2;
 
 	int m_InBufInPos;
 	TYPEREAL m_pWindowTbl[CONV_FIR_SIZE];
@@ -44,6 +77,10 @@ private:
 	MFFTW_PLAN m_FFT_CoefPlan;
 	MFFTW_PLAN m_FFT_FwdPlan;
 	MFFTW_PLAN m_FFT_RevPlan;
+	MFFTW_PLAN m_FFT_RevPlanDecim[CONV_MAX_DECIM_LOG2+1];	//inverse FFT of size CONV_FFT_SIZE >> n
+
+	int m_NumSubbands;
+	conv_subband_t m_Subband[CONV_MAX_SUBBANDS];
 };
 
 extern CFastFIR m_FastFIR[RX_CHANS];
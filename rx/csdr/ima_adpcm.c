@@ -158,57 +158,92 @@ void decode_ima_adpcm_e8_u8(unsigned char* input, unsigned char* output, int inp
 	}
 }
 
-static inline unsigned char ImaAdpcmEncode(short sample, ima_adpcm_state_t *state)
-{
-   int diff = sample - state->previousValue;
-   int step = stepSizeTable[state->index];
-   int deltaCode = 0;
+// Encoder state update without branches: everything data dependent is a mask or a table lookup,
+// so there are no mispredicts whatever the signal. ADPCM is inherently sequential (each sample
+// depends on the decoder state after the previous one) so the samples themselves can't be done
+// in parallel, but this leaves a short dependency chain per sample. Bit-exact with
+// ImaAdpcmDecode() (see tools/adpcm.c).
 
-   // Set sign bit
-   if (diff < 0) { deltaCode = 8; diff = -diff; }
+// next index for each index and magnitude code, clamped to 0..88
+static unsigned char nextIndexTable[89][8];
 
-   // This is essentially deltaCode = (diff<<2)/step,
-   // except the roundoff is handled differently.
-   if ( diff >= step ) {  deltaCode |= 4;  diff -= step;  }
-   step >>= 1;
-   if ( diff >= step ) {  deltaCode |= 2;  diff -= step;  }
-   step >>= 1;
-   if ( diff >= step ) {  deltaCode |= 1;  diff -= step;  }
+static void ImaAdpcmInitTables()
+{
+	static bool init;
+	if (init) return;
+
+	for (int i = 0; i < 89; i++) {
+		for (int c = 0; c < 8; c++) {
+			int n = i + indexAdjustTable[c];
+			nextIndexTable[i][c] = (n < 0)? 0 : ((n > 88)? 88 : n);
+		}
+	}
+	init = true;
+}
+
+// the state is in locals: output[] is unsigned char so could alias *state and force reloads
+struct ima_enc_t { int index, prev, pos_clamp, neg_clamp; };
 
-   ImaAdpcmDecode(deltaCode, state);  // update state
-   return deltaCode;
+static inline unsigned ImaAdpcmEncode(int sample, ima_enc_t *e)
+{
+	int step = stepSizeTable[e->index];
+	int diff = sample - e->prev;
+
+	// sign-magnitude, sign is 0 or -1
+	int sign = diff >> 31;
+	diff = (diff ^ sign) - sign;
+
+	// This is essentially code = (diff<<2)/step, except the roundoff is handled differently.
+	// The decoder's difference is rebuilt from the same bits.
+	int b2 = -(diff >= step);				diff -= step & b2;
+	int b1 = -(diff >= (step >> 1));		diff -= (step >> 1) & b1;
+	int b0 = -(diff >= (step >> 2));
+	int code = (b2 & 4) | (b1 & 2) | (b0 & 1);
+	int difference = (step >> 3) + (step & b2) + ((step >> 1) & b1) + ((step >> 2) & b0);
+
+	int v = e->prev + ((difference ^ sign) - sign);
+	v = (v > e->pos_clamp)? e->pos_clamp : v;		// conditional moves
+	v = (v < e->neg_clamp)? e->neg_clamp : v;
+	e->prev = v;
+	e->index = nextIndexTable[e->index][code];
+
+	return code | (sign & 8);
 }
 
+// Output is built a 32-bit word (8 samples) at a time, first sample in the low nibble of the first byte.
+#define ENCODE_PACKED(input) \
+	ImaAdpcmInitTables(); \
+	ima_enc_t e = { state->index, state->previousValue, state->pos_clamp, state->neg_clamp }; \
+	int i, k, n = input_length/2; \
+	for (k = 0; k + 4 <= n; k += 4, input += 8) { \
+		unsigned w = 0; \
+		for (i = 0; i < 8; i++) w |= ImaAdpcmEncode(input[i], &e) << (4*i); \
+		output[k+0] = w; output[k+1] = w >> 8; output[k+2] = w >> 16; output[k+3] = w >> 24; \
+	} \
+	for (; k < n; k++, input += 2) { \
+		unsigned w = ImaAdpcmEncode(input[0], &e); \
+		output[k] = w | (ImaAdpcmEncode(input[1], &e) << 4); \
+	} \
+	state->index = e.index; \
+	state->previousValue = e.prev;
+
 // used by sound
 // 4:1 compression: 2x shorts -> 1x unsigned char
 void encode_ima_adpcm_i16_e8(short* input, unsigned char* output, int input_length, ima_adpcm_state_t *state)
 {
 	state->pos_clamp = +32767;
 	state->neg_clamp = -32768;
-	
-	int k=0;
-	for (int i=0; i<input_length/2; i++)
-	{
-		output[k] = ImaAdpcmEncode(input[2*i], state);
-		output[k] |= ImaAdpcmEncode(input[2*i+1], state) << 4;
-		k++;
-	}
+	ENCODE_PACKED(input);
 }
 
 // used by waterfall
 // 2:1 compression: 2x unsigned char -> 1x unsigned char
+// Input may be the output buffer: each output word is written after its 8 input bytes are read,
+// and output[k] is behind input[2k].
 void encode_ima_adpcm_u8_e8(unsigned char* input, unsigned char* output, int input_length, ima_adpcm_state_t *state)
 {
 	// not +127 / -128 because unsigned
 	state->pos_clamp = 255;
 	state->neg_clamp = 0;
-	
-	int k=0;
-	for (int i=0; i<input_length/2; i++)
-	{
-		unsigned char i0 = input[2*i], i1 = input[2*i+1];	// handle input == output buffer
-		output[k] = ImaAdpcmEncode(i0, state);
-		output[k] |= ImaAdpcmEncode(i1, state) << 4;
-		k++;
-	}
+	ENCODE_PACKED(input);
 }
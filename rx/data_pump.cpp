@@ -29,6 +29,7 @@ Boston, MA  02110-1301, USA.
 #include "coroutines.h"
 #include "debug.h"
 #include "data_pump.h"
+#include "metrics.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -187,6 +188,7 @@ static void snd_service()
             diff = 0;
         } else {
             dpump_hist[diff]++;
+            metric_observe(M_DPUMP_BACKLOG, 0, diff);
             if (ev_dump && p1 && p2 && dpump_hist[p1] > p2) {
                 printf("DATAPUMP DUMP %d %d %d\n", diff, stored, current);
                 evLatency(EC_DUMP, EV_DPUMP, ev_dump, ">diff",
@@ -272,7 +274,9 @@ static void data_pump(void *param)
 		evDP(EC_EVENT, EV_DPUMP, -1, "data_pump", evprintf("WAKEUP: SPI CTRL_INTERRUPT %d",
 			GPIO_READ_BIT(GPIO0_15)));
 
+		u4_t service_us = timer_us();
 		snd_service();
+		metric_observe(M_DPUMP_SERVICE, 0, (timer_us() - service_us) / 1e6);
 		
 		for (int ch=0; ch < RX_CHANS; ch++) {
 			rx_chan_t *rx = &rx_channels[ch];
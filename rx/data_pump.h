@@ -21,9 +21,12 @@ Boston, MA  02110-1301, USA.
 #define _DATA_PUMP_H_
 
 #include "types.h"
+#include "kiwi.h"
 #include "spi.h"
 #include "cuteSDR.h"
 #include "ima_adpcm.h"
+#include "rx_resamp.h"
+#include "snd_codec.h"
 
 #include <fftw3.h>
 
@@ -59,6 +62,11 @@ struct rx_dpump_t {
 		u4_t real_wr_pos, real_rd_pos;
 		u4_t real_seq, real_seqnum[N_DPBUF];
 		TYPEMONO16 real_samples[N_DPBUF][FASTFIR_OUTBUF_SIZE];
+
+		// audio resampled to the client's out_rate
+		resamp_t resamp;
+		TYPEMONO16 resamp_real[SND_OUT_MAX_BLK];
+		TYPECPX resamp_iq[SND_OUT_MAX_BLK];
 	};
 	
 	struct {
@@ -69,7 +77,7 @@ struct rx_dpump_t {
 		float chunk_wait_us;
 		int zoom, samp_wait_ms;
 		bool overlapped_sampling;
-		ima_adpcm_state_t adpcm_snd;
+		snd_codec_t snd_codec;
 	};
 };
 
@@ -376,7 +376,7 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 					char *geo = c->geo? kiwi_str_encode(c->geo) : NULL;
 					char *ext = ext_users[i].ext? kiwi_str_encode((char *) ext_users[i].ext->name) : NULL;
 					const char *ip = isAdmin? c->remote_ip : "";
-					asprintf(&sb2, "%s{\"i\":%d,\"n\":\"%s\",\"g\":\"%s\",\"f\":%d,\"m\":\"%s\",\"z\":%d,\"t\":\"%d:%02d:%02d\",\"e\":\"%s\",\"a\":\"%s\"}",
+					sb = kstr_asprintf(sb, "%s{\"i\":%d,\"n\":\"%s\",\"g\":\"%s\",\"f\":%d,\"m\":\"%s\",\"z\":%d,\"t\":\"%d:%02d:%02d\",\"e\":\"%s\",\"a\":\"%s\"}",
 						need_comma? ",":"", i, user? user:"", geo? geo:"", c->freqHz,
 						kiwi_enum2str(c->mode, mode_s, ARRAY_LEN(mode_s)), c->zoom, hr, min, sec, ext? ext:"", ip);
 					if (user) free(user);
@@ -386,9 +386,8 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 				}
 			}
 			if (n == 0) {
-				asprintf(&sb2, "%s{\"i\":%d}", need_comma? ",":"", i);
+				sb = kstr_asprintf(sb, "%s{\"i\":%d}", need_comma? ",":"", i);
 			}
-			sb = kstr_cat(sb, kstr_wrap(sb2));
 			need_comma = true;
 		}
 
@@ -524,12 +523,11 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 			
 			// NB: ident and notes are already stored URL encoded
 			float f = dp->freq + (dp->offset / 1000.0);
-			asprintf(&sb2, ",{\"g\":%d,\"f\":%.3f,\"o\":%.0f,\"b\":%d,\"i\":\"%s\"%s%s%s}",
+			sb = kstr_asprintf(sb, ",{\"g\":%d,\"f\":%.3f,\"o\":%.0f,\"b\":%d,\"i\":\"%s\"%s%s%s}",
 				i, freq, dp->offset, dp->flags, dp->ident,
 				dp->notes? ",\"n\":\"":"", dp->notes? dp->notes:"", dp->notes? "\"":"");
 			//printf("dx(%d,%.3f,%.0f,%d,\'%s\'%s%s%s)\n", i, f, dp->offset, dp->flags, dp->ident,
 			//	dp->notes? ",\'":"", dp->notes? dp->notes:"", dp->notes? "\'":"");
-			sb = kstr_cat(sb, kstr_wrap(sb2));
 		}
 		
 		sb = kstr_cat(sb, "]");
@@ -574,21 +572,17 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 		sb = kstr_wrap(sb);
 
 		float sum_kbps = audio_kbps + waterfall_kbps + http_kbps;
-		asprintf(&sb2, ",\"aa\":%.0f,\"aw\":%.0f,\"af\":%.0f,\"at\":%.0f,\"ah\":%.0f,\"as\":%.0f",
+		sb = kstr_asprintf(sb, ",\"aa\":%.0f,\"aw\":%.0f,\"af\":%.0f,\"at\":%.0f,\"ah\":%.0f,\"as\":%.0f",
 			audio_kbps, waterfall_kbps, waterfall_fps[ch], waterfall_fps[RX_CHANS], http_kbps, sum_kbps);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
 
-		asprintf(&sb2, ",\"ga\":%d,\"gt\":%d,\"gg\":%d,\"gf\":%d,\"gc\":%.6f,\"go\":%d",
+		sb = kstr_asprintf(sb, ",\"ga\":%d,\"gt\":%d,\"gg\":%d,\"gf\":%d,\"gc\":%.6f,\"go\":%d",
 			gps.acquiring, gps.tracking, gps.good, gps.fixes, adc_clock_system()/1e6, clk.adc_clk_corrections);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
 
 		extern int audio_dropped;
-		asprintf(&sb2, ",\"ad\":%d,\"au\":%d,\"ae\":%d,\"ar\":%d,\"an\":%d,\"ap\":[",
+		sb = kstr_asprintf(sb, ",\"ad\":%d,\"au\":%d,\"ae\":%d,\"ar\":%d,\"an\":%d,\"ap\":[",
 			audio_dropped, underruns, seq_errors, dpump_resets, NRX_BUFS);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
 		for (i = 0; i < NRX_BUFS; i++) {
-		    asprintf(&sb2, "%s%d", (i != 0)? ",":"", dpump_hist[i]);
-		    sb = kstr_cat(sb, kstr_wrap(sb2));
+		    sb = kstr_asprintf(sb, "%s%d", (i != 0)? ",":"", dpump_hist[i]);
 		}
         sb = kstr_cat(sb, "]");
 
@@ -605,12 +599,10 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 		} else {
 			strcpy(local_s, "");
 		}
-		asprintf(&sb2, ",\"tu\":\"%s\",\"tl\":\"%s\",\"ti\":\"%s\",\"tn\":\"%s\"",
+		sb = kstr_asprintf(sb, ",\"tu\":\"%s\",\"tl\":\"%s\",\"ti\":\"%s\",\"tn\":\"%s\"",
 			utc_s, local_s, tzone_id, tzone_name);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
 
-		asprintf(&sb2, "}");
-		sb = kstr_cat(sb, kstr_wrap(sb2));
+		sb = kstr_cat(sb, "}");
 
 		send_msg(conn, false, "MSG stats_cb=%s", kstr_sp(sb));
 		kstr_free(sb);
@@ -627,11 +619,10 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 		for (i=0; i < gps_chans; i++) {
 			c = &gps.ch[i];
 			int un = c->ca_unlocked;
-			asprintf(&sb2, "%s{ \"ch\":%d,\"prn\":%d,\"snr\":%d,\"rssi\":%d,\"gain\":%d,\"hold\":%d,\"wdog\":%d"
+			sb = kstr_asprintf(sb, "%s{ \"ch\":%d,\"prn\":%d,\"snr\":%d,\"rssi\":%d,\"gain\":%d,\"hold\":%d,\"wdog\":%d"
 				",\"unlock\":%d,\"parity\":%d,\"sub\":%d,\"sub_renew\":%d,\"novfl\":%d}",
 				i? ", ":"", i, c->prn, c->snr, c->rssi, c->gain, c->hold, c->wdog,
 				un, c->parity, c->sub, c->sub_renew, c->novfl);
-			sb = kstr_cat(sb, kstr_wrap(sb2));
 			c->parity = 0;
 			for (j = 0; j < SUBFRAMES; j++) {
 				if (c->sub_renew & (1<<j)) {
@@ -673,12 +664,9 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 		sb = kstr_cat(sb, kstr_wrap(sb2));
 
 		if (gps.StatLat) {
-			asprintf(&sb2, ",\"lat\":\"%8.6f %c\"", gps.StatLat, gps.StatNS);
-			sb = kstr_cat(sb, kstr_wrap(sb2));
-			asprintf(&sb2, ",\"lon\":\"%8.6f %c\"", gps.StatLon, gps.StatEW);
-			sb = kstr_cat(sb, kstr_wrap(sb2));
-			asprintf(&sb2, ",\"alt\":\"%1.0f m\"", gps.StatAlt);
-			sb = kstr_cat(sb, kstr_wrap(sb2));
+			sb = kstr_asprintf(sb, ",\"lat\":\"%8.6f %c\"", gps.StatLat, gps.StatNS);
+			sb = kstr_asprintf(sb, ",\"lon\":\"%8.6f %c\"", gps.StatLon, gps.StatEW);
+			sb = kstr_asprintf(sb, ",\"alt\":\"%1.0f m\"", gps.StatAlt);
 			asprintf(&sb2, ",\"map\":\"<a href='http://wikimapia.org/#lang=en&lat=%8.6f&lon=%8.6f&z=18&m=b' target='_blank'>wikimapia.org</a>\"",
 				gps.sgnLat, gps.sgnLon);
 		} else {
@@ -686,9 +674,17 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 		}
 		sb = kstr_cat(sb, kstr_wrap(sb2));
 			
-		asprintf(&sb2, ",\"acq\":%d,\"track\":%d,\"good\":%d,\"fixes\":%d,\"adc_clk\":%.6f,\"adc_corr\":%d}",
+		// acquisition probability (percent) per minute, most recent first, -1 = no attempts
+		sb = kstr_asprintf(sb, ",\"acq_nc\":%d,\"acq_pd\":[", gps.acq_nc);
+		unsigned minute = (timer_ms() - gps.start)/60000 + 1;
+		for (i = 0; i < ACQ_HIST && minute; i++, minute--) {
+			gps_stats_t::gps_acq_t *a = &gps.acq[minute % ACQ_HIST];
+			sb = kstr_asprintf(sb, "%s%d", i? ",":"", (a->minute == minute && a->tries)? a->hits*100/a->tries : -1);
+		}
+		sb = kstr_cat(sb, "]");
+
+		sb = kstr_asprintf(sb, ",\"acq\":%d,\"track\":%d,\"good\":%d,\"fixes\":%d,\"adc_clk\":%.6f,\"adc_corr\":%d}",
 			gps.acquiring? 1:0, gps.tracking, gps.good, gps.fixes, adc_clock_system()/1e6, clk.adc_clk_corrections);
-		sb = kstr_cat(sb, kstr_wrap(sb2));
 
 		send_msg_encoded(conn, "MSG", "gps_update_cb", "%s", kstr_sp(sb));
 		kstr_free(sb);
@@ -699,7 +695,7 @@ bool rx_common_cmd(const char *stream_name, conn_t *conn, char *cmd)
 	int wf_comp;
 	n = sscanf(cmd, "SET wf_comp=%d", &wf_comp);
 	if (n == 1) {
-		c2s_waterfall_compression(conn->rx_channel, wf_comp? true:false);
+		c2s_waterfall_compression(conn->rx_channel, wf_comp);
 		printf("### SET wf_comp=%d\n", wf_comp);
 		return true;
 	}
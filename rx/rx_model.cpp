@@ -0,0 +1,313 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+// NB: standard assert() so this file also links standalone into tools/ddc
+#include <assert.h>
+
+#include "types.h"
+#include "kiwi.h"
+#include "rx_model.h"
+
+#include <string.h>
+#include <math.h>
+
+const cic_gen_t cic_gen_rx1 = {
+	#include "../verilog/rx/cic_rx1.h"
+};
+
+// for USE_RX_SEQ the combs of the second stage run on the eCPU and aren't modelled
+#ifndef USE_RX_SEQ
+const cic_gen_t cic_gen_rx2 = {
+	#include "../verilog/rx/cic_rx2.h"
+};
+#endif
+
+#ifdef USE_WF_1CIC
+const cic_gen_t cic_gen_wf1 = {
+	#include "../verilog/rx/cic_wf1.h"
+};
+#endif
+
+// ip_dds_sin_cos_13b_15b: 13-bit phase, 15-bit full range output
+#define NCO_PHASE_BITS	13
+#define NCO_AMPL_BITS	15
+#define NCO_LEN			(1 << NCO_PHASE_BITS)
+
+static s2_t nco_sin[NCO_LEN];
+
+static void nco_init()
+{
+	int i;
+
+	if (nco_sin[NCO_LEN/4] != 0) return;
+	for (i = 0; i < NCO_LEN; i++)
+		nco_sin[i] = lround(sin(2.0 * K_PI * i / NCO_LEN) * ((1 << (NCO_AMPL_BITS-1)) - 1));
+}
+
+// iq_mixer.v: out = { prod[SIGN], prod[MANTISSA -:MANTISSA_W] } + prod[RND]
+// The ADC_BITS x 18-bit product never reaches bit 33 so bits 35..33 are all sign bits.
+static inline s4_t mix_round(s4_t prod, int out_bits)
+{
+	return (prod >> (35 - out_bits)) + ((prod >> (34 - out_bits)) & 1);
+}
+
+static void mixer(ddc_model_t *m, const s4_t *adc, int nsamps)
+{
+	int ch, n, L = m->nlanes, W = m->mix_bits;
+
+	for (ch = 0; ch < m->nchans; ch++) {
+		u4_t phase = m->phase[ch], phase_inc = m->phase_inc[ch];
+		s4_t *o = m->mix + 2*ch;
+
+		for (n = 0; n < nsamps; n++, o += L) {
+			u4_t p = phase >> (32 - NCO_PHASE_BITS);
+			s4_t my_i = nco_sin[(p + NCO_LEN/4) & (NCO_LEN-1)] << 3;	// cos
+			s4_t my_q = nco_sin[p] << 3;							// sin
+			o[0] = mix_round(adc[n] * my_i, W);
+			o[1] = mix_round(adc[n] * my_q, W);
+			phase += phase_inc;
+		}
+
+		m->phase[ch] = phase;
+	}
+}
+
+static inline s4_t sext(u64_t v, int bits)
+{
+	return (s4_t) ((s64_t) (v << (64 - bits)) >> (64 - bits));
+}
+
+// The hardware integrators and combs are pipelined (each reads the previous stage's register)
+// which only delays the result, so here each stage uses the current output of the one before.
+
+static void integrate(cic_model_t *c, const s4_t *in, int nsamps)
+{
+	int n, s, l, N = c->g->stages, L = c->nlanes, shift_in = c->shift_in;
+	u64_t (*ig)[DDC_MAX_LANES] = c->integ;
+
+	for (n = 0; n < nsamps; n++, in += L) {
+		for (l = 0; l < L; l++)
+			ig[0][l] += (u64_t) (s64_t) in[l] << shift_in;
+
+		for (s = 1; s < N; s++) {
+			int sh = c->sh[s+1];
+			for (l = 0; l < L; l++)
+				ig[s][l] += ig[s-1][l] >> sh;
+		}
+	}
+}
+
+// integrators wider than 64 bits as lo/hi word pairs
+static void integrate_wide(cic_model_t *c, const s4_t *in, int nsamps)
+{
+	int n, s, l, N = c->g->stages, L = c->nlanes, shift_in = c->shift_in;
+	const int *acc = c->g->acc;
+	u64_t (*ig)[DDC_MAX_LANES] = c->integ, (*ih)[DDC_MAX_LANES] = c->integ_hi;
+
+	for (n = 0; n < nsamps; n++, in += L) {
+		for (l = 0; l < L; l++) {
+			s64_t x = in[l];
+			u64_t lo = (u64_t) x << shift_in;
+			u64_t hi = (u64_t) (x >> (shift_in? (64 - shift_in) : 63));
+			ig[0][l] += lo;
+			ih[0][l] += hi + (ig[0][l] < lo);
+		}
+
+		for (s = 1; s < N; s++) {
+			int sh = c->sh[s+1];
+
+			if (acc[s] <= 64) {
+				for (l = 0; l < L; l++)
+					ig[s][l] += ig[s-1][l] >> sh;
+			} else {
+				for (l = 0; l < L; l++) {
+					u64_t lo, hi;
+					if (sh == 0) {
+						lo = ig[s-1][l]; hi = ih[s-1][l];
+					} else
+					if (sh < 64) {
+						lo = (ig[s-1][l] >> sh) | (ih[s-1][l] << (64 - sh)); hi = ih[s-1][l] >> sh;
+					} else {
+						lo = ih[s-1][l] >> (sh - 64); hi = 0;
+					}
+
+					if (acc[s+1] <= 64) {
+						ig[s][l] += lo;
+					} else {
+						ig[s][l] += lo;
+						ih[s][l] += hi + (ig[s][l] < lo);
+					}
+				}
+			}
+		}
+	}
+}
+
+static void comb(cic_model_t *c, s4_t *out)
+{
+	const cic_gen_t *g = c->g;
+	int s, l, N = g->stages, L = c->nlanes;
+	int out_sh = g->acc[2*N] - g->out_bits;
+
+	for (l = 0; l < L; l++) {
+		u64_t x = c->integ[N-1][l];
+
+		for (s = 0; s < N; s++) {
+			u64_t in = x >> c->sh[N+1+s];
+			x = in - c->prev[s][l];
+			c->prev[s][l] = in;
+		}
+
+		u64_t y = x >> out_sh;
+		if (out_sh > 0) y += (x >> (out_sh-1)) & 1;		// cic_gen.c rounding
+		out[l] = sext(y, g->out_bits);
+	}
+}
+
+void cic_model_init(cic_model_t *c, const cic_gen_t *g, int nlanes, int decim)
+{
+	int s, lg, N = g->stages;
+
+	assert(g->mode == CIC_INTEG_COMB || g->mode == CIC_NO_PRUNE);
+	assert(N <= CIC_MAX_STAGES && nlanes <= DDC_MAX_LANES);
+	memset(c, 0, sizeof(*c));
+	c->g = g;
+	c->nlanes = nlanes;
+	c->decim = decim? decim : g->decim;
+
+	// variable decimation: input pre-shifted to the top of the max case sized first integrator
+	// (decimation 1 bypasses the filter)
+	if (c->decim != g->decim && c->decim != 1) {
+		assert(c->decim > 1 && c->decim < g->decim);
+		assert((c->decim & (c->decim-1)) == 0 && (g->decim & (g->decim-1)) == 0);
+		for (lg = 0; (1 << lg) < c->decim; lg++)
+			;
+		c->shift_in = g->acc[0] - (g->in_bits + N * lg);
+	}
+
+	for (s = 1; s <= 2*N; s++)
+		c->sh[s] = g->acc[s-1] - g->acc[s];
+	c->wide = (g->acc[1] > 64);
+	assert(c->sh[1] == 0 && g->acc[N] <= 64 && c->shift_in < 64);
+}
+
+int cic_model_process(cic_model_t *c, const s4_t *in, int nsamps, s4_t *out)
+{
+	int n, run, nout = 0, L = c->nlanes;
+
+	// cic_prune_var.v: decimation 1 bypasses the filter
+	if (c->decim == 1) {
+		int sh = c->g->in_bits - c->g->out_bits;
+		for (n = 0; n < nsamps * L; n++)
+			out[n] = in[n] >> sh;
+		return nsamps;
+	}
+
+	for (n = 0; n < nsamps; n += run) {
+		run = MIN(c->decim - c->count, nsamps - n);
+		if (c->wide)
+			integrate_wide(c, in + n*L, run);
+		else
+			integrate(c, in + n*L, run);
+
+		c->count += run;
+		if (c->count == c->decim) {
+			c->count = 0;
+			comb(c, out + nout*L);
+			nout++;
+		}
+	}
+
+	return nout;
+}
+
+static void ddc_model_init(ddc_model_t *m, int nchans, int mix_bits)
+{
+	assert(nchans >= 1 && nchans <= RX_CHANS);
+	nco_init();
+	memset(m, 0, sizeof(*m));
+	m->nchans = nchans;
+	m->nlanes = 2 * nchans;
+	m->mix_bits = mix_bits;
+}
+
+void ddc_model_rx_init(ddc_model_t *m, int nchans)
+{
+	ddc_model_init(m, nchans, RX1_BITS);
+
+	#ifdef USE_RX_SEQ
+		assert(0);
+	#else
+		cic_model_init(&m->cic1, &cic_gen_rx1, m->nlanes, 0);
+		cic_model_init(&m->cic2, &cic_gen_rx2, m->nlanes, 0);
+		m->two_stage = true;
+	#endif
+}
+
+void ddc_model_wf_init(ddc_model_t *m, int nchans, int decim)
+{
+	ddc_model_init(m, nchans, WF1_BITS);
+
+	#ifdef USE_WF_1CIC
+		cic_model_init(&m->cic1, &cic_gen_wf1, m->nlanes, decim);
+	#else
+		assert(0);
+	#endif
+}
+
+void ddc_model_freq(ddc_model_t *m, int ch, u4_t phase_inc)
+{
+	m->phase_inc[ch] = phase_inc;
+}
+
+int ddc_model_process(ddc_model_t *m, const s4_t *adc, int nsamps, s4_t *out)
+{
+	int n, n1, run, nout = 0, L = m->nlanes;
+
+	for (n = 0; n < nsamps; n += run) {
+		run = MIN(DDC_BLOCK, nsamps - n);
+		mixer(m, adc + n, run);
+
+		if (m->two_stage) {
+			n1 = cic_model_process(&m->cic1, m->mix, run, m->out1);
+			n1 = cic_model_process(&m->cic2, m->out1, n1, out + nout*L);
+		} else {
+			n1 = cic_model_process(&m->cic1, m->mix, run, out + nout*L);
+		}
+
+		nout += n1;
+	}
+
+	return nout;
+}
+
+void ddc_model_host(const s4_t *out, int nout, int nlanes, int ch, TYPECPX *samps, TYPEREAL DC_offset_I, TYPEREAL DC_offset_Q)
+{
+	int n;
+	TYPEREAL rescale = MPOW(2, -RXOUT_SCALE + CUTESDR_SCALE);
+
+	out += 2*ch;
+	for (n = 0; n < nout; n++, out += nlanes) {
+		s4_t i = out[0], q = out[1];
+
+		// NB: I/Q swapped as in snd_service()
+		samps[n].re = q * rescale + DC_offset_I;
+		samps[n].im = i * rescale + DC_offset_Q;
+	}
+}
@@ -0,0 +1,96 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#ifndef _RX_MODEL_H_
+#define _RX_MODEL_H_
+
+#include "types.h"
+#include "kiwi.gen.h"
+#include "datatypes.h"
+
+// Software model of the FPGA receiver datapath: the IQ mixer (iq_mixer.v) followed by the
+// pruned CIC decimators whose register widths come from the same cic_gen.c run that produced
+// the cic_*.vh files (verilog/rx/cic_*.h), plus the rescale/DC offset snd_service() applies.
+//
+// Arithmetic is bit-exact with the Verilog. The model is not cycle accurate: the hardware
+// pipeline registers only add a fixed latency, and the decimation phase depends on when the
+// hardware counters started. The NCO is a sin/cos table with the phase and amplitude widths of
+// the ip_dds_sin_cos_13b_15b core and so is only as exact as that approximation of the IP.
+//
+// Samples are interleaved by lane: lane 2*ch is I and 2*ch+1 is Q of channel ch. Integrators and
+// combs run over all lanes in the inner loop so the compiler can vectorize them.
+
+#define CIC_MAX_STAGES	8
+#define DDC_MAX_LANES	(2 * RX_CHANS)
+#define DDC_BLOCK		1024		// ADC samples processed per pass of the mixer
+
+// as emitted by cic_gen.c
+#define CIC_NO_PRUNE	1
+#define CIC_INTEG_COMB	2
+
+struct cic_gen_t {
+	int mode, stages, decim, in_bits, out_bits;
+	int acc[2*CIC_MAX_STAGES + 2];		// register widths: input, integrators 1..N, combs 1..N, output
+};
+
+extern const cic_gen_t cic_gen_rx1, cic_gen_rx2, cic_gen_wf1;
+
+struct cic_model_t {
+	const cic_gen_t *g;
+	int nlanes, decim, count;
+	int shift_in;			// pre-shift of variable decimation input (cic_prune_var.v)
+	int sh[2*CIC_MAX_STAGES + 1];	// bits truncated at the input of each integrator and comb
+	bool wide;				// integrators wider than 64 bits (waterfall)
+
+	// Registers are kept modulo 2^64 (2^128 if wide), only the low acc[] bits are significant.
+	u64_t integ[CIC_MAX_STAGES][DDC_MAX_LANES];
+	u64_t integ_hi[CIC_MAX_STAGES][DDC_MAX_LANES];
+	u64_t prev[CIC_MAX_STAGES][DDC_MAX_LANES];
+};
+
+// decim = 0 uses the generated (maximum) decimation, otherwise a power of 2 for variable decimation
+void cic_model_init(cic_model_t *c, const cic_gen_t *g, int nlanes, int decim);
+
+// in[nsamps][nlanes] -> out[][nlanes], returns number of output samples
+int cic_model_process(cic_model_t *c, const s4_t *in, int nsamps, s4_t *out);
+
+struct ddc_model_t {
+	int nchans, nlanes, mix_bits;
+	u4_t phase[RX_CHANS], phase_inc[RX_CHANS];
+	cic_model_t cic1, cic2;
+	bool two_stage;
+	s4_t mix[DDC_BLOCK * DDC_MAX_LANES], out1[DDC_BLOCK * DDC_MAX_LANES];
+};
+
+// audio channels: mixer -> cic_rx1 -> cic_rx2, RXO_BITS out
+void ddc_model_rx_init(ddc_model_t *m, int nchans);
+
+// waterfall: mixer -> cic_wf1 with decimation 1 .. WF_1CIC_MAXD, WFO_BITS out
+void ddc_model_wf_init(ddc_model_t *m, int nchans, int decim);
+
+// phase_inc as sent with CmdSetRXFreq/CmdSetWFFreq (freq / adc_clock * 2^32)
+void ddc_model_freq(ddc_model_t *m, int ch, u4_t phase_inc);
+
+// ADC_BITS samples common to all channels -> out[][nlanes], returns number of output samples
+int ddc_model_process(ddc_model_t *m, const s4_t *adc, int nsamps, s4_t *out);
+
+// one channel of rx output to what snd_service() hands to the CuteSDR code
+void ddc_model_host(const s4_t *out, int nout, int nlanes, int ch, TYPECPX *samps, TYPEREAL DC_offset_I, TYPEREAL DC_offset_Q);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#include "types.h"
+#include "kiwi.h"
+#include "misc.h"
+#include "rx_resamp.h"
+
+#include <string.h>
+#include <math.h>
+
+#ifdef __ARM_NEON__
+ #include <arm_neon.h>
+#endif
+
+#define CUTOFF		0.90	// of the lower Nyquist rate
+
+// 4-term Blackman-Harris over [0, 1]
+static double window(double x)
+{
+	return 0.35875 - 0.48829 * cos(2*K_PI*x) + 0.14128 * cos(4*K_PI*x) - 0.01168 * cos(6*K_PI*x);
+}
+
+static void resamp_kernel(resamp_t *r)
+{
+	int p, k, N;
+	double fc = CUTOFF * MIN(1.0, r->ratio);
+
+	// taps scale with the downsampling ratio to keep the same transition width, multiple of 4 for the dot product
+	N = (int) ceil(RESAMP_MIN_TAPS / MIN(1.0, r->ratio));
+	N = (N + 3) & ~3;
+	r->ntaps = N = MIN(N, RESAMP_MAX_TAPS);
+
+	// phase p is the output at p/RESAMP_NPHASE of an input sample past buf[i + N/2-1]
+	for (p = 0; p <= RESAMP_NPHASE; p++) {
+		float *h = &r->kern[p*N];
+		double sum = 0;
+
+		for (k = 0; k < N; k++) {
+			double x = k - (N/2 - 1) - (double) p / RESAMP_NPHASE;
+			double s = (x == 0)? 1.0 : sin(K_PI * fc * x) / (K_PI * fc * x);
+			h[k] = s * window((x + N/2) / N);
+			sum += h[k];
+		}
+		for (k = 0; k < N; k++)
+			h[k] /= sum;		// unity gain at DC for every phase
+	}
+
+	memset(r->buf, 0, sizeof(r->buf));
+	r->nbuf = N-1;
+	r->t = 0;
+}
+
+void resamp_init(resamp_t *r, double in_rate, double out_rate)
+{
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->step = in_rate / out_rate;
+	r->ratio = out_rate / in_rate;
+	resamp_kernel(r);
+}
+
+void resamp_set_rate(resamp_t *r, double in_rate, double out_rate)
+{
+	float ratio = out_rate / in_rate;
+
+	if (fabsf(ratio / r->ratio - 1) > 0.01) {
+		resamp_init(r, in_rate, out_rate);
+		return;
+	}
+
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->step = in_rate / out_rate;
+}
+
+int resamp_max_out(resamp_t *r, int nin)
+{
+	return (int) ceil(nin / r->step) + 1;
+}
+
+// (1-a) * x.h0 + a * x.h1
+static inline float dot2(const float *x, const float *h0, const float *h1, int n, float a)
+{
+	int k;
+
+	#ifdef __ARM_NEON__
+		float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+		for (k = 0; k < n; k += 4) {
+			float32x4_t xv = vld1q_f32(x+k);
+			acc0 = vmlaq_f32(acc0, xv, vld1q_f32(h0+k));
+			acc1 = vmlaq_f32(acc1, xv, vld1q_f32(h1+k));
+		}
+		float32x4_t d = vmlaq_n_f32(acc0, vsubq_f32(acc1, acc0), a);
+		float32x2_t s = vadd_f32(vget_low_f32(d), vget_high_f32(d));
+		return vget_lane_f32(vpadd_f32(s, s), 0);
+	#else
+		float s0[4] = {0,0,0,0}, s1[4] = {0,0,0,0};
+		for (k = 0; k < n; k += 4) {
+			s0[0] += x[k+0] * h0[k+0]; s1[0] += x[k+0] * h1[k+0];
+			s0[1] += x[k+1] * h0[k+1]; s1[1] += x[k+1] * h1[k+1];
+			s0[2] += x[k+2] * h0[k+2]; s1[2] += x[k+2] * h1[k+2];
+			s0[3] += x[k+3] * h0[k+3]; s1[3] += x[k+3] * h1[k+3];
+		}
+		float d0 = (s0[0] + s0[1]) + (s0[2] + s0[3]);
+		float d1 = (s1[0] + s1[1]) + (s1[2] + s1[3]);
+		return d0 + a * (d1 - d0);
+	#endif
+}
+
+// Next output while a full set of taps is available in buf[].
+static inline bool resamp_next(resamp_t *r, int *i, const float **h0, float *a)
+{
+	*i = (int) r->t;
+	if (*i + r->ntaps > r->nbuf) return false;
+	float f = (r->t - *i) * RESAMP_NPHASE;
+	int p = (int) f;
+	*h0 = &r->kern[p * r->ntaps];
+	*a = f - p;
+	r->t += r->step;
+	return true;
+}
+
+// keep the history still needed by the next output
+static void resamp_shift(resamp_t *r, int nch)
+{
+	int c, i = (int) r->t;
+
+	r->nbuf -= i;
+	r->t -= i;
+	for (c = 0; c < nch; c++)
+		memmove(&r->buf[c][0], &r->buf[c][i], r->nbuf * sizeof(float));
+}
+
+int resamp_process(resamp_t *r, const TYPEMONO16 *in, int nin, TYPEMONO16 *out)
+{
+	int i, j, n = 0, N = r->ntaps;
+	const float *h0;
+	float a, *b = &r->buf[0][r->nbuf];
+
+	assert(r->nbuf + nin <= RESAMP_MAX_TAPS + RESAMP_MAX_IN);
+	for (j = 0; j < nin; j++)
+		b[j] = in[j];
+	r->nbuf += nin;
+
+	while (resamp_next(r, &i, &h0, &a)) {
+		float s = roundf(dot2(&r->buf[0][i], h0, h0 + N, N, a));
+		out[n++] = (s > 32767)? 32767 : ((s < -32768)? -32768 : (TYPEMONO16) s);
+	}
+
+	resamp_shift(r, 1);
+	return n;
+}
+
+int resamp_process(resamp_t *r, const TYPECPX *in, int nin, TYPECPX *out)
+{
+	int i, j, n = 0, N = r->ntaps;
+	const float *h0;
+	float a, *b_re = &r->buf[0][r->nbuf], *b_im = &r->buf[1][r->nbuf];
+
+	assert(r->nbuf + nin <= RESAMP_MAX_TAPS + RESAMP_MAX_IN);
+	for (j = 0; j < nin; j++) {
+		b_re[j] = in[j].re;
+		b_im[j] = in[j].im;
+	}
+	r->nbuf += nin;
+
+	while (resamp_next(r, &i, &h0, &a)) {
+		out[n].re = dot2(&r->buf[0][i], h0, h0 + N, N, a);
+		out[n].im = dot2(&r->buf[1][i], h0, h0 + N, N, a);
+		n++;
+	}
+
+	resamp_shift(r, 2);
+	return n;
+}
@@ -0,0 +1,60 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#ifndef _RX_RESAMP_H_
+#define _RX_RESAMP_H_
+
+#include "types.h"
+#include "datatypes.h"
+#include "cuteSDR.h"
+
+// Fractional resampler for the audio sent to a client at a rate of its choosing.
+//
+// Windowed-sinc polyphase filter, RESAMP_NPHASE phases with the coefficients linearly
+// interpolated between adjacent phases, so any ratio works and the ratio can be changed on
+// the fly (e.g. ADC clock corrections) without a discontinuity. The filter cutoff follows
+// the lower of the two rates, so downsampling is anti-aliased.
+
+#define RESAMP_NPHASE	64
+#define RESAMP_MIN_TAPS	32
+#define RESAMP_MAX_TAPS	128
+#define RESAMP_MAX_IN	FASTFIR_OUTBUF_SIZE		// input samples per call
+
+struct resamp_t {
+	double in_rate, out_rate;
+	double step;		// input samples per output sample
+	double t;			// position of the next output in buf[] (input samples)
+	int ntaps, nbuf;
+	float ratio;		// out_rate/in_rate the kernel was designed for
+	float kern[(RESAMP_NPHASE+1) * RESAMP_MAX_TAPS];
+	float buf[2][RESAMP_MAX_TAPS + RESAMP_MAX_IN];		// re, im: history followed by new input
+};
+
+void resamp_init(resamp_t *r, double in_rate, double out_rate);
+
+// new filter only if the ratio changes significantly, otherwise just the step
+void resamp_set_rate(resamp_t *r, double in_rate, double out_rate);
+
+int resamp_max_out(resamp_t *r, int nin);
+
+// returns number of output samples
+int resamp_process(resamp_t *r, const TYPEMONO16 *in, int nin, TYPEMONO16 *out);
+int resamp_process(resamp_t *r, const TYPECPX *in, int nin, TYPECPX *out);
+
+#endif
@@ -38,6 +38,7 @@ Boston, MA  02110-1301, USA.
 
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <time.h>
 #include <sched.h>
@@ -62,6 +63,7 @@ stream_t streams[] = {
 	{ AJAX_VERSION,		"VER" },
 	{ AJAX_STATUS,		"status" },
 	{ AJAX_DUMP,		"dump" },
+	{ AJAX_METRICS,		"metrics" },
 	{ 0 }
 };
 
@@ -247,6 +249,8 @@ int rx_server_users()
 	
 	conn_t *c = conns;
 	for (int i=0; i < N_CONNS; i++) {
+		// internal connections don't hold off updates
+		if (c->internal_connection) { c++; continue; }
 		//if (c->valid && c->type == STREAM_SOUND && c->arrived) users++;
 		if (c->valid && c->type == STREAM_SOUND) users++;
 		if (c->valid && (c->type == STREAM_SOUND || c->type == STREAM_WATERFALL)) any = 1;
@@ -308,6 +312,74 @@ void stream_tramp(void *param)
 	(conn->task_func)(param);
 }
 
+// handle case of server initially starting disabled, but then being enabled later by admin
+static void snd_wf_init()
+{
+	static bool init_snd_wf;
+	if (!init_snd_wf && !down) {
+		c2s_sound_init();
+		c2s_waterfall_init();
+		init_snd_wf = true;
+	}
+}
+
+// A sound channel with no client behind it, for receivers run by the server itself (e.g. the WSPR skimmer).
+// It's driven by queueing the same commands the client would send with rx_server_internal_cmd().
+// Whatever the channel sends is discarded. Set c->kick to close it.
+conn_t *rx_server_internal(const char *name)
+{
+	conn_t *c;
+	int rx;
+	stream_t *st = &streams[STREAM_SOUND];
+
+	if (down || update_in_progress || backup_in_progress) return NULL;
+	snd_wf_init();
+
+	for (c=conns; c<&conns[N_CONNS]; c++) {
+		if (!c->valid) break;
+	}
+	if (c == &conns[N_CONNS]) return NULL;
+
+	rx_chan_free(&rx);
+	if (rx == -1) return NULL;
+	rx_channels[rx].busy = true;
+
+	conn_init(c);
+	c->type = STREAM_SOUND;
+	c->internal_connection = true;
+	c->isLocal = true;
+	c->inactivity_timeout_override = true;
+	c->rx_channel = rx;
+	rx_channels[rx].conn_snd = c;
+
+	kiwi_strncpy(c->remote_ip, "127.0.0.1", NET_ADDRSTRLEN);
+	c->tstamp = timer_ms();
+	ndesc_init(&c->s2c, NULL);
+	ndesc_init(&c->c2s, NULL);
+	c->ui = &user_iface[0];
+	c->arrival = timer_sec();
+	clock_conn_init(c);
+
+	c->task_func = st->f;
+	asprintf(&c->tname, "%s-%d", name, rx);
+	c->task = CreateTaskSF(stream_tramp, c->tname, c, st->priority, CTF_RX_CHANNEL | (rx & CTF_CHANNEL), 0);
+	c->valid = true;
+	return c;
+}
+
+void rx_server_internal_cmd(conn_t *c, const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+
+	assert(c->internal_connection);
+	va_start(ap, fmt);
+	vasprintf(&s, fmt, ap);
+	va_end(ap);
+	nbuf_allocq(&c->c2s, s, strlen(s));
+	free(s);
+}
+
 // if this connection is new, spawn new receiver channel with sound/waterfall tasks
 conn_t *rx_server_websocket(struct mg_connection *mc, websocket_mode_e mode)
 {
@@ -372,13 +444,7 @@ conn_t *rx_server_websocket(struct mg_connection *mc, websocket_mode_e mode)
 	}
     free(uri_m);
 
-	// handle case of server initially starting disabled, but then being enabled later by admin
-	static bool init_snd_wf;
-	if (!init_snd_wf && !down) {
-		c2s_sound_init();
-		c2s_waterfall_init();
-		init_snd_wf = true;
-	}
+	snd_wf_init();
 
 	if (down || update_in_progress || backup_in_progress) {
 		//printf("down=%d UIP=%d stream=%s\n", down, update_in_progress, st->uri);
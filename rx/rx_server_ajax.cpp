@@ -35,6 +35,7 @@ Boston, MA  02110-1301, USA.
 #include "data_pump.h"
 #include "ext_int.h"
 #include "net.h"
+#include "metrics.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -51,7 +52,7 @@ Boston, MA  02110-1301, USA.
 char *rx_server_ajax(struct mg_connection *mc)
 {
 	int i, j, n;
-	char *sb, *sb2;
+	char *sb;
 	stream_t *st;
 	char *uri = (char *) mc->uri;
 	
@@ -70,6 +71,7 @@ char *rx_server_ajax(struct mg_connection *mc)
 		&& st->type != AJAX_STATUS
 		&& st->type != AJAX_DISCOVERY
 		&& st->type != AJAX_DUMP
+		&& st->type != AJAX_METRICS
 		)
 			return NULL;
 
@@ -81,6 +83,7 @@ char *rx_server_ajax(struct mg_connection *mc)
 		&& st->type != AJAX_STATUS
 		&& st->type != AJAX_DISCOVERY
 		&& st->type != AJAX_PHOTO
+		&& st->type != AJAX_METRICS
 		) {
 		lprintf("rx_server_ajax: missing query string! uri=<%s>\n", uri);
 		return NULL;
@@ -283,15 +286,14 @@ char *rx_server_ajax(struct mg_connection *mc)
 		if (strcmp(mc->query_string, "b3f5ca67159c3bfb6dc150bd1a2064f50b8367ee") != 0)
 			return NULL;
 		dump();
-		asprintf(&sb, "--- LOG DUMP ---\n");
+		sb = kstr_asprintf(NULL, "--- LOG DUMP ---\n");
 		log_save_t *ls = log_save_p;
 		int first = MIN(ls->idx, N_LOG_SAVE/2);
 		for (i = 0; i < first; i++) {
 			sb = kstr_cat(sb, (char *) ls->arr[i]);
 		}
 		if (ls->not_shown) {
-			asprintf(&sb2, "\n--- %d lines not shown ---\n\n", ls->not_shown);
-			sb = kstr_cat(sb, kstr_wrap(sb2));
+			sb = kstr_asprintf(sb, "\n--- %d lines not shown ---\n\n", ls->not_shown);
 		}
 		for (; i < ls->idx; i++) {
 			sb = kstr_cat(sb, (char *) ls->arr[i]);
@@ -299,6 +301,12 @@ char *rx_server_ajax(struct mg_connection *mc)
 		break;
 	}
 
+	// SECURITY:
+	//	Returns Prometheus text format, read-only stats like AJAX_STATUS
+	case AJAX_METRICS:
+		sb = metrics_text();
+		break;
+
 	default:
 		return NULL;
 		break;
@@ -40,7 +40,10 @@ Boston, MA  02110-1301, USA.
 #include "cfg.h"
 #include "mongoose.h"
 #include "ima_adpcm.h"
+#include "rx_resamp.h"
+#include "snd_codec.h"
 #include "ext_int.h"
+#include "metrics.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -102,12 +105,16 @@ void c2s_sound(void *param)
 	int mode=-1, _mode, autonotch=-1, _autonotch, genattn=0, _genattn, mute;
 	double z1 = 0;
 
-	double frate = ext_update_get_sample_rateHz(rx_chan);      // FIXME: do this in loop to get incremental changes
+	double frate = ext_update_get_sample_rateHz(rx_chan);      // incremental changes only followed by the resampler, see below
 	//printf("### frate %f SND_RATE %d\n", frate, SND_RATE);
 	#define ATTACK_TIMECONST .01	// attack time in seconds
 	float sMeterAlpha = 1.0 - expf(-1.0/((float) frate * ATTACK_TIMECONST));
 	float sMeterAvg_dB = 0;
-	bool compression = true;
+	int codec = SND_CODEC_ADPCM, codec_kbps = 0;	// as requested, rx->snd_codec.codec is what's in use
+	bool codec_change = false;
+	int decim = 1, decim_max = 1;	// FIR output decimation, decim_max set by client if it supports it
+	int out_rate = 0;				// non-zero: audio resampled to this rate for the client ("SET out_rate=")
+	float bw = 0;
 	
 	snd->seq = 0;
 	
@@ -140,7 +147,9 @@ void c2s_sound(void *param)
 	u4_t cmd_recv = 0;
 	bool cmd_recv_ok = false, change_LPF = false, change_freq_mode = false;
 	
-	memset(&rx->adpcm_snd, 0, sizeof(ima_adpcm_state_t));
+	snd_codec_t *sc = &rx->snd_codec;
+	snd_codec_init(sc, codec, SND_RATE, 0);
+	metric_set(M_SND_CODEC, rx_chan, sc->codec);
 
 	//clprintf(conn, "SND INIT conn: %p mc: %p %s:%d %s\n",
 	//	conn, conn->mc, conn->remote_ip, conn->remote_port, conn->mc->uri);
@@ -158,6 +167,9 @@ void c2s_sound(void *param)
 			i_phase = f_phase * pow(2,32);
 			if (do_sdr) spi_set(CmdSetRXFreq, rx_chan, i_phase);
 			//printf("SND%d freq updated due to ADC clock correction\n", rx_chan);
+
+			// the resampler absorbs the change in the actual sample rate so the client sees exactly out_rate
+			if (out_rate) resamp_set_rate(&rx->resamp, ext_update_get_sample_rateHz(rx_chan)/decim, out_rate);
 		}
 
 		if (nb) web_to_app_done(conn, nb);
@@ -221,6 +233,8 @@ void c2s_sound(void *param)
 					if (mode == MODE_NBFM)
 						new_nbfm = true;
 					change_freq_mode = true;
+					if (out_rate)
+						resamp_init(&rx->resamp, ext_update_get_sample_rateHz(rx_chan)/decim, out_rate);
 				}
 
 				if (mode == MODE_NBFM && (new_freq || new_nbfm)) {
@@ -237,7 +251,7 @@ void c2s_sound(void *param)
 					if (locut < -fmax) locut = -fmax;
 					
 					// bw for post AM det is max of hi/lo filter cuts
-					float bw = fmaxf(fabs(hicut), fabs(locut));
+					bw = fmaxf(fabs(hicut), fabs(locut));
 					if (bw > frate/2) bw = frate/2;
 					//cprintf(conn, "SND LOcut %.0f HIcut %.0f BW %.0f/%.0f\n", locut, hicut, bw, frate/2);
 					
@@ -247,7 +261,7 @@ void c2s_sound(void *param)
 					
 					// post AM detector filter
 					// FIXME: not needed if we're doing convolver-based LPF in javascript due to decompression?
-					m_AM_FIR[rx_chan].InitLPFilter(0, 1.0, 50.0, bw, bw*1.8, frate);
+					m_AM_FIR[rx_chan].InitLPFilter(0, 1.0, 50.0, bw, fminf(bw*1.8, frate/decim/2), frate/decim);
 					cmd_recv |= CMD_PASSBAND;
 					
 					change_LPF = true;
@@ -306,7 +320,7 @@ void c2s_sound(void *param)
 				manGain = _manGain;
 				//printf("AGC %d hang=%d thresh=%d slope=%d decay=%d manGain=%d srate=%.1f\n",
 				//	agc, hang, thresh, slope, decay, manGain, frate);
-				m_Agc[rx_chan].SetParameters(agc, hang, thresh, manGain, slope, decay, frate);
+				m_Agc[rx_chan].SetParameters(agc, hang, thresh, manGain, slope, decay, frate/decim);
 				cmd_recv |= CMD_AGC;
 				continue;
 			}
@@ -326,6 +340,37 @@ void c2s_sound(void *param)
 				continue;
 			}
 
+			n = sscanf(cmd, "SET decim=%d", &j);
+			if (n == 1) {
+				decim_max = (j >= 1)? j : 1;
+				continue;
+			}
+
+			n = sscanf(cmd, "SET out_rate=%d", &j);
+			if (n == 1) {
+				out_rate = (j <= 0)? 0 : MAX(SND_OUT_RATE_MIN, MIN(SND_OUT_RATE_MAX, j));
+				if (out_rate)
+					resamp_init(&rx->resamp, ext_update_get_sample_rateHz(rx_chan)/decim, out_rate);
+				send_msg(conn, SM_NO_DEBUG, "MSG audio_rate_out=%d", out_rate);
+				if (codec == SND_CODEC_OPUS) codec_change = true;		// encoder runs at the output rate
+				continue;
+			}
+
+			char *codec_m = NULL;
+			n = sscanf(cmd, "SET codec=%16ms kbps=%d", &codec_m, &j);
+			if (n >= 1) {
+				codec = kiwi_str2enum(codec_m, snd_codec_s, N_SND_CODEC);
+				if (codec == NOT_FOUND) {
+					clprintf(conn, "SND bad codec <%s>\n", codec_m);
+					codec = SND_CODEC_ADPCM;
+				}
+				codec_kbps = (n == 2)? j : 0;
+				codec_change = true;
+			    free(codec_m);
+				continue;
+			}
+			free(codec_m);
+
 			n = sscanf(cmd, "SET mute=%d", &mute);
 			if (n == 1) {
 				//printf("mute %d\n", mute);
@@ -396,7 +441,7 @@ void c2s_sound(void *param)
 		// no keep-alive seen for a while or the bug where an initial cmds are not received and the connection hangs open
 		// and locks-up a receiver channel
 		conn->keep_alive = timer_sec() - ka_time;
-		bool keepalive_expired = (conn->keep_alive > KEEPALIVE_SEC);
+		bool keepalive_expired = (conn->keep_alive > KEEPALIVE_SEC && !conn->internal_connection);
 		bool connection_hang = (conn->keepalive_count > 4 && cmd_recv != CMD_ALL);
 		if (keepalive_expired || connection_hang || conn->inactivity_timeout || conn->kick) {
 			//if (keepalive_expired) clprintf(conn, "SND KEEP-ALIVE EXPIRED\n");
@@ -439,6 +484,7 @@ void c2s_sound(void *param)
 		#define	SND_FLAG_LPF		0x10
 		#define	SND_FLAG_ADC_OVFL	0x20
 		#define	SND_FLAG_NEW_FREQ	0x40
+		#define	SND_FLAG_DECIM		0x80	// first data byte is output decimation
 		
 		bp_real = &out_pkt.buf_real[0];
 		bp_iq = &out_pkt.buf_iq[0];
@@ -447,7 +493,49 @@ void c2s_sound(void *param)
 
 		ext_receive_S_meter_t receive_S_meter = ext_users[rx_chan].receive_S_meter;
 
-		while (bc < 1024) {		// fixme: larger?
+		// New codec between packets. The client switches decoders when the message arrives,
+		// which is just ahead of the first packet using the new codec.
+		if (codec_change) {
+			snd_codec_init(sc, codec, out_rate? out_rate : SND_RATE, codec_kbps);
+			send_msg(conn, SM_NO_DEBUG, "MSG audio_codec=%s", snd_codec_s[sc->codec]);
+			metric_set(M_SND_CODEC, rx_chan, sc->codec);
+			codec_change = false;
+		}
+
+		// Narrow passbands are sent at a reduced sample rate, changed only between packets.
+		// Not when extensions are using the audio or IQ since they expect SND_RATE.
+		// FFT and sub-band consumers are fed before the decimation and aren't affected.
+		ext_users_t *eu = &ext_users[rx_chan];
+		bool ext_samps = (eu->receive_iq != NULL || eu->receive_iq_tid != (tid_t) NULL ||
+			eu->receive_real != NULL || eu->receive_real_tid != (tid_t) NULL);
+		// With out_rate the decimation is limited so the FIR output rate stays above it,
+		// and the client gets out_rate directly so the decimation isn't sent.
+		// Opus only takes certain rates, so no decimation (or out_rate must be one of them).
+		int max = (mode == MODE_IQ || mode == MODE_NBFM || ext_samps || sc->codec == SND_CODEC_OPUS)? 1 : decim_max;
+		if (out_rate) max = MAX(1, MIN(max, (int) (frate / out_rate)));
+		int _decim = m_FastFIR[rx_chan].SetMaxDecimation(max);
+		
+		if (decim != _decim) {
+			decim = _decim;
+			double srate = frate/decim;
+			m_Agc[rx_chan].SetParameters(agc, hang, thresh, manGain, slope, decay, srate);
+			m_AM_FIR[rx_chan].InitLPFilter(0, 1.0, 50.0, bw, fminf(bw*1.8, srate/2), srate);
+			sMeterAlpha = 1.0 - expf(-1.0/((float) srate * ATTACK_TIMECONST));
+			if (out_rate) resamp_set_rate(&rx->resamp, ext_update_get_sample_rateHz(rx_chan)/decim, out_rate);
+			change_LPF = true;
+		}
+		
+		bool send_decim = (decim > 1 && !out_rate);
+		if (send_decim) {
+			*bp_real++ = decim; bc++;
+		}
+
+		// FIR blocks per packet: 1024 bytes of compressed audio, one block uncompressed or IQ.
+		// Fewer blocks when out_rate is above frate so the client sees the same packet size.
+		int blks = 0, pkt_blks = (sc->codec != SND_CODEC_PCM && mode != MODE_IQ)? 4 : 1;
+		if (out_rate > frate) pkt_blks = MAX(1, (int) (pkt_blks * frate / out_rate));
+
+		while (blks < pkt_blks) {		// fixme: larger?
 
 			while (rx->wr_pos == rx->rd_pos) {
 				evSnd(EC_EVENT, EV_SND, -1, "rx_snd", "sleeping");
@@ -489,14 +577,17 @@ void c2s_sound(void *param)
 			rx->iq_seqnum[rx->iq_wr_pos] = rx->iq_seq;
 			rx->iq_seq++;
 			int ns_in = NRX_SAMPS, ns_out;
+			u4_t block_us = timer_us();
 
 			ns_out = m_FastFIR[rx_chan].ProcessData(rx_chan, ns_in, i_samps, f_samps);
 
 			// FIR has a pipeline delay: ns_in|ns_out = 85|512 85|0 85|0 85|0 85|0 85|0 85|512 ... (85*6 = 510)
+			// ns_out is 512/decim when decimating
 			//real_printf("%d|%d ", ns_in, ns_out); fflush(stdout);
 			if (!ns_out) {
 				continue;
 			}
+			blks++;
 
 			rx->iq_wr_pos = (rx->iq_wr_pos+1) & (N_DPBUF-1);
 
@@ -517,11 +608,12 @@ void c2s_sound(void *param)
 			
 				// S-meter value in audio packet is sent less often than if we send it from here
 				if (receive_S_meter != NULL && (j == 0 || j == ns_out/2))
-					receive_S_meter(rx_chan, sMeterAvg_dB + S_meter_cal);
+					ext_queue_S_meter(rx_chan, sMeterAvg_dB + S_meter_cal);
 			}
 			
+			// f_samps must not be modified after this (the callback is deferred)
 			if (ext_users[rx_chan].receive_iq != NULL && mode != MODE_NBFM)
-				ext_users[rx_chan].receive_iq(rx_chan, 0, ns_out, f_samps);
+				ext_queue_iq(rx_chan, ns_out, f_samps);
 			
 			if (ext_users[rx_chan].receive_iq_tid != (tid_t) NULL && mode != MODE_NBFM)
 				TaskWakeup(ext_users[rx_chan].receive_iq_tid, TRUE, TO_VOID_PARAM(rx_chan));
@@ -595,43 +687,54 @@ void c2s_sound(void *param)
 			}
 
 			if (mode == MODE_IQ) {
-				m_Agc[rx_chan].ProcessData(ns_out, f_samps, f_samps);
+				TYPECPX *a_samps = rx->agc_samples;
+				m_Agc[rx_chan].ProcessData(ns_out, f_samps, a_samps);
+				int ns_pkt = ns_out;
+
+				if (out_rate) {
+					ns_pkt = resamp_process(&rx->resamp, a_samps, ns_out, rx->resamp_iq);
+					a_samps = rx->resamp_iq;
+				}
 
-                for (j=0; j<ns_out; j++) {
+                for (j=0; j<ns_pkt; j++) {
                     // can cast TYPEREAL directly to s2_t due to choice of CUTESDR_SCALE
-                    s2_t re = (s2_t) f_samps->re, im = (s2_t) f_samps->im;
+                    s2_t re = (s2_t) a_samps->re, im = (s2_t) a_samps->im;
                     *bp_iq++ = (re >> 8) & 0xff; bc++;	// choose a network byte-order (big endian)
                     *bp_iq++ = (re >> 0) & 0xff; bc++;
                     *bp_iq++ = (im >> 8) & 0xff; bc++;
                     *bp_iq++ = (im >> 0) & 0xff; bc++;
-                    f_samps++;
+                    a_samps++;
                 }
 		    } else {
                 rx->real_wr_pos = (rx->real_wr_pos+1) & (N_DPBUF-1);
     
                 if (ext_users[rx_chan].receive_real != NULL)
-                    ext_users[rx_chan].receive_real(rx_chan, 0, ns_out, r_samps);
+                    ext_queue_real(rx_chan, ns_out, r_samps);
                 
                 if (ext_users[rx_chan].receive_real_tid != (tid_t) NULL)
                     TaskWakeup(ext_users[rx_chan].receive_real_tid, TRUE, TO_VOID_PARAM(rx_chan));
     
-                if (compression) {
-                    encode_ima_adpcm_i16_e8(r_samps, bp_real, ns_out, &rx->adpcm_snd);
-                    bp_real += ns_out/2;		// fixed 4:1 compression
-                    bc += ns_out/2;
-                } else {
-                    for (j=0; j<ns_out; j++) {
-                        *bp_real++ = (*r_samps >> 8) & 0xff; bc++;	// choose a network byte-order (big endian)
-                        *bp_real++ = (*r_samps >> 0) & 0xff; bc++;
-                        r_samps++;
-                    }
+                // resampled after the extensions, which expect frate
+                TYPEMONO16 *p_samps = r_samps;
+                int ns_pkt = ns_out;
+                
+                if (out_rate) {
+                    p_samps = rx->resamp_real;
+                    ns_pkt = resamp_process(&rx->resamp, r_samps, ns_out, p_samps);
                 }
+    
+                assert(bc + snd_codec_max_bytes(sc, ns_pkt) <= sizeof(out_pkt.buf_real));
+                u4_t enc_us = timer_us();
+                int bytes = snd_codec_encode(sc, p_samps, ns_pkt, bp_real);
+                metric_observe(M_SND_ENCODE, rx_chan, (timer_us() - enc_us) / 1e6);
+                bp_real += bytes;
+                bc += bytes;
             }
 			
 			#if 0
                 static u4_t last_time[RX_CHANS];
                 static int nctr;
-                ncnt[rx_chan] += ns_out * (compression? 4:1);
+                ncnt[rx_chan] += ns_out * ((sc->codec == SND_CODEC_ADPCM)? 4:1);
                 int nbuf = ncnt[rx_chan] / SND_RATE;
                 if (nbuf >= nctr) {
                     nctr++;
@@ -651,6 +754,9 @@ void c2s_sound(void *param)
                     last_time[rx_chan] = now;
                 }
 			#endif
+
+			ext_queue_commit(rx_chan);
+			metric_observe(M_SND_BLOCK, rx_chan, (timer_us() - block_us) / 1e6);
 		}
 
 		NextTask("s2c begin");
@@ -666,6 +772,7 @@ void c2s_sound(void *param)
 		out_pkt.h.smeter[1] = sMeter & 0xff;
 		
 		if (rx_adc_ovfl) out_pkt.h.smeter[0] |= SND_FLAG_ADC_OVFL;
+		if (send_decim) out_pkt.h.smeter[0] |= SND_FLAG_DECIM;
 
 		if (change_LPF) {
 			out_pkt.h.smeter[0] |= SND_FLAG_LPF;
@@ -685,6 +792,7 @@ void c2s_sound(void *param)
 		int bytes = sizeof(out_pkt.h) + bc;
 		app_to_web(conn, (char*) &out_pkt, bytes);
 		audio_bytes += sizeof(out_pkt.h.smeter) + bc;
+		if (sc->samps) metric_set(M_SND_CODEC_KBPS, rx_chan, sc->bytes * 8.0 * sc->rate / sc->samps / 1e3);
 		
 		#if 0
 			static u4_t last_time[RX_CHANS];
@@ -697,7 +805,7 @@ void c2s_sound(void *param)
 		#if 0
             static u4_t last_time[RX_CHANS];
             static int nctr;
-            ncnt[rx_chan] += bc * (compression? 4:1);
+            ncnt[rx_chan] += bc * ((sc->codec == SND_CODEC_ADPCM)? 4:1);
             int nbuf = ncnt[rx_chan] / SND_RATE;
             if (nbuf >= nctr) {
                 nctr++;
@@ -35,6 +35,7 @@ Boston, MA  02110-1301, USA.
 #include "ext_int.h"
 #include "net.h"
 #include "clk.h"
+#include "metrics.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -163,8 +164,10 @@ void update_vars_from_config()
     cfg_default_int("waterfall_cal", WATERFALL_CALIBRATION_DEFAULT, &update_cfg);
     cfg_default_bool("contact_admin", true, &update_cfg);
     cfg_default_int("chan_no_pwd", 0, &update_cfg);
+    ext_budget_pct = cfg_default_int("ext_budget_pct", EXT_BUDGET_PCT_DEFAULT, &update_cfg);
     cfg_default_string("owner_info", "", &update_cfg);
     cfg_default_int("WSPR.autorun", 0, &update_cfg);
+    cfg_default_string("WSPR.skimmer_bands", "", &update_cfg);
     cfg_default_int("clk_adj", 0, &update_cfg);
     cfg_default_int("sdr_hu_dom_sel", 0, &update_cfg);
     freq_offset = cfg_default_float("freq_offset", 0, &update_cfg);
@@ -336,8 +339,13 @@ void webserver_collect_print_stats(int print)
 			cpu_stats_buf = NULL;
 			free(s);
 		}
+		float ecpu = ecpu_use();
 		asprintf(&cpu_stats_buf, "\"ct\":%d,\"cu\":%.0f,\"cs\":%.0f,\"ci\":%.0f,\"ce\":%.0f",
-			timer_sec(), del_user, del_sys, del_idle, ecpu_use());
+			timer_sec(), del_user, del_sys, del_idle, ecpu);
+		metric_set(M_CPU_USER, 0, del_user);
+		metric_set(M_CPU_SYS, 0, del_sys);
+		metric_set(M_CPU_IDLE, 0, del_idle);
+		metric_set(M_ECPU_USE, 0, ecpu);
 		last_user = user;
 		last_sys = sys;
 		last_idle = idle;
@@ -35,6 +35,7 @@ Boston, MA  02110-1301, USA.
 #include "cfg.h"
 #include "datatypes.h"
 #include "ext_int.h"
+#include "metrics.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -75,6 +76,30 @@ Boston, MA  02110-1301, USA.
 
 static const int wf_fps[] = { WF_SPEED_SLOW, WF_SPEED_MED, WF_SPEED_FAST };
 
+// Backpressure from a slow client uplink: frames back up in the s2c queue (normally 0 or 1 deep)
+// until nbuf starts discarding at ND_HIWAT. Instead halve the frame rate per throttle level and
+// skip computing frames entirely when the queue is deep enough that they'd only add latency.
+// The user's audio queue is included so the waterfall gives way to the audio on a shared link.
+#define	WF_Q_HI				4
+#define	WF_Q_LO				1
+#define	WF_Q_SKIP			(ND_HIWAT/4)
+#define	WF_THROTTLE_MAX		3
+#define	WF_THROTTLE_UP_MS	1000
+#define	WF_THROTTLE_DN_MS	5000
+
+// Delta coding (WF_COMP_DELTA): successive lines of the noise floor are strongly correlated
+// so each line is predicted from the average of the pixel to its left and the pixel above
+// (same bin, previous line) and the residual quantized with a step of 2*NEAR+1 dB, i.e. with
+// at most NEAR dB of error (ADPCM is typically worse). Residuals are Rice coded with the
+// parameter adapted to the running mean (as in JPEG-LS) plus a run mode for the zero residuals
+// of flat areas. A keyframe is predicted from the left pixel only and is sent initially, after
+// a zoom/pan and periodically. The client reconstructs exactly what the encoder did so
+// the prediction can't drift. A line the s2c queue drops doesn't update the reference.
+#define	WF_DELTA_NEAR		2
+#define	WF_DELTA_KEYFRAME	64		// frames
+#define	WF_DELTA_NMAX		64		// adaptation window
+#define	WF_DELTA_QLIM		24		// escape: QLIM ones, then the 9-bit symbol
+
 static float window_function_c[WF_C_NSAMPS];
 
 struct iq_t {
@@ -90,8 +115,15 @@ static struct wf_t {
 	u2_t wf2fft_map[WF_WIDTH];							// map is 1:1 with plot
 	int start, prev_start, zoom, prev_zoom;
 	int mark, slow, fft_used_limit;
-	bool new_map, new_map2, compression;
+	int throttle;
+	u4_t throttle_ms, busy_ms;
+	bool new_map, new_map2;
+	int compression;
 	int flush_wf_pipe;
+	bool delta_ok;
+	int delta_frames;
+	u4_t delta_start, delta_zoom;
+	u1_t delta_ref[WF_WIDTH];
 	SPI_MISO hw_miso;
 } wf_inst[WF_CHANS];
 
@@ -105,6 +137,8 @@ struct wf_pkt_t {
 	char id4[4];
 	u4_t x_bin_server;
 	#define WF_FLAGS_COMPRESSION 0x00010000
+	#define WF_FLAGS_DELTA       0x00020000		// buf[0] = NEAR, then the bitstream
+	#define WF_FLAGS_KEYFRAME    0x00040000
 	u4_t flags_x_zoom_server;
 	u4_t seq;
 	union {
@@ -167,9 +201,113 @@ void c2s_waterfall_init()
 	assert(WF_C_NSAMPS <= 8192);	// hardware sample buffer length limitation
 }
 
-void c2s_waterfall_compression(int rx_chan, bool compression)
+void c2s_waterfall_compression(int rx_chan, int compression)
+{
+	wf_t *wf = &wf_inst[rx_chan];
+	wf->compression = compression;
+	wf->delta_ok = false;
+}
+
+struct wf_bits_t {
+	u1_t *bp, *end;
+	u4_t acc;
+	int nacc;
+	bool ovfl;
+};
+
+// n <= 24
+static void wf_bits_put(wf_bits_t *b, u4_t v, int n)
+{
+	b->acc = (b->acc << n) | (v & ((1 << n) - 1));
+	b->nacc += n;
+	while (b->nacc >= 8) {
+		b->nacc -= 8;
+		if (b->bp == b->end) {
+			b->ovfl = true;
+			return;
+		}
+		*b->bp++ = b->acc >> b->nacc;
+	}
+}
+
+struct wf_rice_t {
+	int A, N;
+};
+
+static int wf_rice_k(wf_rice_t *r)
 {
-	wf_inst[rx_chan].compression = compression;
+	int k;
+	for (k = 0; (r->N << k) < r->A; k++)
+		;
+	return k;
+}
+
+static void wf_rice_update(wf_rice_t *r, u4_t s)
+{
+	r->A += s;
+	if (++r->N == WF_DELTA_NMAX) {
+		r->A >>= 1;
+		r->N >>= 1;
+	}
+}
+
+// Codes in[] relative to ref[] (NULL for a keyframe) leaving the client's reconstruction in rec[].
+// Returns the number of bytes written to out[] or -1 if that would exceed out_max.
+// Must match wf_delta_decode() in openwebrx.js
+static int wf_delta_encode(u1_t *in, u1_t *ref, u1_t *rec, u1_t *out, int out_max, int near)
+{
+	int i, q = 2*near + 1;
+	wf_bits_t b = { out, out + out_max };
+	wf_rice_t r = { 8, 1 };
+
+	wf_bits_put(&b, near, 8);
+
+	#define WF_DELTA_PRED(i) \
+		(ref? ((i)? ((rec[(i)-1] + ref[i] + 1) >> 1) : ref[0]) : ((i)? rec[(i)-1] : 128))
+	#define WF_DELTA_QUANT(e) \
+		(((e) >= 0)? (((e) + near) / q) : -((-(e) + near) / q))
+	#define WF_DELTA_RECON(p, qe) \
+		MAX(0, MIN(255, (p) + (qe) * q))
+
+	for (i = 0; i < WF_WIDTH; i++) {
+		int p = WF_DELTA_PRED(i);
+		int qe = WF_DELTA_QUANT(in[i] - p);
+		rec[i] = WF_DELTA_RECON(p, qe);
+		u4_t s = (qe >= 0)? (2*qe) : (-2*qe - 1);
+
+		int k = wf_rice_k(&r);
+		u4_t uq = s >> k;
+		if (uq >= WF_DELTA_QLIM) {
+			wf_bits_put(&b, ~0, WF_DELTA_QLIM);
+			wf_bits_put(&b, s, 9);
+		} else {
+			wf_bits_put(&b, ((1 << uq) - 1) << 1, uq + 1);
+			if (k) wf_bits_put(&b, s, k);
+		}
+		wf_rice_update(&r, s);
+
+		// run mode: count the zero residuals that follow, Exp-Golomb coded
+		if (k == 0 && s == 0) {
+			int run = 0;
+			while (i+1 < WF_WIDTH) {
+				p = WF_DELTA_PRED(i+1);
+				if (WF_DELTA_QUANT(in[i+1] - p) != 0) break;
+				rec[++i] = p;
+				wf_rice_update(&r, 0);
+				run++;
+			}
+			int nb;
+			for (nb = 1; ((run+1) >> nb) != 0; nb++)
+				;
+			wf_bits_put(&b, 0, nb - 1);
+			wf_bits_put(&b, run + 1, nb);
+		}
+
+		if (b.ovfl) return -1;
+	}
+
+	if (b.nacc) wf_bits_put(&b, 0, 8 - b.nacc);
+	return b.ovfl? -1 : (b.bp - out);
 }
 
 #define	CMD_ZOOM	0x01
@@ -220,7 +358,8 @@ void c2s_waterfall(void *param)
 	wf = &wf_inst[rx_chan];
 	memset(wf, 0, sizeof(wf_t));
 	wf->conn = conn;
-	wf->compression = true;
+	wf->compression = WF_COMP_ADPCM;
+	metric_set(M_WF_THROTTLE, rx_chan, 0);
 
 	fft = &fft_inst[rx_chan];
 
@@ -649,12 +788,40 @@ void c2s_waterfall(void *param)
 		}
 		#endif
 
+		// backpressure
+		conn_t *csnd = conn->other;
+		int queued = nbuf_depth(&conn->s2c);
+		if (csnd && csnd->valid && csnd->type == STREAM_SOUND && csnd->rx_channel == rx_chan)
+			queued = MAX(queued, nbuf_depth(&csnd->s2c));
+		u4_t now_ms = timer_ms();
+		int throttle = wf->throttle;
+		if (queued > WF_Q_LO) wf->busy_ms = now_ms;
+		if (queued >= WF_Q_HI && throttle < WF_THROTTLE_MAX && (now_ms - wf->throttle_ms) > WF_THROTTLE_UP_MS) {
+			throttle++;
+		} else
+		if (throttle > 0 && (now_ms - wf->busy_ms) > WF_THROTTLE_DN_MS && (now_ms - wf->throttle_ms) > WF_THROTTLE_DN_MS) {
+			throttle--;		// only after the queue has stayed drained
+		}
+		if (throttle != wf->throttle) {
+			wf->throttle = throttle;
+			wf->throttle_ms = now_ms;
+			metric_set(M_WF_THROTTLE, rx_chan, throttle);
+			send_msg(conn, SM_WF_DEBUG, "MSG wf_throttle=%d", throttle);
+		}
+
 		// create waterfall
 		
 		// desired frame rate greater than what full sampling can deliver, so start overlapped sampling
 		assert(wf_fps[wf->slow] != 0);
 		int desired = 1000 / wf_fps[wf->slow];
 
+		if (queued >= WF_Q_SKIP) {
+			metric_add(M_WF_SKIPPED, rx_chan, 1);
+			TaskSleepReasonMsec("wf backpressure", desired << wf->throttle);
+			wf->mark = timer_ms();
+			continue;
+		}
+
 		if (!overlapped_sampling && samp_wait_ms > desired) {
 			overlapped_sampling = true;
 			
@@ -759,6 +926,7 @@ void c2s_waterfall(void *param)
 			compute_frame(wf, fft);
 		//}
 
+		desired <<= wf->throttle;
 		int actual = timer_ms() - wf->mark;
 		int delay = desired - actual;
 		//printf("%d %d %d\n", delay, actual, desired);
@@ -781,6 +949,7 @@ void compute_frame(wf_t *wf, fft_t *fft)
 	wf_pkt_t out;
 	u1_t comp_in_buf[WF_WIDTH];
 	float pwr[MAX_FFT_USED];
+	u4_t frame_us = timer_us();
 		
     TaskStatU(0, 0, NULL, TSTAT_INCR|TSTAT_ZERO, 0, "frm");
 
@@ -790,7 +959,12 @@ void compute_frame(wf_t *wf, fft_t *fft)
 	evWF(EC_EVENT, EV_WF, -1, "WF", "compute_frame: FFT done");
 	//NextTask("FFT2");
 
-	u1_t *bp = (wf->compression)? out.un.buf2 : out.un.buf;
+	u1_t *bp;
+	switch (wf->compression) {
+		case WF_COMP_ADPCM: bp = out.un.buf2; break;
+		case WF_COMP_DELTA: bp = comp_in_buf; break;
+		default: bp = out.un.buf; break;
+	}
 			
 	if (!wf->fft_used_limit) wf->fft_used_limit = wf->fft_used;
 
@@ -991,13 +1165,31 @@ if (i == 516) printf("\n");
 
 	int bytes;
 	ima_adpcm_state_t adpcm_wf;
+	u1_t delta_rec[WF_WIDTH];
+	bool key = false;
+	u4_t start = out.x_bin_server, zoom = out.flags_x_zoom_server & 0xffff;
 	
-	if (wf->compression) {
+	if (wf->compression == WF_COMP_ADPCM) {
 		memset(out.un.adpcm_pad, out.un.buf2[0], sizeof(out.un.adpcm_pad));
 		memset(&adpcm_wf, 0, sizeof(ima_adpcm_state_t));
 		encode_ima_adpcm_u8_e8(out.un.buf, out.un.buf, ADPCM_PAD + WF_WIDTH, &adpcm_wf);
 		bytes = (ADPCM_PAD + WF_WIDTH) * sizeof(u1_t) / 2;
 		out.flags_x_zoom_server |= WF_FLAGS_COMPRESSION;
+	} else
+	if (wf->compression == WF_COMP_DELTA) {
+		key = (!wf->delta_ok || wf->delta_frames >= WF_DELTA_KEYFRAME ||
+			start != wf->delta_start || zoom != wf->delta_zoom);
+		bytes = wf_delta_encode(comp_in_buf, key? NULL : wf->delta_ref, delta_rec, out.un.buf, WF_WIDTH, WF_DELTA_NEAR);
+		
+		if (bytes >= 0) {
+			out.flags_x_zoom_server |= WF_FLAGS_DELTA | (key? WF_FLAGS_KEYFRAME : 0);
+		} else {
+			// incompressible, so send as is (the client uses any line as the next reference)
+			memcpy(out.un.buf, comp_in_buf, WF_WIDTH);
+			memcpy(delta_rec, comp_in_buf, WF_WIDTH);
+			bytes = WF_WIDTH * sizeof(u1_t);
+			key = true;
+		}
 	} else {
 		bytes = WF_WIDTH * sizeof(u1_t);
 	}
@@ -1007,10 +1199,22 @@ if (i == 516) printf("\n");
 	snd_t *snd = &snd_inst[rx_chan];
 	out.seq = snd->seq;
 
+	u4_t drops = wf->conn->s2c.drops;
 	app_to_web(wf->conn, (char*) &out, SO_OUT_HDR + bytes);
+
+	// the line only becomes the reference if the client is going to see it
+	if (wf->compression == WF_COMP_DELTA && wf->conn->s2c.drops == drops) {
+		memcpy(wf->delta_ref, delta_rec, WF_WIDTH);
+		wf->delta_ok = true;
+		wf->delta_frames = key? 0 : (wf->delta_frames + 1);
+		wf->delta_start = start;
+		wf->delta_zoom = zoom;
+	}
+
 	waterfall_bytes += bytes;
 	waterfall_frames[RX_CHANS]++;
 	waterfall_frames[rx_chan]++;
+	metric_observe(M_WF_FRAME, rx_chan, (timer_us() - frame_us) / 1e6);
 	evWF(EC_EVENT, EV_WF, -1, "WF", "compute_frame: done");
 
 	#if 0
@@ -0,0 +1,176 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#include "types.h"
+#include "kiwi.h"
+#include "misc.h"
+#include "snd_codec.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+const char *snd_codec_s[N_SND_CODEC] = { "pcm", "adpcm", "opus" };
+
+#ifdef USE_OPUS
+
+static bool opus_init(snd_codec_t *c)
+{
+	int err;
+
+	// the rates the Opus encoder takes
+	if (c->rate != 8000 && c->rate != 12000 && c->rate != 16000 && c->rate != 24000 && c->rate != 48000) {
+		lprintf("SND codec: no Opus at %d sps\n", c->rate);
+		return false;
+	}
+
+	if (c->opus == NULL) {
+		c->opus = (OpusEncoder *) malloc(opus_encoder_get_size(1));
+		assert(c->opus != NULL);
+	}
+
+	if ((err = opus_encoder_init(c->opus, c->rate, 1, OPUS_APPLICATION_AUDIO)) != OPUS_OK) {
+		lprintf("SND codec: opus_encoder_init %s\n", opus_strerror(err));
+		return false;
+	}
+
+	// complexity 10 (the default) is too much for the Beagle with several channels
+	opus_encoder_ctl(c->opus, OPUS_SET_BITRATE(c->kbps * 1000));
+	opus_encoder_ctl(c->opus, OPUS_SET_COMPLEXITY(5));
+	opus_encoder_ctl(c->opus, OPUS_SET_VBR(1));
+	c->frame = c->rate * SND_OPUS_FRAME_MS / 1000;
+	return true;
+}
+
+static int opus_frame(snd_codec_t *c, const TYPEMONO16 *in, u1_t *out)
+{
+	int n = opus_encode(c->opus, in, c->frame, out+2, SND_OPUS_MAX_BYTES);
+
+	if (n < 0) {
+		lprintf("SND codec: opus_encode %s\n", opus_strerror(n));
+		n = 0;		// zero length frame, the client does packet loss concealment
+	}
+	out[0] = (n >> 8) & 0xff;
+	out[1] = (n >> 0) & 0xff;
+	return n+2;
+}
+
+static int opus_encode_samps(snd_codec_t *c, const TYPEMONO16 *in, int nsamps, u1_t *out)
+{
+	int n, bytes = 0;
+
+	if (c->npend) {
+		n = MIN(c->frame - c->npend, nsamps);
+		memcpy(&c->pend[c->npend], in, n * sizeof(TYPEMONO16));
+		c->npend += n; in += n; nsamps -= n;
+		if (c->npend < c->frame) return 0;
+		bytes += opus_frame(c, c->pend, out);
+		c->npend = 0;
+	}
+
+	for (; nsamps >= c->frame; in += c->frame, nsamps -= c->frame)
+		bytes += opus_frame(c, in, out + bytes);
+
+	memcpy(c->pend, in, nsamps * sizeof(TYPEMONO16));
+	c->npend = nsamps;
+	return bytes;
+}
+
+#endif
+
+int snd_codec_init(snd_codec_t *c, int codec, int rate, int kbps)
+{
+	memset(&c->adpcm, 0, sizeof(c->adpcm));
+	c->rate = rate;
+	c->kbps = kbps? kbps : SND_OPUS_KBPS;
+	c->npend = 0;
+	c->bytes = c->samps = 0;
+
+	if (codec < 0 || codec >= N_SND_CODEC) codec = SND_CODEC_ADPCM;
+
+	if (codec == SND_CODEC_OPUS) {
+		#ifdef USE_OPUS
+			if (!opus_init(c)) codec = SND_CODEC_ADPCM;
+		#else
+			codec = SND_CODEC_ADPCM;
+		#endif
+	}
+
+	c->codec = codec;
+	return codec;
+}
+
+int snd_codec_max_bytes(snd_codec_t *c, int nsamps)
+{
+	nsamps += c->npend;
+
+	switch (c->codec) {
+		case SND_CODEC_PCM: return nsamps * sizeof(u2_t);
+		case SND_CODEC_ADPCM: return nsamps / 2;
+		#ifdef USE_OPUS
+			case SND_CODEC_OPUS: return (nsamps / c->frame) * (2 + SND_OPUS_MAX_BYTES);
+		#endif
+	}
+	return 0;
+}
+
+int snd_codec_encode(snd_codec_t *c, const TYPEMONO16 *in, int nsamps, u1_t *out)
+{
+	int j, bytes = 0;
+
+	c->samps += nsamps;
+
+	switch (c->codec) {
+
+	case SND_CODEC_PCM:
+		for (j=0; j<nsamps; j++) {
+			*out++ = (in[j] >> 8) & 0xff;	// choose a network byte-order (big endian)
+			*out++ = (in[j] >> 0) & 0xff;
+		}
+		bytes = nsamps * sizeof(u2_t);
+		break;
+
+	// ADPCM codes samples in pairs, so an odd sample (e.g. from the resampler) waits for the next call
+	case SND_CODEC_ADPCM:
+		if (c->npend && nsamps) {
+			c->pend[1] = *in++; nsamps--;
+			encode_ima_adpcm_i16_e8(c->pend, out, 2, &c->adpcm);
+			out++; bytes++;
+			c->npend = 0;
+		}
+		encode_ima_adpcm_i16_e8((TYPEMONO16 *) in, out, nsamps & ~1, &c->adpcm);
+		bytes += nsamps/2;		// fixed 4:1 compression
+		if (nsamps & 1) {
+			c->pend[0] = in[nsamps-1];
+			c->npend = 1;
+		}
+		break;
+
+	#ifdef USE_OPUS
+		case SND_CODEC_OPUS:
+			bytes = opus_encode_samps(c, in, nsamps, out);
+			break;
+	#endif
+
+	default:
+		panic("snd_codec_encode");
+	}
+
+	c->bytes += bytes;
+	return bytes;
+}
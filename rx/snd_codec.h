@@ -0,0 +1,71 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#ifndef _SND_CODEC_H_
+#define _SND_CODEC_H_
+
+#include "types.h"
+#include "datatypes.h"
+#include "ima_adpcm.h"
+
+#ifdef USE_OPUS
+ #include <opus/opus.h>
+#endif
+
+// Codecs for the (non-IQ) audio of the sound stream, chosen per connection by "SET codec=<name> [kbps=<n>]".
+// The server answers "MSG audio_codec=<name>" with the codec actually used, which is in effect from the
+// next audio packet on. ADPCM is the default and what a codec falls back to if it can't be used.
+
+#define SND_CODEC_PCM	0		// 16-bit big-endian
+#define SND_CODEC_ADPCM	1		// IMA ADPCM, fixed 4:1
+#define SND_CODEC_OPUS	2		// Opus frames, each preceded by a 16-bit big-endian length (USE_OPUS builds only)
+#define N_SND_CODEC		3
+
+#define SND_OPUS_FRAME_MS		20
+#define SND_OPUS_MAX_FRAME		(48000 * SND_OPUS_FRAME_MS / 1000)		// samples at the highest Opus rate
+#define SND_OPUS_MAX_BYTES		400			// per frame, i.e. 160 kbps at 20 ms
+#define SND_OPUS_KBPS			16			// default bitrate
+
+struct snd_codec_t {
+	int codec, rate, kbps;
+	ima_adpcm_state_t adpcm;
+
+	// samples held over to the next call: one for ADPCM (encodes pairs), up to a frame for Opus
+	int npend;
+	TYPEMONO16 pend[SND_OPUS_MAX_FRAME];
+
+	#ifdef USE_OPUS
+		OpusEncoder *opus;		// allocated once per rx channel, re-initialized for each connection
+		int frame;				// samples per frame
+	#endif
+
+	// since init, for the metrics
+	u64_t bytes, samps;
+};
+
+extern const char *snd_codec_s[N_SND_CODEC];
+
+// returns the codec actually selected
+int snd_codec_init(snd_codec_t *c, int codec, int rate, int kbps);
+
+// bytes added to out[], at most snd_codec_max_bytes(c, nsamps)
+int snd_codec_encode(snd_codec_t *c, const TYPEMONO16 *in, int nsamps, u1_t *out);
+int snd_codec_max_bytes(snd_codec_t *c, int nsamps);
+
+#endif
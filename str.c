@@ -38,7 +38,7 @@ Boston, MA  02110-1301, USA.
 struct kstring_t {
 	struct kstring_t *next_free;
 	char *sp;
-	int size;
+	int size, len;		// allocated size of sp and its strlen()
 	bool valid, externally_malloced;
 };
 
@@ -81,8 +81,13 @@ static char *kstr_malloc(kstr_malloc_e type, char *s_kstr_cstr, int size)
         assert(ks != NULL);
         assert(ks->sp != NULL);
         assert(size >= 0);
-        ks->sp = (char *) realloc(ks->sp, size);
-        ks->size = size;
+        
+        // grow geometrically so building a string by appending is linear time
+        if (size > ks->size) {
+            size = MAX(size, ks->size * 2);
+            ks->sp = (char *) realloc(ks->sp, size);
+            ks->size = size;
+        }
         return (char *) ks;
 	}
 	
@@ -98,7 +103,8 @@ static char *kstr_malloc(kstr_malloc_e type, char *s_kstr_cstr, int size)
         assert(s_kstr_cstr != NULL);
         assert(!kstr_is(s_kstr_cstr));
         assert(size == 0);
-        size = strlen(s_kstr_cstr) + SPACE_FOR_NULL;
+        ks->len = strlen(s_kstr_cstr);
+        size = ks->len + SPACE_FOR_NULL;
         //printf("%3d ALLOC %4d %p {%p} EXT <%s>\n", ks-kstrings, size, ks, s_kstr_cstr, s_kstr_cstr);
         externally_malloced = true;
     } else {    // type == KSTR_ALLOC
@@ -106,6 +112,7 @@ static char *kstr_malloc(kstr_malloc_e type, char *s_kstr_cstr, int size)
         assert(size >= 0);
         s_kstr_cstr = (char *) malloc(size);
         s_kstr_cstr[0] = '\0';
+        ks->len = 0;
         //printf("%3d ALLOC %4d %p {%p}\n", ks-kstrings, size, ks, s_kstr_cstr);
     }
 
@@ -167,7 +174,7 @@ void kstr_free(char *s_kstr_cstr)
 		//printf("%3d  FREE %4d %p {%p} %s\n", ks-kstrings, ks->size, ks, ks->sp, ks->externally_malloced? "EXT":"");
 		free((char *) ks->sp);
 		ks->sp = NULL;
-		ks->size = 0;
+		ks->size = ks->len = 0;
 		ks->externally_malloced = false;
 		ks->valid = false;
 		ks->next_free = kstr_next_free;
@@ -180,45 +187,75 @@ void kstr_free(char *s_kstr_cstr)
 // kstr_cstr: kstr|C-string|NULL
 int kstr_len(char *s_kstr_cstr)
 {
-	return (s_kstr_cstr != NULL)? ( strlen(kstr_sp(s_kstr_cstr)) ) : 0;
+	kstring_t *ks = kstr_is(s_kstr_cstr);
+	if (ks) return ks->len;
+	return (s_kstr_cstr != NULL)? strlen(s_kstr_cstr) : 0;
 }
 
-// will kstr_free() cs2 argument
-char *kstr_cat(char *s1, const char *cs2)
+// return s1 as a kstr with room to append n more chars
+static char *kstr_grow(char *s1, int n)
 {
-	char *s2 = (char *) cs2;
     kstring_t *s1k = kstr_is(s1);
-    //kstring_t *s2k = kstr_is(s2);
-	char *s1p, *s1c;
-	int slen = kstr_len(s1) + kstr_len(s2) + SPACE_FOR_NULL;
-	//printf("kstr_cat s1=%s s2=%s\n", kstr_what(s1), kstr_what(s2));
+	//printf("kstr_grow s1=%s n=%d\n", kstr_what(s1), n);
 	
 	if (s1k != NULL) {
 	    // s1 is a kstr
-	    s1 = kstr_malloc(KSTR_REALLOC, s1, slen);
-	    s1p = kstr_sp(s1);
-	} else
-	if (s1 != NULL) {
-	    // s1 is a C-string
-	    s1c = s1;
-	    s1 = kstr_malloc(KSTR_ALLOC, NULL, slen);
-	    s1p = kstr_sp(s1);
-	    strcpy(s1p, s1c);       // safe since lengths already checked and space allocated
-	} else {
-	    // s1 is NULL
-	    s1 = kstr_malloc(KSTR_ALLOC, NULL, slen);
-	    s1p = kstr_sp(s1);
-		s1p[0] = '\0';
+	    return kstr_malloc(KSTR_REALLOC, s1, s1k->len + n + SPACE_FOR_NULL);
 	}
 	
+    // s1 is a C-string or NULL
+    int slen = (s1 != NULL)? strlen(s1) : 0;
+    char *s = kstr_malloc(KSTR_ALLOC, NULL, slen + n + SPACE_FOR_NULL);
+    s1k = kstr_is(s);
+    if (slen) {
+        memcpy(s1k->sp, s1, slen + SPACE_FOR_NULL);     // safe since lengths already checked and space allocated
+        s1k->len = slen;
+    }
+    return s;
+}
+
+// will kstr_free() cs2 argument
+char *kstr_cat(char *s1, const char *cs2)
+{
+	char *s2 = (char *) cs2;
+	int s2len = kstr_len(s2);
+	
+	s1 = kstr_grow(s1, s2len);
+	kstring_t *s1k = kstr_is(s1);
+	
 	if (s2) {
-		strcat(s1p, kstr_sp(s2));       // safe since lengths already checked and space allocated
+		memcpy(&s1k->sp[s1k->len], kstr_sp(s2), s2len + SPACE_FOR_NULL);   // safe since space allocated
+		s1k->len += s2len;
 		kstr_free(s2);
 	}
 	
 	return s1;
 }
 
+// printf-style append
+// Formats directly into the space already allocated, only growing and formatting again when it doesn't fit.
+char *kstr_asprintf(char *s1, const char *fmt, ...)
+{
+	va_list ap;
+	s1 = kstr_grow(s1, 0);
+	kstring_t *s1k = kstr_is(s1);
+	
+	int rem = s1k->size - s1k->len;
+	va_start(ap, fmt);
+	int n = vsnprintf(&s1k->sp[s1k->len], rem, fmt, ap);
+	va_end(ap);
+	
+	if (n >= rem) {
+		s1 = kstr_grow(s1, n);
+		va_start(ap, fmt);
+		vsnprintf(&s1k->sp[s1k->len], n + SPACE_FOR_NULL, fmt, ap);
+		va_end(ap);
+	}
+	
+	s1k->len += n;
+	return s1;
+}
+
 
 ////////////////////////////////
 // misc string functions
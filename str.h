@@ -27,6 +27,9 @@ Boston, MA  02110-1301, USA.
 //
 // any kstr_cstr argument = kstr_t|C-string|NULL
 // C-string: char array or string constant or NULL
+//
+// Appending (kstr_cat, kstr_asprintf) is amortized linear since the buffer grows geometrically
+// and the length is tracked. So don't shorten a kstr by writing into kstr_sp() and then append to it.
 
 typedef char kstr_t;
 
@@ -36,6 +39,7 @@ void kstr_free(kstr_t *s_kstr_cstr);    // only frees a kstr object, will not fr
 int kstr_len(kstr_t *s_kstr_cstr);      // return C-string length from kstr object
 kstr_t *kstr_wrap(char *s_malloc);      // wrap a malloc()'d C-string in a kstr object so it is auto-freed later on
 kstr_t *kstr_cat(kstr_t *s1_kstr_cstr, const kstr_t *s2_kstr_cstr);     // will kstr_free() s2_kstr_cstr argument
+kstr_t *kstr_asprintf(kstr_t *s1_kstr_cstr, const char *fmt, ...);      // printf-style append
 
 
 #define GET_CHARS(field, value) kiwi_get_chars(field, value, sizeof(field));
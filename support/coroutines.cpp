@@ -30,6 +30,7 @@
 #include "peri.h"
 #include "data_pump.h"
 #include "ext_int.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -764,6 +765,7 @@ bool TaskIsChild()
         }
         ct->hist[i]++;
         task_all_hist[i]++;
+        metric_observe(M_TASK_RUN, 0, quanta / 1e6);
     }
     
     our_pid = getpid();
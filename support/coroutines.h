@@ -55,7 +55,7 @@ extern "C" {
 #define	MISC_TASKS			6					// main, stats, spi, data pump, web server, sdr_hu
 #define GPS_TASKS			(GPS_CHANS + 3)		// chan*n + search + solve + stat
 #define	RX_TASKS			(RX_CHANS * 2)		// SND, W/F
-#define	EXT_TASKS			RX_CHANS			// each extension server-side part runs as a separate task
+#define	EXT_TASKS			(RX_CHANS * 2)		// each extension server-side part runs as a separate task, plus sample delivery
 #define	ADMIN_TASKS			4					// simultaneous admin connections
 #define	EXTRA_TASKS			16
 #define	MAX_TASKS           (MISC_TASKS + GPS_TASKS + RX_TASKS + EXT_TASKS + ADMIN_TASKS + EXTRA_TASKS)
@@ -0,0 +1,218 @@
+/*
+--------------------------------------------------------------------------------
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+You should have received a copy of the GNU Library General Public
+License along with this library; if not, write to the
+Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+Boston, MA  02110-1301, USA.
+--------------------------------------------------------------------------------
+*/
+
+// Copyright (c) 2017 John Seamons, ZL/KF6VO
+
+#include "types.h"
+#include "config.h"
+#include "kiwi.h"
+#include "misc.h"
+#include "str.h"
+#include "web.h"
+#include "nbuf.h"
+#include "gps.h"
+#include "data_pump.h"
+#include "ext_int.h"
+#include "metrics.h"
+
+#include <string.h>
+
+// Counters and gauges that already exist as globals are read when scraped (func) rather than
+// duplicating the bookkeeping at the point they're updated.
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM } metric_type_e;
+
+typedef double (*metric_func_t)(int inst);
+
+struct metric_t {
+	metric_type_e type;
+	const char *name, *help;
+	int ninst;					// 1 = no label, else labelled rx_chan
+	metric_func_t func;			// value computed when scraped, else set/observed
+	const double *bounds;		// histogram bucket upper bounds, ascending
+	int nbounds;
+
+	double val[METRIC_NINST];
+	u64_t bucket[METRIC_NINST][METRIC_NBUCKETS+1];		// last is +Inf
+	u64_t count[METRIC_NINST];
+	double sum[METRIC_NINST];
+};
+
+extern int audio_dropped;
+
+static double m_audio_dropped(int inst) { return audio_dropped; }
+static double m_dpump_resets(int inst) { return dpump_resets; }
+static double m_gps_fixes(int inst) { return gps.fixes; }
+static double m_users(int inst) { return current_nusers; }
+static double m_audio_kbps(int inst) { return audio_kbps; }
+static double m_waterfall_kbps(int inst) { return waterfall_kbps; }
+static double m_http_kbps(int inst) { return http_kbps; }
+static double m_gps_acquiring(int inst) { return gps.acquiring? 1:0; }
+static double m_gps_tracking(int inst) { return gps.tracking; }
+static double m_gps_good(int inst) { return gps.good; }
+
+static ndesc_t *s2c(int type, int rx_chan)
+{
+	conn_t *c;
+	for (c = conns; c < &conns[N_CONNS]; c++) {
+		if (c->valid && c->type == type && c->rx_channel == rx_chan)
+			return &c->s2c;
+	}
+	return NULL;
+}
+
+static double queued(int type, int rx_chan)
+{
+	ndesc_t *nd = s2c(type, rx_chan);
+	return nd? nbuf_queued(nd) : 0;
+}
+
+// per-connection, so resets when the channel's user changes
+static double drops(int type, int rx_chan)
+{
+	ndesc_t *nd = s2c(type, rx_chan);
+	return nd? nd->drops : 0;
+}
+
+static double m_snd_queued(int inst) { return queued(STREAM_SOUND, inst); }
+static double m_wf_queued(int inst) { return queued(STREAM_WATERFALL, inst); }
+static double m_snd_drops(int inst) { return drops(STREAM_SOUND, inst); }
+static double m_wf_drops(int inst) { return drops(STREAM_WATERFALL, inst); }
+
+// seconds
+static const double latency_bounds[] = {
+	50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3, 50e-3, 100e-3, 250e-3, 1
+};
+
+// buffers waiting in the FPGA when the data pump was serviced
+static const double backlog_bounds[] = { 0, 1, 2, 3, 4, 6, 8, 12, 16 };
+
+// seconds, the WSPR decode must finish before the next cycle ends
+static const double decode_bounds[] = { 1, 2, 5, 10, 20, 30, 45, 60, 90, 120 };
+
+#define HIST(b) b, ARRAY_LEN(b)
+
+static metric_t metrics[N_METRICS] = {
+	{ METRIC_COUNTER, "kiwi_audio_dropped_total", "Data pump sequence errors (audio dropped)", 1, m_audio_dropped },
+	{ METRIC_COUNTER, "kiwi_dpump_resets_total", "Data pump resets due to FPGA buffer overrun", 1, m_dpump_resets },
+	{ METRIC_COUNTER, "kiwi_gps_fixes_total", "GPS position solutions", 1, m_gps_fixes },
+	{ METRIC_COUNTER, "kiwi_snd_drops_total", "Audio buffers discarded by a full s2c queue", RX_CHANS, m_snd_drops },
+	{ METRIC_COUNTER, "kiwi_wf_drops_total", "Waterfall buffers discarded by a full s2c queue", RX_CHANS, m_wf_drops },
+	{ METRIC_COUNTER, "kiwi_wf_skipped_total", "Waterfall frames not computed due to backpressure", RX_CHANS },
+	{ METRIC_COUNTER, "kiwi_ext_dropped_total", "Audio blocks not delivered to an extension (queue full or throttled)", RX_CHANS },
+	{ METRIC_COUNTER, "kiwi_wspr_spots_total", "WSPR spots decoded", RX_CHANS },
+
+	{ METRIC_GAUGE, "kiwi_users", "Connected users", 1, m_users },
+	{ METRIC_GAUGE, "kiwi_cpu_user_percent", "Beagle CPU user time", 1 },
+	{ METRIC_GAUGE, "kiwi_cpu_sys_percent", "Beagle CPU system time", 1 },
+	{ METRIC_GAUGE, "kiwi_cpu_idle_percent", "Beagle CPU idle time", 1 },
+	{ METRIC_GAUGE, "kiwi_ecpu_use_percent", "FPGA eCPU use", 1 },
+	{ METRIC_GAUGE, "kiwi_audio_kbps", "Audio network output", 1, m_audio_kbps },
+	{ METRIC_GAUGE, "kiwi_waterfall_kbps", "Waterfall network output", 1, m_waterfall_kbps },
+	{ METRIC_GAUGE, "kiwi_http_kbps", "HTTP network output", 1, m_http_kbps },
+	{ METRIC_GAUGE, "kiwi_snd_queued", "Audio buffers queued to the web server", RX_CHANS, m_snd_queued },
+	{ METRIC_GAUGE, "kiwi_wf_queued", "Waterfall buffers queued to the web server", RX_CHANS, m_wf_queued },
+	{ METRIC_GAUGE, "kiwi_wf_throttle", "Waterfall frame rate reduction (1/2^n) due to backpressure", RX_CHANS },
+	{ METRIC_GAUGE, "kiwi_ext_throttle", "Extension sample rate reduction (1/2^n) due to cpu budget", RX_CHANS },
+	{ METRIC_GAUGE, "kiwi_snd_codec", "Audio codec in use (0 = PCM, 1 = ADPCM, 2 = Opus)", RX_CHANS },
+	{ METRIC_GAUGE, "kiwi_snd_codec_kbps", "Audio codec output bitrate since the codec was selected", RX_CHANS },
+	{ METRIC_GAUGE, "kiwi_gps_acquiring", "GPS acquisition running", 1, m_gps_acquiring },
+	{ METRIC_GAUGE, "kiwi_gps_tracking", "GPS channels tracking", 1, m_gps_tracking },
+	{ METRIC_GAUGE, "kiwi_gps_good", "GPS channels with good subframes", 1, m_gps_good },
+
+	{ METRIC_HISTOGRAM, "kiwi_dpump_service_seconds", "Data pump interrupt service time", 1, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_dpump_backlog", "FPGA buffers pending at data pump service", 1, NULL, HIST(backlog_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_snd_block_seconds", "Audio processing time per FIR block", RX_CHANS, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_snd_encode_seconds", "Audio codec time per FIR block", RX_CHANS, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_wf_frame_seconds", "Waterfall compute_frame() time", RX_CHANS, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_ext_run_seconds", "Extension sample callback time per audio block", RX_CHANS, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_task_run_seconds", "Task run time between NextTask() calls", 1, NULL, HIST(latency_bounds) },
+	{ METRIC_HISTOGRAM, "kiwi_wspr_decode_seconds", "WSPR decode time per 2-minute cycle", RX_CHANS, NULL, HIST(decode_bounds) },
+};
+
+void metric_add(metric_e m, int inst, double val)
+{
+	metric_t *mp = &metrics[m];
+	if (inst < 0 || inst >= mp->ninst) return;
+	mp->val[inst] += val;
+}
+
+void metric_set(metric_e m, int inst, double val)
+{
+	metric_t *mp = &metrics[m];
+	if (inst < 0 || inst >= mp->ninst) return;
+	mp->val[inst] = val;
+}
+
+void metric_observe(metric_e m, int inst, double val)
+{
+	int i;
+	metric_t *mp = &metrics[m];
+	if (inst < 0 || inst >= mp->ninst) return;
+
+	for (i = 0; i < mp->nbounds && val > mp->bounds[i]; i++)
+		;
+	mp->bucket[inst][i]++;
+	mp->count[inst]++;
+	mp->sum[inst] += val;
+}
+
+static const char *metric_type_s[] = { "counter", "gauge", "histogram" };
+
+char *metrics_text()
+{
+	int i, inst, b;
+	char *sb = NULL;
+	char label[32];
+
+	assert(ARRAY_LEN(metrics) == N_METRICS);
+	for (i = 0; i < N_METRICS; i++) {
+		metric_t *mp = &metrics[i];
+		assert(mp->name != NULL && mp->ninst <= METRIC_NINST && mp->nbounds <= METRIC_NBUCKETS);
+		sb = kstr_asprintf(sb, "# HELP %s %s\n# TYPE %s %s\n", mp->name, mp->help, mp->name, metric_type_s[mp->type]);
+
+		for (inst = 0; inst < mp->ninst; inst++) {
+			if (mp->ninst > 1)
+				snprintf(label, sizeof(label), "rx_chan=\"%d\"", inst);
+			else
+				label[0] = '\0';
+
+			if (mp->type != METRIC_HISTOGRAM) {
+				double val = mp->func? mp->func(inst) : mp->val[inst];
+				sb = kstr_asprintf(sb, "%s%s%s%s %.9g\n", mp->name,
+					label[0]? "{":"", label, label[0]? "}":"", val);
+				continue;
+			}
+
+			u64_t cum = 0;
+			for (b = 0; b <= mp->nbounds; b++) {
+				cum += mp->bucket[inst][b];
+				if (b < mp->nbounds)
+					sb = kstr_asprintf(sb, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", mp->name,
+						label, label[0]? ",":"", mp->bounds[b], cum);
+				else
+					sb = kstr_asprintf(sb, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", mp->name,
+						label, label[0]? ",":"", cum);
+			}
+			sb = kstr_asprintf(sb, "%s_sum%s%s%s %.9g\n%s_count%s%s%s %llu\n",
+				mp->name, label[0]? "{":"", label, label[0]? "}":"", mp->sum[inst],
+				mp->name, label[0]? "{":"", label, label[0]? "}":"", mp->count[inst]);
+		}
+	}
+
+	return sb;
+}
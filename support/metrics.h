@@ -0,0 +1,32 @@
+#pragma once
+
+#include "types.h"
+#include "kiwi.h"
+
+// Runtime metrics, scraped in Prometheus text format from the "metrics" AJAX request.
+// Metrics are fixed at compile time (see metrics[] in metrics.c), indexed by the enum below.
+// Per-channel metrics have one instance per rx channel (labelled rx_chan), otherwise instance 0.
+
+typedef enum {
+	// counters
+	M_AUDIO_DROPPED, M_DPUMP_RESETS, M_GPS_FIXES, M_SND_DROPS, M_WF_DROPS, M_WF_SKIPPED, M_EXT_DROPS, M_WSPR_SPOTS,
+
+	// gauges
+	M_USERS, M_CPU_USER, M_CPU_SYS, M_CPU_IDLE, M_ECPU_USE,
+	M_AUDIO_KBPS, M_WATERFALL_KBPS, M_HTTP_KBPS,
+	M_SND_QUEUED, M_WF_QUEUED, M_WF_THROTTLE, M_EXT_THROTTLE, M_SND_CODEC, M_SND_CODEC_KBPS,
+	M_GPS_ACQUIRING, M_GPS_TRACKING, M_GPS_GOOD,
+
+	// histograms
+	M_DPUMP_SERVICE, M_DPUMP_BACKLOG, M_SND_BLOCK, M_SND_ENCODE, M_WF_FRAME, M_EXT_RUN, M_TASK_RUN, M_WSPR_DECODE,
+
+	N_METRICS
+} metric_e;
+
+#define	METRIC_NINST		RX_CHANS
+#define	METRIC_NBUCKETS		16
+
+void metric_add(metric_e m, int inst, double val);
+void metric_set(metric_e m, int inst, double val);
+void metric_observe(metric_e m, int inst, double val);
+char *metrics_text();		// kstr, caller frees
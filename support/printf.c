@@ -22,6 +22,8 @@
 #include <stdarg.h>
 #include <time.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
 
 static bool log_foreground_mode = false;
 static bool log_ordinary_printfs = false;
@@ -30,6 +32,7 @@ void xit(int err)
 {
 	void exit(int);
 	
+	log_flush();
 	fflush(stdout);
 	spin_ms(1000);	// needed for syslog messages to be properly recorded
 	exit(err);
@@ -46,6 +49,7 @@ void _panic(const char *str, bool coreFile, const char *file, int line)
 		syslog(LOG_ERR, "%s\n", buf);
 	}
 	
+	log_flush();
 	printf("%s\n", buf);
 	if (coreFile) abort();
 	xit(-1);
@@ -75,22 +79,184 @@ void real_printf(const char *fmt, ...)
 	va_end(ap);
 }
 
+// Asynchronous logging
+//
+// The line prefix, the admin log buffer and any remote messages are done by the calling task,
+// but the syslog() and stdout writes (which can block on the journal) are done by a writer thread.
+// Lines are queued in a ring with a single producer since all server tasks run on one thread.
+// Repeated lines are suppressed and summarized. Lines that don't fit in the ring are counted and
+// reported as dropped, so a real-time task never waits on the log. Neither affects the admin log.
+// Child processes (TaskIsChild) and early startup write synchronously as before.
+
+#define VBUF 1024
+#define LOG_RING		512			// must be power of 2, enough for a dump() or datapump reset burst
+#define LOG_REPEAT_SECS	30			// summarize identical lines for at most this long
+#define LOG_REPEAT_MS	1000		// writer thread reports repeats pending this long
+#define LOG_POLL_MS		20			// writer thread poll interval when idle
+
+struct log_rec_t {
+	bool actually_log;
+	int msg_off;					// start of prefix and message (i.e. without timestamp) in line[]
+	int text_off;					// start of message in line[]
+	char line[N_LOG_MSG_LEN + VBUF];
+};
+
+static struct {
+	log_rec_t rec[LOG_RING];
+	u4_t head, tail;				// head only written by producer, tail only by writer thread
+	bool running;
+	pthread_t writer;
+
+	u4_t dropped, dropped_reported;
+	
+	conn_t *last_c;
+	u4_t last_type, last_ms;
+	int repeats;					// taken with an atomic exchange by whichever of producer or writer reports them
+	char last[VBUF];
+} logq;
+
+static log_rec_t log_sync_rec;
+
+static void log_write(log_rec_t *r)
+{
+	if (r->actually_log) {
+		syslog(LOG_INFO, "%s", &r->line[r->msg_off]);
+	}
+
+	// remove our override and call the actual underlying printf
+	#undef printf
+		printf("%s", r->line);
+	#define printf ALT_PRINTF
+}
+
+// Repeats of the last line are otherwise only reported when a different line arrives.
+// With the ring empty the line written last is the one repeating, so its prefix is reused.
+static void log_writer_repeats(log_rec_t *last, u4_t *pending_ms)
+{
+	static log_rec_t r;
+
+	if (__atomic_load_n(&logq.repeats, __ATOMIC_RELAXED) == 0) {
+		*pending_ms = 0;
+		return;
+	}
+	u4_t now = timer_ms();
+	if (*pending_ms == 0) *pending_ms = now;
+	if ((now - *pending_ms) < LOG_REPEAT_MS) return;
+	*pending_ms = 0;
+
+	int repeats = __atomic_exchange_n(&logq.repeats, 0, __ATOMIC_RELAXED);
+	if (repeats == 0) return;
+
+	time_t t;
+	time(&t);
+	char tb[CTIME_R_BUFSIZE];
+	ctime_r(&t, tb);
+	tb[CTIME_R_NL] = '\0';
+	r.actually_log = last->actually_log;
+	r.msg_off = snprintf(r.line, sizeof(r.line), "%s ", tb);
+	snprintf(&r.line[r.msg_off], sizeof(r.line) - r.msg_off, "%.*s last message repeated %d times\n",
+		last->text_off - last->msg_off - 1, &last->line[last->msg_off], repeats);
+	log_write(&r);
+}
+
+static void *log_writer(void *param)
+{
+	static log_rec_t last;
+	u4_t pending_ms = 0;
+
+	while (true) {
+		u4_t tail = logq.tail;
+		if (tail == __atomic_load_n(&logq.head, __ATOMIC_ACQUIRE)) {
+			if (last.text_off) log_writer_repeats(&last, &pending_ms);
+			fflush(stdout);
+			usleep(LOG_POLL_MS * 1000);
+			continue;
+		}
+		log_rec_t *r = &logq.rec[tail & (LOG_RING-1)];
+		log_write(r);
+		last.actually_log = r->actually_log;
+		last.msg_off = r->msg_off;
+		last.text_off = r->text_off;
+		memcpy(last.line, r->line, r->text_off);
+		__atomic_store_n(&logq.tail, tail+1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+// wait for the writer thread to catch up, e.g. before exiting
+void log_flush()
+{
+	if (!logq.running || TaskIsChild()) return;
+	for (int i = 0; i < 1000 && __atomic_load_n(&logq.tail, __ATOMIC_ACQUIRE) != logq.head; i++)
+		usleep(1000);
+	fflush(stdout);
+}
+
+// returns false if the line should not be output because it repeats the previous line
+static bool log_repeat(u4_t type, conn_t *c, const char *s, int *repeats)
+{
+	*repeats = 0;
+	if (TaskIsChild()) return true;
+
+	u4_t now = timer_ms();
+	if (c == logq.last_c && type == logq.last_type && (now - logq.last_ms) < LOG_REPEAT_SECS * 1000 &&
+		strcmp(s, logq.last) == 0) {
+		__atomic_fetch_add(&logq.repeats, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	*repeats = __atomic_exchange_n(&logq.repeats, 0, __ATOMIC_RELAXED);
+	logq.last_c = c;
+	logq.last_type = type;
+	logq.last_ms = now;
+	kiwi_strncpy(logq.last, s, VBUF);
+	return true;
+}
+
+static bool log_line(bool actually_log, const char *tb, const char *prefix, const char *s)
+{
+	log_rec_t *r;
+	bool sync = TaskIsChild();
+
+	if (!sync && !logq.running) {
+		logq.running = (pthread_create(&logq.writer, NULL, log_writer, NULL) == 0);
+		if (!logq.running) sync = true;
+	}
+	
+	if (sync) {
+		r = &log_sync_rec;
+	} else {
+		if ((logq.head - __atomic_load_n(&logq.tail, __ATOMIC_ACQUIRE)) >= LOG_RING) {
+			logq.dropped++;
+			return false;
+		}
+		r = &logq.rec[logq.head & (LOG_RING-1)];
+	}
+
+	r->actually_log = actually_log;
+	r->msg_off = snprintf(r->line, sizeof(r->line), "%s ", tb);
+	r->text_off = r->msg_off + snprintf(&r->line[r->msg_off], sizeof(r->line) - r->msg_off, "%s ", prefix);
+	snprintf(&r->line[r->text_off], sizeof(r->line) - r->text_off, "%s", s);
+	
+	if (sync)
+		log_write(r);
+	else
+		__atomic_store_n(&logq.head, logq.head+1, __ATOMIC_RELEASE);
+	return true;
+}
+
 static bool appending;
-static char *buf, *last_s, *start_s;
+static char buf[VBUF], *last_s, *start_s;
 static int brem;
 log_save_t *log_save_p;
 static log_save_t log_save;
 
 static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 {
-	int i, n, sl;
+	int i, n, sl, repeats;
 	char *s, *cp;
-	#define VBUF 1024
 	
 	if (!do_sdr) {
 	//if (!background_mode) {
-		if ((buf = (char*) malloc(VBUF)) == NULL)
-			panic("log malloc");
 		vsnprintf(buf, VBUF, fmt, ap);
 
 		// remove our override and call the actual underlying printf
@@ -99,9 +265,6 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		#define printf ALT_PRINTF
 		
 		evPrintf(EC_EVENT, EV_PRINTF, -1, "printf", buf);
-	
-		free(buf);
-		buf = NULL;
 		return;
 	}
 	
@@ -109,8 +272,6 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		s = last_s;
 	} else {
 		brem = VBUF;
-		if ((buf = (char*) malloc(VBUF)) == NULL)
-			panic("log malloc");
 		s = buf;
 		start_s = s;
 	}
@@ -137,7 +298,7 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		for (i=0; i < sl; i++)
 			if (buf[i] > 0x7f) buf[i] = '?';
 
-		char *sb, *sb2;
+		char sb2[N_LOG_MSG_LEN], *sb = sb2, *se = &sb2[N_LOG_MSG_LEN];
 		bool want_logged = (type & PRINTF_LOG);
 		
 		// uptime
@@ -147,10 +308,9 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		u4_t hr  = up % 24; up /= 24;
 		u4_t days = up;
 		if (days)
-			asprintf(&sb, "%dd:%02d:%02d:%02d ", days, hr, min, sec);
+			sb += snprintf(sb, se - sb, "%dd:%02d:%02d:%02d ", days, hr, min, sec);
 		else
-			asprintf(&sb, "%d:%02d:%02d ", hr, min, sec);
-        sb = kstr_wrap(sb);
+			sb += snprintf(sb, se - sb, "%d:%02d:%02d ", hr, min, sec);
 	
 		// show state of all rx channels
 		rx_chan_t *rx;
@@ -160,7 +320,7 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		}
 		ch_stat[i] = ' ';
 		ch_stat[i+1] = '\0';
-		sb = kstr_cat(sb, ch_stat);
+		sb += snprintf(sb, se - sb, "%s", ch_stat);
 		
 		// show rx channel number if message is associated with a particular rx channel
         int chan = -1;
@@ -177,21 +337,15 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
                 ch_stat[i++] = want_logged? 'L':' ';
             }
             ch_stat[i] = '\0';
-            sb = kstr_cat(sb, ch_stat);
+            snprintf(sb, se - sb, "%s", ch_stat);
         } else {
             if (background_mode)
-                asprintf(&sb2, "[%02d]", c->self_idx);
+                snprintf(sb, se - sb, "[%02d]", c->self_idx);
             else
-                asprintf(&sb2, "[%02d] %c", c->self_idx, want_logged? 'L':' ');
-            sb = kstr_cat(sb, kstr_wrap(sb2));
+                snprintf(sb, se - sb, "[%02d] %c", c->self_idx, want_logged? 'L':' ');
         }
-        
-        sb2 = kstr_sp(sb);
 		
 		bool actually_log = ((want_logged && (background_mode || log_foreground_mode)) || log_ordinary_printfs);
-		if (actually_log) {
-			syslog(LOG_INFO, "%s %s", sb2, buf);
-		}
 	
 		time_t t;
 		time(&t);
@@ -199,10 +353,22 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 		ctime_r(&t, tb);
 		tb[CTIME_R_NL] = '\0';
 		
-		// remove our override and call the actual underlying printf
-		#undef printf
-			printf("%s %s %s", tb, sb2, buf);
-		#define printf ALT_PRINTF
+		// Repeats are only suppressed on stdout and syslog, the admin log below gets every line.
+		// Lines summarizing suppressed repeats and dropped lines go ahead of this one.
+		if (log_repeat(type, c, buf, &repeats)) {
+			char sum[64];
+			if (repeats) {
+				snprintf(sum, sizeof(sum), "last message repeated %d times\n", repeats);
+				log_line(actually_log, tb, sb2, sum);
+			}
+			u4_t dropped = logq.dropped - logq.dropped_reported;
+			if (dropped) {
+				snprintf(sum, sizeof(sum), "%d log messages dropped\n", dropped);
+				if (log_line(true, tb, sb2, sum))
+					logq.dropped_reported += dropped;
+			}
+			log_line(actually_log, tb, sb2, buf);
+		}
 
 		evPrintf(EC_EVENT, EV_PRINTF, -1, "printf", buf);
 
@@ -272,8 +438,6 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 					}
 				}
 		}
-
-	    kstr_free(sb);
 	}
 	
 	// attempt to selectively record message remotely
@@ -289,9 +453,6 @@ static void ll_printf(u4_t type, conn_t *c, const char *fmt, va_list ap)
 				send_msg_encoded(c, "MSG", "status_msg_text", "%s", buf);
 		}
 	}
-	
-	free(buf);
-	buf = NULL;
 }
 
 void alt_printf(const char *fmt, ...)
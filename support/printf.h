@@ -91,6 +91,8 @@ void mlprintf_ff(const char *fmt, ...);
 char *stprintf(const char *fmt, ...);
 int esnprintf(char *str, size_t slen, const char *fmt, ...);
 
+void log_flush();
+
 void _panic(const char *str, bool coreFile, const char *file, int line);
 void _sys_panic(const char *str, const char *file, int line);
 void xit(int err);
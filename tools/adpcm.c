@@ -0,0 +1,199 @@
+// Checks the IMA ADPCM encoder (rx/csdr/ima_adpcm.c) against the original per-sample
+// branching encoder, and benchmarks both.
+//
+// make UTIL=adpcm; ./adpcm [-t] [-b] [-n nsamps]
+
+#include "../types.h"
+#include "../rx/csdr/ima_adpcm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+// the encoder as it was
+static const int ref_index_adjust[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+static const int stepSizeTable[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34,
+	37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+	157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494,
+	544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552,
+	1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026,
+	4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+	27086, 29794, 32767
+};
+
+static void ref_decode(unsigned char deltaCode, ima_adpcm_state_t *state)
+{
+	int step = stepSizeTable[state->index];
+	int difference = step>>3;
+	if ( deltaCode & 1 ) difference += step>>2;
+	if ( deltaCode & 2 ) difference += step>>1;
+	if ( deltaCode & 4 ) difference += step;
+	if ( deltaCode & 8 ) difference = -difference;
+	state->previousValue += difference;
+	if (state->previousValue > state->pos_clamp) state->previousValue = state->pos_clamp;
+	else if (state->previousValue < state->neg_clamp) state->previousValue = state->neg_clamp;
+	state->index += ref_index_adjust[deltaCode];
+	if (state->index < 0) state->index = 0;
+	else if (state->index > 88) state->index = 88;
+}
+
+static unsigned char ref_encode(short sample, ima_adpcm_state_t *state)
+{
+	int diff = sample - state->previousValue;
+	int step = stepSizeTable[state->index];
+	int deltaCode = 0;
+	if (diff < 0) { deltaCode = 8; diff = -diff; }
+	if ( diff >= step ) {  deltaCode |= 4;  diff -= step;  }
+	step >>= 1;
+	if ( diff >= step ) {  deltaCode |= 2;  diff -= step;  }
+	step >>= 1;
+	if ( diff >= step ) {  deltaCode |= 1;  diff -= step;  }
+	ref_decode(deltaCode, state);
+	return deltaCode;
+}
+
+static void ref_i16(short *input, unsigned char *output, int input_length, ima_adpcm_state_t *state)
+{
+	state->pos_clamp = +32767;
+	state->neg_clamp = -32768;
+	for (int i=0, k=0; i<input_length/2; i++, k++) {
+		output[k] = ref_encode(input[2*i], state);
+		output[k] |= ref_encode(input[2*i+1], state) << 4;
+	}
+}
+
+static void ref_u8(unsigned char *input, unsigned char *output, int input_length, ima_adpcm_state_t *state)
+{
+	state->pos_clamp = 255;
+	state->neg_clamp = 0;
+	for (int i=0, k=0; i<input_length/2; i++, k++) {
+		unsigned char i0 = input[2*i], i1 = input[2*i+1];
+		output[k] = ref_encode(i0, state);
+		output[k] |= ref_encode(i1, state) << 4;
+	}
+}
+
+static short *s16;
+static unsigned char *u8, *u8_ip, *out, *ref_out;
+
+// noise, full-scale square waves (clamping, max index), tones, silence (min index)
+static void gen(int nsamps, int kind)
+{
+	for (int n = 0; n < nsamps; n++) {
+		double v;
+		switch (kind) {
+			case 0: v = (random() & 0xffff) - 32768; break;
+			case 1: v = ((n / 37) & 1)? 32767 : -32768; break;
+			case 2: v = 30000 * sin(n * 0.3) + 2000 * sin(n * 0.0071); break;
+			default: v = ((n / 4096) & 1)? 0 : (random() % 5) - 2; break;
+		}
+		s16[n] = (short) v;
+		u8[n] = (unsigned char) ((int) v >> 8) + 128;
+	}
+}
+
+static int compare(const char *name, const unsigned char *a, const unsigned char *b, int nbytes, ima_adpcm_state_t *sa, ima_adpcm_state_t *sb)
+{
+	int errs = 0;
+	for (int n = 0; n < nbytes; n++)
+		if (a[n] != b[n] && errs++ < 8)
+			printf("%s: byte %d 0x%02x ref 0x%02x\n", name, n, a[n], b[n]);
+	bool st = (sa->index != sb->index || sa->previousValue != sb->previousValue);
+	printf("%s: %d bytes, %s\n", name, nbytes, (errs || st)? "MISMATCH" : "bit exact");
+	return (errs || st);
+}
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, kind, nsamps = 1 << 22;
+	bool test = false, benchmark = false;
+	ima_adpcm_state_t st, rst;
+
+	while ((i = getopt(argc, argv, "tbn:")) != -1) {
+		switch (i) {
+			case 't': test = true; break;
+			case 'b': benchmark = true; break;
+			case 'n': nsamps = strtol(optarg, 0, 0); break;
+			default: printf("usage: adpcm [-t] [-b] [-n nsamps]\n"); exit(-1);
+		}
+	}
+	if (!test && !benchmark) test = benchmark = true;
+	nsamps &= ~1;
+
+	s16 = (short *) malloc(nsamps * sizeof(short));
+	u8 = (unsigned char *) malloc(nsamps);
+	u8_ip = (unsigned char *) malloc(nsamps);
+	out = (unsigned char *) malloc(nsamps);
+	ref_out = (unsigned char *) malloc(nsamps);
+	int errs = 0;
+
+	if (test) {
+		static const char *kind_s[] = { "noise", "square", "tone", "quiet" };
+		char name[32];
+
+		for (kind = 0; kind < 4; kind++) {
+			gen(nsamps, kind);
+
+			// audio: state carried across calls of the sizes c2s_sound uses, including odd lengths
+			memset(&st, 0, sizeof(st)); memset(&rst, 0, sizeof(rst));
+			int n, len, bytes = 0;
+			for (n = 0; n < nsamps; n += len) {
+				len = MIN(nsamps - n, (n & 0x400)? 512 : 2 + (random() % 64) * 2);
+				encode_ima_adpcm_i16_e8(s16 + n, out + bytes, len, &st);
+				ref_i16(s16 + n, ref_out + bytes, len, &rst);
+				bytes += len/2;
+			}
+			sprintf(name, "i16 %s", kind_s[kind]);
+			errs += compare(name, out, ref_out, bytes, &st, &rst);
+
+			// waterfall: in place as rx_waterfall.cpp does, a line at a time
+			memset(&st, 0, sizeof(st)); memset(&rst, 0, sizeof(rst));
+			memcpy(u8_ip, u8, nsamps);
+			bytes = 0;
+			for (n = 0; n + 1034 <= nsamps; n += 1034) {
+				encode_ima_adpcm_u8_e8(u8_ip + n, u8_ip + n, 1034, &st);
+				ref_u8(u8 + n, ref_out + bytes, 1034, &rst);
+				memmove(out + bytes, u8_ip + n, 517);
+				bytes += 517;
+			}
+			sprintf(name, "u8 %s", kind_s[kind]);
+			errs += compare(name, out, ref_out, bytes, &st, &rst);
+		}
+	}
+
+	if (benchmark) {
+		for (kind = 0; kind <= 2; kind += 2) {
+			gen(nsamps, kind);
+			for (i = 0; i < 2; i++) {
+				memset(&st, 0, sizeof(st));
+				double start = time_sec();
+				if (i) encode_ima_adpcm_i16_e8(s16, out, nsamps, &st); else ref_i16(s16, out, nsamps, &st);
+				double secs = time_sec() - start;
+				printf("i16 %s %s: %.2f Msps (%.1f ns/samp)\n", kind? "tone" : "noise", i? "new" : "ref",
+					nsamps / secs / 1e6, secs / nsamps * 1e9);
+			}
+		}
+		gen(nsamps, 0);
+		for (i = 0; i < 2; i++) {
+			memset(&st, 0, sizeof(st));
+			double start = time_sec();
+			if (i) encode_ima_adpcm_u8_e8(u8, out, nsamps, &st); else ref_u8(u8, out, nsamps, &st);
+			double secs = time_sec() - start;
+			printf("u8 noise %s: %.2f Msps (%.1f ns/samp)\n", i? "new" : "ref", nsamps / secs / 1e6, secs / nsamps * 1e9);
+		}
+	}
+
+	return errs? -1 : 0;
+}
@@ -0,0 +1,284 @@
+// Benchmarks the AGC (rx/CuteSDR/agc.cpp) against the original implementation it replaced, per
+// sample in hang and exponential decay modes, and checks its output stays close to the original's.
+//
+// make UTIL=agc; ./agc [-n nsamps]
+//
+// Signals are noise bursts at random levels (speech-like), and a repeatedly decaying signal, which
+// is the worst case for the original: once the window is inside a decay the oldest sample in it is
+// always the peak, so it rescanned the whole window every sample. The decay is fast enough that
+// every sample in the window is a distinct peak candidate, so at the rate where the peak window is
+// the full MAX_DELAY_BUF samples it also fills the peak deque.
+
+#include "../types.h"
+#include "../rx/CuteSDR/agc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define NSAMPS		512			// per call, as rx_sound does
+
+#define DELAY_TIMECONST .015
+#define WINDOW_TIMECONST .018
+#define ATTACK_RISE_TIMECONST .002
+#define ATTACK_FALL_TIMECONST .005
+#define DECAY_RISEFALL_RATIO .3
+#define RELEASE_TIMECONST .05
+#define AGC_OUTSCALE 0.7
+#define MAX_AMPLITUDE 32767.0
+#define MIN_CONSTANT 3.2767e-4
+
+// the AGC as it was
+class RefAgc
+{
+public:
+	void SetParameters(bool UseHang, int Threshold, int SlopeFactor, int Decay, TYPEREAL SampleRate);
+	void ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData);
+
+private:
+	bool m_UseHang;
+	TYPEREAL m_SampleRate;
+	TYPEREAL m_DecayAve, m_AttackAve;
+	TYPEREAL m_AttackRiseAlpha, m_AttackFallAlpha, m_DecayRiseAlpha, m_DecayFallAlpha;
+	TYPEREAL m_FixedGain, m_Knee, m_GainSlope, m_Peak;
+	int m_SigDelayPtr, m_MagBufPos, m_DelaySamples, m_WindowSamples, m_HangTime, m_HangTimer;
+	TYPECPX m_SigDelayBuf[MAX_DELAY_BUF];
+	TYPEREAL m_MagBuf[MAX_DELAY_BUF];
+};
+
+void RefAgc::SetParameters(bool UseHang, int Threshold, int SlopeFactor, int Decay, TYPEREAL SampleRate)
+{
+	m_UseHang = UseHang;
+	m_SampleRate = SampleRate;
+	for(int i=0; i<MAX_DELAY_BUF; i++)
+	{
+		m_SigDelayBuf[i].re = 0.0;
+		m_SigDelayBuf[i].im = 0.0;
+		m_MagBuf[i] = -16.0;
+	}
+	m_SigDelayPtr = 0;
+	m_HangTimer = 0;
+	m_Peak = -16.0;
+	m_DecayAve = -5.0;
+	m_AttackAve = -5.0;
+	m_MagBufPos = 0;
+
+	m_Knee = (TYPEREAL)Threshold/20.0;
+	m_GainSlope = SlopeFactor/(100.0);
+	m_FixedGain = AGC_OUTSCALE * MPOW(10.0, m_Knee*(m_GainSlope - 1.0) );
+	m_AttackRiseAlpha = (1.0-MEXP(-1.0/(m_SampleRate*ATTACK_RISE_TIMECONST)) );
+	m_AttackFallAlpha = (1.0-MEXP(-1.0/(m_SampleRate*ATTACK_FALL_TIMECONST)) );
+	m_DecayRiseAlpha = (1.0-MEXP(-1.0/(m_SampleRate * (TYPEREAL)Decay*.001*DECAY_RISEFALL_RATIO)) );
+	m_HangTime = (int)(m_SampleRate * (TYPEREAL)Decay * .001);
+	if(m_UseHang)
+		m_DecayFallAlpha = (1.0-MEXP(-1.0/(m_SampleRate * RELEASE_TIMECONST)) );
+	else
+		m_DecayFallAlpha = (1.0-MEXP(-1.0/(m_SampleRate * (TYPEREAL)Decay *.001)) );
+	m_DelaySamples = (int)(m_SampleRate*DELAY_TIMECONST);
+	m_WindowSamples = (int)(m_SampleRate*WINDOW_TIMECONST);
+	if(m_DelaySamples >= MAX_DELAY_BUF-1)
+		m_DelaySamples = MAX_DELAY_BUF-1;
+}
+
+void RefAgc::ProcessData(int Length, TYPECPX* pInData, TYPECPX* pOutData)
+{
+	TYPEREAL gain, mag;
+	TYPECPX delayedin;
+
+	for(int i=0; i<Length; i++)
+	{
+		TYPECPX in = pInData[i];
+		delayedin = m_SigDelayBuf[m_SigDelayPtr];
+		m_SigDelayBuf[m_SigDelayPtr++] = in;
+		if( m_SigDelayPtr >= m_DelaySamples)
+			m_SigDelayPtr = 0;
+
+		mag = MFABS(in.re);
+		TYPEREAL mim = MFABS(in.im);
+		if(mim>mag)
+			mag = mim;
+		mag = MLOG10( mag + MIN_CONSTANT ) - MLOG10(MAX_AMPLITUDE);
+
+		TYPEREAL tmp = m_MagBuf[m_MagBufPos];
+		m_MagBuf[m_MagBufPos++] = mag;
+		if( m_MagBufPos >= m_WindowSamples)
+			m_MagBufPos = 0;
+		if(mag > m_Peak)
+		{
+			m_Peak = mag;
+		}
+		else
+		{
+			if(tmp == m_Peak)
+			{
+				m_Peak = -8.0;
+				for(int i=0; i<m_WindowSamples; i++)
+				{
+					tmp = m_MagBuf[i];
+					if(tmp > m_Peak)
+						m_Peak = tmp;
+				}
+			}
+		}
+
+		if(m_Peak>m_AttackAve)
+			m_AttackAve = (1.0-m_AttackRiseAlpha)*m_AttackAve + m_AttackRiseAlpha*m_Peak;
+		else
+			m_AttackAve = (1.0-m_AttackFallAlpha)*m_AttackAve + m_AttackFallAlpha*m_Peak;
+
+		if(m_UseHang)
+		{
+			if(m_Peak>m_DecayAve)
+			{
+				m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*m_Peak;
+				m_HangTimer = 0;
+			}
+			else
+			{
+				if(m_HangTimer<m_HangTime)
+					m_HangTimer++;
+				else
+					m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*m_Peak;
+			}
+		}
+		else
+		{
+			if(m_Peak>m_DecayAve)
+				m_DecayAve = (1.0-m_DecayRiseAlpha)*m_DecayAve + m_DecayRiseAlpha*(m_Peak);
+			else
+				m_DecayAve = (1.0-m_DecayFallAlpha)*m_DecayAve + m_DecayFallAlpha*(m_Peak);
+		}
+
+		mag = (m_AttackAve>m_DecayAve)? m_AttackAve : m_DecayAve;
+		if(mag<=m_Knee)
+			gain = m_FixedGain;
+		else
+			gain = AGC_OUTSCALE * MPOW(10.0, mag*(m_GainSlope - 1.0) );
+		pOutData[i].re = delayedin.re * gain;
+		pOutData[i].im = delayedin.im * gain;
+	}
+}
+
+// settings as from the UI defaults
+#define THRESHOLD	-100
+#define MANUAL_GAIN	50
+#define SLOPE		6
+#define DECAY		1000
+
+static TYPECPX *in, *out, *ref_out;
+static RefAgc ref;
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double gauss()
+{
+	double u1 = (random() + 1.0) / (RAND_MAX + 2.0), u2 = random() / (RAND_MAX + 1.0);
+	return sqrt(-2 * log(u1)) * cos(2 * K_PI * u2);
+}
+
+static void gen(int nsamps, int kind, double rate)
+{
+	double a = 0;
+	int n, burst = (int) (rate * 0.05);
+
+	for (n = 0; n < nsamps; n++) {
+		if (kind == 0) {
+			if (n % burst == 0) a = 32767 * pow(10, -(random() % 100) / 20.0) / 4;
+			in[n].re = a * gauss();
+			in[n].im = a * gauss();
+		} else {
+			// down 60 dB over 25 msec, then again
+			a = 30000 * pow(10, -3.0 * (n % (int) (rate * .025)) / (rate * .025));
+			in[n].re = a;
+			in[n].im = a * 0.5;
+		}
+	}
+}
+
+// Output level difference in dB where the original's output is above the noise floor of the
+// comparison. Gain changes are interpolated over AGC_GAIN_INTERP samples, so the largest
+// differences are a few samples at the start of a fast attack; it's the RMS that must stay small.
+static int compare(const char *name, int nsamps, double rate)
+{
+	double sum = 0, max = 0;
+	int n, cnt = 0;
+
+	for (n = (int) (rate * 0.1); n < nsamps; n++) {
+		double r = MAX(fabs(ref_out[n].re), fabs(ref_out[n].im));
+		double o = MAX(fabs(out[n].re), fabs(out[n].im));
+		if (r < 1) continue;
+		double d = 20 * log10((o + 1e-9) / r);
+		sum += d * d;
+		if (fabs(d) > max) max = fabs(d);
+		cnt++;
+	}
+
+	double rms = cnt? sqrt(sum / cnt) : 0;
+	printf("%s: output vs original RMS %.4f dB, max %.3f dB\n", name, rms, max);
+	return rms > 0.25;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, nsamps = 1 << 21;
+	int errs = 0;
+
+	while ((i = getopt(argc, argv, "n:")) != -1) {
+		switch (i) {
+			case 'n': nsamps = strtol(optarg, 0, 0); break;
+			default: printf("usage: agc [-n nsamps]\n"); exit(-1);
+		}
+	}
+	nsamps -= nsamps % NSAMPS;
+
+	in = (TYPECPX *) malloc(nsamps * sizeof(TYPECPX));
+	out = (TYPECPX *) malloc(nsamps * sizeof(TYPECPX));
+	ref_out = (TYPECPX *) malloc(nsamps * sizeof(TYPECPX));
+	memset(out, 0, nsamps * sizeof(TYPECPX));
+	memset(ref_out, 0, nsamps * sizeof(TYPECPX));
+
+	// the rate at which the peak window is MAX_DELAY_BUF samples
+	double full_rate = ceil(MAX_DELAY_BUF / WINDOW_TIMECONST);
+	const char *kind_s[] = { "bursts", "decaying" };
+
+	for (int r = 0; r < 2; r++) {
+		double rate = r? full_rate : SND_RATE;
+
+		for (int kind = r; kind < 2; kind++) {
+			gen(nsamps, kind, rate);
+
+			for (int hang = 0; hang < 2; hang++) {
+				CAgc *agc = new CAgc;
+				agc->SetParameters(true, hang, THRESHOLD, MANUAL_GAIN, SLOPE, DECAY, rate);
+				ref.SetParameters(hang, THRESHOLD, SLOPE, DECAY, rate);
+				char name[64];
+				sprintf(name, "%s %s %.0f sps", kind_s[kind], hang? "hang" : "exp ", rate);
+
+				double start = time_sec();
+				for (int n = 0; n < nsamps; n += NSAMPS)
+					agc->ProcessData(NSAMPS, &in[n], &out[n]);
+				double t_new = time_sec() - start;
+
+				start = time_sec();
+				for (int n = 0; n < nsamps; n += NSAMPS)
+					ref.ProcessData(NSAMPS, &in[n], &ref_out[n]);
+				double t_ref = time_sec() - start;
+
+				printf("%s: %.1f ns/samp (original %.1f, %.1fx)\n", name,
+					t_new / nsamps * 1e9, t_ref / nsamps * 1e9, t_ref / t_new);
+				errs += compare(name, nsamps, rate);
+				delete agc;
+			}
+		}
+	}
+
+	return errs? -1 : 0;
+}
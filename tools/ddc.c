@@ -0,0 +1,276 @@
+// Checks the software model of the receiver datapath (rx/rx_model.cpp) against a literal
+// reading of iq_mixer.v and the generated cic_*.vh, and benchmarks it.
+//
+// make UTIL=ddc; ./ddc [-t] [-b] [-n nsamps] [-d wf_decim]
+//
+// The reference below does every register at its declared width using 32-bit limbs, one
+// sample and one stage at a time, so it shares none of the modulo 2^64 shortcuts of the model.
+
+#include "../types.h"
+#include "../kiwi.gen.h"
+#include "../clk.h"
+#include "../rx/rx_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define NLIMB	4
+
+struct big_t { u4_t w[NLIMB]; };
+
+static big_t big_s64(s64_t v)
+{
+	big_t b;
+	u4_t ext = (v < 0)? 0xffffffff : 0;
+	b.w[0] = (u4_t) v; b.w[1] = (u4_t) (v >> 32); b.w[2] = b.w[3] = ext;
+	return b;
+}
+
+static big_t big_mask(big_t a, int bits)
+{
+	int i;
+	for (i = 0; i < NLIMB; i++) {
+		int lo = i*32;
+		if (bits <= lo) a.w[i] = 0; else
+		if (bits < lo+32) a.w[i] &= (1U << (bits - lo)) - 1;
+	}
+	return a;
+}
+
+static big_t big_add(big_t a, big_t b, int bits)
+{
+	int i; u64_t c = 0;
+	for (i = 0; i < NLIMB; i++) { c += (u64_t) a.w[i] + b.w[i]; a.w[i] = (u4_t) c; c >>= 32; }
+	return big_mask(a, bits);
+}
+
+static big_t big_sub(big_t a, big_t b, int bits)
+{
+	int i;
+	for (i = 0; i < NLIMB; i++) b.w[i] = ~b.w[i];
+	return big_add(big_add(a, b, 128), big_s64(1), bits);
+}
+
+static big_t big_shr(big_t a, int n)
+{
+	while (n--) {
+		int i;
+		for (i = 0; i < NLIMB; i++)
+			a.w[i] = (a.w[i] >> 1) | ((i < NLIMB-1)? (a.w[i+1] << 31) : 0);
+	}
+	return a;
+}
+
+static big_t big_shl(big_t a, int n)
+{
+	while (n--) {
+		int i;
+		for (i = NLIMB-1; i >= 0; i--)
+			a.w[i] = (a.w[i] << 1) | (i? (a.w[i-1] >> 31) : 0);
+	}
+	return a;
+}
+
+static int big_bit(big_t a, int bit) { return (a.w[bit/32] >> (bit%32)) & 1; }
+
+// v[from-1 -: to] of a from-bit register
+static big_t slice(big_t v, int from, int to) { return big_mask(big_shr(v, from - to), to); }
+
+static s4_t big_sext(big_t a, int bits)
+{
+	u4_t v = a.w[0];
+	return (bits < 32 && (v & (1U << (bits-1))))? (s4_t) (v | ~((1U << bits) - 1)) : (s4_t) v;
+}
+
+struct ref_cic_t {
+	const cic_gen_t *g;
+	int decim, count, shift_in;
+	big_t integ[CIC_MAX_STAGES], prev[CIC_MAX_STAGES];
+};
+
+static void ref_cic_init(ref_cic_t *r, const cic_gen_t *g, int decim)
+{
+	int lg;
+	memset(r, 0, sizeof(*r));
+	r->g = g;
+	r->decim = decim? decim : g->decim;
+	for (lg = 0; (1 << lg) < r->decim; lg++)
+		;
+	if (r->decim != g->decim && r->decim != 1) r->shift_in = g->acc[0] - (g->in_bits + g->stages * lg);
+}
+
+static bool ref_cic(ref_cic_t *r, s4_t x, s4_t *out)
+{
+	const cic_gen_t *g = r->g;
+	const int *acc = g->acc;
+	int s, N = g->stages, Bout = g->out_bits;
+
+	if (r->decim == 1) {
+		*out = x >> (g->in_bits - Bout);
+		return true;
+	}
+
+	big_t in = big_mask(big_shl(big_s64(x), r->shift_in), acc[0]);
+	r->integ[0] = big_add(r->integ[0], slice(in, acc[0], acc[1]), acc[1]);
+	for (s = 1; s < N; s++)
+		r->integ[s] = big_add(r->integ[s], slice(r->integ[s-1], acc[s], acc[s+1]), acc[s+1]);
+
+	if (++r->count < r->decim) return false;
+	r->count = 0;
+
+	big_t v = r->integ[N-1];
+	for (s = 0; s < N; s++) {
+		big_t c_in = slice(v, acc[N+s], acc[N+s+1]);
+		v = big_sub(c_in, r->prev[s], acc[N+s+1]);
+		r->prev[s] = c_in;
+	}
+
+	big_t y = slice(v, acc[2*N], Bout);
+	if (acc[2*N] > Bout) y = big_add(y, big_s64(big_bit(v, acc[2*N]-1-Bout)), Bout);
+	*out = big_sext(y, Bout);
+	return true;
+}
+
+static s4_t ref_sin[1 << 13];
+
+static s4_t ref_mixer(s4_t adc, u4_t phase, bool q, int W)
+{
+	int p = phase >> (32-13);
+	s64_t my = (s64_t) ref_sin[q? p : ((p + 2048) & 8191)] * 8;
+	s64_t prod = (s64_t) adc * my;
+	int sign = (prod >> 35) & 1, mant_w = W-1;
+	s64_t v = ((s64_t) sign << mant_w) | ((prod >> (33 - mant_w + 1)) & ((1LL << mant_w) - 1));
+	v = (v + ((prod >> (33 - mant_w)) & 1)) & ((1LL << W) - 1);
+	return (v & (1LL << (W-1)))? (s4_t) (v - (1LL << W)) : (s4_t) v;
+}
+
+static s4_t *adc_samps, *model_out, *ref_out;
+
+static void gen_adc(int nsamps, bool noise)
+{
+	int n;
+	for (n = 0; n < nsamps; n++) {
+		double v = noise? (random() % (1 << ADC_BITS)) - (1 << (ADC_BITS-1)) :
+			8191.0 * sin(2.0 * M_PI * n * 7.1e6 / ADC_CLOCK_NOM) + (random() % 7) - 3;
+		adc_samps[n] = (s4_t) MAX(-(1 << (ADC_BITS-1)), MIN((1 << (ADC_BITS-1)) - 1, v));
+	}
+}
+
+static u4_t freq_inc(double f) { return (u4_t) (s64_t) round(f / ADC_CLOCK_NOM * 4294967296.0); }
+
+static int compare(const char *name, ddc_model_t *m, const cic_gen_t *g1, const cic_gen_t *g2, int decim, int nsamps)
+{
+	int n, ch, l, L = m->nlanes, nref = 0, errs = 0;
+	ref_cic_t r1[DDC_MAX_LANES], r2[DDC_MAX_LANES];
+
+	for (ch = 0; ch < m->nchans; ch++)
+		ddc_model_freq(m, ch, freq_inc(1e6 + ch * 7.13e6));
+	int nout = ddc_model_process(m, adc_samps, nsamps, model_out);
+
+	for (l = 0; l < L; l++) {
+		ref_cic_init(&r1[l], g1, decim);
+		if (g2) ref_cic_init(&r2[l], g2, 0);
+	}
+
+	for (n = 0; n < nsamps; n++) {
+		bool avail = false;
+		for (l = 0; l < L; l++) {
+			u4_t phase = (u4_t) n * freq_inc(1e6 + (l/2) * 7.13e6);
+			s4_t x = ref_mixer(adc_samps[n], phase, l & 1, m->mix_bits), y;
+			avail = ref_cic(&r1[l], x, &y);
+			if (avail && g2) avail = ref_cic(&r2[l], y, &y);
+			if (avail) ref_out[nref*L + l] = y;
+		}
+		if (avail) nref++;
+	}
+
+	for (n = 0; n < nout * L; n++)
+		if (model_out[n] != ref_out[n] && errs++ < 8)
+			printf("%s: sample %d lane %d model %d ref %d\n", name, n / L, n % L, model_out[n], ref_out[n]);
+
+	printf("%s: %d outputs x %d lanes, %s\n", name, nout, L, (nout != nref)? "COUNT MISMATCH" : (errs? "MISMATCH" : "bit exact"));
+	return (errs || nout != nref);
+}
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void bench(const char *name, ddc_model_t *m, int nsamps)
+{
+	int ch;
+	for (ch = 0; ch < m->nchans; ch++)
+		ddc_model_freq(m, ch, freq_inc(1e6 + ch * 7.13e6));
+
+	double start = time_sec();
+	int nout = ddc_model_process(m, adc_samps, nsamps, model_out);
+	double secs = time_sec() - start;
+	double sps = nsamps / secs;
+	printf("%s: %d chans, %d in, %d out, %.3f sec, %.2f Msps/chan in (%.1f%% of ADC clock), %.1f ksps/chan out\n",
+		name, m->nchans, nsamps, nout, secs, sps / 1e6, sps / ADC_CLOCK_NOM * 100, nout / secs / 1e3);
+}
+
+static ddc_model_t model;
+
+int main(int argc, char *argv[])
+{
+	int i, ch, nsamps = 1 << 22, wf_decim = 0;
+	bool test = false, benchmark = false;
+
+	while ((i = getopt(argc, argv, "tbn:d:")) != -1) {
+		switch (i) {
+			case 't': test = true; break;
+			case 'b': benchmark = true; break;
+			case 'n': nsamps = strtol(optarg, 0, 0); break;
+			case 'd': wf_decim = strtol(optarg, 0, 0); break;
+			default: printf("usage: ddc [-t] [-b] [-n nsamps] [-d wf_decim]\n"); exit(-1);
+		}
+	}
+	if (!test && !benchmark) test = benchmark = true;
+
+	adc_samps = (s4_t *) malloc(nsamps * sizeof(s4_t));
+	model_out = (s4_t *) malloc(nsamps * DDC_MAX_LANES * sizeof(s4_t));
+	ref_out = (s4_t *) malloc(nsamps * DDC_MAX_LANES * sizeof(s4_t));
+	for (i = 0; i < (1 << 13); i++)
+		ref_sin[i] = lround(sin(2.0 * M_PI * i / (1 << 13)) * 16383);
+
+	int errs = 0;
+
+	if (test) {
+		int n = MIN(nsamps, 1 << 20), pass;
+		char name[32];
+
+		for (pass = 0; pass < 2; pass++) {
+			gen_adc(n, pass == 0);
+			ddc_model_rx_init(&model, RX_CHANS);
+			sprintf(name, "rx %s", pass? "tone" : "noise");
+			errs += compare(name, &model, &cic_gen_rx1, &cic_gen_rx2, 0, n);
+
+			for (i = 1; i <= WF_1CIC_MAXD; i <<= 1) {
+				if (wf_decim && i != wf_decim) continue;
+				ddc_model_wf_init(&model, 1, i);
+				sprintf(name, "wf %s decim %d", pass? "tone" : "noise", i);
+				errs += compare(name, &model, &cic_gen_wf1, NULL, i, (i == 1)? 4096 : n);
+			}
+		}
+	}
+
+	if (benchmark) {
+		gen_adc(nsamps, false);
+		ddc_model_rx_init(&model, RX_CHANS);
+		bench("rx", &model, nsamps);
+		ddc_model_rx_init(&model, 1);
+		bench("rx", &model, nsamps);
+		ddc_model_wf_init(&model, WF_CHANS, wf_decim? wf_decim : WF_1CIC_MAXD);
+		bench("wf", &model, nsamps);
+	}
+
+	return errs? -1 : 0;
+}
@@ -0,0 +1,257 @@
+// Benchmark of the FAX decoder front-end (extensions/fax/FaxDecoder.cpp) on recorded or synthesized
+// FAX audio. The decoder now resamples the audio from its actual rate to the nominal rate with the
+// polyphase resampler (rx/rx_resamp.cpp) before demodulating. The previous front-end, which picked
+// the nearest input sample instead, is reproduced by picking the samples here and telling the decoder
+// the rate is nominal. Reports the time per line, and the average time of the calls that complete
+// a line against the others (each call is a FASTFIR_OUTBUF_SIZE block of audio, as from the fax
+// task), which shows any burst at the end of a line. Writes both images as fax.new.pgm and fax.old.pgm.
+//
+// make UTIL=fax; ./fax [-f file.s16] [-r rate] [-p ppm] [-n snr_db] [-l lines]
+//
+// file.s16 is 16-bit mono audio, e.g. recorded from the Kiwi with a 1900 Hz carrier frequency, at
+// rate samples/sec (the actual rate of the recording, default 12000). Without a file, a 120 lpm
+// test chart is synthesized at a sample rate ppm off nominal (default 50 ppm, about what the
+// ADC clock correction gives), and the decoded images are also compared against it.
+
+#include "../types.h"
+#include "../extensions/fax/FaxDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define NSAMPS		FASTFIR_OUTBUF_SIZE
+#define WIDTH		1024
+#define LPM			120
+#define CARRIER		1900
+#define DEVIATION	400
+
+static double rate;				// what the decoder is told
+static u1_t *img;				// decoded lines
+static int nlines, max_lines;
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// the server routines the decoder uses
+double ext_update_get_sample_rateHz(int rx_chan)
+{
+	return rate;
+}
+
+int ext_send_msg_data(int rx_chan, bool debug, u1_t cmd, u1_t *bytes, int nbytes)
+{
+	if (cmd == FAX_MSG_DRAW && nlines < max_lines)
+		memcpy(&img[WIDTH * nlines++], bytes, WIDTH);
+	return 0;
+}
+
+int ext_send_msg(int rx_chan, bool debug, const char *msg, ...)
+{
+	return 0;
+}
+
+FILE *pgm_file_open(const char *fn, int *offset, int width, int height, int depth)
+{
+	return NULL;
+}
+
+void pgm_file_height(FILE *fp, int offset, int height)
+{
+}
+
+void _panic(const char *str, bool coreFile, const char *file, int line)
+{
+	printf("PANIC: \"%s\" (%s, line %d)\n", str, file, line);
+	exit(-1);
+}
+
+int ev_dump;
+void _NextTask(const char *s, u4_t param, u_int64_t pc) {}
+void _NextTask(u4_t param) {}
+void evLatency(int cmd, int event, int param, const char *s, const char *s2) {}
+char *evprintf(const char *fmt, ...) { return NULL; }
+
+// test chart: grey scale steps, bars, a ramp, blocks and a diagonal line
+static int chart(int line, double x)
+{
+	int px = (int) (x * WIDTH);
+	if (abs(px - (line * 3) % WIDTH) < 3) return 0;
+	if (px < 256) return (px / 32) * 255 / 7;
+	if (px < 384) return ((px / 16) & 1)? 255 : 0;
+	if (px < 896) return (px - 384) / 2;
+	return ((line / 8) & 1)? 255 : 32;
+}
+
+static double gauss()
+{
+	double u1 = (random() + 1.0) / (RAND_MAX + 2.0), u2 = random() / (RAND_MAX + 1.0);
+	return sqrt(-2 * log(u1)) * cos(2 * K_PI * u2);
+}
+
+static void write_pgm(const char *fn, u1_t *p, int lines)
+{
+	FILE *fp = fopen(fn, "w");
+	if (fp == NULL) return;
+	fprintf(fp, "P5\n%d %d\n255\n", WIDTH, lines);
+	fwrite(p, WIDTH, lines, fp);
+	fclose(fp);
+}
+
+// RMS error against the chart, and the number of pixels off by more than a quarter of full scale.
+// The delay through the filters is allowed for as a shift of a few pixels, and pixels near an edge
+// in the chart, which the bandwidth of the signal blurs anyway, aren't counted.
+#define EDGE	4
+
+static bool near_edge(u1_t *ref, int x)
+{
+	for (int i = MAX(0, x - EDGE); i < MIN(WIDTH - 1, x + EDGE); i++)
+		if (abs(ref[i+1] - ref[i]) > 8) return true;
+	return false;
+}
+
+static double error(u1_t *p, int lines, u1_t *ref, int s, int *bad, int *n)
+{
+	int l, x;
+	double err = 0;
+
+	*bad = *n = 0;
+	for (l = 2; l < lines; l++)
+		for (x = 0; x < WIDTH - s; x++) {
+			if (near_edge(&ref[l*WIDTH], x)) continue;
+			int d = p[l*WIDTH + x + s] - ref[l*WIDTH + x];
+			err += d * d;
+			if (abs(d) > 64) (*bad)++;
+			(*n)++;
+		}
+	return sqrt(err / *n);
+}
+
+static void compare(const char *name, u1_t *p, int lines, u1_t *ref)
+{
+	int s, best_s = 0, bad, n;
+	double rms, best = -1;
+
+	for (s = 0; s <= 8; s++) {
+		rms = error(p, lines, ref, s, &bad, &n);
+		if (best < 0 || rms < best) { best = rms; best_s = s; }
+	}
+
+	rms = error(p, lines, ref, best_s, &bad, &n);
+	printf("%s: RMS error %.2f (PSNR %.1f dB), %d pixels off by > 64 (%.3f%%), shift %d\n",
+		name, rms, 20 * log10(255 / rms), bad, 100.0 * bad / n, best_s);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, n, lines = 200;
+	double in_rate = SND_RATE, ppm = 50, snr = 99;
+	bool noise = false;
+	const char *fn = NULL;
+
+	while ((i = getopt(argc, argv, "f:r:p:n:l:")) != -1) {
+		switch (i) {
+			case 'f': fn = optarg; break;
+			case 'r': in_rate = strtod(optarg, 0); break;
+			case 'p': ppm = strtod(optarg, 0); break;
+			case 'n': snr = strtod(optarg, 0); noise = true; break;
+			case 'l': lines = strtol(optarg, 0, 0); break;
+			default: printf("usage: fax [-f file.s16] [-r rate] [-p ppm] [-n snr_db] [-l lines]\n"); exit(-1);
+		}
+	}
+
+	s2_t *samps;
+	u1_t *ref = NULL;
+
+	if (fn) {
+		FILE *fp = fopen(fn, "r");
+		if (fp == NULL) { printf("can't open %s\n", fn); exit(-1); }
+		fseek(fp, 0, SEEK_END);
+		n = ftell(fp) / sizeof(s2_t);
+		rewind(fp);
+		samps = (s2_t *) malloc((n + NSAMPS) * sizeof(s2_t));
+		n = fread(samps, sizeof(s2_t), n, fp);
+		fclose(fp);
+		lines = n / in_rate * LPM / 60;
+	} else {
+		// FM, black (0) at carrier - deviation, white (255) at carrier + deviation
+		in_rate = SND_RATE * (1 + ppm * 1e-6);
+		n = (int) (lines * 60.0 / LPM * in_rate);
+		samps = (s2_t *) malloc((n + NSAMPS) * sizeof(s2_t));
+		ref = (u1_t *) malloc(WIDTH * lines);
+		for (int l = 0; l < lines; l++)
+			for (int x = 0; x < WIDTH; x++)
+				ref[l*WIDTH + x] = chart(l, (x + 0.5) / WIDTH);
+
+		double ph = 0, sigma = noise? 8192 / sqrt(2) / pow(10, snr/20) : 0;
+		for (i = 0; i < n; i++) {
+			double t = i / in_rate * LPM / 60;		// in lines
+			int l = (int) t;
+			double f = CARRIER + DEVIATION * (chart(l, t - l) / 127.5 - 1);
+			ph += 2 * K_PI * f / in_rate;
+			double s = 8192 * sin(ph) + sigma * gauss();
+			samps[i] = (s > 32767)? 32767 : ((s < -32768)? -32768 : (s2_t) lround(s));
+		}
+	}
+	memset(&samps[n], 0, NSAMPS * sizeof(s2_t));
+
+	// the previous front-end: nearest input sample at the nominal rate
+	s2_t *picked = (s2_t *) malloc((n + NSAMPS) * sizeof(s2_t));
+	double ratio = in_rate / SND_RATE, fi = 0;
+	int npicked = 0;
+	for (i = 0; i < n; i = (int) trunc(fi)) {
+		picked[npicked++] = samps[i];
+		fi += ratio;
+	}
+	memset(&picked[npicked], 0, NSAMPS * sizeof(s2_t));
+
+	max_lines = lines + 1;
+	img = (u1_t *) malloc(WIDTH * max_lines);
+	u1_t *old_img = (u1_t *) malloc(WIDTH * max_lines);
+	int old_lines = 0;
+
+	for (int front = 0; front < 2; front++) {
+		FaxDecoder *fax = &m_FaxDecoder[0];
+		s2_t *in = front? samps : picked;
+		int nin = front? n : npicked;
+		rate = front? in_rate : SND_RATE;
+		nlines = 0;
+
+		fax->Configure(0, WIDTH, 8, CARRIER, DEVIATION, FaxDecoder::firfilter::MIDDLE, 15.0, true, true, true);
+
+		double start = time_sec(), t_eol = 0, t_other = 0;
+		int n_eol = 0, n_other = 0;
+		for (i = 0; i < nin; i += NSAMPS) {
+			int l = nlines;
+			double t = time_sec();
+			fax->ProcessSamples(&in[i], NSAMPS, 0);
+			t = time_sec() - t;
+			if (nlines != l) { t_eol += t; n_eol++; } else { t_other += t; n_other++; }
+		}
+		double secs = time_sec() - start;
+		double audio = (double) nin / SND_RATE;
+		printf("%s: %d lines, %.1f usec/line, %.0fx real time, %.1f usec/call ending a line, %.1f otherwise\n",
+			front? "polyphase" : "nearest", nlines, secs / nlines * 1e6, audio / secs,
+			n_eol? t_eol / n_eol * 1e6 : 0, n_other? t_other / n_other * 1e6 : 0);
+
+		if (front) {
+			write_pgm("fax.new.pgm", img, nlines);
+			if (ref) compare("polyphase", img, MIN(nlines, lines), ref);
+		} else {
+			write_pgm("fax.old.pgm", img, nlines);
+			if (ref) compare("nearest  ", img, MIN(nlines, lines), ref);
+			memcpy(old_img, img, WIDTH * nlines);
+			old_lines = nlines;
+		}
+	}
+
+	if (fn && old_lines) compare("polyphase vs nearest", img, MIN(nlines, old_lines), old_img);
+	return 0;
+}
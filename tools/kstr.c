@@ -0,0 +1,271 @@
+// Timing of the kstr string builder (str.c) against the original kstr_cat() it replaced, which
+// re-ran strlen() on both strings and realloc()'d to the exact size on every append.
+//
+// make UTIL=kstr; ./kstr [-n dx_entries] [-m read_MB] [-f file]
+//
+// Builds the "MSG mkr=" DX label list as the SET MKR command does, with the original
+// asprintf() + kstr_wrap() + kstr_cat() per entry and with kstr_asprintf(), for lists of
+// increasing size so the growth of the time with the size shows. Then reads a file in 256-byte
+// chunks as read_file_string_reply() and non_blocking_cmd() do, by default a file of increasing
+// size written to /tmp, or the given file (e.g. one in /proc). The results must be identical.
+
+#include "../types.h"
+#include "../kiwi.h"
+#include "../str.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+// the server routines str.c uses
+void _panic(const char *str, bool coreFile, const char *file, int line)
+{
+	printf("PANIC: \"%s\" (%s, line %d)\n", str, file, line);
+	exit(-1);
+}
+
+void mg_url_encode(const char *src, char *dst, size_t dst_len) {}
+int mg_url_decode(const char *src, int src_len, char *dst, int dst_len, int is_form_url_encoded) { return 0; }
+
+// the kstr as it was
+struct ref_kstring_t {
+	struct ref_kstring_t *next_free;
+	char *sp;
+	int size;
+	bool valid, externally_malloced;
+};
+
+#define KSTRINGS	1024
+static ref_kstring_t ref_kstrings[KSTRINGS], *ref_kstr_next_free;
+
+static void ref_kstr_init()
+{
+	ref_kstring_t *ks;
+	for (ks = ref_kstrings; ks < &ref_kstrings[KSTRINGS-1]; ks++)
+		ks->next_free = ks+1;
+	ks->next_free = NULL;
+	ref_kstr_next_free = ref_kstrings;
+}
+
+static ref_kstring_t *ref_kstr_is(char *s)
+{
+	ref_kstring_t *ks = (ref_kstring_t *) s;
+	return (ks >= ref_kstrings && ks < &ref_kstrings[KSTRINGS])? ks : NULL;
+}
+
+static char *ref_kstr_malloc(int type, char *s, int size)
+{
+	ref_kstring_t *ks;
+
+	if (type == 1) {		// realloc
+		ks = ref_kstr_is(s);
+		ks->sp = (char *) realloc(ks->sp, size);
+		ks->size = size;
+		return (char *) ks;
+	}
+
+	ks = ref_kstr_next_free;
+	if (ks == NULL) panic("ref_kstr_malloc");
+	ref_kstr_next_free = ks->next_free;
+	if (type == 2) {		// external malloc
+		size = strlen(s) + SPACE_FOR_NULL;
+	} else {
+		s = (char *) malloc(size);
+		s[0] = '\0';
+	}
+	ks->sp = s;
+	ks->size = size;
+	ks->externally_malloced = (type == 2);
+	ks->valid = true;
+	return (char *) ks;
+}
+
+static char *ref_kstr_sp(char *s)
+{
+	ref_kstring_t *ks = ref_kstr_is(s);
+	return ks? ks->sp : s;
+}
+
+static char *ref_kstr_wrap(char *s)
+{
+	return s? ref_kstr_malloc(2, s, 0) : NULL;
+}
+
+static void ref_kstr_free(char *s)
+{
+	ref_kstring_t *ks = ref_kstr_is(s);
+	if (ks == NULL) return;
+	free(ks->sp);
+	ks->sp = NULL;
+	ks->valid = false;
+	ks->next_free = ref_kstr_next_free;
+	ref_kstr_next_free = ks;
+}
+
+static int ref_kstr_len(char *s)
+{
+	return s? strlen(ref_kstr_sp(s)) : 0;
+}
+
+static char *ref_kstr_cat(char *s1, const char *cs2)
+{
+	char *s2 = (char *) cs2, *s1p, *s1c;
+	int slen = ref_kstr_len(s1) + ref_kstr_len(s2) + SPACE_FOR_NULL;
+
+	if (ref_kstr_is(s1)) {
+		s1 = ref_kstr_malloc(1, s1, slen);
+		s1p = ref_kstr_sp(s1);
+	} else
+	if (s1 != NULL) {
+		s1c = s1;
+		s1 = ref_kstr_malloc(0, NULL, slen);
+		s1p = ref_kstr_sp(s1);
+		strcpy(s1p, s1c);
+	} else {
+		s1 = ref_kstr_malloc(0, NULL, slen);
+		s1p = ref_kstr_sp(s1);
+	}
+
+	if (s2) {
+		strcat(s1p, ref_kstr_sp(s2));
+		ref_kstr_free(s2);
+	}
+	return s1;
+}
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// DX list entries as stored: ident and notes URL encoded
+struct dx_t {
+	float freq, offset;
+	int flags;
+	char *ident, *notes;
+};
+
+static dx_t *dx;
+
+static void dx_gen(int n)
+{
+	dx = (dx_t *) malloc(n * sizeof(dx_t));
+	for (int i = 0; i < n; i++) {
+		dx[i].freq = 10 + i * 30000.0 / n;
+		dx[i].offset = (i % 7)? 0 : 1000;
+		dx[i].flags = i % 5;
+		asprintf(&dx[i].ident, "Station%%20%d%%20QRG", i);
+		if (i % 3) asprintf(&dx[i].notes, "Schedule%%20%d%%20UTC", i % 2400); else dx[i].notes = NULL;
+	}
+}
+
+static char *dx_list_ref(int n)
+{
+	char *sb, *sb2;
+	asprintf(&sb, "[{\"t\":%d}", 0);
+	sb = ref_kstr_wrap(sb);
+	for (int i = 0; i < n; i++) {
+		dx_t *dp = &dx[i];
+		asprintf(&sb2, ",{\"g\":%d,\"f\":%.3f,\"o\":%.0f,\"b\":%d,\"i\":\"%s\"%s%s%s}",
+			i, dp->freq + dp->offset / 1000.0, dp->offset, dp->flags, dp->ident,
+			dp->notes? ",\"n\":\"":"", dp->notes? dp->notes:"", dp->notes? "\"":"");
+		sb = ref_kstr_cat(sb, ref_kstr_wrap(sb2));
+	}
+	return ref_kstr_cat(sb, "]");
+}
+
+static char *dx_list_new(int n)
+{
+	char *sb = kstr_asprintf(NULL, "[{\"t\":%d}", 0);
+	for (int i = 0; i < n; i++) {
+		dx_t *dp = &dx[i];
+		sb = kstr_asprintf(sb, ",{\"g\":%d,\"f\":%.3f,\"o\":%.0f,\"b\":%d,\"i\":\"%s\"%s%s%s}",
+			i, dp->freq + dp->offset / 1000.0, dp->offset, dp->flags, dp->ident,
+			dp->notes? ",\"n\":\"":"", dp->notes? dp->notes:"", dp->notes? "\"":"");
+	}
+	return kstr_cat(sb, "]");
+}
+
+// as read_file_string_reply()
+static char *read_file(const char *fn, bool ref)
+{
+	int n, fd = open(fn, O_RDONLY);
+	if (fd < 0) { printf("can't open %s\n", fn); exit(-1); }
+	char *reply = NULL, buf[256 + SPACE_FOR_NULL];
+	do {
+		n = read(fd, buf, 256);
+		if (n > 0) {
+			buf[n] = '\0';
+			reply = ref? ref_kstr_cat(reply, buf) : kstr_cat(reply, buf);
+		}
+	} while (n > 0);
+	close(fd);
+	return reply;
+}
+
+static int errs;
+
+static void compare(const char *what, char *ref, char *s)
+{
+	if (strcmp(ref_kstr_sp(ref), kstr_sp(s)) != 0) {
+		printf("%s: results differ\n", what);
+		errs++;
+	}
+	ref_kstr_free(ref);
+	kstr_free(s);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, n_dx = 64000, mb = 4;
+	const char *fn = NULL;
+	double t, t_ref, t_new;
+
+	while ((i = getopt(argc, argv, "n:m:f:")) != -1) {
+		switch (i) {
+			case 'n': n_dx = strtol(optarg, 0, 0); break;
+			case 'm': mb = strtol(optarg, 0, 0); break;
+			case 'f': fn = optarg; break;
+			default: printf("usage: kstr [-n dx_entries] [-m read_MB] [-f file]\n"); exit(-1);
+		}
+	}
+
+	kstr_init();
+	ref_kstr_init();
+	dx_gen(n_dx);
+
+	for (int n = 1000; n <= n_dx; n *= 4) {
+		t = time_sec(); char *ref = dx_list_ref(n); t_ref = time_sec() - t;
+		t = time_sec(); char *s = dx_list_new(n); t_new = time_sec() - t;
+		printf("DX list %6d entries, %5d KB: original %9.2f ms, new %7.2f ms, %6.1f ns/byte\n",
+			n, kstr_len(s) / 1024, t_ref * 1e3, t_new * 1e3, t_new / kstr_len(s) * 1e9);
+		compare("DX list", ref, s);
+	}
+
+	if (fn) {
+		t = time_sec(); char *ref = read_file(fn, true); t_ref = time_sec() - t;
+		t = time_sec(); char *s = read_file(fn, false); t_new = time_sec() - t;
+		printf("%s, %d KB: original %.2f ms, new %.2f ms\n", fn, kstr_len(s) / 1024, t_ref * 1e3, t_new * 1e3);
+		compare(fn, ref, s);
+	} else {
+		const char *tmp = "/tmp/kstr.dat";
+		for (int kb = 64; kb <= mb * 1024; kb *= 4) {
+			FILE *fp = fopen(tmp, "w");
+			for (i = 0; i < kb * 1024 / 32; i++) fprintf(fp, "%-31d\n", i);
+			fclose(fp);
+			t = time_sec(); char *ref = read_file(tmp, true); t_ref = time_sec() - t;
+			t = time_sec(); char *s = read_file(tmp, false); t_new = time_sec() - t;
+			printf("read %5d KB in 256-byte chunks: original %9.2f ms, new %7.2f ms, %6.1f ns/byte\n",
+				kb, t_ref * 1e3, t_new * 1e3, t_new / kstr_len(s) * 1e9);
+			compare("read", ref, s);
+		}
+		unlink(tmp);
+	}
+
+	return errs? -1 : 0;
+}
@@ -0,0 +1,264 @@
+// Checks the GPS NAV subframe sync and parity engine (gps/navsync.cpp) against the original
+// bit-per-char implementation it replaced, on injected or recorded NAV bit streams.
+//
+// make UTIL=navsync; ./navsync [-n subframes] [-e bit_error_rate] [-s slip_rate] [-i] [-f file]
+//
+// The synthesized stream is valid subframes (random data, parity chained through D29*/D30*,
+// D29 = D30 = 0 at the end of the HOW and the last word as the ICD has it), with bit errors,
+// bit slips (a bit dropped or repeated) and, with -i, inverted polarity in alternate halves.
+// A recorded stream is the 16-bit NAV words (host byte order) as uploaded from the eCPU nav_buf.
+//
+// Both engines see the same words. A subframe both find must be found at the same word with the
+// same contents, and the packed parity must agree with the original on every word. The new engine
+// finds more subframes when there are bit errors: the original skipped 30 bits after a preamble
+// whose TLM failed parity, possibly over the real preamble. Once the two are hunting from
+// different bits, the new one occasionally locks onto a false preamble (TLM passing parity by
+// chance) the original skipped, and loses a subframe the original found. Those are reported as
+// missing but aren't an error. The original also counted false preambles as parity errors, so
+// its count is higher.
+
+#include "../types.h"
+#include "../gps/navsync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the engine as it was
+static const char preambleUpright [] = {1,0,0,0,1,0,1,1};
+static const char preambleInverse [] = {0,1,1,1,0,1,0,0};
+
+static int ref_parity(char *p, char *word, char D29, char D30) {
+    char *d = word-1;
+    for (int i=1; i<25; i++) d[i] ^= D30;
+    p[0] = D29 ^ d[1] ^ d[2] ^ d[3] ^ d[5] ^ d[6] ^ d[10] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[17] ^ d[18] ^ d[20] ^ d[23];
+    p[1] = D30 ^ d[2] ^ d[3] ^ d[4] ^ d[6] ^ d[7] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[18] ^ d[19] ^ d[21] ^ d[24];
+    p[2] = D29 ^ d[1] ^ d[3] ^ d[4] ^ d[5] ^ d[7] ^ d[8] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[19] ^ d[20] ^ d[22];
+    p[3] = D30 ^ d[2] ^ d[4] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[20] ^ d[21] ^ d[23];
+    p[4] = D30 ^ d[1] ^ d[3] ^ d[5] ^ d[6] ^ d[7] ^ d[9] ^ d[10] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[18] ^ d[21] ^ d[22] ^ d[24];
+    p[5] = D29 ^ d[3] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[10] ^ d[11] ^ d[13] ^ d[15] ^ d[19] ^ d[22] ^ d[23] ^ d[24];
+    return memcmp(d+25, p, 6);
+}
+
+static int ref_check(char *buf, int *nbits) {
+    char p[6];
+
+    if      (0==memcmp(buf, preambleUpright, 8)) p[4]=p[5]=0;
+    else if (0==memcmp(buf, preambleInverse, 8)) p[4]=p[5]=1;
+    else return *nbits=1;
+
+    for (int i=0; i<300; i+=30) {
+        if (ref_parity(p, buf+i, p[4], p[5]))
+            return *nbits=i+30;
+    }
+
+    *nbits=300;
+    return 0;
+}
+
+// subframes found: the word after which they were, and the contents packed as NAVSYNC has them
+struct found_t {
+    int word;
+    u4_t sf[10];
+};
+
+static found_t *ref_found, *new_found;
+static int nref, nnew, ref_par, new_par;
+
+static u4_t pack(char *bits) {
+    u4_t w = 0;
+    for (int i=0; i<30; i++) w = (w<<1) | bits[i];
+    return w;
+}
+
+static void run(uint16_t *words, int nwords) {
+    static char buf[300 + 16];
+    int holding = 0;
+    NAVSYNC nav;
+
+    nav.Reset();
+    nref = nnew = ref_par = new_par = 0;
+
+    for (int n=0; n < nwords; n++) {
+        int word = words[n];
+        for (int i=0; i<16; i++) {
+            word<<=1;
+            buf[holding++] = (word>>16) & 1;
+        }
+        while (holding>=300) {
+            int nbits;
+            if (0==ref_check(buf, &nbits)) {
+                ref_found[nref].word = n;
+                for (int i=0; i<10; i++) ref_found[nref].sf[i] = pack(buf + i*30);
+                nref++;
+            } else {
+                if (nbits != 1) ref_par++;
+            }
+            memmove(buf, buf+nbits, holding-=nbits);
+        }
+
+        int ev = nav.Push(words[n]);
+        if (ev & NAV_PARITY) new_par++;
+        if (ev & NAV_SUBFRAME) {
+            new_found[nnew].word = n;
+            memcpy(new_found[nnew].sf, nav.subframe, sizeof(nav.subframe));
+            nnew++;
+        }
+    }
+}
+
+// subframes the original found, looked for in the new list
+static int compare() {
+    int i, j = 0, missing = 0, differ = 0;
+
+    for (i = 0; i < nref; i++) {
+        while (j < nnew && new_found[j].word < ref_found[i].word) j++;
+        if (j == nnew || new_found[j].word != ref_found[i].word) {
+            missing++;
+            continue;
+        }
+        if (memcmp(new_found[j].sf, ref_found[i].sf, sizeof(ref_found[i].sf))) {
+            if (differ++ < 8) printf("subframe at word %d: contents differ\n", ref_found[i].word);
+        }
+    }
+
+    printf("subframes: original %d, new %d (%d more), missing %d, differing %d; parity errors: original %d, new %d\n",
+        nref, nnew, nnew - nref, missing, differ, ref_par, new_par);
+    return differ;
+}
+
+// Packed parity against the original on random words, for each D29*, D30*
+static int check_parity(int nwords) {
+    int errs = 0;
+
+    for (int n = 0; n < nwords; n++) {
+        u4_t w = ((random() << 16) ^ random()) & 0x3fffffff;
+        u4_t prev = (n>>1) & 3;
+        char bits[30], p[6];
+
+        if (n & 1) {
+            // half with correct parity
+            char tx[30];
+            for (int i=0; i<30; i++) bits[i] = tx[i] = (w >> (29-i)) & 1;
+            ref_parity(p, tx, (prev>>1) & 1, prev & 1);
+            for (int i=0; i<6; i++) bits[24+i] = p[i];
+            w = pack(bits);
+        }
+
+        for (int i=0; i<30; i++) bits[i] = (w >> (29-i)) & 1;
+        bool ref_ok = !ref_parity(p, bits, (prev>>1) & 1, prev & 1);
+        u4_t nw = w;
+        bool new_ok = NavParity(&nw, prev);
+        if (ref_ok != new_ok || nw != pack(bits)) {
+            if (errs++ < 8) printf("parity 0x%08x prev %d: original %d new %d\n", w, prev, ref_ok, new_ok);
+        }
+    }
+
+    printf("parity: %d random words, %d mismatches\n", nwords, errs);
+    return errs;
+}
+
+// stream of bits as transmitted
+static char *bits;
+static int nbits, max_bits;
+
+static void put_bit(int b) {
+    if (nbits < max_bits) bits[nbits++] = b;
+}
+
+static void gen_subframes(int nsf) {
+    char D29 = 0, D30 = 0;
+
+    for (int s = 0; s < nsf; s++) {
+        for (int w = 0; w < 10; w++) {
+            char word[30], p[6], tx[30];
+            for (int i=0; i<24; i++) word[i] = random() & 1;
+            if (w == 0) for (int i=0; i<8; i++) word[i] = preambleUpright[i];
+
+            // HOW and the last word: solve d23, d24 for D29 = D30 = 0
+            for (int t = 0; t < 4; t++) {
+                if (w == 1 || w == 9) { word[22] = t>>1; word[23] = t&1; }
+                memcpy(tx, word, 24);
+                for (int i=0; i<24; i++) tx[i] ^= D30;      // as ref_parity() will undo
+                ref_parity(p, tx, D29, D30);
+                if ((w != 1 && w != 9) || (p[4] == 0 && p[5] == 0)) break;
+            }
+            for (int i=0; i<24; i++) put_bit(word[i] ^ D30);
+            for (int i=0; i<6; i++) put_bit(p[i]);
+            D29 = p[4]; D30 = p[5];
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int i, nsf = 5000;
+    double ber = 1e-3, slip = 1e-5;
+    bool invert = false;
+    const char *fn = NULL;
+    uint16_t *words;
+    int nwords;
+
+    while ((i = getopt(argc, argv, "n:e:s:if:")) != -1) {
+        switch (i) {
+            case 'n': nsf = strtol(optarg, 0, 0); break;
+            case 'e': ber = strtod(optarg, 0); break;
+            case 's': slip = strtod(optarg, 0); break;
+            case 'i': invert = true; break;
+            case 'f': fn = optarg; break;
+            default: printf("usage: navsync [-n subframes] [-e bit_error_rate] [-s slip_rate] [-i] [-f file]\n"); exit(-1);
+        }
+    }
+
+    srandom(1);
+    int errs = check_parity(1 << 20);
+
+    if (fn) {
+        FILE *fp = fopen(fn, "r");
+        if (fp == NULL) { printf("can't open %s\n", fn); exit(-1); }
+        fseek(fp, 0, SEEK_END);
+        nwords = ftell(fp) / sizeof(uint16_t);
+        rewind(fp);
+        words = (uint16_t *) malloc(nwords * sizeof(uint16_t));
+        nwords = fread(words, sizeof(uint16_t), nwords, fp);
+        fclose(fp);
+        printf("%s: %d NAV words\n", fn, nwords);
+    } else {
+        max_bits = nsf * 300 * 2;
+        bits = (char *) malloc(max_bits);
+        char *clean = (char *) malloc(max_bits);
+        nbits = 0;
+        for (i = random() % 300; i; i--) put_bit(random() & 1);     // start mid-subframe
+        gen_subframes(nsf);
+
+        // impairments
+        int n, m = 0, flips = 0, slips = 0;
+        memcpy(clean, bits, nbits);
+        for (n = 0; n < nbits && m < max_bits; n++) {
+            double r = random() / (RAND_MAX + 1.0);
+            if (r < slip / 2) { slips++; continue; }                                    // dropped
+            if (r < slip) { slips++; bits[m++] = clean[n]; }                           // repeated
+            int b = clean[n];
+            if (random() / (RAND_MAX + 1.0) < ber) { b ^= 1; flips++; }
+            if (invert && (n / (nbits/2 + 1)) & 1) b ^= 1;
+            bits[m++] = b;
+        }
+        nbits = m;
+
+        nwords = nbits / 16;
+        words = (uint16_t *) malloc(nwords * sizeof(uint16_t));
+        for (n = 0; n < nwords; n++) {
+            words[n] = 0;
+            for (i = 0; i < 16; i++) words[n] = (words[n] << 1) | bits[n*16 + i];
+        }
+        printf("%d subframes, %d bit errors, %d slips%s\n", nsf, flips, slips, invert? ", inverted half way" : "");
+    }
+
+    ref_found = (found_t *) malloc((nwords * 16 / 300 + 1) * sizeof(found_t));
+    new_found = (found_t *) malloc((nwords * 16 / 300 + 1) * sizeof(found_t));
+    run(words, nwords);
+    errs += compare();
+
+    return errs? -1 : 0;
+}
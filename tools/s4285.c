@@ -0,0 +1,170 @@
+// Loopback timing benchmark of the STANAG 4285 modem (extensions/s4285). The transmitter output, taken
+// with getTxOutput() as the extension's MODE_TX_LOOPBACK does, is run through the receiver tracking the
+// preamble only, then with the data demodulation, equalizer and Viterbi decoder enabled. Reports
+// symbols/sec against the 2400 baud needed for real time.
+//
+// It isn't a check the decoder works: the data demodulation doesn't decode the loopback signal yet
+// (the receiver locks, but the hard decisions don't match what was sent), so the error rate of the
+// decoded bits printed is about 0.5, i.e. no better than chance, whatever the SNR. It's only there so
+// a fix shows up, and as a sanity check the decoding work was actually done.
+//
+// make UTIL=s4285; ./s4285 [-s secs] [-n snr_db] [-m rx_mode]
+//
+// snr_db is in the full 9600 Hz bandwidth of the modem samples. The transmitter always runs 600L,
+// the default mode, so other receive modes only make sense for timing.
+
+#include "../types.h"
+#include "../extensions/s4285/st4285.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define NSAMPS		512		// per call, as the extension gets them
+
+static u1_t *tx_bits, *rx_bits;
+static int ntx_bits, nrx_bits, max_bits;
+static u4_t lfsr = 1;
+
+static u1_t tx_byte()
+{
+	int i;
+	u1_t b = 0;
+
+	for (i = 0; i < 8; i++) {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xd0000001);
+		b |= (lfsr & 1) << i;
+		if (ntx_bits < max_bits) tx_bits[ntx_bits++] = lfsr & 1;		// tx_octet() sends LSB first
+	}
+	return b;
+}
+
+static double gauss()
+{
+	double u1 = (random() + 1.0) / (RAND_MAX + 2.0), u2 = random() / (RAND_MAX + 1.0);
+	return sqrt(-2 * log(u1)) * cos(2 * K_PI * u2);
+}
+
+static double time_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// the server routines the modem uses
+u4_t timer_us()
+{
+	return (u4_t) (time_sec() * 1e6);
+}
+
+void _panic(const char *str, bool coreFile, const char *file, int line)
+{
+	printf("PANIC: \"%s\" (%s, line %d)\n", str, file, line);
+	exit(-1);
+}
+
+// The decoder output lags the input by the interleaver and traceback delays, and starts once the
+// preamble is found, so find where the received bits line up with the sent ones.
+static int ber(int *off, int *nbits)
+{
+	#define SKIP	2000
+	#define WIN		2000
+	#define MAX_OFF	30000
+	int o, n, errs, best = WIN+1;
+
+	*off = 0;
+	*nbits = 0;
+	if (nrx_bits < SKIP + WIN) return -1;
+
+	for (o = -MAX_OFF; o <= MAX_OFF; o++) {
+		if (SKIP + o < 0 || SKIP + o + WIN > ntx_bits) continue;
+		for (n = errs = 0; n < WIN && errs < best; n++)
+			errs += rx_bits[SKIP+n] ^ tx_bits[SKIP+o+n];
+		if (errs < best) { best = errs; *off = o; }
+	}
+
+	for (n = SKIP, errs = 0; n < nrx_bits && n + *off < ntx_bits; n++) {
+		errs += rx_bits[n] ^ tx_bits[n + *off];
+		(*nbits)++;
+	}
+	return errs;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, secs = 120;
+	float snr = 99;
+	bool noise = false;
+	const char *mode = "600L";
+	char cmd[32], resp[256];
+
+	while ((i = getopt(argc, argv, "s:n:m:")) != -1) {
+		switch (i) {
+			case 's': secs = strtol(optarg, 0, 0); break;
+			case 'n': snr = strtof(optarg, 0); noise = true; break;
+			case 'm': mode = optarg; break;
+			default: printf("usage: s4285 [-s secs] [-n snr_db] [-m rx_mode]\n"); exit(-1);
+		}
+	}
+
+	int nsamps = secs * 9600;
+	max_bits = secs * 2400 + 1024;
+	tx_bits = (u1_t *) malloc(max_bits);
+	rx_bits = (u1_t *) malloc(max_bits);
+	TYPEMONO16 *samps = (TYPEMONO16 *) malloc((nsamps + NSAMPS) * sizeof(TYPEMONO16));
+	int *out = (int *) malloc(max_bits * sizeof(int));
+
+	for (int decode = 0; decode < 2; decode++) {
+		CSt4285 *st = &m_CSt4285[0];
+		st->reset();
+		st->registerTxCallback(tx_byte);
+		sprintf(cmd, "SET,MODE,%s", mode);
+		st->control(cmd, resp, 0);
+		st->control((void *) (decode? "SET,DECODE,ON" : "SET,DECODE,OFF"), resp, 0);
+		ntx_bits = nrx_bits = 0;
+		lfsr = 1;
+		srandom(1);
+
+		// the transmitter isn't part of the timing
+		int n;
+		double rms = 0;
+		for (n = 0; n < nsamps; n += NSAMPS)
+			st->getTxOutput((void *) &samps[n], NSAMPS, TYPE_REAL_S16_DATA, K_AMPMAX/2);
+		if (noise) {
+			for (n = 0; n < nsamps; n++) rms += (double) samps[n] * samps[n];
+			double sigma = sqrt(rms / nsamps) / pow(10, snr/20);
+			for (n = 0; n < nsamps; n++) {
+				double s = samps[n] + sigma * gauss();
+				samps[n] = (s > 32767)? 32767 : ((s < -32768)? -32768 : (TYPEMONO16) lround(s));
+			}
+		}
+
+		double start = time_sec();
+		for (n = 0; n < nsamps; n += NSAMPS) {
+			st->process_rx_block(&samps[n], NSAMPS, K_AMPMAX);
+			int len = 0;
+			st->getRxOutput(out, len, TYPE_BITSTREAM_DATA);
+			for (i = 0; i < len && nrx_bits < max_bits; i++)
+				rx_bits[nrx_bits++] = out[i];
+		}
+		double t = time_sec() - start;
+		double syms = nsamps / 4.0;
+		printf("%s %s: %.0f symbols/sec, %.1fx real time, %.1f usec/symbol\n", mode, decode? "decode" : "track only",
+			syms / t, syms / t / 2400, t / syms * 1e6);
+
+		if (decode) {
+			int off, nbits, errs = ber(&off, &nbits);
+			if (errs < 0)
+				printf("%s: no data decoded (%d bits)\n", mode, nrx_bits);
+			else
+				printf("%s: decoded bits vs sent %.2e errors (%d in %d bits, offset %d)%s, ~0.5 until the demodulation works\n",
+					mode, nbits? (double) errs / nbits : 0, errs, nbits, off, noise? "" : " no noise");
+		}
+	}
+
+	return 0;
+}
@@ -11,7 +11,7 @@
 `define DEF_FW_ID
 	localparam ADC_BITS = 14;    // DEFp 0xe
 `define DEF_ADC_BITS
-	localparam NUM_CMDS = 36;    // DEFp 0x24
+	localparam NUM_CMDS = 37;    // DEFp 0x25
 `define DEF_NUM_CMDS
 	localparam DEFAULT_NSYNC = 2;    // DEFp 0x2
 `define DEF_DEFAULT_NSYNC
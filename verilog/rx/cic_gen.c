@@ -93,10 +93,15 @@ void cic_gen(char *fn, int mflags, int N, int R, int Bin, int Bout)
 
 	const char *mode_s[4] = { "EMPTY", "NO_PRUNE", "INTEG_COMB", "INTEG_ONLY" };
 
-	FILE *fp = NULL;
-	if (strstr(fn, ".vh"))
+	// The same register widths are also written as a C initializer (.h) for the software model (rx/rx_model.cpp).
+	FILE *fp = NULL, *cfp = NULL;
+	if (strstr(fn, ".vh")) {
+		char cfn[64];
 		if ((fp = fopen(fn, "w")) == NULL) sys_panic("fopen");
-	if (mode == EMPTY) { if (fp) fclose(fp); return; }
+		strcpy(cfn, fn); strcpy(strstr(cfn, ".vh"), ".h");
+		if ((cfp = fopen(cfn, "w")) == NULL) sys_panic("fopen");
+	}
+	if (mode == EMPTY) { if (fp) fclose(fp); if (cfp) fclose(cfp); return; }
 	
 	if (fp) fprintf(fp, "// generated file\n\n");
 	if (fp) fprintf(fp, "// CIC: %s N=%d R=%d M=%d Bin=%d Bout=%d\n", mode_s[mode], N, R, M, Bin, Bout);
@@ -272,6 +277,14 @@ void cic_gen(char *fn, int mflags, int N, int R, int Bin, int Bout)
 	if (!fp)
 		return;
 
+	fprintf(cfp, "// generated file\n\n");
+	fprintf(cfp, "// CIC: %s N=%d R=%d M=%d Bin=%d Bout=%d\n", mode_s[mode], N, R, M, Bin, Bout);
+	fprintf(cfp, "// mode, N, R, Bin, Bout, { register widths: input, integrators 1..N, combs 1..N, output }\n");
+	fprintf(cfp, "%d, %d, %d, %d, %d, {", mode, N, R, Bin, Bout);
+	for (s=0; s<=N2P1; s++) fprintf(cfp, " %d%s", pACC[s], (s < N2P1)? ",":"");
+	fprintf(cfp, " }\n");
+	fclose(cfp);
+
 	int NBO = Num_Output_Bits_With_No_Truncation-1;
 	
 	if (mode == INTEG_ONLY) {
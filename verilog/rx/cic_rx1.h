@@ -0,0 +1,5 @@
+// generated file
+
+// CIC: INTEG_COMB N=3 R=505 M=1 Bin=22 Bout=18
+// mode, N, R, Bin, Bout, { register widths: input, integrators 1..N, combs 1..N, output }
+2, 3, 505, 22, 18, { 49, 49, 49, 26, 22, 21, 20, 18 }
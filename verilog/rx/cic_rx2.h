@@ -0,0 +1,5 @@
+// generated file
+
+// CIC: INTEG_COMB N=5 R=11 M=1 Bin=18 Bout=24
+// mode, N, R, Bin, Bout, { register widths: input, integrators 1..N, combs 1..N, output }
+2, 5, 11, 18, 24, { 36, 36, 36, 35, 33, 31, 30, 29, 28, 27, 27, 24 }
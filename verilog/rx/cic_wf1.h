@@ -0,0 +1,5 @@
+// generated file
+
+// CIC: INTEG_COMB N=5 R=8192 M=1 Bin=24 Bout=16
+// mode, N, R, Bin, Bout, { register widths: input, integrators 1..N, combs 1..N, output }
+2, 5, 8192, 24, 16, { 89, 89, 89, 89, 89, 28, 23, 22, 21, 20, 20, 16 }
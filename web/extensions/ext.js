@@ -324,6 +324,15 @@ function extint_msg_cb(param, ws)
 		case "ext_client_init":
 			extint_focus();
 			break;
+
+		// server is throttling or has stopped the extension's sample callbacks (cpu budget)
+		case "ext_budget_throttle":
+			if (+param[1]) add_problem('extension throttled');
+			break;
+
+		case "ext_budget_exceeded":
+			add_problem('extension stopped: over '+ param[1] +'% cpu', true);
+			break;
 	}
 }
 
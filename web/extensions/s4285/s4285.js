@@ -140,7 +140,7 @@ var s4285_gain_init = 5;
 var s4285_points_init = 10;
 
 var s4285 = {
-	'mode':s4285_mode_init, 'gain':s4285_gain_init, 'draw':0, 'points':s4285_points_init
+	'mode':s4285_mode_init, 'gain':s4285_gain_init, 'draw':0, 'points':s4285_points_init, 'decode':0
 };
 
 var s4285_canvas;
@@ -156,6 +156,7 @@ function s4285_controls_setup()
 
 	var mode_s = { 0:'receive', 1:'tx loopback' };
 	var draw_s = { 0:'points', 1:'density' };
+	var decode_s = { 0:'off (track preamble)', 1:'on' };
 	
 	var controls_html =
 		w3_divs('id-s4285-controls w3-text-aqua', '',
@@ -165,6 +166,7 @@ function s4285_controls_setup()
 				w3_slider('Gain', 's4285.gain', s4285.gain, 0, 100, 1, 's4285_gain_cb'),
 				w3_select('Draw', '', 's4285.draw', s4285.draw, draw_s, 's4285_draw_select_cb'),
 				w3_slider('Points', 's4285.points', s4285.points, 4, 14, 1, 's4285_points_cb'),
+				w3_select('Decode', '', 's4285.decode', s4285.decode, decode_s, 's4285_decode_select_cb'),
 				w3_button('', 'Clear', 's4285_clear_cb'),
 				w3_divs('', 'w3-text-aqua',
 					'<b>Status:</b>',
@@ -188,6 +190,7 @@ function s4285_controls_setup()
 	ext_set_passband(600, 3000);
 	//msg_send("SET slow=0");
 	ext_send('SET mode='+ s4285_mode_init);
+	ext_send('SET decode='+ s4285.decode);
 	ext_send('SET run=1');
 	s4285_clear();
 }
@@ -215,6 +218,13 @@ function s4285_points_cb(path, val)
 	s4285_clear();
 }
 
+function s4285_decode_select_cb(path, idx)
+{
+	idx = +idx;
+	s4285.decode = idx;
+	ext_send('SET decode='+ idx);
+}
+
 var s4285_density_interval;
 
 function s4285_draw_select_cb(path, idx)
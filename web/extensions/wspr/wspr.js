@@ -408,7 +408,10 @@ function wspr_config_html()
 					w3_input_get_param('Reporter callsign', 'WSPR.callsign', 'w3_string_set_cfg_cb', ''),
 					w3_input_get_param('Reporter grid square ', 'WSPR.grid', 'w3_string_set_cfg_cb', '', '4 or 6-character grid square location', '',
 						w3_div('id-wspr-grid-set cl-admin-check w3-inline w3-blue w3-pointer w3-hide', 'set from GPS')	// FIXME
-					)
+					),
+					w3_input_get_param('Skimmer (1 = on): decode the bands below with no browser connected', 'WSPR.autorun', 'w3_num_set_cfg_cb', ''),
+					w3_input_get_param('Skimmer bands', 'WSPR.skimmer_bands', 'w3_string_set_cfg_cb', '',
+						'e.g. 40m, 30m, 20m &mdash; one receiver channel each, takes effect on restart, spots to wspr_spots.txt')
 				), ''
 			)
 		)
@@ -202,7 +202,14 @@ function config_html()
 					'set to 116000 kHz when 144-148 maps to 28-32 MHz.'
 				)
 			),
-			'',
+			w3_divs('', 'w3-center w3-tspace-8',
+				'<b>Opus audio</b>',
+				w3_divs('', 'w3-text-black',
+					'Requested with URL parameter codec=opus. Needs libopus <br> installed when the server is built, and the browser <br>' +
+					'to connect over HTTPS (e.g. through a reverse proxy), <br> browsers only decode Opus in secure contexts. <br>' +
+					'Otherwise users get ADPCM audio.'
+				)
+			),
 			''
 		);
 
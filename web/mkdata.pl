@@ -2,22 +2,99 @@
 # a list of files as an input, and produces a .c data file that contains
 # contents of all these files as collection of char arrays.
 #
-# Usage: perl <this_file> <file1> [file2, ...] > embedded_data.c
+# Usage: perl <this_file> <func_name> <file1> [file2, ...] > embedded_data.c
+#
+# Lookup is by a minimal perfect hash (hash and displace): a file name hashes to a bucket,
+# the bucket's seed rehashes it to its unique slot in embedded_files[].
+# NB: hash() must match embedded_hash() emitted below, needs a perl with 64-bit integers.
+#
+# Compressible files also get a gzip variant for clients with "Accept-Encoding: gzip".
+# It is emitted as gzip header + deflate data ending with a sync flush, i.e. without the final
+# block and trailer, so the server can append data (e.g. the .js version check) as a stored
+# block before completing the stream with the crc32 (also emitted) and length.
+
+use strict;
+use Compress::Zlib;
 
-foreach my $i (1 .. $#ARGV) {
-  open FD, '<:raw', $ARGV[$i] or die "Cannot open $ARGV[$i]: $!\n";
-  printf("static const unsigned char v%d[] = {", $i);
-  my $byte;
+my @files = @ARGV[1 .. $#ARGV];
+my $n = scalar(@files);
+
+sub hash {
+  my ($seed, $s) = @_;
+  my $h = (0x811c9dc5 ^ $seed) & 0xffffffff;
+  foreach my $c (unpack('C*', $s)) {
+    $h ^= $c;
+    $h = ($h * 0x01000193) & 0xffffffff;
+  }
+  return $h;
+}
+
+sub print_array {
+  my ($name, $data) = @_;
+  printf("static const unsigned char %s[] = {", $name);
   my $j = 0;
-  while (read(FD, $byte, 1)) {
+  foreach my $byte (unpack('C*', $data)) {
     if (($j % 12) == 0) {
       print "\n";
     }
-    printf ' %#04x,', ord($byte);
+    printf ' %#04x,', $byte;
     $j++;
   }
   print " 0x00\n};\n";
+}
+
+my %gz_ok = map { $_ => 1 } qw(js css html json svg txt map);
+my (@gz, @crc);
+
+foreach my $i (0 .. $n-1) {
+  open FD, '<:raw', $files[$i] or die "Cannot open $files[$i]: $!\n";
+  local $/;
+  my $data = <FD>;
+  $data = '' if !defined($data);
   close FD;
+  print_array("v$i", $data);
+
+  # only if the compressed variant is worth it
+  my ($suffix) = $files[$i] =~ /\.([^.\/]+)$/;
+  next if length($data) < 256 || !defined($suffix) || !$gz_ok{$suffix};
+  my ($d, $status) = deflateInit(-Level => Z_BEST_COMPRESSION, -WindowBits => -MAX_WBITS);
+  die "deflateInit failed: $status\n" if !$d;
+  my ($z1, $s1) = $d->deflate($data);
+  my ($z2, $s2) = $d->flush(Z_SYNC_FLUSH);
+  die "deflate failed: $files[$i]\n" if $s1 != Z_OK || $s2 != Z_OK;
+  my $gz = pack('C10', 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 3) . $z1 . $z2;
+  next if length($gz) + 10 >= length($data) * 0.9;
+  print_array("z$i", $gz);
+  $gz[$i] = 1;
+  $crc[$i] = crc32($data);
+}
+
+# hash and displace
+my $m = $n? $n : 1;
+my $nb = int($n/4) + 1;
+my (@bucket, @seed, @slot, @used);
+foreach my $i (0 .. $n-1) {
+  push @{$bucket[hash(0, $files[$i]) % $nb]}, $i;
+}
+foreach my $k (sort { scalar(@{$bucket[$b] // []}) <=> scalar(@{$bucket[$a] // []}) } (0 .. $nb-1)) {
+  my @keys = @{$bucket[$k] // []};
+  $seed[$k] = 0;
+  next if !@keys;
+  SEED: for (my $s = 1; ; $s++) {
+    die "no perfect hash found\n" if $s > 1000000;
+    my %try;
+    foreach my $i (@keys) {
+      my $p = hash($s, $files[$i]) % $m;
+      next SEED if $used[$p] || $try{$p};
+      $try{$p} = $i;
+    }
+    foreach my $p (keys %try) {
+      $used[$p] = 1;
+      $slot[$p] = $try{$p};
+    }
+    $seed[$k] = $s;
+    last;
+  }
 }
 
 print <<EOS;
@@ -29,31 +106,63 @@ static const struct embedded_file {
   const char *name;
   const unsigned char *data;
   size_t size;
+  const unsigned char *gz;
+  size_t gz_size;
+  unsigned int crc;
 } embedded_files[] = {
 EOS
 
-foreach my $i (1 .. $#ARGV) {
-  print "  {\"$ARGV[$i]\", v$i, sizeof(v$i) - 1},\n";
+foreach my $p (0 .. $m-1) {
+  my $i = $slot[$p];
+  if (!defined($i)) {
+    print "  {NULL, NULL, 0, NULL, 0, 0},\n";
+  } elsif ($gz[$i]) {
+    printf("  {\"%s\", v%d, sizeof(v%d) - 1, z%d, sizeof(z%d) - 1, %#x},\n", $files[$i], $i, $i, $i, $i, $crc[$i]);
+  } else {
+    printf("  {\"%s\", v%d, sizeof(v%d) - 1, NULL, 0, 0},\n", $files[$i], $i, $i);
+  }
 }
 
-print <<EOS;
-  {NULL, NULL, 0}
-};
-
-const char*
-EOS
+print "};\n\nstatic const unsigned int embedded_seed[] = {";
+foreach my $k (0 .. $nb-1) {
+  print "\n" if ($k % 12) == 0;
+  printf ' %d,', $seed[$k];
+}
+print "\n};\n";
 
-printf("%s", $ARGV[0]);
+my $func = $ARGV[0];
 
 print <<EOS;
-(const char *name, size_t *size) {
-  const struct embedded_file *p;
-  for (p = embedded_files; p->name != NULL; p++) {
-    if (!strcmp(p->name, name)) {
-      if (size != NULL) { *size = p->size; }
-      return (const char *) p->data;
-    }
+
+static unsigned int embedded_hash(unsigned int seed, const char *s) {
+  unsigned int h = 0x811c9dc5 ^ seed;
+  while (*s) {
+    h ^= (unsigned char) *s++;
+    h *= 0x01000193;
   }
-  return NULL;
+  return h;
+}
+
+static const struct embedded_file *lookup(const char *name) {
+  unsigned int seed = embedded_seed[embedded_hash(0, name) % $nb];
+  const struct embedded_file *p = &embedded_files[embedded_hash(seed, name) % $m];
+  return (p->name != NULL && !strcmp(p->name, name))? p : NULL;
+}
+
+const char*
+${func}(const char *name, size_t *size) {
+  const struct embedded_file *p = lookup(name);
+  if (p == NULL) return NULL;
+  if (size != NULL) { *size = p->size; }
+  return (const char *) p->data;
+}
+
+const char*
+${func}_gzip(const char *name, size_t *size, unsigned int *crc) {
+  const struct embedded_file *p = lookup(name);
+  if (p == NULL || p->gz == NULL) return NULL;
+  *size = p->gz_size;
+  *crc = p->crc;
+  return (const char *) p->gz;
 }
 EOS
@@ -230,6 +230,7 @@ void nbuf_allocq(ndesc_t *nd, char *s, int sl)
 	
 	check_nbuf(nb);
 	if (ovfl) {
+		nd->drops++;
 		kiwi_free("nbuf:buf", nb->buf);
 		nbuf_free(nb);
 	}
@@ -285,6 +286,13 @@ int nbuf_queued(ndesc_t *nd)
 	return queued;
 }
 
+// Same as nbuf_queued() but without walking the queue, for the data producers to check
+// for backpressure each time around their loop.
+int nbuf_depth(ndesc_t *nd)
+{
+	return nd->cnt;
+}
+
 void nbuf_cleanup(ndesc_t *nd)
 {
 	check_ndesc(nd);
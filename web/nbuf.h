@@ -31,6 +31,7 @@ typedef struct {
 	u4_t magic_e;
 	u2_t cnt, ttl;
 	bool ovfl, dbug;
+	u4_t drops;			// buffers discarded while over ND_HIWAT
 } ndesc_t;
 
 #define	ND_HIWAT	64
@@ -44,6 +45,7 @@ void nbuf_stat();
 void nbuf_allocq(ndesc_t *nd, char *s, int sl);
 nbuf_t *nbuf_dequeue(ndesc_t *nd);
 int nbuf_queued(ndesc_t *nd);
+int nbuf_depth(ndesc_t *nd);
 void nbuf_cleanup(ndesc_t *nd);
 
 #endif
@@ -350,6 +350,7 @@ function audio_flush()
 function audio_rate(input_rate)
 {
 	audio_input_rate = input_rate;
+	audio_decim = 1;		// interpolator history is from the old stream
 
 	if (audio_input_rate == 0) {
 		snd_send("SET zero audio_input_rate?");
@@ -394,6 +395,7 @@ function audio_rate(input_rate)
 		audio_transition_bw = 0.001;
 		audio_resample_ratio = audio_output_rate / audio_input_rate;
 		snd_send("SET AR OK in="+ input_rate +" out="+ audio_output_rate);
+		snd_send("SET decim="+ audio_decim_max);
 		//divlog("Network audio rate: "+audio_input_rate.toString()+" sps");
 	}
 
@@ -402,8 +404,171 @@ function audio_rate(input_rate)
 	console.log('AUDIO min_length_sec='+ audio_buffer_min_length_sec +'('+ audio_min_nbuf +' bufs) max_length_sec='+ audio_buffer_max_length_sec +'('+ audio_max_nbuf +' bufs)');
 }
 
+// Server-side resampling: ask the server to send audio at out_rate ("max" meaning our output rate)
+// so we resample little or not at all. The server replies with the rate it will send.
+var audio_out_rate_req = '';
+
+function audio_out_rate_request()
+{
+	if (audio_out_rate_req == '' || audio_output_rate == 0) return;
+	var rate = (audio_out_rate_req == 'max')? audio_output_rate : parseInt(audio_out_rate_req);
+	if (!isNaN(rate)) snd_send("SET out_rate="+ Math.round(rate));
+}
+
+function audio_rate_out(rate)
+{
+	if (rate == 0 || rate == audio_input_rate) return;
+	console.log('AUDIO server resampling to '+ rate +' sps');
+	resample_init1 = false;		// redesign resampler for the new input rate
+	audio_rate(rate);
+}
+
+// Audio codec, requested with URL param codec=pcm|adpcm|opus. The server confirms the codec it
+// uses with "MSG audio_codec=" just before the first packet coded with it.
+// Opus is decoded with WebCodecs, so isn't requested if the browser doesn't have it. Browsers only
+// have WebCodecs in a secure context, so Opus needs the Kiwi to be reached over HTTPS (e.g. through
+// a reverse proxy). Over plain HTTP, which the Kiwi web server itself serves, the audio stays ADPCM.
+var audio_codec_req = '';
+var audio_codec = 'adpcm';
+var audio_opus = null;
+var audio_opus_pkts = [];		// { seq, flags, nframes } of packets waiting for the decoder
+var audio_opus_data = new Int16Array(16384);
+var audio_opus_nsamps = 0;
+var audio_opus_ts = 0;
+var audio_opus_net_rate;		// rate the server sends, the decoder output may differ
+
+function audio_codec_request()
+{
+	if (audio_codec_req == '') return;
+	if (audio_codec_req == 'opus' && typeof AudioDecoder == 'undefined') {
+		if (window.isSecureContext === false)
+			console.log('AUDIO Opus needs an HTTPS connection (no WebCodecs over HTTP), staying with ADPCM');
+		else
+			console.log('AUDIO no WebCodecs AudioDecoder, staying with ADPCM');
+		return;
+	}
+	snd_send('SET codec='+ audio_codec_req);
+}
+
+function audio_set_codec(name)
+{
+	console.log('AUDIO codec '+ name);
+	audio_codec = name;
+	audio_compression = (name == 'adpcm');
+	audio_adpcm.index = audio_adpcm.previousValue = 0;		// server encoder was reset
+	audio_decim = 1;
+	
+	if (audio_opus) {
+		audio_opus.close();
+		audio_opus = null;
+		if (audio_input_rate != audio_opus_net_rate) {
+			resample_init1 = false;
+			audio_rate(audio_opus_net_rate);
+		}
+	}
+	if (name != 'opus') return;
+
+	audio_opus_net_rate = audio_input_rate;
+
+	audio_opus_pkts = [];
+	audio_opus_nsamps = 0;
+	audio_opus = new AudioDecoder({
+		output: audio_opus_output,
+		error: function(e) { console.log('AUDIO Opus decoder: '+ e); }
+	});
+	audio_opus.configure({ codec:'opus', sampleRate:audio_input_rate, numberOfChannels:1 });
+}
+
+// packet payload: frames each preceded by a 16-bit big-endian length
+function audio_opus_decode(ad8, seq, flags_smeter)
+{
+	var i = 0, nframes = 0;
+	while (i+2 <= ad8.length) {
+		var len = (ad8[i] << 8) | ad8[i+1];
+		i += 2;
+		audio_opus.decode(new EncodedAudioChunk({ type:'key', timestamp:audio_opus_ts, data:ad8.subarray(i, i+len) }));
+		audio_opus_ts += 20000;		// usec
+		i += len;
+		nframes++;
+	}
+	if (nframes)
+		audio_opus_pkts.push({ seq:seq, flags:flags_smeter, nframes:nframes });
+}
+
+// decoder output arrives in order, a frame at a time
+function audio_opus_output(ad)
+{
+	var n = ad.numberOfFrames, rate = ad.sampleRate;
+	var f = new Float32Array(n);
+	ad.copyTo(f, { planeIndex:0, format:'f32-planar' });
+	ad.close();
+	
+	// decoder may run at a rate other than requested (typically 48k)
+	if (rate != audio_input_rate) {
+		resample_init1 = false;
+		audio_rate(rate);
+	}
+
+	var p = audio_opus_pkts[0];
+	if (p == undefined) return;
+	for (var i = 0; i < n && audio_opus_nsamps < audio_opus_data.length; i++)
+		audio_opus_data[audio_opus_nsamps++] = Math.max(-32768, Math.min(32767, Math.round(f[i] * 32768)));
+
+	if (--p.nframes == 0) {
+		audio_opus_pkts.shift();
+		audio_recv_samps(audio_opus_data, audio_opus_nsamps, p.seq, p.flags);
+		audio_opus_nsamps = 0;
+	}
+}
+
 var audio_adpcm = { index:0, previousValue:0 };
-var audio_flags = { SND_FLAG_SMETER: 0x0fff, SND_FLAG_LPF: 0x1000, SND_FLAG_ADC_OVFL: 0x2000, SND_FLAG_NEW_FREQ: 0x4000 };
+var audio_flags = { SND_FLAG_SMETER: 0x0fff, SND_FLAG_LPF: 0x1000, SND_FLAG_ADC_OVFL: 0x2000, SND_FLAG_NEW_FREQ: 0x4000, SND_FLAG_DECIM: 0x8000 };
+
+// Server may send narrow passbands at a reduced rate. Interpolate back up to the network rate
+// with a polyphase windowed-sinc FIR of AUDIO_DECIM_TAPS taps per output phase.
+// The server only decimates when the passband is within 0.9 of the decimated Nyquist, so the
+// images start at 0.55 of the decimated rate, in the stopband of a filter cut off at half of it.
+var audio_decim_max = 4;
+var audio_decim_data = new Int16Array(audio_buffer_size);
+var AUDIO_DECIM_TAPS = 32;
+var audio_decim = 1;			// factor the interpolator is set up for, 1 = history must be cleared
+var audio_decim_taps;			// [phase * AUDIO_DECIM_TAPS + k] applies to the k'th newest input
+var audio_decim_hist = new Float32Array(AUDIO_DECIM_TAPS * 2);		// doubled so the taps see it contiguous
+var audio_decim_pos = 0;
+
+function audio_decim_init(decim)
+{
+	var i, p, k, len = AUDIO_DECIM_TAPS * decim;
+	var proto = new Float32Array(len);
+	firdes_lowpass_f(proto, len-1, 0.5/decim);		// odd length, last tap left zero
+	
+	audio_decim_taps = new Float32Array(len);
+	for (p = 0; p < decim; p++)
+		for (k = 0; k < AUDIO_DECIM_TAPS; k++)
+			audio_decim_taps[p * AUDIO_DECIM_TAPS + k] = proto[p + k*decim] * decim;		// gain of decim for the zero stuffing
+	for (i = 0; i < AUDIO_DECIM_TAPS * 2; i++)
+		audio_decim_hist[i] = 0;
+	audio_decim_pos = 0;
+	audio_decim = decim;
+}
+
+function audio_decim_interp(in_data, samps, out_data)
+{
+	var i, p, k, o = 0, decim = audio_decim, T = AUDIO_DECIM_TAPS;
+	var hist = audio_decim_hist, taps = audio_decim_taps, pos = audio_decim_pos;
+	
+	for (i = 0; i < samps; i++) {
+		pos = (pos + 1) % T;
+		hist[pos] = hist[pos + T] = in_data[i];
+		for (p = 0; p < decim; p++) {
+			var acc = 0, t = p * T, h = pos + T;
+			for (k = 0; k < T; k++)
+				acc += taps[t + k] * hist[h - k];
+			out_data[o++] = Math.max(-32768, Math.min(32767, Math.round(acc)));
+		}
+	}
+	audio_decim_pos = pos;
+}
 var audio_ext_adc_ovfl = false;
 var audio_need_stats_reset = true;
 
@@ -416,19 +581,42 @@ function audio_recv(data)
 	var flags_smeter = (fs8[0] << 8) | fs8[1];
 	
 	var ad8 = new Uint8Array(data, 10);
+	if (audio_codec == 'opus') {
+		audio_opus_decode(ad8, seq, flags_smeter);
+		return;
+	}
+
+	var decim = 1;
+	if (flags_smeter & audio_flags.SND_FLAG_DECIM) {
+		decim = ad8[0];
+		ad8 = ad8.subarray(1);
+	}
 	var i, bytes = ad8.length, samps;
+	var d_data = (decim > 1)? audio_decim_data : audio_data;
 	
 	if (!audio_compression) {
 		for (i=0; i<bytes; i+=2) {
-			audio_data[i/2] = (ad8[i]<<8) | ad8[i+1];		// convert from network byte-order
+			d_data[i/2] = (ad8[i]<<8) | ad8[i+1];		// convert from network byte-order
 		}
 		samps = bytes/2;		// i.e. 1024 8b bytes -> 512 16b samps, 1KB -> 1KB, 1:1 no compression
 	} else {
-		decode_ima_adpcm_e8_i16(ad8, audio_data, bytes, audio_adpcm);
+		decode_ima_adpcm_e8_i16(ad8, d_data, bytes, audio_adpcm);
 		samps = bytes*2;		// i.e. 1024 8b bytes -> 2048 16b samps, 1KB -> 4KB, 4:1 over uncompressed
 	}
 	
-	audio_prepare(audio_data, samps, seq, flags_smeter);
+	if (decim > 1) {
+		if (decim != audio_decim) audio_decim_init(decim);
+		audio_decim_interp(d_data, samps, audio_data);
+		samps *= decim;
+	} else
+		audio_decim = 1;
+	
+	audio_recv_samps(audio_data, samps, seq, flags_smeter);
+}
+
+function audio_recv_samps(data, samps, seq, flags_smeter)
+{
+	audio_prepare(data, samps, seq, flags_smeter);
 
 	if (!audio_started) {
 	   var enough_buffered = audio_prepared_buffers.length > audio_min_nbuf;
@@ -443,7 +631,7 @@ function audio_recv(data)
 	audio_stat_input_size += samps;
 	audio_stat_total_input_size += samps;
 	
-	extint_audio_data(audio_data, samps);
+	extint_audio_data(data, samps);
 }
 
 function audio_prepare(data, data_len, seq, flags_smeter)
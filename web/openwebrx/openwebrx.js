@@ -47,7 +47,7 @@ var inactivity_timeout_override = -1, inactivity_timeout_msg = false;
 var spectrum_show = 0;
 var gen_freq = 0, gen_attn = 0;
 var squelch_threshold = 0;
-var wf_compression = 1;
+var wf_compression = 2;		// 0 = none, 1 = ADPCM, 2 = delta coded (wf_delta_decode)
 var debug_v = 0;		// a general value settable from the URI to be used during debugging
 var sb_trace = 0;
 var kiwi_gc = 1;
@@ -146,6 +146,8 @@ function kiwi_main()
 	s = 'sp'; if (q[s]) spectrum_show = parseInt(q[s]);
 	s = 'sq'; if (q[s]) squelch_threshold = parseFloat(q[s]);
 	s = 'blen'; if (q[s]) audio_buffer_min_length_sec = parseFloat(q[s])/1000;
+	s = 'arate'; if (q[s]) audio_out_rate_req = q[s];
+	s = 'codec'; if (q[s]) audio_codec_req = q[s];
 	s = 'wfdly'; if (q[s]) waterfall_delay = parseFloat(q[s]);
 	s = 'audio'; if (q[s]) audio_meas_dly_ena = parseFloat(q[s]);
 	s = 'mute'; if (q[s]) muted_initially = parseInt(q[s]);
@@ -214,7 +216,7 @@ function kiwi_main()
 	// fixme: okay to remove this now?
 	wf_send("SET zoom=0 start=0");
 	wf_send("SET maxdb=0 mindb=-100");
-	if (wf_compression == 0) wf_send('SET wf_comp=0');
+	if (wf_compression != 1) wf_send('SET wf_comp='+ wf_compression);
 	wf_send("SET slow=2");
 }
 
@@ -2587,12 +2589,68 @@ var need_maxmindb_update = false;
 var need_clear_specavg = false, clear_specavg = true;
 var specavg = [];
 
+// Delta coded waterfall lines, see the comments and wf_delta_encode() in rx_waterfall.cpp
+// Every line received, whatever its flags, becomes the reference for the next one.
+var wf_delta = { NMAX:64, QLIM:24, ref:new Uint8Array(1024) };
+
+function wf_delta_decode(input, key)
+{
+	var w = wf_delta.ref.length, ref = wf_delta.ref;
+	var out = new Uint8Array(w);
+	var bi = 0, nbits = input.length * 8;
+	var A = 8, N = 1;
+
+	var bit = function() {
+		if (bi >= nbits) return 0;
+		var b = (input[bi >> 3] >> (7 - (bi & 7))) & 1;
+		bi++;
+		return b;
+	};
+	var bits = function(n) {
+		var v = 0;
+		while (n--) v = (v << 1) | bit();
+		return v;
+	};
+	var update = function(s) {
+		A += s;
+		if (++N == wf_delta.NMAX) { A >>= 1; N >>= 1; }
+	};
+	var pred = function(i) {
+		if (key) return i? out[i-1] : 128;
+		return i? ((out[i-1] + ref[i] + 1) >> 1) : ref[0];
+	};
+
+	var q = 2*bits(8) + 1;
+	for (var i = 0; i < w; i++) {
+		var k, s, uq;
+		for (k = 0; (N << k) < A; k++)
+			;
+		for (uq = 0; uq < wf_delta.QLIM && bit(); uq++)
+			;
+		s = (uq == wf_delta.QLIM)? bits(9) : ((uq << k) | bits(k));
+		var qe = (s & 1)? -((s+1) >> 1) : (s >> 1);
+		var p = pred(i);
+		out[i] = Math.max(0, Math.min(255, p + qe*q));
+		update(s);
+
+		if (k == 0 && s == 0) {
+			var nb, run;
+			for (nb = 1; bit() == 0 && nb < 16; nb++)
+				;
+			run = ((1 << (nb-1)) | bits(nb-1)) - 1;
+			while (run-- && i+1 < w) {
+				i++;
+				out[i] = pred(i);
+				update(0);
+			}
+		}
+	}
+	return out;
+}
+
 function waterfall_add(data_raw)
 {
 	if (data_raw == null) return;
-	//var canvas = wf_canvases[0];
-	var canvas = wf_cur_canvas;
-	if (canvas == null) return;
 	
 	var u32View = new Uint32Array(data_raw, 4, 3);
 	var x_bin_server = u32View[0];		// bin & zoom from server at time data was queued
@@ -2600,12 +2658,32 @@ function waterfall_add(data_raw)
 	if (kiwi_gc_wf) u32View = null;	// gc
 	var x_zoom_server = u32 & 0xffff;
 	var flags = (u32 >> 16) & 0xffff;
-	var wf_flags = { COMPRESSED:1 };
+	var wf_flags = { COMPRESSED:1, DELTA:2, KEYFRAME:4 };
 
 	var data_arr_u8 = new Uint8Array(data_raw, 16);	// unsigned dBm values, converted to signed later on
 	var bytes = data_arr_u8.length;
 	var w = wf_fft_size;
 
+	// must decode every line, even those not displayed, to keep the reference
+	var data, decomp_data = null;
+	if (flags & wf_flags.COMPRESSED) {
+		decomp_data = new Uint8Array(bytes*2);
+		var wf_adpcm = { index:0, previousValue:0 };
+		decode_ima_adpcm_e8_u8(data_arr_u8, decomp_data, bytes, wf_adpcm);
+		var ADPCM_PAD = 10;
+		data = decomp_data.subarray(ADPCM_PAD);
+	} else
+	if (flags & wf_flags.DELTA) {
+		data = wf_delta_decode(data_arr_u8, flags & wf_flags.KEYFRAME);
+	} else {
+		data = data_arr_u8;
+	}
+	if (wf_compression == 2) wf_delta.ref.set(data.subarray(0, wf_delta.ref.length));
+
+	//var canvas = wf_canvases[0];
+	var canvas = wf_cur_canvas;
+	if (canvas == null) return;
+
 	// when caught up, update the max/min db so lagging w/f data doesn't use wrong (newer) zoom correction
 	if (need_maxmindb_update && zoom_level == x_zoom_server) {
 		update_maxmindb_sliders();
@@ -2618,17 +2696,6 @@ function waterfall_add(data_raw)
 		need_clear_specavg = false;
 	}
 	
-	var data, decomp_data = null;
-	if (flags & wf_flags.COMPRESSED) {
-		decomp_data = new Uint8Array(bytes*2);
-		var wf_adpcm = { index:0, previousValue:0 };
-		decode_ima_adpcm_e8_u8(data_arr_u8, decomp_data, bytes, wf_adpcm);
-		var ADPCM_PAD = 10;
-		data = decomp_data.subarray(ADPCM_PAD);
-	} else {
-		data = data_arr_u8;
-	}
-	
 	var sw, sh, tw=25;
 	var need_spectrum_update = false;
 	if (spectrum_display && spectrum_update != spectrum_last_update) {
@@ -5521,6 +5588,20 @@ function add_problem(what, sticky)
 		window.setTimeout(function(ps,ns) { ps.removeChild(ns); }, 1000, problems_span, new_span);
 }
 
+// for sticky problems that clear
+function remove_problem(what)
+{
+	problems_span = html('id-problems');
+	if (!problems_span) return;
+	for (var i=0; i < problems_span.children.length; i++)
+		if (problems_span.children[i].innerHTML == what) {
+			problems_span.removeChild(problems_span.children[i]);
+			return;
+		}
+}
+
+var wf_throttle_problem = null;
+
 function set_gen(freq, attn)
 {
 	snd_send("SET genattn="+ attn.toFixed(0));
@@ -5562,6 +5643,13 @@ function owrx_msg_cb(param, ws)
 		case "wf_fps":
 			wf_fps = parseInt(param[1]);
 			break;
+		case "wf_throttle":
+			// only sent when it changes, so shown until throttling ends
+			var throttle = parseInt(param[1]);
+			if (wf_throttle_problem) remove_problem(wf_throttle_problem);
+			wf_throttle_problem = throttle? ('slow network: waterfall 1/'+ (1 << throttle) +' rate') : null;
+			if (wf_throttle_problem) add_problem(wf_throttle_problem, true);
+			break;
 		case "start":
 			bin_server = parseInt(param[1]);
 			break;
@@ -5578,6 +5666,14 @@ function owrx_msg_cb(param, ws)
 			break;
 		case "audio_rate":
 			audio_rate(parseFloat(param[1]));
+			audio_out_rate_request();
+			audio_codec_request();
+			break;
+		case "audio_rate_out":
+			audio_rate_out(parseInt(param[1]));
+			break;
+		case "audio_codec":
+			audio_set_codec(param[1]);
 			break;
 		case "kiwi_up":
 			kiwi_up(parseInt(param[1]));
@@ -141,7 +141,7 @@ static const char* edata(const char *uri, bool cache_check, size_t *size, u4_t *
 	// so this code is not enclosed in an "#ifdef EDATA_DEVEL".
 	if (!data) {
 
-        // Since the file content must be known during the cache_check pass (for "%[" substitution dirty testing)
+        // Since the file content must be known during the cache_check pass (for "%[" template rendering)
         // keep the content buffer for the possible fetch_file pass which might happen immediately after.
 		static char *last_uri2_read;
 		static const char *last_data, *last_free;
@@ -243,6 +243,78 @@ static const char* edata(const char *uri, bool cache_check, size_t *size, u4_t *
 	return data;
 }
 
+extern const char *edata_embed_gzip(const char *, size_t *, u4_t *);
+extern const char *edata_always_gzip(const char *, size_t *, u4_t *);
+
+// Precompressed variant (see mkdata.pl) of the same in-memory data edata() would return.
+// Files loaded from the filesystem don't have one.
+static const char* edata_gzip(const char *uri, size_t *size, u4_t *crc)
+{
+	size_t dsize;
+
+#ifdef EDATA_EMBED
+	if (edata_embed(uri, &dsize))
+		return edata_embed_gzip(uri, size, crc);
+#endif
+	if (edata_always(uri, &dsize))
+		return edata_always_gzip(uri, size, crc);
+	return NULL;
+}
+
+static bool web_accepts_gzip(struct mg_connection *mc)
+{
+	const char *ae = mg_get_header(mc, "Accept-Encoding");
+	if (ae == NULL) return false;
+	const char *s = strstr(ae, "gzip");
+	if (s == NULL) return false;
+
+	// "gzip;q=0" means not acceptable
+	s += 4;
+	while (*s == ' ') s++;
+	if (*s == ';') {
+		float q;
+		s++;
+		while (*s == ' ') s++;
+		if (sscanf(s, "q=%f", &q) == 1 && q == 0) return false;
+	}
+	return true;
+}
+
+static u4_t crc32_update(u4_t crc, const char *s, int n)
+{
+	int i;
+	crc = ~crc;
+	while (n--) {
+		crc ^= (u1_t) *s++;
+		for (i=0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+// Complete a precompressed stream (which ends with a deflate sync flush): any appended data
+// goes into a final stored block, followed by the gzip trailer (crc32 and size of all the data).
+static int gzip_tail(char **tail, const char *app, int app_size, u4_t crc, u4_t size)
+{
+	u1_t *t = (u1_t *) malloc(5 + app_size + 8), *tp = t;
+	
+	if (app_size) {
+		*tp++ = 0x01;		// final, stored
+		*tp++ = app_size & 0xff; *tp++ = app_size >> 8;
+		*tp++ = ~app_size & 0xff; *tp++ = (~app_size >> 8) & 0xff;
+		memcpy(tp, app, app_size); tp += app_size;
+		crc = crc32_update(crc, app, app_size);
+		size += app_size;
+	} else {
+		*tp++ = 0x03; *tp++ = 0x00;		// final, empty fixed Huffman block
+	}
+	
+	for (int i=0; i < 4; i++) *tp++ = crc >> (i*8);
+	for (int i=0; i < 4; i++) *tp++ = size >> (i*8);
+	*tail = (char *) t;
+	return tp - t;
+}
+
 struct iparams_t {
 	char *id, *val;
 };
@@ -287,10 +359,171 @@ bool index_params_cb(cfg_t *cfg, void *param, jsmntok_t *jt, int seq, int hit, i
 	return false;
 }
 
+// .html and .css files are templates with %[id] substitutions from iparams.
+// Each file is split once into literal and placeholder segments. The rendered result is kept
+// until the file or the params change so it can be served with a single copy and cached by
+// the browser (the content hash becomes part of the etag).
+
+struct tmpl_seg_t {
+	int off, len;		// in src: literal text or the whole "%[id]"
+	bool placeholder;
+	int param;			// iparams index, -1 = unknown id (output unchanged)
+	int out_len;
+};
+
+struct tmpl_t {
+	tmpl_t *next;
+	char *uri;
+	char *src;
+	size_t src_size;
+	u4_t src_mtime;
+	int nseg, nseg_alloc;
+	tmpl_seg_t *seg;
+	char *out;
+	size_t out_size;
+	u4_t hash;
+	int nsubst;			// number of placeholders substituted
+	u4_t changed;		// time rendered content last changed without src changing (params reload)
+};
+
+static tmpl_t *tmpls;
+
+static void tmpl_seg_add(tmpl_t *t, int off, int len, bool placeholder)
+{
+	if (len == 0) return;
+	if (t->nseg == t->nseg_alloc) {
+		t->nseg_alloc = t->nseg_alloc? t->nseg_alloc*2 : 16;
+		t->seg = (tmpl_seg_t *) kiwi_realloc("tmpl_seg", t->seg, t->nseg_alloc * sizeof(tmpl_seg_t));
+	}
+	tmpl_seg_t *s = &t->seg[t->nseg++];
+	s->off = off;
+	s->len = len;
+	s->placeholder = placeholder;
+	s->param = -1;
+}
+
+static void tmpl_parse(tmpl_t *t)
+{
+	const char *src = t->src;
+	int size = t->src_size, cl, lit, pl;
+
+	t->nseg = 0;
+	for (cl = lit = 0; cl < size-1; cl++) {
+		if (src[cl] != '%' || src[cl+1] != '[') continue;
+		for (pl = cl+2; pl < size && src[pl] != ']'; pl++)
+			;
+		if (pl == size) break;		// unterminated, rest is literal
+		tmpl_seg_add(t, lit, cl - lit, false);
+		tmpl_seg_add(t, cl, pl+1 - cl, true);
+		cl = pl;
+		lit = pl+1;
+	}
+	tmpl_seg_add(t, lit, size - lit, false);
+}
+
+static void tmpl_resolve(tmpl_t *t)
+{
+	int i, j;
+
+	for (i=0; i < t->nseg; i++) {
+		tmpl_seg_t *s = &t->seg[i];
+		if (!s->placeholder) continue;
+		const char *id = t->src + s->off + 2;
+		int id_len = s->len - 3;
+		s->param = -1;
+		for (j=0; j < n_iparams; j++) {
+			if (strncmp(id, iparams[j].id, id_len) == 0 && iparams[j].id[id_len] == '\0') {
+				s->param = j;
+				break;
+			}
+		}
+	}
+}
+
+static u4_t tmpl_hash(const char *s, size_t n)
+{
+	u4_t h = 0x811c9dc5;	// FNV-1a
+	while (n--) {
+		h ^= (u1_t) *s++;
+		h *= 0x01000193;
+	}
+	return h? h : 1;		// zero means "no hash" to mongoose
+}
+
+static void tmpl_render(tmpl_t *t)
+{
+	int i;
+	tmpl_seg_t *s;
+	size_t size = 0;
+
+	t->nsubst = 0;
+	for (i=0, s = t->seg; i < t->nseg; i++, s++) {
+		s->out_len = (s->param >= 0)? strlen(iparams[s->param].val) : s->len;
+		size += s->out_len;
+		if (s->param >= 0) t->nsubst++;
+	}
+
+	char *out = (char *) kiwi_malloc("tmpl_out", size + SPACE_FOR_NULL), *op = out;
+	for (i=0, s = t->seg; i < t->nseg; i++, s++) {
+		memcpy(op, (s->param >= 0)? iparams[s->param].val : t->src + s->off, s->out_len);
+		op += s->out_len;
+	}
+	*op = '\0';
+
+	u4_t hash = tmpl_hash(out, size);
+	if (t->out) {
+		if (hash != t->hash) t->changed = time(NULL);
+		kiwi_free("tmpl_out", t->out);
+	}
+	t->out = out;
+	t->out_size = size;
+	t->hash = hash;
+}
+
+static tmpl_t *tmpl_get(const char *uri, const char *data, size_t size, u4_t mtime)
+{
+	tmpl_t *t;
+
+	for (t = tmpls; t; t = t->next) {
+		if (strcmp(t->uri, uri) == 0)
+			break;
+	}
+
+	if (t && t->src_size == size && t->src_mtime == mtime)
+		return t;
+
+	if (t == NULL) {
+		t = (tmpl_t *) kiwi_malloc("tmpl_t", sizeof(tmpl_t));
+		memset(t, 0, sizeof(tmpl_t));
+		t->uri = strdup(uri);
+		t->next = tmpls;
+		tmpls = t;
+	} else {
+		// source changed (development mode)
+		kiwi_free("tmpl_src", t->src);
+		kiwi_free("tmpl_out", t->out);
+		t->out = NULL;
+		t->changed = 0;
+	}
+
+	// copy because in development mode the file buffer from edata() is only valid for this request
+	t->src = (char *) kiwi_malloc("tmpl_src", size + SPACE_FOR_NULL);
+	memcpy(t->src, data, size);
+	t->src[size] = '\0';
+	t->src_size = size;
+	t->src_mtime = mtime;
+
+	tmpl_parse(t);
+	tmpl_resolve(t);
+	tmpl_render(t);
+	web_printf("TEMPLATE        %d segments, size %d => %d, hash %08x %s\n", t->nseg, (int) size, (int) t->out_size, t->hash, uri);
+	return t;
+}
+
 void reload_index_params()
 {
 	int i;
-	
+
 	//printf("reload_index_params: free %d\n", n_iparams);
 	for (i=0; i < n_iparams; i++) {
 		free(iparams[i].id);
@@ -314,6 +547,12 @@ void reload_index_params()
 	char *cs = (char *) cfg_string("owner_info", NULL, CFG_REQUIRED);
 	iparams_add("OWNER_INFO", cs);
 	cfg_string_free(cs);
+
+	// param indices and values may have changed
+	for (tmpl_t *t = tmpls; t; t = t->next) {
+		tmpl_resolve(t);
+		tmpl_render(t);
+	}
 }
 
 
@@ -414,7 +653,7 @@ void web_to_app_done(conn_t *c, nbuf_t *nb)
 
 void app_to_web(conn_t *c, char *s, int sl)
 {
-	if (c->stop_data) return;
+	if (c->stop_data || c->internal_connection) return;
 	nbuf_allocq(&c->s2c, s, sl);
 	//NextTask("s2c");
 }
@@ -678,61 +917,14 @@ static int request(struct mg_connection *mc, enum mg_event ev) {
 			return MG_FALSE;
 		}
 		
-		// for *.html and *.css process %[substitution]
-		// fixme: don't just panic because the config params are bad
-		char *html_data;
-		bool free_html_data = false;
+		// for *.html and *.css process %[substitution] using the pre-split template
 		suffix = strrchr(uri, '.');
-		
-		bool dirty = false;		// must never return a 304 if a %[] substitution was made!
+		tmpl_t *tmpl = NULL;
 		if (!isAJAX && suffix && (strcmp(suffix, ".html") == 0 || strcmp(suffix, ".css") == 0)) {
-			int nsize = edata_size;
-			html_data = (char *) kiwi_malloc("html_data", nsize);
-			free_html_data = true;
-			char *cp = (char *) edata_data, *np = html_data, *pp;
-			int cl, sl, pl, nl;
-
-			//printf("checking for \"%%[\": %s %d\n", uri, nsize);
-
-			for (cl=nl=0; cl < edata_size;) {
-				if (*cp == '%' && *(cp+1) == '[') {
-					cp += 2; cl += 2; pp = cp; pl = 0;
-					while (*cp != ']' && cl < edata_size) { cp++; cl++; pl++; }
-					cp++; cl++;
-					
-					for (i=0; i < n_iparams; i++) {
-						iparams_t *ip = &iparams[i];
-						if (strncmp(pp, ip->id, pl) == 0) {
-							sl = strlen(ip->val);
-
-							// expand buffer
-							html_data = (char *) kiwi_realloc("html_data", html_data, nsize+sl);
-							np = html_data + nl;		// in case buffer moved
-							nsize += sl;
-							//printf("%d %%[%s] %d <%s> %s\n", nsize, ip->id, sl, ip->val, uri);
-							strcpy(np, ip->val); np += sl; nl += sl;
-							dirty = true;
-							break;
-						}
-					}
-					
-					if (i == n_iparams) {
-						// not found, put back original
-						strcpy(np, "%["); np += 2;
-						strncpy(np, pp, pl); np += pl;
-						*np++ = ']';
-						nl += pl + 3;
-					}
-				} else {
-					*np++ = *cp++; nl++; cl++;
-				}
-
-				assert(nl <= nsize);
-			}
-			
-			assert((np - html_data) == nl);
-			edata_data = html_data;
-			edata_size = nl;
+			tmpl = tmpl_get(uri, edata_data, edata_size, mtime);
+			edata_data = tmpl->out;
+			edata_size = tmpl->out_size;
+			if (tmpl->changed > mtime) mtime = tmpl->changed;
 		}
 		
 		// Add version checking to each .js file served.
@@ -745,14 +937,32 @@ static int request(struct mg_connection *mc, enum mg_event ev) {
 			ver_size = strlen(ver);
 		}
 
+		// Serve the precompressed variant if the client accepts it. Not possible for templates
+		// with substitutions. The .js version check is appended as part of the compressed stream.
+		const char *gz_data = NULL;
+		size_t gz_size = 0;
+		char *gz_tail = NULL;
+		int gz_tail_size = 0;
+		bool has_gz = false;
+		if (!isAJAX && !is_sdr_hu && (tmpl == NULL || tmpl->nsubst == 0)) {
+			u4_t crc;
+			gz_data = edata_gzip(uri, &gz_size, &crc);
+			has_gz = (gz_data != NULL);
+			if (has_gz && web_accepts_gzip(mc))
+				gz_tail_size = gzip_tail(&gz_tail, ver, ver_size, crc, edata_size);
+			else
+				gz_data = NULL;
+		}
+
 		// Tell web server the file size and modify time so it can make a decision about caching.
 		// Modify time _was_ conservative: server start time as .js files have version info appended.
 		// Modify time is now:
 		//		server running in background (production) mode: build time of server binary.
 		//		server running in foreground (development) mode: stat is fetched from filesystems, else build time of server binary.
 		
-		// NB: Will see cases of etag_match=N but not_mod_since=Y because of %[] substitution.
-		// The size in the etag is different due to the substitution, but the underlying file mtime hasn't changed.
+		// The size is that of the representation sent, so the gzip variant gets its own etag.
+		// For templates the hash of the substituted content is added to the etag so a params change
+		// (which doesn't change the underlying file mtime) is never answered with a 304.
 		
 		// FIXME: Is what we do here re caching really correct? Do we need to be returning "Cache-Control: must-revalidate"?
 		
@@ -765,20 +975,21 @@ static int request(struct mg_connection *mc, enum mg_event ev) {
             //if (mobile_device) real_printf("mobile_device User-Agent: %s | %s\n", ua, mc->uri);
         }
 
-  		mc->cache_info.st.st_size = edata_size + ver_size;
+  		mc->cache_info.st.st_size = gz_data? (gz_size + gz_tail_size) : (edata_size + ver_size);
   		if (!isAJAX) assert(mtime != 0);
   		mc->cache_info.st.st_mtime = mtime;
+  		mc->cache_info.etag_hash = tmpl? tmpl->hash : 0;
 
 		if (!(isAJAX && ev == MG_CACHE_INFO)) {		// don't print for isAJAX + MG_CACHE_INFO nop case
-			web_printf("%-15s %s:%05d%s size=%6d dirty=%d mtime=%lu/%lx %s %s %s%s\n", (ev == MG_CACHE_INFO)? "MG_CACHE_INFO" : "MG_REQUEST",
+			web_printf("%-15s %s:%05d%s size=%6d%s hash=%08x mtime=%lu/%lx %s %s %s%s\n", (ev == MG_CACHE_INFO)? "MG_CACHE_INFO" : "MG_REQUEST",
 				remote_ip, mc->remote_port, is_sdr_hu? "[sdr.hu]":"",
-				mc->cache_info.st.st_size, dirty, mtime, mtime, isAJAX? mc->uri : uri, mg_get_mime_type(isAJAX? mc->uri : uri, "text/plain"),
+				mc->cache_info.st.st_size, gz_data? " gzip" : "", mc->cache_info.etag_hash, mtime, mtime, isAJAX? mc->uri : uri, mg_get_mime_type(isAJAX? mc->uri : uri, "text/plain"),
 				(mc->query_string != NULL)? "qs:" : "", (mc->query_string != NULL)? mc->query_string : "");
 		}
 
 		int rtn = MG_TRUE;
 		if (ev == MG_CACHE_INFO) {
-			if (dirty || isAJAX || is_sdr_hu || web_nocache || mobile_device) {   // FIXME: it's really wrong that nocache is not applied per-connection
+			if (isAJAX || is_sdr_hu || web_nocache || mobile_device) {   // FIXME: it's really wrong that nocache is not applied per-connection
 			    web_printf("%-15s NO CACHE %s%s\n", "MG_CACHE_INFO",
 			        mobile_device? "mobile_device " : (is_sdr_hu? "sdr.hu " : ""), uri);
 				rtn = MG_FALSE;		// returning false here will prevent any 304 decision based on the mtime set above
@@ -812,22 +1023,32 @@ static int request(struct mg_connection *mc, enum mg_event ev) {
 			
 			//if (is_sdr_hu) mg_send_header(mc, "Content-Length", stprintf("%d", edata_size));
 			
+			if (has_gz)
+			    mg_send_header(mc, "Vary", "Accept-Encoding");
+			if (gz_data)
+			    mg_send_header(mc, "Content-Encoding", "gzip");
+			
 			if (!is_sdr_hu)
 			    mg_send_header(mc, "Server", web_server_hdr);
 			
-			mg_send_data(mc, kstr_sp((char *) edata_data), edata_size);
-
-			if (ver != NULL) {
-				mg_send_data(mc, ver, ver_size);
+			if (gz_data) {
+				mg_send_data(mc, gz_data, gz_size);
+				mg_send_data(mc, gz_tail, gz_tail_size);
+			} else {
+				mg_send_data(mc, kstr_sp((char *) edata_data), edata_size);
+	
+				if (ver != NULL) {
+					mg_send_data(mc, ver, ver_size);
+				}
 			}
 		}
 		
 		if (ver != NULL) free(ver);
-		if (free_html_data) kiwi_free("html_data", (void *) html_data);
+		if (gz_tail != NULL) free(gz_tail);
 		if (free_ajax_data) kstr_free((char *) ajax_data);
 		if (free_uri) free(uri);
 		
-		if (ev != MG_CACHE_INFO) http_bytes += edata_size;
+		if (ev != MG_CACHE_INFO) http_bytes += gz_data? (gz_size + gz_tail_size) : edata_size;
 		return rtn;
 	}
 }
@@ -149,6 +149,7 @@ struct conn_t {
 #define AJAX_VERSION		7
 #define AJAX_STATUS			8
 #define AJAX_DUMP			9
+#define AJAX_METRICS		10
 
 void app_to_web(conn_t *c, char *s, int sl);
 